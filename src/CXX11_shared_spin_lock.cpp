@@ -1,5 +1,41 @@
 #include "CXX11_shared_spin_lock.hpp"
 
+#include "UDPC.h"
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <thread>
+
+#if UDPC_PLATFORM == UDPC_PLATFORM_LINUX
+# include <linux/futex.h>
+# include <sys/syscall.h>
+# include <unistd.h>
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+# include <immintrin.h>
+#endif
+
+namespace {
+
+// Failed attempts spun on before parking.
+constexpr unsigned int SPIN_LIMIT = 16;
+// Backoff doubles per failed attempt up to 2^BACKOFF_SHIFT_MAX pauses.
+constexpr unsigned int BACKOFF_SHIFT_MAX = 8;
+// Pauses on the state lock before yielding to a (possibly preempted) holder.
+constexpr unsigned int STATE_SPIN_LIMIT = 64;
+
+inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    _mm_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+} // namespace
+
 UDPC::Badge UDPC::Badge::newInvalid() {
     Badge badge;
     badge.isValid = false;
@@ -20,129 +56,195 @@ UDPC::SharedSpinLock::SharedSpinLock() :
 selfWeakPtr(),
 spinLock(false),
 read(0),
-write(false)
+write(false),
+generation(0),
+parked(0),
+statAcquisitions(0),
+statSpins(0),
+statParks(0),
+statWaitNs(0)
 {}
 
-UDPC::LockObj<false> UDPC::SharedSpinLock::spin_read_lock() {
-    bool expected;
-    while (true) {
-        expected = false;
-        if(spinLock.compare_exchange_weak(expected, true, std::memory_order_acquire)) {
-            if (!write) {
-                ++read;
-                spinLock.store(false, std::memory_order_release);
-                return LockObj<false>(selfWeakPtr, Badge{});
+void UDPC::SharedSpinLock::lock_state() {
+    unsigned int spins = 0;
+    while(spinLock.exchange(true, std::memory_order_acquire)) {
+        // wait for it to look free before trying again, to not bounce the
+        // cache line between waiters
+        while(spinLock.load(std::memory_order_relaxed)) {
+            if(++spins < STATE_SPIN_LIMIT) {
+                cpu_relax();
             } else {
-                spinLock.store(false, std::memory_order_release);
+                spins = 0;
+                std::this_thread::yield();
+            }
+        }
+    }
+}
+
+void UDPC::SharedSpinLock::unlock_state(bool isReleased) {
+    if(isReleased) {
+        generation.fetch_add(1, std::memory_order_seq_cst);
+    }
+    spinLock.store(false, std::memory_order_release);
+#if UDPC_PLATFORM == UDPC_PLATFORM_LINUX
+    if(isReleased && parked.load(std::memory_order_seq_cst) > 0) {
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&generation),
+            FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+    }
+#endif
+}
+
+template <typename TryAcquireFn>
+bool UDPC::SharedSpinLock::acquire(
+        TryAcquireFn tryAcquire, bool isTry, bool isReleasing) {
+    unsigned int attempt = 0;
+    std::chrono::steady_clock::time_point waitStart;
+    while(true) {
+        lock_state();
+        const uint32_t observed = generation.load(std::memory_order_relaxed);
+        const bool isAcquired = tryAcquire();
+        unlock_state(isAcquired && isReleasing);
+
+        if(isAcquired) {
+            statAcquisitions.fetch_add(1, std::memory_order_relaxed);
+            if(attempt > 0) {
+                statWaitNs.fetch_add(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now() - waitStart).count(),
+                    std::memory_order_relaxed);
             }
+            return true;
+        } else if(isTry) {
+            return false;
+        }
+
+        if(attempt == 0) {
+            waitStart = std::chrono::steady_clock::now();
+        }
+        ++attempt;
+        if(attempt <= SPIN_LIMIT) {
+            statSpins.fetch_add(1, std::memory_order_relaxed);
+            const unsigned int pauses =
+                1u << std::min(attempt, BACKOFF_SHIFT_MAX);
+            for(unsigned int i = 0; i < pauses; ++i) {
+                cpu_relax();
+            }
+        } else {
+            statParks.fetch_add(1, std::memory_order_relaxed);
+            park(observed);
         }
     }
 }
 
+void UDPC::SharedSpinLock::park(uint32_t observedGeneration) {
+#if UDPC_PLATFORM == UDPC_PLATFORM_LINUX
+    // returns immediately if released since observedGeneration was loaded
+    parked.fetch_add(1, std::memory_order_seq_cst);
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&generation),
+        FUTEX_WAIT_PRIVATE, observedGeneration, nullptr, nullptr, 0);
+    parked.fetch_sub(1, std::memory_order_seq_cst);
+#else
+    (void)observedGeneration;
+    std::this_thread::yield();
+#endif
+}
+
+UDPC::SharedSpinLockStats UDPC::SharedSpinLock::get_stats() const {
+    SharedSpinLockStats stats;
+    stats.acquisitions = statAcquisitions.load(std::memory_order_relaxed);
+    stats.spins = statSpins.load(std::memory_order_relaxed);
+    stats.parks = statParks.load(std::memory_order_relaxed);
+    stats.waitNs = statWaitNs.load(std::memory_order_relaxed);
+    return stats;
+}
+
+UDPC::LockObj<false> UDPC::SharedSpinLock::spin_read_lock() {
+    acquire([this] () {
+        if (!write) {
+            ++read;
+            return true;
+        }
+        return false;
+    }, false);
+    return LockObj<false>(selfWeakPtr, Badge{});
+}
+
 UDPC::LockObj<false> UDPC::SharedSpinLock::try_spin_read_lock() {
-    bool expected;
-    while (true) {
-        expected = false;
-        if (spinLock.compare_exchange_weak(expected, true, std::memory_order_acquire)) {
+    if (acquire([this] () {
             if (!write) {
                 ++read;
-                spinLock.store(false, std::memory_order_release);
-                return LockObj<false>(selfWeakPtr, Badge{});
-            } else {
-                spinLock.store(false, std::memory_order_release);
-                break;
+                return true;
             }
-        }
+            return false;
+        }, true)) {
+        return LockObj<false>(selfWeakPtr, Badge{});
     }
     return LockObj<false>{};
 }
 
 void UDPC::SharedSpinLock::read_unlock(UDPC::Badge &&badge) {
     if (badge.isValid) {
-        bool expected;
-        while (true) {
-            expected = false;
-            if (spinLock.compare_exchange_weak(expected, true, std::memory_order_acquire)) {
-                if (read > 0) {
-                    --read;
-                    badge.isValid = false;
-                }
-                spinLock.store(false, std::memory_order_release);
-                break;
-            }
+        lock_state();
+        bool isReleased = false;
+        if (read > 0) {
+            --read;
+            badge.isValid = false;
+            isReleased = read == 0;
         }
+        unlock_state(isReleased);
     }
 }
 
 UDPC::LockObj<true> UDPC::SharedSpinLock::spin_write_lock() {
-    bool expected;
-    while (true) {
-        expected = false;
-        if (spinLock.compare_exchange_weak(expected, true, std::memory_order_acquire)) {
-            if (!write && read == 0) {
-                write = true;
-                spinLock.store(false, std::memory_order_release);
-                return LockObj<true>(selfWeakPtr, Badge{});
-            } else {
-                spinLock.store(false, std::memory_order_release);
-            }
+    acquire([this] () {
+        if (!write && read == 0) {
+            write = true;
+            return true;
         }
-    }
+        return false;
+    }, false);
+    return LockObj<true>(selfWeakPtr, Badge{});
 }
 
 UDPC::LockObj<true> UDPC::SharedSpinLock::try_spin_write_lock() {
-    bool expected;
-    while (true) {
-        expected = false;
-        if (spinLock.compare_exchange_weak(expected, true, std::memory_order_acquire)) {
+    if (acquire([this] () {
             if (!write && read == 0) {
                 write = true;
-                spinLock.store(false, std::memory_order_release);
-                return LockObj<true>(selfWeakPtr, Badge{});
-            } else {
-                spinLock.store(false, std::memory_order_release);
-                break;
+                return true;
             }
-        }
+            return false;
+        }, true)) {
+        return LockObj<true>(selfWeakPtr, Badge{});
     }
     return LockObj<true>{};
 }
 
 void UDPC::SharedSpinLock::write_unlock(UDPC::Badge &&badge) {
     if (badge.isValid) {
-        bool expected;
-        while(true) {
-            expected = false;
-            if (spinLock.compare_exchange_weak(expected, true, std::memory_order_acquire)) {
-                if (write) {
-                    write = false;
-                    badge.isValid = false;
-                }
-                spinLock.store(false, std::memory_order_release);
-                break;
-            }
+        lock_state();
+        bool isReleased = false;
+        if (write) {
+            write = false;
+            badge.isValid = false;
+            isReleased = true;
         }
+        unlock_state(isReleased);
     }
 }
 
 UDPC::LockObj<false> UDPC::SharedSpinLock::trade_write_for_read_lock(UDPC::LockObj<true> &lockObj) {
     if (lockObj.isValid() && lockObj.badge.isValid) {
-        bool expected;
-        while (true) {
-            expected = false;
-            if (spinLock.compare_exchange_weak(expected, true, std::memory_order_acquire)) {
-                if (write && read == 0) {
-                    read = 1;
-                    write = false;
-                    lockObj.isLocked = false;
-                    lockObj.badge.isValid = false;
-                    spinLock.store(false, std::memory_order_release);
-                    return LockObj<false>(selfWeakPtr, Badge{});
-                } else {
-                    spinLock.store(false, std::memory_order_release);
-                }
+        acquire([this, &lockObj] () {
+            if (write && read == 0) {
+                read = 1;
+                write = false;
+                lockObj.isLocked = false;
+                lockObj.badge.isValid = false;
+                return true;
             }
-        }
+            return false;
+        }, false, true);
+        return LockObj<false>(selfWeakPtr, Badge{});
     } else {
         return LockObj<false>{};
     }
@@ -150,22 +252,17 @@ UDPC::LockObj<false> UDPC::SharedSpinLock::trade_write_for_read_lock(UDPC::LockO
 
 UDPC::LockObj<false> UDPC::SharedSpinLock::try_trade_write_for_read_lock(UDPC::LockObj<true> &lockObj) {
     if (lockObj.isValid() && lockObj.badge.isValid) {
-        bool expected;
-        while (true) {
-            expected = false;
-            if (spinLock.compare_exchange_weak(expected, true, std::memory_order_acquire)) {
+        if (acquire([this, &lockObj] () {
                 if (write && read == 0) {
                     read = 1;
                     write = false;
                     lockObj.isLocked = false;
                     lockObj.badge.isValid = false;
-                    spinLock.store(false, std::memory_order_release);
-                    return LockObj<false>(selfWeakPtr, Badge{});
-                } else {
-                    spinLock.store(false, std::memory_order_release);
-                    break;
+                    return true;
                 }
-            }
+                return false;
+            }, true, true)) {
+            return LockObj<false>(selfWeakPtr, Badge{});
         }
     }
     return LockObj<false>{};
@@ -3,6 +3,7 @@
 
 #include <memory>
 #include <atomic>
+#include <cstdint>
 
 namespace UDPC {
 
@@ -30,6 +31,17 @@ private:
     bool isValid;
 };
 
+struct SharedSpinLockStats {
+    // Successful lock acquisitions (including try_* and trades).
+    uint64_t acquisitions;
+    // Failed attempts that were followed by a backoff spin.
+    uint64_t spins;
+    // Times a waiting thread was parked until the lock was released.
+    uint64_t parks;
+    // Total time acquisitions waited for the lock, in nanoseconds.
+    uint64_t waitNs;
+};
+
 template <bool IsWriteObj>
 class LockObj {
 public:
@@ -58,6 +70,8 @@ private:
     LockObj(Badge &&badge);
     LockObj(std::weak_ptr<SharedSpinLock> lockPtr, Badge &&badge);
 
+    void unlock();
+
     std::weak_ptr<SharedSpinLock> weakPtrLock;
     bool isLocked;
     Badge badge;
@@ -89,9 +103,24 @@ public:
     LockObj<false> trade_write_for_read_lock(LockObj<true>&);
     LockObj<false> try_trade_write_for_read_lock(LockObj<true>&);
 
+    /// Counters are relaxed, so they are approximate while the lock is in use.
+    SharedSpinLockStats get_stats() const;
+
 private:
     SharedSpinLock();
 
+    void lock_state();
+    void unlock_state(bool isReleased);
+
+    /// Calls tryAcquire with the read/write variables locked until it returns
+    /// true. While it returns false, spins with exponential backoff a bounded
+    /// number of times, then parks until the lock is released. Does not wait
+    /// if isTry is true. isReleasing wakes parked threads on success (e.g. a
+    /// write lock traded for a read lock lets other readers in).
+    template <typename TryAcquireFn>
+    bool acquire(TryAcquireFn tryAcquire, bool isTry, bool isReleasing = false);
+    void park(uint32_t observedGeneration);
+
     Weak selfWeakPtr;
 
     /// Used to lock the read/write member variables.
@@ -100,6 +129,14 @@ private:
     unsigned int read;
     bool write;
 
+    /// Incremented on every release, parked threads wait for it to change.
+    std::atomic_uint32_t generation;
+    std::atomic_uint32_t parked;
+
+    std::atomic_uint64_t statAcquisitions;
+    std::atomic_uint64_t statSpins;
+    std::atomic_uint64_t statParks;
+    std::atomic_uint64_t statWaitNs;
 };
 
 template <bool IsWriteObj>
@@ -125,9 +162,15 @@ badge(std::forward<Badge>(badge))
 
 template <bool IsWriteObj>
 LockObj<IsWriteObj>::~LockObj() {
+    unlock();
+}
+
+template <bool IsWriteObj>
+void LockObj<IsWriteObj>::unlock() {
     if (!isLocked) {
         return;
     }
+    isLocked = false;
     auto strongPtrLock = weakPtrLock.lock();
     if (strongPtrLock) {
         if (IsWriteObj) {
@@ -149,7 +192,8 @@ LockObj<IsWriteObj>::LockObj(LockObj<IsWriteObj> &&other) {
 
 template <bool IsWriteObj>
 LockObj<IsWriteObj> &LockObj<IsWriteObj>::operator=(LockObj<IsWriteObj> &&other) {
-    this->~LockObj();
+    // not the destructor, that would also destroy the members assigned below
+    unlock();
 
     this->weakPtrLock = std::move(other.weakPtrLock);
     this->isLocked = std::move(other.isLocked);
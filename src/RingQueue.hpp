@@ -0,0 +1,260 @@
+#ifndef UDPC_LOCKFREE_RING_QUEUE_HPP
+#define UDPC_LOCKFREE_RING_QUEUE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+/*
+ * Bounded lock-free multi-producer multi-consumer queue (based on Dmitry
+ * Vyukov's bounded MPMC queue).
+ *
+ * Each slot holds a sequence number that tells a producer or consumer whether
+ * the slot is ready for its position, so a push or pop is one compare-exchange
+ * on the position and one store of the slot's sequence. Items are moved in
+ * from and out to caller storage, nothing is allocated after construction.
+ * The head and tail positions are on separate cache lines so that producers and
+ * consumers do not invalidate each other's line.
+ *
+ * T must be default constructible and move assignable.
+ */
+template <typename T>
+class RingQueue {
+  public:
+    // capacity is rounded up to a power of two (minimum 2)
+    explicit RingQueue(std::size_t capacity);
+
+    // disable copy
+    RingQueue(const RingQueue &other) = delete;
+    RingQueue &operator=(const RingQueue &other) = delete;
+    // disable move, slots are referenced by position
+    RingQueue(RingQueue &&other) = delete;
+    RingQueue &operator=(RingQueue &&other) = delete;
+
+    // Returns false if full, in which case data is not moved from.
+    bool push_back(T &&data);
+    bool push_back(const T &data);
+    // Pushes up to n items moved from items, claiming their slots with one
+    // compare-exchange. Returns the number of items pushed, the rest are not
+    // moved from.
+    std::size_t push_back_n(T *items, std::size_t n);
+    // Returns false if empty, in which case out is unchanged.
+    bool pop_front(T &out);
+    // Pops up to max items into out, claiming them with one compare-exchange.
+    // Returns the number of items popped.
+    std::size_t pop_front_n(T *out, std::size_t max);
+
+    // Approximate while other threads push or pop.
+    bool empty() const;
+    unsigned long size() const;
+    unsigned long capacity() const;
+
+  private:
+    static constexpr std::size_t CACHE_LINE_SIZE = 64;
+
+    struct Slot {
+        Slot();
+
+        std::atomic_size_t seq;
+        T data;
+    };
+
+    template <typename U>
+    bool push_back_impl(U &&data);
+
+    std::unique_ptr<Slot[]> slots;
+    std::size_t mask;
+    // next position to pop
+    alignas(CACHE_LINE_SIZE) std::atomic_size_t head;
+    // next position to push
+    alignas(CACHE_LINE_SIZE) std::atomic_size_t tail;
+    char tailPadding[CACHE_LINE_SIZE - sizeof(std::atomic_size_t)];
+};
+
+template <typename T>
+RingQueue<T>::RingQueue(std::size_t capacity) :
+    slots(),
+    mask(0),
+    head(0),
+    tail(0),
+    tailPadding()
+{
+    std::size_t size = 2;
+    while(size < capacity) {
+        size <<= 1;
+    }
+    slots = std::unique_ptr<Slot[]>(new Slot[size]);
+    mask = size - 1;
+    for(std::size_t i = 0; i < size; ++i) {
+        slots[i].seq.store(i, std::memory_order_relaxed);
+    }
+}
+
+template <typename T>
+bool RingQueue<T>::push_back(T &&data) {
+    return push_back_impl(std::move(data));
+}
+
+template <typename T>
+bool RingQueue<T>::push_back(const T &data) {
+    return push_back_impl(data);
+}
+
+template <typename T>
+template <typename U>
+bool RingQueue<T>::push_back_impl(U &&data) {
+    std::size_t pos = tail.load(std::memory_order_relaxed);
+    while(true) {
+        Slot &slot = slots[pos & mask];
+        std::size_t seq = slot.seq.load(std::memory_order_acquire);
+        std::intptr_t diff = (std::intptr_t)seq - (std::intptr_t)pos;
+        if(diff == 0) {
+            // slot is free for this position, claim it
+            if(tail.compare_exchange_weak(
+                    pos, pos + 1, std::memory_order_relaxed)) {
+                slot.data = std::forward<U>(data);
+                slot.seq.store(pos + 1, std::memory_order_release);
+                return true;
+            }
+        } else if(diff < 0) {
+            // slot still holds the item from one lap ago
+            return false;
+        } else {
+            // another producer claimed this position
+            pos = tail.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+template <typename T>
+std::size_t RingQueue<T>::push_back_n(T *items, std::size_t n) {
+    if(n == 0) {
+        return 0;
+    }
+    std::size_t pos = tail.load(std::memory_order_relaxed);
+    while(true) {
+        // count the free slots from pos, they cannot be filled by another
+        // producer without moving tail past pos
+        std::size_t count = 0;
+        while(count < n && count <= mask) {
+            const Slot &slot = slots[(pos + count) & mask];
+            if(slot.seq.load(std::memory_order_acquire) != pos + count) {
+                break;
+            }
+            ++count;
+        }
+        if(count == 0) {
+            std::size_t seq = slots[pos & mask].seq.load(std::memory_order_acquire);
+            if((std::intptr_t)seq - (std::intptr_t)pos < 0) {
+                // slot still holds the item from one lap ago
+                return 0;
+            }
+            // another producer claimed this position
+            pos = tail.load(std::memory_order_relaxed);
+            continue;
+        }
+        if(tail.compare_exchange_weak(
+                pos, pos + count, std::memory_order_relaxed)) {
+            for(std::size_t i = 0; i < count; ++i) {
+                Slot &slot = slots[(pos + i) & mask];
+                slot.data = std::move(items[i]);
+                slot.seq.store(pos + i + 1, std::memory_order_release);
+            }
+            return count;
+        }
+    }
+}
+
+template <typename T>
+bool RingQueue<T>::pop_front(T &out) {
+    std::size_t pos = head.load(std::memory_order_relaxed);
+    while(true) {
+        Slot &slot = slots[pos & mask];
+        std::size_t seq = slot.seq.load(std::memory_order_acquire);
+        std::intptr_t diff = (std::intptr_t)seq - (std::intptr_t)(pos + 1);
+        if(diff == 0) {
+            // slot is filled for this position, claim it
+            if(head.compare_exchange_weak(
+                    pos, pos + 1, std::memory_order_relaxed)) {
+                out = std::move(slot.data);
+                // free for the producer one lap ahead
+                slot.seq.store(pos + mask + 1, std::memory_order_release);
+                return true;
+            }
+        } else if(diff < 0) {
+            // not filled yet
+            return false;
+        } else {
+            // another consumer claimed this position
+            pos = head.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+template <typename T>
+std::size_t RingQueue<T>::pop_front_n(T *out, std::size_t max) {
+    if(max == 0) {
+        return 0;
+    }
+    std::size_t pos = head.load(std::memory_order_relaxed);
+    while(true) {
+        // count the filled slots from pos, they cannot be popped by another
+        // consumer without moving head past pos
+        std::size_t count = 0;
+        while(count < max && count <= mask) {
+            const Slot &slot = slots[(pos + count) & mask];
+            if(slot.seq.load(std::memory_order_acquire) != pos + count + 1) {
+                break;
+            }
+            ++count;
+        }
+        if(count == 0) {
+            std::size_t seq = slots[pos & mask].seq.load(std::memory_order_acquire);
+            if((std::intptr_t)seq - (std::intptr_t)(pos + 1) < 0) {
+                // not filled yet
+                return 0;
+            }
+            // another consumer claimed this position
+            pos = head.load(std::memory_order_relaxed);
+            continue;
+        }
+        if(head.compare_exchange_weak(
+                pos, pos + count, std::memory_order_relaxed)) {
+            for(std::size_t i = 0; i < count; ++i) {
+                Slot &slot = slots[(pos + i) & mask];
+                out[i] = std::move(slot.data);
+                // free for the producer one lap ahead
+                slot.seq.store(pos + i + mask + 1, std::memory_order_release);
+            }
+            return count;
+        }
+    }
+}
+
+template <typename T>
+bool RingQueue<T>::empty() const {
+    return size() == 0;
+}
+
+template <typename T>
+unsigned long RingQueue<T>::size() const {
+    std::size_t h = head.load(std::memory_order_acquire);
+    std::size_t t = tail.load(std::memory_order_acquire);
+    // head may have been loaded before a pop that passed the loaded tail
+    return t > h ? t - h : 0;
+}
+
+template <typename T>
+unsigned long RingQueue<T>::capacity() const {
+    return mask + 1;
+}
+
+template <typename T>
+RingQueue<T>::Slot::Slot() :
+seq(0),
+data()
+{}
+
+#endif
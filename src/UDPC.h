@@ -157,6 +157,14 @@ typedef enum UDPC_EXPORT UDPC_AuthPolicy {
     UDPC_AUTH_POLICY_SIZE
 } UDPC_AuthPolicy;
 
+/// The backend used to send and receive datagrams, see UDPC_init_io_engine()
+typedef enum UDPC_EXPORT UDPC_IOEngine {
+    /// Non-blocking socket calls (recvmmsg/sendmmsg on Linux)
+    UDPC_IO_ENGINE_SOCKET=0,
+    /// io_uring with multishot receive and batched sends (Linux only)
+    UDPC_IO_ENGINE_IO_URING
+} UDPC_IOEngine;
+
 /*!
  * \brief Data identifying a peer via addr, port, and scope_id
  *
@@ -171,6 +179,22 @@ typedef struct UDPC_EXPORT UDPC_ConnectionId {
     uint16_t port;
 } UDPC_ConnectionId;
 
+/*!
+ * \brief A compact identifier of a connection of a UDPC context
+ *
+ * A context assigns a handle to each connection when it is established, and
+ * sets it in the events (see UDPC_Event) and received packets (see
+ * UDPC_PacketInfo) of that connection. The functions ending with \p _h take a
+ * handle instead of a UDPC_ConnectionId, which they resolve without hashing.
+ *
+ * A handle only refers to the connection it was assigned to. Once that
+ * connection is removed, the handle refers to no connection, even if a new
+ * connection to the same peer is established (which gets a new handle).
+ *
+ * 0 is never a valid handle.
+ */
+typedef uint64_t UDPC_ConnectionHandle;
+
 /*!
  * \brief Data representing a received/sent packet
  *
@@ -221,6 +245,9 @@ typedef struct UDPC_EXPORT UDPC_PacketInfo {
     UDPC_ConnectionId sender;
     /// The \ref UDPC_ConnectionId of the receiver
     UDPC_ConnectionId receiver;
+    /// The \ref UDPC_ConnectionHandle of the connection the packet was
+    /// received from
+    UDPC_ConnectionHandle handle;
 } UDPC_PacketInfo;
 
 /*!
@@ -250,7 +277,8 @@ typedef enum UDPC_EXPORT UDPC_EventType {
     UDPC_ET_DISCONNECTED,
     UDPC_ET_FAIL_CONNECT,
     UDPC_ET_GOOD_MODE,
-    UDPC_ET_BAD_MODE
+    UDPC_ET_BAD_MODE,
+    UDPC_ET_REQUEST_SEND_RATE
 } UDPC_EventType;
 
 /*!
@@ -269,9 +297,121 @@ typedef struct UDPC_EXPORT UDPC_Event {
     union Value {
         int dropAllWithAddr;
         int enableLibSodium;
+        struct {
+            uint16_t goodMode;
+            uint16_t badMode;
+            uint16_t burst;
+        } sendRate;
     } v;
+    /// The \ref UDPC_ConnectionHandle of the connection the event refers to,
+    /// 0 for UDPC_ET_NONE
+    UDPC_ConnectionHandle handle;
 } UDPC_Event;
 
+/*!
+ * \brief A peer in a \ref UDPC_PeerList
+ */
+typedef struct UDPC_EXPORT UDPC_PeerInfo {
+    UDPC_ConnectionId id;
+    UDPC_ConnectionHandle handle;
+    /// The connection's RTT in milliseconds when the list was published
+    uint16_t rtt;
+    /// Non-zero if the connection was in good mode when the list was published
+    uint16_t isGoodMode;
+} UDPC_PeerInfo;
+
+/*!
+ * \brief An immutable list of the peers a UDPC context has connections with
+ *
+ * The context publishes a new list when a connection is added or removed, or
+ * switches between good and bad mode. See UDPC_acquire_peer_list().
+ */
+typedef struct UDPC_EXPORT UDPC_PeerList {
+    /**
+     * Incremented with every published list, the list published before any
+     * connection existed has version 0
+     */
+    uint64_t version;
+    /// The number of peers in \ref peers
+    uint32_t size;
+    /// The peers in no particular order, NULL if \ref size is 0
+    const UDPC_PeerInfo *peers;
+} UDPC_PeerList;
+
+/*!
+ * \brief Counters describing how datagrams were received by a UDPC context
+ *
+ * A receive call is a single recvfrom() or recvmmsg() that returned data. With
+ * GRO enabled, one received buffer may hold several datagrams, which are split
+ * up and counted individually in \ref datagrams.
+ */
+typedef struct UDPC_EXPORT UDPC_ReceiveStats {
+    /// The number of receive calls that returned at least one datagram
+    uint64_t calls;
+    /// The total number of datagrams yielded by all receive calls
+    uint64_t datagrams;
+    /// The number of received buffers that were coalesced by GRO
+    uint64_t coalescedBuffers;
+    /// The most datagrams yielded by a single receive call
+    uint32_t maxPerCall;
+    /**
+     * The number of datagrams dropped because the receive thread's handoff to
+     * update was full (see UDPC_set_receive_thread_enabled())
+     */
+    uint64_t handoffDropped;
+} UDPC_ReceiveStats;
+
+/*!
+ * \brief Counters describing a UDPC context's packet buffer pool
+ *
+ * Packet data (queued, sent, re-sent and received) is allocated from a pool
+ * owned by the context, that keeps freed buffers of a few size classes for
+ * reuse. See UDPC_get_pool_stats().
+ */
+typedef struct UDPC_EXPORT UDPC_PoolStats {
+    /// The number of allocations served by a previously freed buffer
+    uint64_t hits;
+    /// The number of allocations that needed memory from the system
+    uint64_t misses;
+    /**
+     * The number of misses that were too large for any size class, or whose
+     * size class reached its memory limit, and were allocated individually
+     */
+    uint64_t fallbacks;
+    /// The number of 64KiB slabs the pool allocated its buffers from
+    uint32_t slabs;
+    /// The number of pooled buffers currently allocated
+    uint64_t inUse;
+} UDPC_PoolStats;
+
+/// The outcome of queueing one packet with UDPC_queue_send_batch()
+typedef enum UDPC_EXPORT UDPC_SendResult {
+    /// The packet was queued to be sent
+    UDPC_SR_QUEUED=0,
+    /// The packet has no data
+    UDPC_SR_INVALID,
+    /// There is no connection to the packet's destination
+    UDPC_SR_NOT_CONNECTED,
+    /// The connection to the packet's destination has too many queued packets
+    UDPC_SR_CONNECTION_QUEUE_FULL,
+    /// The context's send queue is full
+    UDPC_SR_SEND_QUEUE_FULL
+} UDPC_SendResult;
+
+/*!
+ * \brief A packet to queue with UDPC_queue_send_batch()
+ *
+ * The fields are the parameters of UDPC_queue_send().
+ */
+typedef struct UDPC_EXPORT UDPC_SendItem {
+    UDPC_ConnectionId destinationId;
+    /// Copied when queued, may be free'd after UDPC_queue_send_batch() returns
+    const void *data;
+    uint32_t size;
+    /// Non-zero if the packet should be re-sent if the peer doesn't receive it
+    int isChecked;
+} UDPC_SendItem;
+
 /*!
  * \brief Creates an UDPC_ConnectionId with the given addr and port
  *
@@ -347,6 +487,11 @@ UDPC_EXPORT UDPC_HContext UDPC_init(UDPC_ConnectionId listenId, int isClient, in
  *
  * By default, the update interval is set to 8 milliseconds.
  *
+ * \note On Linux, the thread instead waits until a packet is received, work is
+ * queued (e.g. by UDPC_queue_send()), or a connection's timer (send rate,
+ * heartbeat, timeout) is due, so the update interval is only used if that
+ * could not be set up.
+ *
  * \param listenId The addr and port to listen on (contained in a
  * UDPC_ConnectionId)
  * \param isClient Whether or not this instance is a client or a server
@@ -388,11 +533,79 @@ UDPC_EXPORT UDPC_HContext UDPC_init_threaded_update_ms(
     int isClient,
     int updateMS,
     int isUsingLibsodium);
+/*!
+ * \brief Creates an UDPC_HContext like UDPC_init() that uses the given I/O
+ * engine
+ *
+ * With \ref UDPC_IO_ENGINE_IO_URING, received datagrams are collected by a
+ * multishot recvmsg into a ring of kernel-selected buffers, and each update's
+ * outgoing datagrams are submitted as one batch of sendmsg requests. If
+ * io_uring is unavailable (not Linux, not compiled in, or not permitted by the
+ * kernel), the context falls back to \ref UDPC_IO_ENGINE_SOCKET. Use
+ * UDPC_get_io_engine() to check which engine is in use.
+ *
+ * Threaded update may be enabled afterwards with \ref
+ * UDPC_enable_threaded_update or \ref UDPC_enable_threaded_update_ms.
+ *
+ * \param listenId The addr and port to listen on (contained in a
+ * UDPC_ConnectionId)
+ * \param isClient Whether or not this instance is a client or a server
+ * \param isUsingLibsodium Set to non-zero if libsodium verification of packets
+ * should be enabled (fails if libsodium support was not compiled)
+ * \param ioEngine The I/O engine to use (see \ref UDPC_IOEngine)
+ *
+ * \warning The received UDPC_HContext must be freed with a call to UDPC_destroy().
+ *
+ * \return A UDPC context
+ */
+UDPC_EXPORT UDPC_HContext UDPC_init_io_engine(
+    UDPC_ConnectionId listenId,
+    int isClient,
+    int isUsingLibsodium,
+    UDPC_IOEngine ioEngine);
+/*!
+ * \brief Gets the I/O engine used by the UDPC context
+ *
+ * \param ctx The UDPC context
+ * \return The I/O engine in use (see \ref UDPC_IOEngine)
+ */
+UDPC_EXPORT UDPC_IOEngine UDPC_get_io_engine(UDPC_HContext ctx);
+/*!
+ * \brief Creates a server UDPC_HContext that spreads connections over several
+ * worker threads
+ *
+ * workerCount sockets are bound to the same addr and port with SO_REUSEPORT,
+ * each owned by a shard with its own connections, queues, and auto-updating
+ * thread. The kernel steers each peer to one socket, so a connection always
+ * stays on the same shard. The returned context may be used with the rest of
+ * the API as usual; calls are routed to the shard that owns the connection,
+ * settings are applied to every shard, and UDPC_get_event() and
+ * UDPC_get_received() take from the shards in turn.
+ *
+ * On platforms other than Linux, this creates a context like
+ * UDPC_init_threaded_update() with one worker.
+ *
+ * \param listenId The addr and port to listen on (contained in a
+ * UDPC_ConnectionId)
+ * \param workerCount The number of workers (clamped at a minimum of 1 and a
+ * maximum of 64)
+ * \param isUsingLibsodium Set to non-zero if libsodium verification of packets
+ * should be enabled (fails if libsodium support was not compiled)
+ *
+ * \warning The received UDPC_HContext must be freed with a call to UDPC_destroy().
+ *
+ * \return A UDPC context
+ */
+UDPC_EXPORT UDPC_HContext UDPC_init_sharded(
+    UDPC_ConnectionId listenId,
+    unsigned int workerCount,
+    int isUsingLibsodium);
 
 /*!
  * \brief Enables auto updating on a separate thread for the given UDPC_HContext
  *
- * By default, the update interval is set to 8 milliseconds.
+ * By default, the update interval is set to 8 milliseconds. On Linux, the
+ * thread updates only when needed instead (see UDPC_init_threaded_update()).
  *
  * \param ctx The context to enable auto updating for
  * \return non-zero if auto updating is enabled. If the context already had auto
@@ -459,6 +672,39 @@ UDPC_EXPORT void UDPC_destroy(UDPC_HContext ctx);
  */
 UDPC_EXPORT void UDPC_update(UDPC_HContext ctx);
 
+/*!
+ * \brief Gets a file descriptor that becomes readable when the context should
+ * be updated
+ *
+ * This allows calling UDPC_update() from an application's own event loop only
+ * when needed instead of at a fixed rate. The descriptor (an epoll instance on
+ * Linux) becomes readable when a packet is received, when work was queued (e.g.
+ * by UDPC_queue_send()), or when a connection's timer (send rate, heartbeat,
+ * timeout) is due. Each call to UDPC_update() clears it and re-arms the timer.
+ * UDPC_get_next_deadline_us() may be used instead of relying on the timer.
+ *
+ * The descriptor is owned by the context and is closed by UDPC_destroy(). It
+ * must only be polled for reading.
+ *
+ * \param ctx The context to get the descriptor of
+ * \return The file descriptor, or -1 if not supported on this platform, or if
+ * the context uses auto updating
+ */
+UDPC_EXPORT int UDPC_get_pollable_fd(UDPC_HContext ctx);
+
+/*!
+ * \brief Gets the time until the context should next be updated
+ *
+ * This covers the timers of connections (send rate, heartbeat, connection
+ * retry, timeout). Received packets and queued work are not included, see
+ * UDPC_get_pollable_fd() for those.
+ *
+ * \param ctx The context to check
+ * \return Microseconds until UDPC_update() should be called, 0 if it should be
+ * called now, or -1 if there is nothing to wait for (no connections)
+ */
+UDPC_EXPORT int64_t UDPC_get_next_deadline_us(UDPC_HContext ctx);
+
 /*!
  * \brief Initiate a connection to a server peer
  *
@@ -485,6 +731,10 @@ UDPC_EXPORT void UDPC_client_initiate_connection(
  * initiate-connection-packet from a client to establish a connection (sent by
  * previously mentioned UDPC_client_initiate_* functions).
  *
+ * The queue this adds to holds up to 8192 packets (see
+ * UDPC_get_queue_send_current_size()). If it is full, the packet is dropped and
+ * logged with log-level warning.
+ *
  * \param ctx The context to send a packet on
  * \param destinationId The peer to send a packet to
  * \param isChecked Set to non-zero if the packet should be re-sent if the peer
@@ -495,16 +745,133 @@ UDPC_EXPORT void UDPC_client_initiate_connection(
 UDPC_EXPORT void UDPC_queue_send(UDPC_HContext ctx, UDPC_ConnectionId destinationId,
                      int isChecked, const void *data, uint32_t size);
 
+/*!
+ * \brief Queues a packet to be sent to the peer of a connection handle
+ *
+ * Behaves as UDPC_queue_send(), except that the connection is found by its
+ * handle. If the handle's connection was removed, the packet is dropped.
+ *
+ * \param ctx The context to send a packet on
+ * \param handle The handle of the connection to send a packet to
+ * \param isChecked Set to non-zero if the packet should be re-sent if the peer
+ * doesn't receive it
+ * \param data A pointer to data to be sent in a packet
+ * \param size The size in bytes of the data to be sent
+ */
+UDPC_EXPORT void UDPC_queue_send_h(UDPC_HContext ctx, UDPC_ConnectionHandle handle,
+                     int isChecked, const void *data, uint32_t size);
+
+/*!
+ * \brief Queues many packets to be sent at once
+ *
+ * Behaves as calling UDPC_queue_send() for each item, except that the
+ * connections are looked up once for all items, the items are added to the
+ * context's send queue together, and items that cannot be sent are not queued.
+ * An item is not queued if it has no data, if there is no connection to its
+ * destination, or if its connection already has 64 queued packets (not counting
+ * packets queued that update has not handled yet).
+ *
+ * \param ctx The context to send packets on
+ * \param items Array of count packets to queue
+ * \param count The number of items
+ * \param results Array of count results to set to the outcome of each item,
+ * may be NULL
+ * \return The number of items that were queued
+ */
+UDPC_EXPORT unsigned long UDPC_queue_send_batch(
+    UDPC_HContext ctx, const UDPC_SendItem *items, unsigned long count,
+    UDPC_SendResult *results);
+
+/*!
+ * \brief Queues the same packet to be sent to many peers
+ *
+ * Behaves as calling UDPC_queue_send() with data for each destination, except
+ * that data is copied once, and the copy is shared by the packets to all
+ * destinations until each of them was sent (and, if checked, until it does not
+ * need to be re-sent anymore). Only the header in front of it is built for each
+ * destination. Packets to peers whose headers are signed (see
+ * UDPC_set_libsodium_keys()) are copied when sent, and data that is too large
+ * to be shared is copied for each destination.
+ *
+ * \param ctx The context to send packets on
+ * \param destinationIds Array of count peers to send the packet to
+ * \param count The number of destinations
+ * \param isChecked Set to non-zero if the packets should be re-sent if a peer
+ * doesn't receive it
+ * \param data The data to send, may be free'd after this call returns
+ * \param size The size in bytes of data
+ * \return The number of destinations the packet was queued to, less than count
+ * if the context's send queue is full
+ */
+UDPC_EXPORT unsigned long UDPC_queue_send_many(
+    UDPC_HContext ctx, const UDPC_ConnectionId *destinationIds,
+    unsigned long count, int isChecked, const void *data, uint32_t size);
+
+/*!
+ * \brief Reserves a buffer to write a packet's data to, to be queued without
+ * copying it with \ref UDPC_send_commit
+ *
+ * The returned buffer is preceded by room for the packet's header, so the
+ * packet is sent from the same buffer it was written to, which is also kept in
+ * case the packet has to be re-sent. A packet whose header does not fit (e.g.
+ * one to a peer that does not verify packets, on a context that uses libsodium)
+ * is copied when sent, as with UDPC_queue_send().
+ *
+ * The buffer must be given to \ref UDPC_send_commit or
+ * \ref UDPC_send_abort on the same context, it may be written to from any
+ * thread until then.
+ *
+ * Usage:
+ * \code{.c}
+ * char *buf = UDPC_send_reserve(ctx, peer, sizeof(state));
+ * if(buf) {
+ *     write_state(buf);
+ *     UDPC_send_commit(ctx, buf, sizeof(state), 0);
+ * }
+ * \endcode
+ *
+ * \param ctx The context to send a packet on
+ * \param destinationId The peer to send a packet to
+ * \param size The maximum size in bytes of the data to be sent
+ * \return A buffer of size bytes, or NULL if ctx is invalid or size is 0
+ */
+UDPC_EXPORT void *UDPC_send_reserve(UDPC_HContext ctx, UDPC_ConnectionId destinationId, uint32_t size);
+
+/*!
+ * \brief Queues a buffer gotten from \ref UDPC_send_reserve to be sent
+ *
+ * Behaves as UDPC_queue_send() with the peer given to
+ * \ref UDPC_send_reserve, except that data is not copied. The buffer is owned
+ * by the context after this call, even if the packet was dropped.
+ *
+ * \param ctx The context the buffer was reserved from
+ * \param buf The buffer returned by \ref UDPC_send_reserve
+ * \param size The size in bytes of the data written to buf, must not be
+ * larger than the reserved size (the buffer is freed and nothing is sent if it
+ * is), 0 is the same as calling \ref UDPC_send_abort
+ * \param isChecked Set to non-zero if the packet should be re-sent if the peer
+ * doesn't receive it
+ */
+UDPC_EXPORT void UDPC_send_commit(UDPC_HContext ctx, void *buf, uint32_t size, int isChecked);
+
+/*!
+ * \brief Frees a buffer gotten from \ref UDPC_send_reserve without sending it
+ *
+ * \param ctx The context the buffer was reserved from
+ * \param buf The buffer returned by \ref UDPC_send_reserve (may be NULL)
+ */
+UDPC_EXPORT void UDPC_send_abort(UDPC_HContext ctx, void *buf);
+
 /*!
  * \brief Gets the size of the data structure holding queued packets
  *
  * Note that a UDPC context holds a different data structure per established
  * connection that holds a limited amount of packets to send. If a connection's
  * queue is full, it will not be removed from the main queue that this function
- * (and UDPC_queue_send()) uses. The queue that this function refers to does not
- * have an imposed limit as it is implemented as a thread-safe linked list (data
- * is dynamically stored on the heap) and access to this data structure is
- * faster than accessing a connection's internal queue. Also note that this
+ * (and UDPC_queue_send()) uses. The queue that this function refers to holds up
+ * to 8192 packets as it is implemented as a fixed size lock-free ring buffer,
+ * and access to this data structure is faster than accessing a connection's
+ * internal queue. Also note that this
  * queue holds packets for all connections this context maintains. Thus if one
  * connection has free space, then it may partially remove packets only destined
  * for that connection from the queue this function refers to.
@@ -531,6 +898,16 @@ UDPC_EXPORT unsigned long UDPC_get_queue_send_current_size(UDPC_HContext ctx);
  */
 UDPC_EXPORT unsigned long UDPC_get_queued_size(UDPC_HContext ctx, UDPC_ConnectionId id, int *exists);
 
+/*!
+ * \brief Gets the size of a connection's queue of queued packets by the
+ * connection's handle
+ *
+ * Behaves as UDPC_get_queued_size().
+ *
+ * \return The size of a connection's queue
+ */
+UDPC_EXPORT unsigned long UDPC_get_queued_size_h(UDPC_HContext ctx, UDPC_ConnectionHandle handle, int *exists);
+
 /*!
  * \brief Gets the size limit of a connection's queue of queued packets
  *
@@ -541,6 +918,61 @@ UDPC_EXPORT unsigned long UDPC_get_queued_size(UDPC_HContext ctx, UDPC_Connectio
  */
 UDPC_EXPORT unsigned long UDPC_get_max_queued_size();
 
+/*!
+ * \brief Sets how often a connection sends, and how many queued packets it
+ * sends each time
+ *
+ * By default, a connection sends 30 times a second in "good mode" and 10 times
+ * a second in "bad mode", one queued packet (or a heartbeat packet if none are
+ * queued) each time. Raising the rates and \p burst raises how many packets
+ * per second can be queued to the connection (see
+ * UDPC_get_max_queued_size()). The default for new connections can be set with
+ * UDPC_set_default_send_rate().
+ *
+ * Note that a connection sending faster than the defaults sends at most 24
+ * check-received packets ahead of the peer's acks, which come with the packets
+ * the peer sends. If the peer's connection also sends faster than the
+ * defaults, it sends early to ack received packets, but only as often as its
+ * own send rate.
+ *
+ * \param ctx The UDPC context
+ * \param connectionId The identifier of the peer
+ * \param goodModeRate Sends per second in "good mode" (clamped at a minimum of
+ * 1 and a maximum of 1000)
+ * \param badModeRate Sends per second in "bad mode" (clamped at a minimum of
+ * 1 and a maximum of \p goodModeRate)
+ * \param burst Queued packets sent per send (clamped at a minimum of 1 and a
+ * maximum of 64)
+ */
+UDPC_EXPORT void UDPC_set_send_rate(UDPC_HContext ctx, UDPC_ConnectionId connectionId, unsigned int goodModeRate, unsigned int badModeRate, unsigned int burst);
+
+/*!
+ * \brief Sets the send rate of a connection by its handle
+ *
+ * Behaves as UDPC_set_send_rate(). Does nothing if the handle's connection
+ * was already removed.
+ *
+ * \param ctx The UDPC context
+ * \param handle The handle of the connection
+ * \param goodModeRate Sends per second in "good mode"
+ * \param badModeRate Sends per second in "bad mode"
+ * \param burst Queued packets sent per send
+ */
+UDPC_EXPORT void UDPC_set_send_rate_h(UDPC_HContext ctx, UDPC_ConnectionHandle handle, unsigned int goodModeRate, unsigned int badModeRate, unsigned int burst);
+
+/*!
+ * \brief Sets the send rate of connections created after this call
+ *
+ * See UDPC_set_send_rate() for the arguments, the defaults are 30, 10 and 1.
+ * Existing connections keep their send rate.
+ *
+ * \param ctx The UDPC context
+ * \param goodModeRate Sends per second in "good mode"
+ * \param badModeRate Sends per second in "bad mode"
+ * \param burst Queued packets sent per send
+ */
+UDPC_EXPORT void UDPC_set_default_send_rate(UDPC_HContext ctx, unsigned int goodModeRate, unsigned int badModeRate, unsigned int burst);
+
 /*!
  * \brief Set whether or not the UDPC context will accept new connections
  * \param ctx The UDPC context
@@ -562,6 +994,17 @@ UDPC_EXPORT int UDPC_set_accept_new_connections(UDPC_HContext ctx, int isAccepti
  */
 UDPC_EXPORT void UDPC_drop_connection(UDPC_HContext ctx, UDPC_ConnectionId connectionId, int dropAllWithAddr);
 
+/*!
+ * \brief Drops an existing connection by its handle
+ *
+ * Behaves as UDPC_drop_connection() with \p dropAllWithAddr set to zero. Does
+ * nothing if the handle's connection was already removed.
+ *
+ * \param ctx The UDPC context
+ * \param handle The handle of the connection to drop
+ */
+UDPC_EXPORT void UDPC_drop_connection_h(UDPC_HContext ctx, UDPC_ConnectionHandle handle);
+
 /*!
  * \brief Checks if a connection exists to the peer identified by the given
  * \p connectionId
@@ -573,6 +1016,26 @@ UDPC_EXPORT void UDPC_drop_connection(UDPC_HContext ctx, UDPC_ConnectionId conne
  */
 UDPC_EXPORT int UDPC_has_connection(UDPC_HContext ctx, UDPC_ConnectionId connectionId);
 
+/*!
+ * \brief Checks if the connection of a handle exists
+ *
+ * \param ctx The UDPC context
+ * \param handle The handle of a connection
+ *
+ * \return non-zero if the connection exists
+ */
+UDPC_EXPORT int UDPC_has_connection_h(UDPC_HContext ctx, UDPC_ConnectionHandle handle);
+
+/*!
+ * \brief Gets the handle of the connection to a peer
+ *
+ * \param ctx The UDPC context
+ * \param connectionId The identifier for a peer
+ *
+ * \return The connection's handle, or 0 if there is no connection to the peer
+ */
+UDPC_EXPORT UDPC_ConnectionHandle UDPC_get_handle(UDPC_HContext ctx, UDPC_ConnectionId connectionId);
+
 /*!
  * \brief Gets a dynamically allocated array of connected peers' identifiers
  *
@@ -595,6 +1058,30 @@ UDPC_EXPORT UDPC_ConnectionId* UDPC_get_list_connected(UDPC_HContext ctx, unsign
  */
 UDPC_EXPORT void UDPC_free_list_connected(UDPC_ConnectionId *list);
 
+/*!
+ * \brief Gets the most recently published list of connected peers
+ *
+ * Unlike UDPC_get_list_connected(), this does not lock, allocate or copy, so it
+ * can be called every frame. The list is not changed once published, compare
+ * its \ref UDPC_PeerList::version with the previously acquired list's to skip
+ * unchanged lists.
+ *
+ * \warning One must call UDPC_release_peer_list() with the returned list once
+ * done with it, it is valid until then (even after a newer list is published)
+ *
+ * \param ctx The UDPC context
+ * \return The list, or NULL if ctx is invalid
+ */
+UDPC_EXPORT const UDPC_PeerList *UDPC_acquire_peer_list(UDPC_HContext ctx);
+
+/*!
+ * \brief Releases a list returned by UDPC_acquire_peer_list()
+ *
+ * \param ctx The UDPC context the list was acquired from
+ * \param list The list to release, it must not be used afterwards
+ */
+UDPC_EXPORT void UDPC_release_peer_list(UDPC_HContext ctx, const UDPC_PeerList *list);
+
 /*!
  * \brief Gets the protocol id of the UDPC context
  *
@@ -620,6 +1107,146 @@ UDPC_EXPORT uint32_t UDPC_get_protocol_id(UDPC_HContext ctx);
  */
 UDPC_EXPORT uint32_t UDPC_set_protocol_id(UDPC_HContext ctx, uint32_t id);
 
+/*!
+ * \brief Gets how many datagrams the UDPC context may receive per system call
+ *
+ * See UDPC_set_receive_batch_depth() for details.
+ *
+ * \param ctx The UDPC context
+ * \return The receive batch depth of the UDPC context
+ */
+UDPC_EXPORT unsigned int UDPC_get_receive_batch_depth(UDPC_HContext ctx);
+
+/*!
+ * \brief Sets how many datagrams the UDPC context may receive per system call
+ *
+ * On Linux, an update drains the socket with recvmmsg() into a ring of
+ * \p depth pre-allocated receive buffers, then processes the whole batch.
+ * A depth of 1 receives one datagram per call with recvfrom(), which is also
+ * what is always done on other platforms. The default depth is 32.
+ *
+ * Note that each receive buffer holds a packet of up to
+ * \ref UDPC_PACKET_MAX_SIZE bytes, or 64KiB if GRO is enabled (see
+ * UDPC_set_gro_enabled()). The new depth takes effect on the next update.
+ *
+ * \param ctx The UDPC context
+ * \param depth The number of datagrams to receive per call (clamped at a
+ * minimum of 1 and a maximum of 256)
+ * \return The previous receive batch depth of the UDPC context
+ */
+UDPC_EXPORT unsigned int UDPC_set_receive_batch_depth(UDPC_HContext ctx, unsigned int depth);
+
+/*!
+ * \brief Checks if UDP generic segmentation offload is used when sending
+ *
+ * See UDPC_set_gso_enabled() for details.
+ *
+ * \param ctx The UDPC context
+ * \return non-zero if GSO is enabled
+ */
+UDPC_EXPORT int UDPC_get_gso_enabled(UDPC_HContext ctx);
+
+/*!
+ * \brief Enables or disables UDP generic segmentation offload when sending
+ *
+ * This is only supported on Linux. When enabled, an update may send a burst of
+ * up to 16 queued packets to a peer instead of only one, and consecutive
+ * equal-sized packets to the same peer are handed to the kernel as a single
+ * buffer to be split into datagrams (UDP_SEGMENT). Packets of differing sizes
+ * are still sent as individual datagrams. GSO is disabled by default.
+ *
+ * If the kernel does not support GSO, it remains disabled. If a segmented send
+ * fails, GSO is disabled and the packets are sent individually.
+ *
+ * \param ctx The UDPC context
+ * \param isEnabled Set to non-zero to enable GSO
+ * \return The previous setting (1 if enabled, 0 if not)
+ */
+UDPC_EXPORT int UDPC_set_gso_enabled(UDPC_HContext ctx, int isEnabled);
+
+/*!
+ * \brief Checks if UDP generic receive offload is enabled on the socket
+ *
+ * See UDPC_set_gro_enabled() for details.
+ *
+ * \param ctx The UDPC context
+ * \return non-zero if GRO is enabled
+ */
+UDPC_EXPORT int UDPC_get_gro_enabled(UDPC_HContext ctx);
+
+/*!
+ * \brief Enables or disables UDP generic receive offload on the socket
+ *
+ * This is only supported on Linux. When enabled, the kernel may hand a single
+ * buffer holding several datagrams from the same peer to an update, which
+ * splits it back into individual packets before processing them. Receive
+ * buffers grow to 64KiB each while GRO is enabled, and datagrams are always
+ * received with recvmmsg() regardless of the receive batch depth. GRO is
+ * disabled by default, and cannot be enabled on a context using the io_uring
+ * I/O engine.
+ *
+ * \param ctx The UDPC context
+ * \param isEnabled Set to non-zero to enable GRO
+ * \return The previous setting (1 if enabled, 0 if not)
+ */
+UDPC_EXPORT int UDPC_set_gro_enabled(UDPC_HContext ctx, int isEnabled);
+
+/*!
+ * \brief Gets the receive counters of the UDPC context
+ *
+ * The average number of datagrams yielded per receive call is
+ * \p datagrams / \p calls of the returned struct.
+ *
+ * \param ctx The UDPC context
+ * \return The receive counters, zeroed if \p ctx is invalid
+ */
+UDPC_EXPORT UDPC_ReceiveStats UDPC_get_receive_stats(UDPC_HContext ctx);
+
+/*!
+ * \brief Gets the packet buffer pool counters of the UDPC context
+ *
+ * Useful to tell whether the pool's memory limits fit the application's packet
+ * rate and sizes: a growing \ref UDPC_PoolStats::fallbacks means buffers are
+ * allocated individually instead of reused. For a context created with
+ * UDPC_init_sharded(), the counters of all shards are summed.
+ *
+ * \param ctx The UDPC context
+ * \return The counters, all zero if ctx is invalid
+ */
+UDPC_EXPORT UDPC_PoolStats UDPC_get_pool_stats(UDPC_HContext ctx);
+
+/*!
+ * \brief Checks if the context receives on a dedicated receive thread
+ *
+ * See UDPC_set_receive_thread_enabled() for details.
+ *
+ * \param ctx The context to check
+ * \return non-zero if the receive thread is running
+ */
+UDPC_EXPORT int UDPC_get_receive_thread_enabled(UDPC_HContext ctx);
+
+/*!
+ * \brief Enables or disables receiving on a dedicated thread
+ *
+ * Normally datagrams are received at the end of each update, after sending, so
+ * a slow update (e.g. signing packets for many peers) can let the socket's
+ * receive buffer overflow. With this enabled, a separate thread reads from the
+ * socket as soon as data arrives, drops datagrams with an invalid header, and
+ * hands the rest to the next update, which applies them to the connections
+ * (acks, rtt, received packets) as before. The handoff holds up to 4096
+ * datagrams, further datagrams are dropped and counted in
+ * UDPC_ReceiveStats::handoffDropped.
+ *
+ * This works with both UDPC_update() and auto updating, and is only available
+ * on Linux with \ref UDPC_IO_ENGINE_SOCKET.
+ *
+ * \param ctx The context to set the receive thread for
+ * \param isEnabled Set to non-zero to start the receive thread
+ * \return non-zero if the receive thread was running before this call
+ */
+UDPC_EXPORT int UDPC_set_receive_thread_enabled(
+    UDPC_HContext ctx, int isEnabled);
+
 /*!
  * \brief Gets the logging type of the UDPC context
  *
@@ -667,6 +1294,9 @@ UDPC_EXPORT int UDPC_set_receiving_events(UDPC_HContext ctx, int isReceivingEven
  *
  * See \ref UDPC_EventType for possible types of a UDPC_Event.
  *
+ * Up to 1024 events are held until they are gotten, events that occur while
+ * that many are held are dropped and logged with log-level warning.
+ *
  * \param ctx The UDPC context
  * \param remaining Pointer to set the number of remaining events that can be
  * returned
@@ -675,19 +1305,125 @@ UDPC_EXPORT int UDPC_set_receiving_events(UDPC_HContext ctx, int isReceivingEven
  */
 UDPC_EXPORT UDPC_Event UDPC_get_event(UDPC_HContext ctx, unsigned long *remaining);
 
+/*!
+ * \brief Gets up to max recorded events at once
+ *
+ * Like \ref UDPC_get_event, but the events are written to the given array,
+ * and are taken out of the context's event queue together instead of one by
+ * one.
+ *
+ * \param ctx The UDPC context
+ * \param events Array of at least max events to write the gotten events to
+ * \param max The maximum number of events to get
+ * \param remaining Pointer to set the number of remaining events that can be
+ * returned
+ * \return The number of events written to events
+ */
+UDPC_EXPORT unsigned long UDPC_get_event_batch(
+    UDPC_HContext ctx, UDPC_Event *events, unsigned long max,
+    unsigned long *remaining);
+
 /*!
  * \brief Get a received packet from a given UDPC context.
  *
+ * Up to 8192 received packets are held until they are gotten, packets received
+ * while that many are held are dropped and logged with log-level warning.
+ *
  * \warning The received packet (if valid) must be free'd with a call to
  * \ref UDPC_free_PacketInfo_ptr or \ref UDPC_free_PacketInfo to avoid a memory
- * leak.
+ * leak. Its data is allocated from the context's buffer pool, so it must not be
+ * passed to free() directly. It may be free'd after the context was destroyed.
+ *
+ * A payload larger than 2048 bytes is not copied out of the buffer it was
+ * received in, the packet's data points into that buffer instead (on Linux, a
+ * packet larger than a receive buffer is first copied to a buffer of its
+ * size). Smaller payloads are copied to a buffer of their size, so that they do
+ * not hold on to a whole receive buffer (see \ref UDPC_get_received_view to
+ * not copy them).
+ * Packets that are held count against the context's buffer pool (see
+ * UDPC_get_pool_stats()).
  */
 UDPC_EXPORT UDPC_PacketInfo UDPC_get_received(UDPC_HContext ctx, unsigned long *remaining);
 
+/*!
+ * \brief Gets up to max received packets at once
+ *
+ * Like \ref UDPC_get_received, but the packets are written to the given array,
+ * and are taken out of the context's receive queue together instead of one by
+ * one.
+ *
+ * Usage:
+ * \code{.c}
+ * UDPC_PacketInfo pinfos[256];
+ * unsigned long count = UDPC_get_received_batch(ctx, pinfos, 256, NULL);
+ * for(unsigned long i = 0; i < count; ++i) {
+ *     handle_update(pinfos[i].data, pinfos[i].dataSize);
+ *     UDPC_free_PacketInfo(pinfos[i]);
+ * }
+ * \endcode
+ *
+ * \warning Every gotten packet must be free'd as with \ref UDPC_get_received.
+ *
+ * \param ctx The UDPC context
+ * \param pinfos Array of at least max packets to write the gotten packets to
+ * \param max The maximum number of packets to get
+ * \param remaining Pointer to set the number of remaining received packets
+ * \return The number of packets written to pinfos
+ */
+UDPC_EXPORT unsigned long UDPC_get_received_batch(
+    UDPC_HContext ctx, UDPC_PacketInfo *pinfos, unsigned long max,
+    unsigned long *remaining);
+
+/*!
+ * \brief Borrows a received packet from a given UDPC context.
+ *
+ * Like \ref UDPC_get_received, but the packet is written to view, and its data
+ * is borrowed from the context's receive buffers: on Linux, a payload of 1024
+ * bytes up to 4096 bytes points into the receive buffer it was received in,
+ * right after the packet's header, and is not copied before or after being
+ * handed out. Smaller payloads are copied once on receive to a buffer of their
+ * size, and larger ones to a buffer of the packet's size.
+ *
+ * The receive buffer is given back to the context for receiving by
+ * \ref UDPC_release_view, which must be called for every view that was gotten.
+ * Receive buffers held by views are replaced, so holding a large number of
+ * views makes the context fall back to allocating with malloc() (see
+ * UDPC_get_pool_stats()).
+ *
+ * Usage:
+ * \code{.c}
+ * UDPC_PacketInfo view;
+ * while(UDPC_get_received_view(ctx, &view, NULL)) {
+ *     handle_update(view.data, view.dataSize);
+ *     UDPC_release_view(ctx, &view);
+ * }
+ * \endcode
+ *
+ * \param ctx The UDPC context
+ * \param view Pointer to set to the received packet, set to an empty packet if
+ * there is none
+ * \param remaining Pointer to set the number of remaining received packets
+ * \return Non-zero if a packet was gotten
+ */
+UDPC_EXPORT int UDPC_get_received_view(
+    UDPC_HContext ctx, UDPC_PacketInfo *view, unsigned long *remaining);
+
+/*!
+ * \brief Releases a packet gotten with \ref UDPC_get_received_view.
+ *
+ * Gives its receive buffer back to the context it was borrowed from, and
+ * zeroes out the view's data pointer and size so that releasing it twice is
+ * safe. The view may be released after the context was destroyed, ctx is not
+ * used then.
+ */
+UDPC_EXPORT void UDPC_release_view(UDPC_HContext ctx, UDPC_PacketInfo *view);
+
 /*!
  * \brief Frees a UDPC_PacketInfo.
  *
- * Internally, the member variable \ref UDPC_PacketInfo::data will be free'd.
+ * Internally, the member variable \ref UDPC_PacketInfo::data will be free'd,
+ * returning it to the buffer pool of the context that allocated it (data
+ * allocated with malloc() is also accepted).
  * \ref UDPC_free_PacketInfo_ptr is safer to use than this function, as it
  * also zeros out the relevant data to avoid double frees.
  */
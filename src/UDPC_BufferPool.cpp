@@ -0,0 +1,356 @@
+#include "UDPC_BufferPool.hpp"
+
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#if UDPC_PLATFORM == UDPC_PLATFORM_WINDOWS
+# include <malloc.h>
+#endif
+
+namespace UDPC {
+
+struct BufferPoolSlab {
+    BufferPool *pool;
+    char *base;
+    unsigned int classIndex;
+};
+
+} // namespace UDPC
+
+namespace {
+
+constexpr unsigned int SLAB_SHIFT = 16;
+constexpr std::size_t SLAB_SIZE = (std::size_t)1 << SLAB_SHIFT;
+
+// The largest class fits a full packet with the largest header.
+constexpr std::size_t CLASS_SIZES[] = {
+    128, 512, 2048, 9216
+};
+constexpr unsigned int CLASS_COUNT = sizeof(CLASS_SIZES) / sizeof(std::size_t);
+// Slabs per size class, bounds a pool's memory to 512KiB per class except for
+// the largest, which also backs received packets too large for a receive
+// buffer (1MiB).
+constexpr unsigned int CLASS_SLABS_MAX[CLASS_COUNT] = {
+    8, 8, 8, 16
+};
+// Slabs of receive buffers, which are also held by the received packets that
+// were handed out without copying them (2MiB).
+constexpr unsigned int RECEIVE_CLASS_SLABS_MAX = 32;
+// Slabs per shared size class, shared buffers are held once per payload
+// instead of once per packet.
+constexpr unsigned int SHARED_CLASS_SLABS_MAX[CLASS_COUNT] = {
+    4, 4, 4, 8
+};
+// A shared buffer starts with its reference count, its data follows aligned.
+constexpr std::size_t SHARED_HEADER_SIZE = 16;
+static_assert(sizeof(std::atomic_uint32_t) <= SHARED_HEADER_SIZE,
+    "reference count must fit in the shared buffer's header");
+
+// Classes [0, CLASS_COUNT) are plain, [CLASS_COUNT, 2 * CLASS_COUNT) shared,
+// followed by the receive class.
+constexpr unsigned int RECEIVE_CLASS = CLASS_COUNT * 2;
+
+bool isSharedClass(unsigned int classIndex) {
+    return classIndex >= CLASS_COUNT && classIndex < RECEIVE_CLASS;
+}
+
+std::size_t classSize(unsigned int classIndex) {
+    if(classIndex == RECEIVE_CLASS) {
+        return UDPC::BufferPool::RECEIVE_SIZE;
+    }
+    return CLASS_SIZES[classIndex % CLASS_COUNT];
+}
+
+unsigned int classSlabsMax(unsigned int classIndex) {
+    if(classIndex == RECEIVE_CLASS) {
+        return RECEIVE_CLASS_SLABS_MAX;
+    }
+    return isSharedClass(classIndex)
+        ? SHARED_CLASS_SLABS_MAX[classIndex - CLASS_COUNT]
+        : CLASS_SLABS_MAX[classIndex];
+}
+
+// Two level table from slab address to slab, covering 48 bit addresses. Leaves
+// are allocated on first use and never freed.
+constexpr unsigned int ADDRESS_BITS = 48;
+constexpr unsigned int LEAF_BITS = 16;
+constexpr unsigned int ROOT_BITS = ADDRESS_BITS - SLAB_SHIFT - LEAF_BITS;
+
+struct SlabLeaf {
+    std::atomic<UDPC::BufferPoolSlab*> slabs[(std::size_t)1 << LEAF_BITS];
+};
+
+std::atomic<SlabLeaf*> slabRoot[(std::size_t)1 << ROOT_BITS];
+
+bool isMappable(std::uintptr_t address) {
+    return (address >> ADDRESS_BITS) == 0;
+}
+
+std::atomic<UDPC::BufferPoolSlab*> *slabEntry(
+        std::uintptr_t address, bool isCreating) {
+    const std::size_t page = address >> SLAB_SHIFT;
+    std::atomic<SlabLeaf*> &rootEntry = slabRoot[page >> LEAF_BITS];
+    SlabLeaf *leaf = rootEntry.load(std::memory_order_acquire);
+    if(!leaf) {
+        if(!isCreating) {
+            return nullptr;
+        }
+        // calloc so that the leaf's untouched pages stay uncommitted
+        SlabLeaf *newLeaf = (SlabLeaf*)std::calloc(1, sizeof(SlabLeaf));
+        if(!newLeaf) {
+            return nullptr;
+        }
+        if(rootEntry.compare_exchange_strong(leaf, newLeaf,
+                std::memory_order_acq_rel)) {
+            leaf = newLeaf;
+        } else {
+            std::free(newLeaf);
+        }
+    }
+    return &leaf->slabs[page & (((std::size_t)1 << LEAF_BITS) - 1)];
+}
+
+char *allocateSlabMemory() {
+#if UDPC_PLATFORM == UDPC_PLATFORM_WINDOWS
+    return (char*)_aligned_malloc(SLAB_SIZE, SLAB_SIZE);
+#else
+    return (char*)std::aligned_alloc(SLAB_SIZE, SLAB_SIZE);
+#endif
+}
+
+UDPC::BufferPoolSlab *findSlab(const void *buf) {
+    if(!buf || !isMappable((std::uintptr_t)buf)) {
+        return nullptr;
+    }
+    std::atomic<UDPC::BufferPoolSlab*> *entry =
+        slabEntry((std::uintptr_t)buf, false);
+    return entry ? entry->load(std::memory_order_acquire) : nullptr;
+}
+
+void freeSlabMemory(char *base) {
+#if UDPC_PLATFORM == UDPC_PLATFORM_WINDOWS
+    _aligned_free(base);
+#else
+    std::free(base);
+#endif
+}
+
+} // namespace
+
+UDPC::BufferPool::SizeClass::SizeClass(std::size_t size, std::size_t capacity) :
+size(size),
+freeList(capacity),
+slabCount(0)
+{}
+
+UDPC::BufferPool *UDPC::BufferPool::newInstance() {
+    return new BufferPool();
+}
+
+UDPC::BufferPool::BufferPool() :
+refs(1),
+classes(),
+slabs(),
+slabsMutex(),
+statHits(0),
+statMisses(0),
+statFallbacks(0),
+statInUse(0)
+{
+    for(unsigned int i = 0; i <= RECEIVE_CLASS; ++i) {
+        const std::size_t size = classSize(i);
+        classes.emplace_back(new SizeClass(size,
+            classSlabsMax(i) * (SLAB_SIZE / size)));
+    }
+}
+
+UDPC::BufferPool::~BufferPool() {
+    // all pooled buffers were deallocated, only the slabs remain
+    for(BufferPoolSlab *slab : slabs) {
+        slabEntry((std::uintptr_t)slab->base, false)->store(
+            nullptr, std::memory_order_release);
+        freeSlabMemory(slab->base);
+        delete slab;
+    }
+}
+
+void UDPC::BufferPool::release() {
+    unref();
+}
+
+void UDPC::BufferPool::unref() {
+    if(refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        delete this;
+    }
+}
+
+char *UDPC::BufferPool::allocate(std::size_t size) {
+    unsigned int classIndex = 0;
+    while(classIndex < CLASS_COUNT && CLASS_SIZES[classIndex] < size) {
+        ++classIndex;
+    }
+
+    char *buf = nullptr;
+    if(classIndex < CLASS_COUNT) {
+        buf = allocateFromClass(classIndex);
+    } else {
+        statMisses.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    if(!buf) {
+        statFallbacks.fetch_add(1, std::memory_order_relaxed);
+        return (char*)std::malloc(size);
+    }
+    return buf;
+}
+
+char *UDPC::BufferPool::allocateReceive() {
+    char *buf = allocateFromClass(RECEIVE_CLASS);
+    if(!buf) {
+        statFallbacks.fetch_add(1, std::memory_order_relaxed);
+        return (char*)std::malloc(RECEIVE_SIZE);
+    }
+    return buf;
+}
+
+char *UDPC::BufferPool::allocateShared(std::size_t size) {
+    unsigned int classIndex = 0;
+    while(classIndex < CLASS_COUNT
+            && CLASS_SIZES[classIndex] < size + SHARED_HEADER_SIZE) {
+        ++classIndex;
+    }
+    if(classIndex == CLASS_COUNT) {
+        return nullptr;
+    }
+
+    char *buf = allocateFromClass(CLASS_COUNT + classIndex);
+    if(!buf) {
+        return nullptr;
+    }
+    new(buf) std::atomic_uint32_t(1);
+    return buf + SHARED_HEADER_SIZE;
+}
+
+char *UDPC::BufferPool::allocateFromClass(unsigned int classIndex) {
+    char *buf = nullptr;
+    if(classes[classIndex]->freeList.pop_front(buf)) {
+        statHits.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        statMisses.fetch_add(1, std::memory_order_relaxed);
+        buf = allocateSlab(classIndex);
+    }
+
+    if(buf) {
+        refs.fetch_add(1, std::memory_order_relaxed);
+        statInUse.fetch_add(1, std::memory_order_relaxed);
+    }
+    return buf;
+}
+
+char *UDPC::BufferPool::allocateSlab(unsigned int classIndex) {
+    SizeClass &sizeClass = *classes[classIndex];
+    std::lock_guard<std::mutex> slabsLock(slabsMutex);
+    char *buf = nullptr;
+    // another thread may have added a slab while this one waited
+    if(sizeClass.freeList.pop_front(buf)) {
+        return buf;
+    } else if(sizeClass.slabCount.load() >= classSlabsMax(classIndex)) {
+        return nullptr;
+    }
+
+    char *base = allocateSlabMemory();
+    if(!base) {
+        return nullptr;
+    }
+    std::atomic<BufferPoolSlab*> *entry = nullptr;
+    if(isMappable((std::uintptr_t)base)) {
+        entry = slabEntry((std::uintptr_t)base, true);
+    }
+    if(!entry) {
+        freeSlabMemory(base);
+        return nullptr;
+    }
+
+    BufferPoolSlab *slab = new BufferPoolSlab{this, base, classIndex};
+    slabs.push_back(slab);
+    sizeClass.slabCount.fetch_add(1);
+    entry->store(slab, std::memory_order_release);
+
+    // keep the first buffer, the rest go to the free list
+    const std::size_t count = SLAB_SIZE / sizeClass.size;
+    for(std::size_t i = 1; i < count; ++i) {
+        bool isPushed = sizeClass.freeList.push_back(base + i * sizeClass.size);
+        assert(isPushed && "free list must fit all buffers of its class");
+        (void)isPushed;
+    }
+    return base;
+}
+
+void UDPC::BufferPool::deallocate(void *buf) {
+    if(!buf) {
+        return;
+    }
+
+    BufferPoolSlab *slab = findSlab(buf);
+    if(!slab) {
+        std::free(buf);
+        return;
+    }
+
+    // buf may point into the buffer, round down to the buffer's start
+    BufferPool *pool = slab->pool;
+    const std::size_t classSize = pool->classes[slab->classIndex]->size;
+    const std::size_t offset = (std::size_t)((char*)buf - slab->base);
+    char *start = slab->base + offset / classSize * classSize;
+    if(isSharedClass(slab->classIndex)) {
+        std::atomic_uint32_t *shareRefs = (std::atomic_uint32_t*)start;
+        if(shareRefs->fetch_sub(1, std::memory_order_acq_rel) != 1) {
+            return;
+        }
+    }
+    bool isPushed = pool->classes[slab->classIndex]->freeList.push_back(start);
+    assert(isPushed && "free list must fit all buffers of its class");
+    (void)isPushed;
+    pool->statInUse.fetch_sub(1, std::memory_order_relaxed);
+    pool->unref();
+}
+
+bool UDPC::BufferPool::isPooled(const void *buf) {
+    return findSlab(buf) != nullptr;
+}
+
+void UDPC::BufferPool::share(const void *buf) {
+    BufferPoolSlab *slab = findSlab(buf);
+    assert(slab && isSharedClass(slab->classIndex)
+        && "Only shared buffers can be shared");
+    const std::size_t classSize = slab->pool->classes[slab->classIndex]->size;
+    const std::size_t offset = (std::size_t)((const char*)buf - slab->base);
+    std::atomic_uint32_t *shareRefs = (std::atomic_uint32_t*)(
+        slab->base + offset / classSize * classSize);
+    shareRefs->fetch_add(1, std::memory_order_relaxed);
+}
+
+bool UDPC::BufferPool::isReceive(const void *buf) {
+    BufferPoolSlab *slab = findSlab(buf);
+    return slab && slab->classIndex == RECEIVE_CLASS;
+}
+
+bool UDPC::BufferPool::isShared(const void *buf) {
+    BufferPoolSlab *slab = findSlab(buf);
+    return slab && isSharedClass(slab->classIndex);
+}
+
+UDPC_PoolStats UDPC::BufferPool::getStats() const {
+    UDPC_PoolStats stats;
+    std::memset(&stats, 0, sizeof(UDPC_PoolStats));
+    stats.hits = statHits.load(std::memory_order_relaxed);
+    stats.misses = statMisses.load(std::memory_order_relaxed);
+    stats.fallbacks = statFallbacks.load(std::memory_order_relaxed);
+    for(const std::unique_ptr<SizeClass> &sizeClass : classes) {
+        stats.slabs += sizeClass->slabCount.load(std::memory_order_relaxed);
+    }
+    stats.inUse = statInUse.load(std::memory_order_relaxed);
+    return stats;
+}
@@ -0,0 +1,111 @@
+#ifndef UDPC_BUFFER_POOL_HPP_
+#define UDPC_BUFFER_POOL_HPP_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "RingQueue.hpp"
+#include "UDPC.h"
+
+namespace UDPC {
+
+struct BufferPoolSlab;
+
+// Size-classed pool of packet buffers. Buffers of a size class are carved out
+// of 64KiB slabs allocated on demand (up to a limit per class), and freed
+// buffers are kept on a lock-free free list per class for reuse. Larger
+// buffers, or buffers of a class that reached its slab limit, are allocated
+// with std::malloc.
+//
+// Any buffer gotten from allocate() (pooled or not) is freed with the static
+// deallocate(), which looks up the owning slab in a process wide table, so it
+// does not need to know the pool and also accepts buffers from std::malloc.
+// A pooled buffer may also be freed through a pointer into it, so a part of a
+// buffer (e.g. a received packet's payload) can be handed out on its own.
+// The pool stays alive until both its owner called release() and all of its
+// pooled buffers were deallocated, so received packets may outlive their
+// context.
+//
+// Receive buffers (from allocateReceive()) also come from their own slabs, so
+// that received packets handed out in their receive buffer and released give
+// the buffer back for receiving only.
+//
+// Shared buffers (from allocateShared()) come from their own slabs, and start
+// with a reference count. share() adds a reference, and deallocate() only frees
+// a shared buffer once its last reference was dropped, so a shared buffer may
+// be held by many packets that each free it as their own.
+//
+// Thread safe.
+class BufferPool {
+public:
+    // Fits a packet's header followed by a 4KiB payload.
+    static constexpr std::size_t RECEIVE_SIZE = 4352;
+
+    static BufferPool *newInstance();
+
+    // Disallow copy, buffers refer to the pool.
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    // Drops the owner's reference, the pool must not be allocated from after.
+    void release();
+
+    char *allocate(std::size_t size);
+    // Frees buf (may be nullptr) to its pool, or with std::free if it was not
+    // allocated from a pool. buf may point into a pooled buffer.
+    static void deallocate(void *buf);
+    // Returns true if buf points into a buffer allocated from a pool.
+    static bool isPooled(const void *buf);
+
+    // Returns a buffer of RECEIVE_SIZE bytes, allocated with std::malloc if
+    // the pool reached its limit for receive buffers.
+    char *allocateReceive();
+    // Returns true if buf points into a buffer from allocateReceive().
+    static bool isReceive(const void *buf);
+
+    // Returns a buffer of size bytes with one reference, or nullptr if size is
+    // too large or the pool reached its limit for shared buffers.
+    char *allocateShared(std::size_t size);
+    // Adds a reference to the shared buffer buf points into.
+    static void share(const void *buf);
+    // Returns true if buf points into a buffer from allocateShared().
+    static bool isShared(const void *buf);
+
+    UDPC_PoolStats getStats() const;
+
+private:
+    struct SizeClass {
+        SizeClass(std::size_t size, std::size_t capacity);
+
+        std::size_t size;
+        RingQueue<char*> freeList;
+        // only changed while holding slabsMutex
+        std::atomic_uint slabCount;
+    };
+
+    BufferPool();
+    ~BufferPool();
+
+    // Returns nullptr if the class is at its slab limit.
+    char *allocateSlab(unsigned int classIndex);
+    char *allocateFromClass(unsigned int classIndex);
+    void unref();
+
+    std::atomic_ulong refs;
+    std::vector<std::unique_ptr<SizeClass>> classes;
+    std::vector<BufferPoolSlab*> slabs;
+    std::mutex slabsMutex;
+
+    std::atomic_uint64_t statHits;
+    std::atomic_uint64_t statMisses;
+    std::atomic_uint64_t statFallbacks;
+    std::atomic_uint64_t statInUse;
+};
+
+} // namespace UDPC
+
+#endif
@@ -0,0 +1,127 @@
+#include "UDPC_ConnectionTable.hpp"
+
+#include <cassert>
+
+UDPC::ConnectionTableIndex::ConnectionTableIndex() :
+buckets(),
+mask(0),
+oldBuckets(),
+oldMask(0),
+oldMoved(0),
+count(0)
+{}
+
+void UDPC::ConnectionTableIndex::insert(std::uint32_t hash, std::uint32_t slot) {
+    if(!buckets) {
+        buckets = newBuckets(INITIAL_CAPACITY);
+        mask = INITIAL_CAPACITY - 1;
+    } else if((count + 1) * 2 > mask + 1) {
+        // finish the last growth first, this only happens if it did not get
+        // enough inserts and erases to move all old buckets
+        moveOld(oldMask + 1);
+        oldBuckets = std::move(buckets);
+        oldMask = mask;
+        oldMoved = 0;
+        buckets = newBuckets((mask + 1) * 2);
+        mask = mask * 2 + 1;
+    }
+    place(Bucket{hash, slot});
+    ++count;
+    moveOld(MOVES_PER_CHANGE);
+}
+
+void UDPC::ConnectionTableIndex::erase(std::uint32_t hash, std::uint32_t slot) {
+    Bucket *bucket = findBucket(hash, slot);
+    assert(bucket && "erased slot must be in the index");
+    if(oldBuckets && bucket >= oldBuckets.get()
+            && bucket <= oldBuckets.get() + oldMask) {
+        bucket->slot = MOVED;
+    } else {
+        // shift the following buckets back so that no probe passes a gap
+        std::uint32_t i = (std::uint32_t)(bucket - buckets.get());
+        for(std::uint32_t j = (i + 1) & mask;; j = (j + 1) & mask) {
+            if(buckets[j].slot == EMPTY) {
+                break;
+            }
+            std::uint32_t home = buckets[j].hash & mask;
+            // move j to i unless its home is cyclically within (i, j]
+            if(i <= j ? (home <= i || home > j) : (home <= i && home > j)) {
+                buckets[i] = buckets[j];
+                i = j;
+            }
+        }
+        buckets[i].slot = EMPTY;
+    }
+    --count;
+    moveOld(MOVES_PER_CHANGE);
+}
+
+void UDPC::ConnectionTableIndex::replace(
+        std::uint32_t hash, std::uint32_t slot, std::uint32_t newSlot) {
+    Bucket *bucket = findBucket(hash, slot);
+    assert(bucket && "replaced slot must be in the index");
+    bucket->slot = newSlot;
+}
+
+std::uint32_t UDPC::ConnectionTableIndex::size() const {
+    return count;
+}
+
+bool UDPC::ConnectionTableIndex::isGrowing() const {
+    return (bool)oldBuckets;
+}
+
+std::unique_ptr<UDPC::ConnectionTableIndex::Bucket[]>
+UDPC::ConnectionTableIndex::newBuckets(std::uint32_t capacity) {
+    std::unique_ptr<Bucket[]> newBuckets(new Bucket[capacity]);
+    for(std::uint32_t i = 0; i < capacity; ++i) {
+        newBuckets[i] = Bucket{0, EMPTY};
+    }
+    return newBuckets;
+}
+
+void UDPC::ConnectionTableIndex::place(Bucket bucket) {
+    std::uint32_t i = bucket.hash & mask;
+    while(buckets[i].slot != EMPTY) {
+        i = (i + 1) & mask;
+    }
+    buckets[i] = bucket;
+}
+
+void UDPC::ConnectionTableIndex::moveOld(std::uint32_t moves) {
+    for(; oldBuckets && moves > 0; --moves) {
+        Bucket &bucket = oldBuckets[oldMoved];
+        if(bucket.slot != EMPTY && bucket.slot != MOVED) {
+            place(bucket);
+            // not EMPTY, lookups of the remaining old buckets must probe past
+            // it
+            bucket.slot = MOVED;
+        }
+        if(oldMoved++ == oldMask) {
+            oldBuckets.reset();
+        }
+    }
+}
+
+UDPC::ConnectionTableIndex::Bucket *UDPC::ConnectionTableIndex::findBucket(
+        std::uint32_t hash, std::uint32_t slot) {
+    if(buckets) {
+        for(std::uint32_t i = hash & mask;; i = (i + 1) & mask) {
+            if(buckets[i].slot == EMPTY) {
+                break;
+            } else if(buckets[i].slot == slot) {
+                return &buckets[i];
+            }
+        }
+    }
+    if(oldBuckets) {
+        for(std::uint32_t i = hash & oldMask;; i = (i + 1) & oldMask) {
+            if(oldBuckets[i].slot == EMPTY) {
+                break;
+            } else if(oldBuckets[i].slot == slot) {
+                return &oldBuckets[i];
+            }
+        }
+    }
+    return nullptr;
+}
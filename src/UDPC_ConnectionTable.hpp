@@ -0,0 +1,620 @@
+#ifndef UDPC_CONNECTION_TABLE_HPP_
+#define UDPC_CONNECTION_TABLE_HPP_
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "UDPC.h"
+
+namespace UDPC {
+
+inline std::uint64_t mixHash(std::uint64_t h) {
+    // finalizer of MurmurHash3
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+inline std::uint64_t hashAddr(const UDPC_IPV6_ADDR_TYPE &addr) {
+    std::uint64_t high;
+    std::uint64_t low;
+    std::memcpy(&high, UDPC_IPV6_ADDR_SUB(addr), 8);
+    std::memcpy(&low, UDPC_IPV6_ADDR_SUB(addr) + 8, 8);
+    return mixHash(high ^ mixHash(low));
+}
+
+inline std::uint64_t hashConnectionId(const UDPC_ConnectionId &id) {
+    return mixHash(hashAddr(id.addr)
+        ^ (((std::uint64_t)id.scope_id << 16) | id.port));
+}
+
+inline bool isSameAddr(
+        const UDPC_IPV6_ADDR_TYPE &a, const UDPC_IPV6_ADDR_TYPE &b) {
+    return std::memcmp(UDPC_IPV6_ADDR_SUB(a), UDPC_IPV6_ADDR_SUB(b), 16) == 0;
+}
+
+inline bool isSameConnectionId(
+        const UDPC_ConnectionId &a, const UDPC_ConnectionId &b) {
+    return a.port == b.port && a.scope_id == b.scope_id
+        && isSameAddr(a.addr, b.addr);
+}
+
+// Open addressing (linear probing) index from 32 bit hashes to slots of a
+// ConnectionTable. Matching a key is left to the caller, so one index type
+// serves every key of the table.
+//
+// Growing does not rehash all at once. The buckets in use become the old
+// buckets and are moved to the new, twice as large, buckets a few at a time on
+// each insert or erase, and lookups check both until the old buckets are
+// empty.
+class ConnectionTableIndex {
+public:
+    static constexpr std::uint32_t NPOS = 0xFFFFFFFF;
+
+    ConnectionTableIndex();
+
+    // disable copy
+    ConnectionTableIndex(const ConnectionTableIndex &other) = delete;
+    ConnectionTableIndex &operator=(const ConnectionTableIndex &other) = delete;
+    // enable move
+    ConnectionTableIndex(ConnectionTableIndex &&other) = default;
+    ConnectionTableIndex &operator=(ConnectionTableIndex &&other) = default;
+
+    // Returns the first slot with hash for which isMatch(slot) is true, or
+    // NPOS.
+    template <typename Match>
+    std::uint32_t find(std::uint32_t hash, Match isMatch) const;
+    // slot must not be in the index.
+    void insert(std::uint32_t hash, std::uint32_t slot);
+    // slot must be in the index under hash.
+    void erase(std::uint32_t hash, std::uint32_t slot);
+    // Puts newSlot where slot is under hash.
+    void replace(std::uint32_t hash, std::uint32_t slot, std::uint32_t newSlot);
+
+    std::uint32_t size() const;
+    bool isGrowing() const;
+
+private:
+    // slot of a free bucket
+    static constexpr std::uint32_t EMPTY = 0xFFFFFFFF;
+    // slot of an old bucket that was moved or erased, lookups probe past it
+    static constexpr std::uint32_t MOVED = 0xFFFFFFFE;
+    static constexpr std::uint32_t INITIAL_CAPACITY = 16;
+    // old buckets moved per insert or erase, the old buckets are empty long
+    // before the new ones are half full
+    static constexpr std::uint32_t MOVES_PER_CHANGE = 8;
+
+    struct Bucket {
+        std::uint32_t hash;
+        std::uint32_t slot;
+    };
+
+    static std::unique_ptr<Bucket[]> newBuckets(std::uint32_t capacity);
+    void place(Bucket bucket);
+    void moveOld(std::uint32_t moves);
+    Bucket *findBucket(std::uint32_t hash, std::uint32_t slot);
+
+    std::unique_ptr<Bucket[]> buckets;
+    std::uint32_t mask;
+    std::unique_ptr<Bucket[]> oldBuckets;
+    std::uint32_t oldMask;
+    // old buckets before this one were moved
+    std::uint32_t oldMoved;
+    // entries in both buckets
+    std::uint32_t count;
+};
+
+// Flat table of connections keyed by UDPC_ConnectionId, with secondary indexes
+// by address and by connection id (conID) kept in the same structure.
+//
+// Entries are kept in fixed size chunks of slots that are never moved, so
+// iterators and references stay valid until their entry is erased, and a slot
+// freed by erase() is reused by a later insert(). Hashing does not allocate.
+//
+// Iteration order is slot order, erase() only invalidates iterators to the
+// erased entry.
+//
+// Each entry also has a handle, made of its slot and the slot's generation,
+// which is bumped when the entry is erased. A handle is resolved by indexing
+// its slot, and no longer resolves once its entry was erased even if the slot
+// is reused. Handles are never 0, the slot is in the low 24 bits and the
+// generation in the high 32 bits, bits 24 to 31 are left to the table's owner
+// (and ignored by findHandle()).
+//
+// Not thread safe.
+template <typename V>
+class ConnectionTable {
+public:
+    static constexpr std::uint32_t NPOS = ConnectionTableIndex::NPOS;
+
+    struct Entry {
+        const UDPC_ConnectionId first;
+        V second;
+    };
+
+    template <bool IsConst>
+    class Iterator {
+    public:
+        typedef typename std::conditional<IsConst,
+            const ConnectionTable, ConnectionTable>::type TableType;
+        typedef typename std::conditional<IsConst,
+            const Entry, Entry>::type EntryType;
+
+        Iterator(TableType *table, std::uint32_t slot);
+        // iterator converts to const_iterator
+        template <bool IsOtherConst,
+            typename = typename std::enable_if<IsConst || !IsOtherConst>::type>
+        Iterator(const Iterator<IsOtherConst> &other);
+
+        EntryType &operator*() const;
+        EntryType *operator->() const;
+        Iterator &operator++();
+
+        bool operator==(const Iterator &other) const;
+        bool operator!=(const Iterator &other) const;
+
+        std::uint32_t getSlot() const;
+
+    private:
+        template <bool IsOtherConst>
+        friend class Iterator;
+
+        TableType *table;
+        std::uint32_t slot;
+    };
+    typedef Iterator<false> iterator;
+    typedef Iterator<true> const_iterator;
+
+    ConnectionTable();
+    ~ConnectionTable();
+
+    // disable copy
+    ConnectionTable(const ConnectionTable &other) = delete;
+    ConnectionTable &operator=(const ConnectionTable &other) = delete;
+    // disable move, iterators reference the table
+    ConnectionTable(ConnectionTable &&other) = delete;
+    ConnectionTable &operator=(ConnectionTable &&other) = delete;
+
+    iterator begin();
+    iterator end();
+    const_iterator begin() const;
+    const_iterator end() const;
+
+    iterator find(const UDPC_ConnectionId &id);
+    const_iterator find(const UDPC_ConnectionId &id) const;
+    // Does not move from value if id is already in the table, in which case
+    // the returned iterator is to the existing entry.
+    std::pair<iterator, bool> insert(const UDPC_ConnectionId &id, V &&value);
+    // Returns the iterator to the entry after the erased one.
+    iterator erase(iterator iter);
+    std::size_t erase(const UDPC_ConnectionId &id);
+
+    std::size_t size() const;
+    bool empty() const;
+
+    // Returns the first entry with addr, the others follow with nextWithAddr().
+    iterator findAddr(const UDPC_IPV6_ADDR_TYPE &addr);
+    iterator nextWithAddr(iterator iter);
+
+    // Returns the entry indexed under conID, see setConID().
+    iterator findConID(std::uint32_t conID);
+    // Indexes the entry under conID, replacing the conID it was indexed under.
+    // conID must not be indexed for another entry.
+    void setConID(iterator iter, std::uint32_t conID);
+
+    std::uint64_t handleOf(const_iterator iter) const;
+    // Returns end() if the handle's entry was erased.
+    iterator findHandle(std::uint64_t handle);
+
+private:
+    static constexpr unsigned int CHUNK_SHIFT = 6;
+    static constexpr std::uint32_t CHUNK_SIZE = 1 << CHUNK_SHIFT;
+    static constexpr std::uint32_t HANDLE_SLOT_MASK = 0xFFFFFF;
+
+    struct Slot {
+        Slot();
+
+        alignas(Entry) unsigned char storage[sizeof(Entry)];
+        std::uint32_t hash;
+        std::uint32_t addrHash;
+        // other slots with the same address, NPOS terminated
+        std::uint32_t addrPrev;
+        std::uint32_t addrNext;
+        std::uint32_t conID;
+        std::uint32_t generation;
+        bool isUsed;
+        bool hasConID;
+    };
+
+    static std::uint32_t hashConID(std::uint32_t conID);
+
+    Slot &slotAt(std::uint32_t slot);
+    const Slot &slotAt(std::uint32_t slot) const;
+    Entry &entryAt(std::uint32_t slot);
+    const Entry &entryAt(std::uint32_t slot) const;
+    std::uint32_t findSlot(const UDPC_ConnectionId &id) const;
+    // Returns the first used slot from slot, or NPOS.
+    std::uint32_t nextUsed(std::uint32_t slot) const;
+
+    std::vector<std::unique_ptr<Slot[]>> chunks;
+    // slots before this one were used at some point
+    std::uint32_t slotEnd;
+    std::vector<std::uint32_t> freeSlots;
+    std::size_t entryCount;
+    ConnectionTableIndex idIndex;
+    // one slot per address, the first of its address list
+    ConnectionTableIndex addrIndex;
+    ConnectionTableIndex conIDIndex;
+};
+
+template <typename Match>
+std::uint32_t ConnectionTableIndex::find(std::uint32_t hash, Match isMatch) const {
+    if(buckets) {
+        for(std::uint32_t i = hash & mask;; i = (i + 1) & mask) {
+            const Bucket &bucket = buckets[i];
+            if(bucket.slot == EMPTY) {
+                break;
+            } else if(bucket.hash == hash && isMatch(bucket.slot)) {
+                return bucket.slot;
+            }
+        }
+    }
+    if(oldBuckets) {
+        for(std::uint32_t i = hash & oldMask;; i = (i + 1) & oldMask) {
+            const Bucket &bucket = oldBuckets[i];
+            if(bucket.slot == EMPTY) {
+                break;
+            } else if(bucket.slot != MOVED
+                    && bucket.hash == hash && isMatch(bucket.slot)) {
+                return bucket.slot;
+            }
+        }
+    }
+    return NPOS;
+}
+
+template <typename V>
+template <bool IsConst>
+ConnectionTable<V>::Iterator<IsConst>::Iterator(
+        TableType *table, std::uint32_t slot) :
+table(table),
+slot(slot)
+{}
+
+template <typename V>
+template <bool IsConst>
+template <bool IsOtherConst, typename>
+ConnectionTable<V>::Iterator<IsConst>::Iterator(
+        const Iterator<IsOtherConst> &other) :
+table(other.table),
+slot(other.slot)
+{}
+
+template <typename V>
+template <bool IsConst>
+typename ConnectionTable<V>::template Iterator<IsConst>::EntryType &
+ConnectionTable<V>::Iterator<IsConst>::operator*() const {
+    return table->entryAt(slot);
+}
+
+template <typename V>
+template <bool IsConst>
+typename ConnectionTable<V>::template Iterator<IsConst>::EntryType *
+ConnectionTable<V>::Iterator<IsConst>::operator->() const {
+    return &table->entryAt(slot);
+}
+
+template <typename V>
+template <bool IsConst>
+typename ConnectionTable<V>::template Iterator<IsConst> &
+ConnectionTable<V>::Iterator<IsConst>::operator++() {
+    slot = table->nextUsed(slot + 1);
+    return *this;
+}
+
+template <typename V>
+template <bool IsConst>
+bool ConnectionTable<V>::Iterator<IsConst>::operator==(
+        const Iterator &other) const {
+    return slot == other.slot;
+}
+
+template <typename V>
+template <bool IsConst>
+bool ConnectionTable<V>::Iterator<IsConst>::operator!=(
+        const Iterator &other) const {
+    return slot != other.slot;
+}
+
+template <typename V>
+template <bool IsConst>
+std::uint32_t ConnectionTable<V>::Iterator<IsConst>::getSlot() const {
+    return slot;
+}
+
+template <typename V>
+ConnectionTable<V>::ConnectionTable() :
+chunks(),
+slotEnd(0),
+freeSlots(),
+entryCount(0),
+idIndex(),
+addrIndex(),
+conIDIndex()
+{}
+
+template <typename V>
+ConnectionTable<V>::~ConnectionTable() {
+    for(std::uint32_t slot = 0; slot < slotEnd; ++slot) {
+        if(slotAt(slot).isUsed) {
+            entryAt(slot).~Entry();
+        }
+    }
+}
+
+template <typename V>
+typename ConnectionTable<V>::iterator ConnectionTable<V>::begin() {
+    return iterator(this, nextUsed(0));
+}
+
+template <typename V>
+typename ConnectionTable<V>::iterator ConnectionTable<V>::end() {
+    return iterator(this, NPOS);
+}
+
+template <typename V>
+typename ConnectionTable<V>::const_iterator ConnectionTable<V>::begin() const {
+    return const_iterator(this, nextUsed(0));
+}
+
+template <typename V>
+typename ConnectionTable<V>::const_iterator ConnectionTable<V>::end() const {
+    return const_iterator(this, NPOS);
+}
+
+template <typename V>
+typename ConnectionTable<V>::iterator ConnectionTable<V>::find(
+        const UDPC_ConnectionId &id) {
+    return iterator(this, findSlot(id));
+}
+
+template <typename V>
+typename ConnectionTable<V>::const_iterator ConnectionTable<V>::find(
+        const UDPC_ConnectionId &id) const {
+    return const_iterator(this, findSlot(id));
+}
+
+template <typename V>
+std::pair<typename ConnectionTable<V>::iterator, bool>
+ConnectionTable<V>::insert(const UDPC_ConnectionId &id, V &&value) {
+    std::uint32_t existing = findSlot(id);
+    if(existing != NPOS) {
+        return std::make_pair(iterator(this, existing), false);
+    }
+
+    std::uint32_t slot;
+    if(!freeSlots.empty()) {
+        slot = freeSlots.back();
+        freeSlots.pop_back();
+    } else {
+        assert(slotEnd < HANDLE_SLOT_MASK && "slots must fit in handles");
+        if((slotEnd >> CHUNK_SHIFT) == chunks.size()) {
+            chunks.emplace_back(new Slot[CHUNK_SIZE]);
+        }
+        slot = slotEnd++;
+    }
+
+    Slot &newSlot = slotAt(slot);
+    new(newSlot.storage) Entry{id, std::move(value)};
+    newSlot.isUsed = true;
+    newSlot.hasConID = false;
+    newSlot.hash = (std::uint32_t)hashConnectionId(id);
+    newSlot.addrHash = (std::uint32_t)hashAddr(id.addr);
+    idIndex.insert(newSlot.hash, slot);
+
+    // link after the first slot with the same address, if any
+    std::uint32_t first = addrIndex.find(newSlot.addrHash,
+        [this, &id] (std::uint32_t other) {
+            return isSameAddr(entryAt(other).first.addr, id.addr);
+        });
+    if(first == NPOS) {
+        newSlot.addrPrev = NPOS;
+        newSlot.addrNext = NPOS;
+        addrIndex.insert(newSlot.addrHash, slot);
+    } else {
+        Slot &firstSlot = slotAt(first);
+        newSlot.addrPrev = first;
+        newSlot.addrNext = firstSlot.addrNext;
+        if(firstSlot.addrNext != NPOS) {
+            slotAt(firstSlot.addrNext).addrPrev = slot;
+        }
+        firstSlot.addrNext = slot;
+    }
+
+    ++entryCount;
+    return std::make_pair(iterator(this, slot), true);
+}
+
+template <typename V>
+typename ConnectionTable<V>::iterator ConnectionTable<V>::erase(
+        iterator iter) {
+    const std::uint32_t slot = iter.getSlot();
+    Slot &oldSlot = slotAt(slot);
+
+    idIndex.erase(oldSlot.hash, slot);
+    if(oldSlot.addrPrev != NPOS) {
+        slotAt(oldSlot.addrPrev).addrNext = oldSlot.addrNext;
+        if(oldSlot.addrNext != NPOS) {
+            slotAt(oldSlot.addrNext).addrPrev = oldSlot.addrPrev;
+        }
+    } else if(oldSlot.addrNext != NPOS) {
+        // next slot becomes the first of the address
+        addrIndex.replace(oldSlot.addrHash, slot, oldSlot.addrNext);
+        slotAt(oldSlot.addrNext).addrPrev = NPOS;
+    } else {
+        addrIndex.erase(oldSlot.addrHash, slot);
+    }
+    if(oldSlot.hasConID) {
+        conIDIndex.erase(hashConID(oldSlot.conID), slot);
+    }
+
+    entryAt(slot).~Entry();
+    oldSlot.isUsed = false;
+    if(++oldSlot.generation == 0) {
+        oldSlot.generation = 1;
+    }
+    freeSlots.push_back(slot);
+    --entryCount;
+    return iterator(this, nextUsed(slot + 1));
+}
+
+template <typename V>
+std::size_t ConnectionTable<V>::erase(const UDPC_ConnectionId &id) {
+    std::uint32_t slot = findSlot(id);
+    if(slot == NPOS) {
+        return 0;
+    }
+    erase(iterator(this, slot));
+    return 1;
+}
+
+template <typename V>
+std::size_t ConnectionTable<V>::size() const {
+    return entryCount;
+}
+
+template <typename V>
+bool ConnectionTable<V>::empty() const {
+    return entryCount == 0;
+}
+
+template <typename V>
+typename ConnectionTable<V>::iterator ConnectionTable<V>::findAddr(
+        const UDPC_IPV6_ADDR_TYPE &addr) {
+    return iterator(this, addrIndex.find((std::uint32_t)hashAddr(addr),
+        [this, &addr] (std::uint32_t slot) {
+            return isSameAddr(entryAt(slot).first.addr, addr);
+        }));
+}
+
+template <typename V>
+typename ConnectionTable<V>::iterator ConnectionTable<V>::nextWithAddr(
+        iterator iter) {
+    return iterator(this, slotAt(iter.getSlot()).addrNext);
+}
+
+template <typename V>
+typename ConnectionTable<V>::iterator ConnectionTable<V>::findConID(
+        std::uint32_t conID) {
+    return iterator(this, conIDIndex.find(hashConID(conID),
+        [this, conID] (std::uint32_t slot) {
+            return slotAt(slot).conID == conID;
+        }));
+}
+
+template <typename V>
+void ConnectionTable<V>::setConID(iterator iter, std::uint32_t conID) {
+    const std::uint32_t slot = iter.getSlot();
+    Slot &idSlot = slotAt(slot);
+    if(idSlot.hasConID) {
+        conIDIndex.erase(hashConID(idSlot.conID), slot);
+    }
+    idSlot.conID = conID;
+    idSlot.hasConID = true;
+    conIDIndex.insert(hashConID(conID), slot);
+}
+
+template <typename V>
+std::uint64_t ConnectionTable<V>::handleOf(const_iterator iter) const {
+    const std::uint32_t slot = iter.getSlot();
+    return ((std::uint64_t)slotAt(slot).generation << 32) | (slot + 1);
+}
+
+template <typename V>
+typename ConnectionTable<V>::iterator ConnectionTable<V>::findHandle(
+        std::uint64_t handle) {
+    const std::uint32_t slot = (std::uint32_t)(handle & HANDLE_SLOT_MASK) - 1;
+    if(slot >= slotEnd) {
+        return end();
+    }
+    const Slot &handleSlot = slotAt(slot);
+    if(!handleSlot.isUsed
+            || handleSlot.generation != (std::uint32_t)(handle >> 32)) {
+        return end();
+    }
+    return iterator(this, slot);
+}
+
+template <typename V>
+ConnectionTable<V>::Slot::Slot() :
+storage(),
+hash(0),
+addrHash(0),
+addrPrev(NPOS),
+addrNext(NPOS),
+conID(0),
+generation(1),
+isUsed(false),
+hasConID(false)
+{}
+
+template <typename V>
+std::uint32_t ConnectionTable<V>::hashConID(std::uint32_t conID) {
+    return (std::uint32_t)mixHash(conID);
+}
+
+template <typename V>
+typename ConnectionTable<V>::Slot &ConnectionTable<V>::slotAt(
+        std::uint32_t slot) {
+    return chunks[slot >> CHUNK_SHIFT][slot & (CHUNK_SIZE - 1)];
+}
+
+template <typename V>
+const typename ConnectionTable<V>::Slot &ConnectionTable<V>::slotAt(
+        std::uint32_t slot) const {
+    return chunks[slot >> CHUNK_SHIFT][slot & (CHUNK_SIZE - 1)];
+}
+
+template <typename V>
+typename ConnectionTable<V>::Entry &ConnectionTable<V>::entryAt(
+        std::uint32_t slot) {
+    return *std::launder(reinterpret_cast<Entry*>(slotAt(slot).storage));
+}
+
+template <typename V>
+const typename ConnectionTable<V>::Entry &ConnectionTable<V>::entryAt(
+        std::uint32_t slot) const {
+    return *std::launder(reinterpret_cast<const Entry*>(slotAt(slot).storage));
+}
+
+template <typename V>
+std::uint32_t ConnectionTable<V>::findSlot(const UDPC_ConnectionId &id) const {
+    return idIndex.find((std::uint32_t)hashConnectionId(id),
+        [this, &id] (std::uint32_t slot) {
+            return isSameConnectionId(entryAt(slot).first, id);
+        });
+}
+
+template <typename V>
+std::uint32_t ConnectionTable<V>::nextUsed(std::uint32_t slot) const {
+    for(; slot < slotEnd; ++slot) {
+        if(slotAt(slot).isUsed) {
+            return slot;
+        }
+    }
+    return NPOS;
+}
+
+} // namespace UDPC
+
+#endif
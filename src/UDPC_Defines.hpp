@@ -3,8 +3,21 @@
 #define UDPC_DEFINES_HPP
 
 #define UDPC_CONTEXT_IDENTIFIER 0x902F4DB3
-#define UDPC_SENT_PKTS_MAX_SIZE 33
+// slots of ConnectionData::sentPkts, a power of two that covers the ack window
+// (the peer's rseq and 32 packets before it)
+#define UDPC_SENT_PKTS_MAX_SIZE 64
 #define UDPC_QUEUED_PKTS_MAX_SIZE 64
+// sends per second of a connection, one per tick of Context::timers at most
+#define UDPC_SEND_RATE_MAX 1000
+// queued packets sent per send of a connection
+#define UDPC_SEND_BURST_MAX UDPC_QUEUED_PKTS_MAX_SIZE
+// ids a sent packet is tracked for by the peer's acks, the peer's rseq and 32
+// packets before it
+#define UDPC_ACK_WINDOW_SIZE 33
+// ids sent but not acked yet before queued packets wait for the peer's acks,
+// for connections sending faster than the default rates, the rest of the ack
+// window is left to heartbeats acking the peer's packets
+#define UDPC_SEND_WINDOW_SIZE 24
 #define UDPC_RECEIVED_PKTS_MAX_SIZE 64
 
 #define UDPC_ID_CONNECT 0x80000000
@@ -18,11 +31,13 @@
 
 #define UDPC_CHECK_LOG(ctx, type, ...) if(ctx->willLog(type)){ctx->log(type, __VA_ARGS__);}
 
+#include <array>
 #include <atomic>
 #include <bitset>
 #include <chrono>
 #include <cstdint>
 #include <deque>
+#include <vector>
 #include <unordered_map>
 #include <unordered_set>
 #include <random>
@@ -32,8 +47,13 @@
 #include <iostream>
 #include <shared_mutex>
 
-#include "TSLQueue.hpp"
+#include "RingQueue.hpp"
 #include "UDPC.h"
+#include "UDPC_BufferPool.hpp"
+#include "UDPC_ConnectionTable.hpp"
+#include "UDPC_IOUring.hpp"
+#include "UDPC_PeerList.hpp"
+#include "UDPC_TimingWheel.hpp"
 
 #ifdef UDPC_LIBSODIUM_ENABLED
 # include <sodium.h>
@@ -56,6 +76,38 @@
 #define UDPC_UPDATE_MS_MAX 333
 #define UDPC_UPDATE_MS_DEFAULT 8
 
+#define UDPC_RECV_BATCH_DEFAULT 32
+#define UDPC_RECV_BATCH_MAX 256
+
+#define UDPC_GSO_BURST_MAX 16
+#define UDPC_GSO_MAX_SEGMENTS 64
+#define UDPC_GSO_MAX_BYTES 65507
+
+// receive buffer size per batch slot when GRO may coalesce datagrams
+#define UDPC_GRO_BUFFER_SIZE 65536
+
+#define UDPC_IO_URING_RECV_ENTRIES 4
+#define UDPC_IO_URING_RECV_BUFFERS 256
+#define UDPC_IO_URING_SEND_ENTRIES 256
+
+#define UDPC_SHARDS_MAX 64
+
+// datagrams the receive thread can hand to update before dropping
+#define UDPC_RECV_HANDOFF_CAPACITY 4096
+// payloads at least this large are handed out in the receive buffer they
+// arrived in instead of being copied, smaller ones are copied to a buffer of
+// their size so that they do not hold on to a whole receive buffer
+#define UDPC_RECV_ADOPT_MIN_SIZE 1024
+// payloads up to this size that are gotten with UDPC_get_received() instead of
+// as a view are copied out of their receive buffer to a buffer of their size
+#define UDPC_RECV_SHRINK_MAX_SIZE 2048
+// capacities of the context wide queues (see UDPC.h for the documented values)
+#define UDPC_SEND_QUEUE_CAPACITY 8192
+#define UDPC_RECEIVED_QUEUE_CAPACITY 8192
+#define UDPC_EVENT_QUEUE_CAPACITY 1024
+// cached peer to shard lookups, cleared when full
+#define UDPC_SHARD_INDEX_MAP_MAX 65536
+
 namespace UDPC {
 
 constexpr auto ONE_SECOND = std::chrono::seconds(1);
@@ -69,26 +121,71 @@ constexpr auto GOOD_RTT_LIMIT = std::chrono::milliseconds(250);
 constexpr auto CONNECTION_TIMEOUT = TEN_SECONDS;
 constexpr auto GOOD_MODE_SEND_RATE = std::chrono::microseconds(33333);
 constexpr auto BAD_MODE_SEND_RATE = std::chrono::milliseconds(100);
+// UDPC_set_default_send_rate() defaults, in sends per second
+constexpr unsigned int GOOD_MODE_SENDS = 30;
+constexpr unsigned int BAD_MODE_SENDS = 10;
+
+constexpr uint64_t NO_TICK = 0xFFFFFFFFFFFFFFFF;
 
 // forward declaration
 struct Context;
 struct PktInfoWrapper;
 
-struct SentPktInfo {
-    typedef std::shared_ptr<SentPktInfo> Ptr;
+struct SentPkt {
+    SentPkt();
+    ~SentPkt();
+
+    // copy
+    SentPkt(const SentPkt& other) = delete;
+    SentPkt& operator=(const SentPkt& other) = delete;
+
+    // move
+    SentPkt(SentPkt&& other);
+    SentPkt& operator=(SentPkt&& other);
 
-    SentPktInfo();
+    // frees data, and the shared payload it refers to (flag 0x20)
+    void reset();
 
+    // the sent datagram if it is check-received, nullptr otherwise
+    char *data;
+    uint32_t dataSize;
     uint32_t id;
+    /*
+     * 0x1 - slot holds a sent packet
+     * 0x4 - not check-received
+     * 0x8 - already re-sent, or timed out without payload
+     * 0x20 - data is the header followed by a pointer to a shared payload
+     */
+    uint32_t flags;
     std::chrono::steady_clock::time_point sentTime;
 };
 
-struct ConnectionIdHasher {
-    std::size_t operator()(const UDPC_ConnectionId& key) const;
+struct StagedSend {
+    // the datagram if it is not in Context::sendStage (a committed send
+    // buffer), nullptr otherwise
+    const char *buf;
+    // offset of the datagram into Context::sendStage
+    std::size_t offset;
+    // size of the whole datagram, including payloadSize
+    uint32_t size;
+    // the datagram's payload if it is sent from a shared buffer after the
+    // staged header, nullptr otherwise
+    const char *payload;
+    uint32_t payloadSize;
+    UDPC_IPV6_SOCKADDR_TYPE dest;
 };
 
-struct IPV6_Hasher {
-    std::size_t operator()(const UDPC_IPV6_ADDR_TYPE& addr) const;
+struct ReceivedDatagram {
+    // from the context's pool (or malloc'd), freed once processed by update
+    // unless its payload was adopted by the received packet
+    char *data = nullptr;
+    uint32_t size = 0;
+    UDPC_IPV6_SOCKADDR_TYPE sender = {};
+    std::chrono::steady_clock::time_point received = {};
+};
+
+struct ConnectionIdHasher {
+    std::size_t operator()(const UDPC_ConnectionId& key) const;
 };
 
 struct PKContainer {
@@ -122,7 +219,12 @@ struct ConnectionData {
     ConnectionData(ConnectionData&& other) = default;
     ConnectionData& operator=(ConnectionData&& other) = default;
 
-    void cleanupSentPkts();
+    // Returns the slot for the packet sent with id, freeing the packet sent
+    // UDPC_SENT_PKTS_MAX_SIZE packets before it.
+    SentPkt &addSentPkt(
+        uint32_t id, const std::chrono::steady_clock::time_point &sentTime);
+    // Returns nullptr if no packet was sent with id, or its slot was reused.
+    SentPkt *findSentPkt(uint32_t id);
 
     /*
      * 0 - trigger send
@@ -138,18 +240,37 @@ struct ConnectionData {
     uint32_t lseq;
     uint32_t rseq;
     uint32_t ack;
+    // the newest rseq received from the peer, with the acks of all received
+    // packets merged into peerAck (bit 31 is peerRseq - 1)
+    uint32_t peerRseq;
+    uint32_t peerAck;
+    // rseq when a packet was last sent, a heartbeat is sent early once half
+    // the send window was received since
+    uint32_t sentRseq;
+    // oldest sent id not known to be received, re-sent or not check-received
+    uint32_t sendWindowStart;
+    // advanced by the time since timersUpdated whenever the connection is due
+    // in Context::timers
     std::chrono::steady_clock::duration timer;
     std::chrono::steady_clock::duration toggleT;
     std::chrono::steady_clock::duration toggleTimer;
     std::chrono::steady_clock::duration toggledTimer;
+    // time between sends in good and bad mode, see UDPC_set_send_rate()
+    std::chrono::steady_clock::duration goodModeSendRate;
+    std::chrono::steady_clock::duration badModeSendRate;
+    // queued packets sent per send
+    unsigned int sendBurst;
+    std::chrono::steady_clock::time_point timersUpdated;
+    // tick the connection is due at in Context::timers, NO_TICK if not
+    // scheduled
+    uint64_t timerTick;
     UDPC_IPV6_ADDR_TYPE addr; // in network order
     uint32_t scope_id;
     uint16_t port; // in native order
-    std::deque<UDPC_PacketInfo> sentPkts;
+    // sent packets by id % UDPC_SENT_PKTS_MAX_SIZE
+    std::array<SentPkt, UDPC_SENT_PKTS_MAX_SIZE> sentPkts;
     std::deque<UDPC_PacketInfo> sendPkts;
     std::deque<UDPC_PacketInfo> priorityPkts;
-    // pkt id to pkt shared_ptr
-    std::unordered_map<uint32_t, SentPktInfo::Ptr> sentInfoMap;
     std::chrono::steady_clock::time_point received;
     std::chrono::steady_clock::time_point sent;
     std::chrono::steady_clock::duration rtt;
@@ -166,6 +287,10 @@ public:
     Context(bool isThreaded);
     ~Context();
 
+    // Disallow copy, owns the socket, threads and buffer pool.
+    Context(const Context&) = delete;
+    Context &operator=(const Context&) = delete;
+
     bool willLog(UDPC_LoggingType);
 
     void log(UDPC_LoggingType) {}
@@ -221,10 +346,173 @@ private:
 
 public:
     void update_impl();
+    // receives from the socket, or the receive thread's handoff
+    void receive_impl(const std::chrono::steady_clock::time_point &now);
+    // Publishes conMap's connections to peerList, and to the combined
+    // peerList of the sharded context if this is a shard.
+    void publishPeerList();
+    // If isAdopted is not nullptr, recvBuf is a pooled buffer that the
+    // received packet may keep its payload in, which sets isAdopted.
+    void receivePacket(
+        char *recvBuf,
+        int bytes,
+        const UDPC_IPV6_SOCKADDR_TYPE &receivedData,
+        const std::chrono::steady_clock::time_point &now,
+        bool *isAdopted = nullptr);
+    // Queues the payload of sent, which timed out without being received, to
+    // be re-sent once.
+    void resendTimedOut(ConnectionData &con, SentPkt &sent);
+    // Only a connection sending faster than the default rates can have sent
+    // packets slide out of the peer's ack window before they were acked, the
+    // send window and early heartbeats are only used for such connections.
+    bool isSendWindowed(const ConnectionData &con) const;
+    // Moves the connection's send window past the packets the peer received
+    // and re-sends the ones it reported missing or that timed out. Returns
+    // false while size ids are not acked yet.
+    bool isSendWindowOpen(
+        ConnectionData &con,
+        const std::chrono::steady_clock::time_point &now,
+        uint32_t size);
+    char *takePayload(
+        char *recvBuf,
+        unsigned int offset,
+        unsigned int size,
+        bool *isAdopted);
+    // Copies a small payload out of the receive buffer it was handed out in,
+    // so a packet the application keeps does not hold on to the buffer.
+    void shrinkReceived(UDPC_PacketInfo &pinfo);
+    void setupRecvBufs(unsigned int depth, unsigned int slotSize);
+    void freeRecvBufs();
+    char *allocateRecvBuf(unsigned int slotSize);
+    void replaceRecvBuf(unsigned int index);
+    void countReceived(unsigned int datagrams);
+#if UDPC_PLATFORM == UDPC_PLATFORM_LINUX
+    void receiveBatched(
+        const std::chrono::steady_clock::time_point &now,
+        bool isHandingOff = false);
+    bool startReceiveThread();
+    void stopReceiveThread();
+    void receiveThreaded();
+#endif
+    // Like receivePacket, buf is adopted instead of copied if isAdopted is
+    // not nullptr.
+    void handOff(
+        char *buf,
+        unsigned int size,
+        const UDPC_IPV6_SOCKADDR_TYPE &sender,
+        const std::chrono::steady_clock::time_point &now,
+        bool *isAdopted = nullptr);
+    void receiveHandedOff();
+    bool isValidHeader(
+        const char *buf,
+        int bytes,
+        const UDPC_IPV6_SOCKADDR_TYPE &sender);
+    void pushEvent(const UDPC_Event &event);
+    // pushes an event with the id and handle of iter's connection
+    void pushEvent(
+        UDPC_EventType type,
+        ConnectionTable<ConnectionData>::const_iterator iter);
+    void pushReceived(UDPC_PacketInfo &pinfo);
+    // wrapper is freed if the send queue is full
+    void pushSend(PktInfoWrapper &wrapper);
+    // Returns the number of wrappers pushed, the rest are left as they are.
+    std::size_t pushSends(PktInfoWrapper *wrappers, std::size_t count);
+    // Reserves room for up to count packets in cSendQueuedSize, returns the
+    // number reserved.
+    std::size_t reserveSends(std::size_t count);
+    char *stageSend(unsigned int size, const UDPC_ConnectionId &dest);
+    // buf must stay valid until flushSends() returns
+    void stageSendBuffer(
+        const char *buf, unsigned int size, const UDPC_ConnectionId &dest);
+    // Stages headerSize bytes like stageSend(), followed by payload when sent,
+    // which must stay valid until flushSends() returns.
+    char *stageSendHeader(unsigned int headerSize, const char *payload,
+        uint32_t payloadSize, const UDPC_ConnectionId &dest);
+    void unstageSend();
+    void flushSends();
+    void clearStagedSends();
+    Context *shardFor(const UDPC_ConnectionId &id);
+    // index into shards of the shard owning id, 0 if no shard knows it
+    unsigned int shardIndexFor(const UDPC_ConnectionId &id);
+    // Groups the indices of count ids by the shard owning them, with shard
+    // i's in order[offsets[i]] to order[offsets[i + 1] - 1]. Each distinct
+    // id is looked up once, including ids unknown to every shard.
+    template <typename IdOf>
+    void groupByShard(unsigned long count, IdOf idOf,
+        std::vector<unsigned long> &order,
+        std::vector<unsigned long> &offsets);
+    // nullptr if the handle's shard index is out of range
+    Context *shardForHandle(UDPC_ConnectionHandle handle);
+    // the table's handle with shardIndex in bits 24 to 31
+    UDPC_ConnectionHandle handleOf(
+        ConnectionTable<ConnectionData>::const_iterator iter) const;
+#if UDPC_PLATFORM == UDPC_PLATFORM_LINUX
+    void sendFailed(const struct msghdr &msg, int error);
+    void sendSegmented(const struct msghdr &msg);
+#endif
+#ifdef UDPC_IO_URING_ENABLED
+    bool setupIOUring();
+    void armReceiveIOUring();
+    void receiveIOUring(const std::chrono::steady_clock::time_point &now);
+    void sendIOUring(std::size_t msgCount);
+#endif
+#if UDPC_PLATFORM == UDPC_PLATFORM_LINUX
+    bool setupPolling();
+    void setPollTarget(int oldFd, int newFd);
+    void armTimer(const std::chrono::steady_clock::time_point &deadline);
+    void waitForWork();
+#endif
+    void wake();
+    std::chrono::steady_clock::time_point nextDeadline();
+    // Returns when the connection next has something to do: its send rate
+    // timer triggering a send (of queued packets, a heartbeat or an initiate
+    // connection packet), a good/bad mode check or timing out.
+    std::chrono::steady_clock::time_point nextDue(const ConnectionData &con) const;
+    // Schedules the connection in timers at time, unless it is already due
+    // at or before then.
+    void scheduleConnection(
+        ConnectionTable<ConnectionData>::iterator iter,
+        const std::chrono::steady_clock::time_point &time);
+    // header size reserved before the payload of a committed send buffer
+    unsigned int sendHeadroom() const;
 
     uint_fast32_t _contextIdentifier;
 
-    char recvBuf[UDPC_PACKET_MAX_SIZE];
+    // recvBufsDepth buffers of size recvBufsSlotSize, only touched while
+    // holding recvMutex. Buffers are from bufferPool unless larger than a
+    // packet, a buffer adopted by a received packet is replaced. Slots smaller
+    // than a packet are receive buffers (see BufferPool::allocateReceive()),
+    // each continued by a tail in recvTails for the rest of a larger packet.
+    std::vector<char*> recvBufs;
+    std::vector<char*> recvTails;
+    unsigned int recvBufsDepth;
+    unsigned int recvBufsSlotSize;
+#if UDPC_PLATFORM == UDPC_PLATFORM_LINUX
+    std::vector<struct mmsghdr> recvMsgs;
+    std::vector<struct iovec> recvIovs;
+    std::vector<UDPC_IPV6_SOCKADDR_TYPE> recvAddrs;
+    // one UDP_GRO cmsg per entry in recvMsgs
+    std::vector<char> recvCtrl;
+#endif
+    // datagrams built during update, sent together by flushSends()
+    std::vector<char> sendStage;
+    std::vector<StagedSend> stagedSends;
+    // staged send buffers that are not kept for resending, freed by
+    // flushSends()
+    std::vector<char*> sendStageOwned;
+#if UDPC_PLATFORM == UDPC_PLATFORM_LINUX
+    std::vector<struct mmsghdr> sendMsgs;
+    std::vector<struct iovec> sendIovs;
+    // one UDP_SEGMENT cmsg per entry in sendMsgs
+    std::vector<char> sendCtrl;
+#endif
+#ifdef UDPC_IO_URING_ENABLED
+    // only set if the io_uring I/O engine is in use
+    std::unique_ptr<IOUring> recvRing;
+    std::unique_ptr<IOUring> sendRing;
+    struct msghdr recvMsgTemplate;
+    bool isRecvArmed;
+#endif
     /*
      * 0 - is destucting
      * 1 - is client
@@ -234,6 +522,20 @@ public:
     std::atomic_bool isAcceptNewConnections;
     std::atomic_bool isReceivingEvents;
     std::atomic_bool isAutoUpdating;
+    std::atomic_uint recvBatchDepth;
+    UDPC_IOEngine ioEngine;
+    std::atomic_bool isGSOEnabled;
+    std::atomic_bool isGROEnabled;
+    // send rate of new connections, see UDPC_set_default_send_rate()
+    std::atomic_uint goodModeSends;
+    std::atomic_uint badModeSends;
+    std::atomic_uint sendBurst;
+    // see UDPC_ReceiveStats in UDPC.h
+    std::atomic_uint64_t recvStatCalls;
+    std::atomic_uint64_t recvStatDatagrams;
+    std::atomic_uint64_t recvStatCoalesced;
+    std::atomic_uint32_t recvStatMaxPerCall;
+    std::atomic_uint64_t recvStatHandoffDropped;
     std::atomic_uint32_t protocolID;
     std::atomic_uint_fast8_t loggingType;
     // See UDPC_AuthPolicy enum in UDPC.h for possible values
@@ -244,29 +546,72 @@ public:
     UDPC_IPV6_SOCKADDR_TYPE socketInfo;
 
     std::chrono::steady_clock::time_point lastUpdated;
-    // ipv6 address and port (as UDPC_ConnectionId) to ConnectionData
-    std::unordered_map<UDPC_ConnectionId, ConnectionData, ConnectionIdHasher> conMap;
-    // ipv6 address to all connected UDPC_ConnectionId
-    std::unordered_map<UDPC_IPV6_ADDR_TYPE, std::unordered_set<UDPC_ConnectionId, ConnectionIdHasher>, IPV6_Hasher> addrConMap;
-    // id to ipv6 address and port (as UDPC_ConnectionId)
-    std::unordered_map<uint32_t, UDPC_ConnectionId> idMap;
+    // ipv6 address and port (as UDPC_ConnectionId) to ConnectionData, also
+    // indexed by ipv6 address and (for the server) by id. Only changed by the
+    // thread running update_impl(), which reads it without conMapMutex.
+    ConnectionTable<ConnectionData> conMap;
+    // handles of conMap's connections by when they are next due (see
+    // nextDue()), entries of erased connections are skipped when due
+    TimingWheel timers;
+    // conMap's connections for other threads (see UDPC_acquire_peer_list()),
+    // or the connections of all shards for a sharded context
+    PeerListPublisher peerList;
+    // conMap's connections were added, removed or changed mode since
+    // peerList was published
+    bool isPeerListChanged;
     std::unordered_set<UDPC_ConnectionId, ConnectionIdHasher> deletionMap;
     std::unordered_set<PKContainer, PKContainer> peerPKWhitelist;
-    TSLQueue<UDPC_PacketInfo> receivedPkts;
-    TSLQueue<PktInfoWrapper> cSendPkts;
+    // packet data, released by the destructor but kept alive by packets not
+    // freed yet (see BufferPool)
+    BufferPool *bufferPool;
+    RingQueue<UDPC_PacketInfo> receivedPkts;
+    RingQueue<PktInfoWrapper> cSendPkts;
+    // queued packets whose connection's queue was full, only used by update,
+    // swapped with cSendRequeueNext every update so that neither reallocates
+    std::vector<PktInfoWrapper> cSendRequeue;
+    std::vector<PktInfoWrapper> cSendRequeueNext;
+    // packets in cSendPkts and cSendRequeue, reserved before pushing to
+    // cSendPkts so that both hold at most UDPC_SEND_QUEUE_CAPACITY together
+    std::atomic_ulong cSendQueuedSize;
     // handled internally
-    TSLQueue<UDPC_Event> internalEvents;
+    RingQueue<UDPC_Event> internalEvents;
     // handled via interface, if isReceivingEvents is true
-    TSLQueue<UDPC_Event> externalEvents;
+    RingQueue<UDPC_Event> externalEvents;
 
     std::default_random_engine rng_engine;
 
     std::thread thread;
     std::atomic_bool threadRunning;
+    // held while conMap's connections or a connection's sendPkts change, and
+    // by other threads while they read them, never while signing or sending
     std::mutex conMapMutex;
+    // held while timers change, and by nextDeadline()
+    std::mutex timersMutex;
     std::shared_mutex peerPKWhitelistMutex;
 
     std::chrono::milliseconds threadedSleepTime;
+#if UDPC_PLATFORM == UDPC_PLATFORM_LINUX
+    // Threaded update waits on epollFd, which watches the socket (or the
+    // io_uring receive ring), wakeFd (signaled when work is queued), and
+    // timerFd (armed to the next deadline). -1 if not set up.
+    int epollFd;
+    int wakeFd;
+    int timerFd;
+    // set once epollFd is handed out by UDPC_get_pollable_fd()
+    std::atomic_bool isPollFdUsed;
+#endif
+
+    // held while reading from the socket, by update or the receive thread
+    std::mutex recvMutex;
+#if UDPC_PLATFORM == UDPC_PLATFORM_LINUX
+    // optional thread that drains the socket into recvHandoff
+    std::thread recvThread;
+    std::atomic_bool isRecvThreadRunning;
+    // signaled to stop the receive thread
+    int recvThreadWakeFd;
+#endif
+    // received by the receive thread, processed by update
+    RingQueue<ReceivedDatagram> recvHandoff;
     unsigned char sk[crypto_sign_SECRETKEYBYTES];
     unsigned char pk[crypto_sign_PUBLICKEYBYTES];
     std::atomic_bool keysSet;
@@ -277,6 +622,23 @@ public:
     std::mutex setThreadedUpdateMutex;
     std::atomic_uint32_t enableDisableFuncRunningCount;
 
+    // Only non-empty for a sharded context (see UDPC_init_sharded()), which
+    // owns these worker contexts and routes API calls to them.
+    std::vector<Context*> shards;
+    // peer to index into shards, the kernel keeps a peer on the same socket
+    std::unordered_map<UDPC_ConnectionId, unsigned int, ConnectionIdHasher> shardIndexMap;
+    std::shared_mutex shardIndexMapMutex;
+    // shard to start from when polling for received packets or events
+    std::atomic_uint shardPollIndex;
+    // index of this context in its sharded context's shards, set in its
+    // connections' handles
+    unsigned int shardIndex;
+    // the sharded context this is a shard of, nullptr if not a shard
+    Context *shardedContext;
+    // held by shards while publishing the sharded context's peerList, and
+    // while shards is cleared
+    std::mutex peerListMutex;
+
 }; // struct Context
 
 struct PktInfoWrapper {
@@ -288,8 +650,8 @@ struct PktInfoWrapper {
     PktInfoWrapper(const PktInfoWrapper&);
     PktInfoWrapper &operator=(const PktInfoWrapper&);
     // Allow move
-    PktInfoWrapper(PktInfoWrapper&&);
-    PktInfoWrapper &operator=(PktInfoWrapper&&);
+    PktInfoWrapper(PktInfoWrapper&&) noexcept;
+    PktInfoWrapper &operator=(PktInfoWrapper&&) noexcept;
 
     UDPC_PacketInfo pinfo;
 };
@@ -301,6 +663,9 @@ bool isBigEndian();
 void be64(char *integer);
 void be64_copy(char *out, const char *in);
 
+// index of the least significant set bit, bits must not be 0
+unsigned int lowestBit(uint32_t bits);
+
 /*
  * flags:
  *   0x1 - connect
@@ -313,6 +678,12 @@ void preparePacket(char *data, uint32_t protocolID, uint32_t conID,
 
 uint32_t generateConnectionID(Context &ctx);
 
+// the time between sends at sends per second
+std::chrono::steady_clock::duration sendRateToDuration(unsigned int sends);
+// clamps the arguments of UDPC_set_send_rate() to their documented range
+void clampSendRate(
+    unsigned int &goodModeRate, unsigned int &badModeRate, unsigned int &burst);
+
 float durationToFSec(const std::chrono::steady_clock::duration& duration);
 
 uint16_t durationToMS(const std::chrono::steady_clock::duration& duration);
@@ -325,6 +696,12 @@ UDPC_PacketInfo get_empty_pinfo();
 
 void threadedUpdate(Context *ctx);
 
+Context *initContext(
+    UDPC_ConnectionId listenId,
+    int isClient,
+    int isUsingLibsodium,
+    bool isReusePort);
+
 } // namespace UDPC
 
 bool operator ==(const UDPC_ConnectionId& a, const UDPC_ConnectionId& b);
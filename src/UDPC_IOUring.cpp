@@ -0,0 +1,268 @@
+#include "UDPC_IOUring.hpp"
+
+#ifdef UDPC_IO_URING_ENABLED
+
+#include <cerrno>
+#include <cstring>
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+
+int sys_io_uring_setup(unsigned int entries, struct io_uring_params *p) {
+    int ret = syscall(__NR_io_uring_setup, entries, p);
+    return ret < 0 ? -errno : ret;
+}
+
+int sys_io_uring_enter(
+        int fd, unsigned int toSubmit, unsigned int minComplete,
+        unsigned int flags) {
+    int ret = syscall(
+        __NR_io_uring_enter, fd, toSubmit, minComplete, flags, nullptr, 0);
+    return ret < 0 ? -errno : ret;
+}
+
+int sys_io_uring_register(
+        int fd, unsigned int opcode, void *arg, unsigned int nrArgs) {
+    int ret = syscall(__NR_io_uring_register, fd, opcode, arg, nrArgs);
+    return ret < 0 ? -errno : ret;
+}
+
+} // namespace
+
+UDPC::IOUring::IOUring() :
+ringFd(-1),
+entries(0),
+sqRingPtr(MAP_FAILED),
+sqRingSize(0),
+cqRingPtr(MAP_FAILED),
+cqRingSize(0),
+sqes(nullptr),
+sqesSize(0),
+sqHead(nullptr),
+sqTail(nullptr),
+sqMask(nullptr),
+sqArray(nullptr),
+sqLocalTail(0),
+cqHead(nullptr),
+cqTail(nullptr),
+cqMask(nullptr),
+cqes(nullptr),
+bufRing(nullptr),
+bufRingSize(0),
+bufs(),
+bufCount(0),
+bufSize(0),
+bufGroup(0),
+bufTail(0)
+{}
+
+UDPC::IOUring::~IOUring() {
+    cleanup();
+}
+
+int UDPC::IOUring::init(unsigned int entries) {
+    cleanup();
+
+    struct io_uring_params params;
+    std::memset(&params, 0, sizeof(struct io_uring_params));
+    int fd = sys_io_uring_setup(entries, &params);
+    if(fd < 0) {
+        return fd;
+    }
+    ringFd = fd;
+    this->entries = params.sq_entries;
+
+    sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    cqRingSize = params.cq_off.cqes
+        + params.cq_entries * sizeof(struct io_uring_cqe);
+    if(params.features & IORING_FEAT_SINGLE_MMAP) {
+        if(cqRingSize > sqRingSize) {
+            sqRingSize = cqRingSize;
+        }
+        cqRingSize = sqRingSize;
+    }
+
+    sqRingPtr = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+    if(sqRingPtr == MAP_FAILED) {
+        int error = -errno;
+        cleanup();
+        return error;
+    }
+
+    if(params.features & IORING_FEAT_SINGLE_MMAP) {
+        cqRingPtr = sqRingPtr;
+    } else {
+        cqRingPtr = mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+        if(cqRingPtr == MAP_FAILED) {
+            int error = -errno;
+            cleanup();
+            return error;
+        }
+    }
+
+    sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    void *sqesPtr = mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+    if(sqesPtr == MAP_FAILED) {
+        int error = -errno;
+        cleanup();
+        return error;
+    }
+    sqes = (struct io_uring_sqe*)sqesPtr;
+
+    char *sq = (char*)sqRingPtr;
+    sqHead = (unsigned int*)(sq + params.sq_off.head);
+    sqTail = (unsigned int*)(sq + params.sq_off.tail);
+    sqMask = (unsigned int*)(sq + params.sq_off.ring_mask);
+    sqArray = (unsigned int*)(sq + params.sq_off.array);
+    sqLocalTail = *sqTail;
+
+    char *cq = (char*)cqRingPtr;
+    cqHead = (unsigned int*)(cq + params.cq_off.head);
+    cqTail = (unsigned int*)(cq + params.cq_off.tail);
+    cqMask = (unsigned int*)(cq + params.cq_off.ring_mask);
+    cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+
+    return 0;
+}
+
+bool UDPC::IOUring::isValid() const {
+    return ringFd >= 0;
+}
+
+unsigned int UDPC::IOUring::getEntries() const {
+    return entries;
+}
+
+int UDPC::IOUring::getFd() const {
+    return ringFd;
+}
+
+struct io_uring_sqe *UDPC::IOUring::getSQE() {
+    unsigned int head = __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+    if(sqLocalTail - head >= entries) {
+        return nullptr;
+    }
+    unsigned int index = sqLocalTail & *sqMask;
+    sqArray[index] = index;
+    ++sqLocalTail;
+    std::memset(&sqes[index], 0, sizeof(struct io_uring_sqe));
+    return &sqes[index];
+}
+
+int UDPC::IOUring::submit(unsigned int waitNr) {
+    unsigned int toSubmit = sqLocalTail - *sqTail;
+    __atomic_store_n(sqTail, sqLocalTail, __ATOMIC_RELEASE);
+    int ret;
+    do {
+        ret = sys_io_uring_enter(
+            ringFd, toSubmit, waitNr, IORING_ENTER_GETEVENTS);
+    } while(ret == -EINTR);
+    return ret;
+}
+
+struct io_uring_cqe *UDPC::IOUring::peekCQE() {
+    unsigned int head = *cqHead;
+    if(head == __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)) {
+        return nullptr;
+    }
+    return &cqes[head & *cqMask];
+}
+
+void UDPC::IOUring::seenCQE() {
+    __atomic_store_n(cqHead, *cqHead + 1, __ATOMIC_RELEASE);
+}
+
+int UDPC::IOUring::setupBufferRing(
+        unsigned short group, unsigned int count, unsigned int size) {
+    if(count == 0 || (count & (count - 1)) != 0 || count > 32768) {
+        return -EINVAL;
+    }
+
+    // ring must be page aligned
+    bufRingSize = count * sizeof(struct io_uring_buf);
+    void *ringPtr = mmap(nullptr, bufRingSize, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(ringPtr == MAP_FAILED) {
+        bufRingSize = 0;
+        return -errno;
+    }
+    bufRing = (struct io_uring_buf_ring*)ringPtr;
+
+    struct io_uring_buf_reg reg;
+    std::memset(&reg, 0, sizeof(struct io_uring_buf_reg));
+    reg.ring_addr = (unsigned long)bufRing;
+    reg.ring_entries = count;
+    reg.bgid = group;
+    int ret = sys_io_uring_register(
+        ringFd, IORING_REGISTER_PBUF_RING, &reg, 1);
+    if(ret < 0) {
+        munmap(bufRing, bufRingSize);
+        bufRing = nullptr;
+        bufRingSize = 0;
+        return ret;
+    }
+
+    bufs = std::unique_ptr<char[]>(new char[(std::size_t)count * size]);
+    bufCount = count;
+    bufSize = size;
+    bufGroup = group;
+    bufTail = 0;
+    for(unsigned int i = 0; i < count; ++i) {
+        recycleBuffer(i);
+    }
+    return 0;
+}
+
+char *UDPC::IOUring::getBuffer(unsigned short id) {
+    return bufs.get() + (std::size_t)id * bufSize;
+}
+
+unsigned int UDPC::IOUring::getBufferSize() const {
+    return bufSize;
+}
+
+void UDPC::IOUring::recycleBuffer(unsigned short id) {
+    // index the ring directly, __DECLARE_FLEX_ARRAY gives bufs a non-zero
+    // offset when compiled as C++ (tail aliases the first entry's resv field)
+    struct io_uring_buf *buf =
+        (struct io_uring_buf*)bufRing + (bufTail & (bufCount - 1));
+    buf->addr = (unsigned long)getBuffer(id);
+    buf->len = bufSize;
+    buf->bid = id;
+    ++bufTail;
+    __atomic_store_n(&bufRing->tail, bufTail, __ATOMIC_RELEASE);
+}
+
+void UDPC::IOUring::cleanup() {
+    if(sqes) {
+        munmap(sqes, sqesSize);
+        sqes = nullptr;
+    }
+    if(cqRingPtr != MAP_FAILED && cqRingPtr != sqRingPtr) {
+        munmap(cqRingPtr, cqRingSize);
+    }
+    cqRingPtr = MAP_FAILED;
+    if(sqRingPtr != MAP_FAILED) {
+        munmap(sqRingPtr, sqRingSize);
+        sqRingPtr = MAP_FAILED;
+    }
+    if(ringFd >= 0) {
+        // also unregisters the buffer ring
+        close(ringFd);
+        ringFd = -1;
+    }
+    if(bufRing) {
+        munmap(bufRing, bufRingSize);
+        bufRing = nullptr;
+    }
+    bufs.reset();
+    entries = 0;
+}
+
+#endif // UDPC_IO_URING_ENABLED
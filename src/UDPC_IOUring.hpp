@@ -0,0 +1,92 @@
+#ifndef UDPC_IO_URING_HPP_
+#define UDPC_IO_URING_HPP_
+
+#ifdef UDPC_IO_URING_ENABLED
+
+#include <cstddef>
+#include <memory>
+
+#include <linux/io_uring.h>
+
+namespace UDPC {
+
+// Minimal io_uring wrapper using the raw system calls (liburing is not
+// required). Not thread safe, only used by a context's update.
+class IOUring {
+public:
+    IOUring();
+    ~IOUring();
+
+    // Disallow copy, the rings are mapped memory.
+    IOUring(const IOUring&) = delete;
+    IOUring& operator=(const IOUring&) = delete;
+
+    // Returns 0 on success or a negative errno.
+    int init(unsigned int entries);
+    bool isValid() const;
+    unsigned int getEntries() const;
+    // Readable (pollable) while completions are available.
+    int getFd() const;
+
+    // Returns nullptr if the submission queue is full. The returned SQE is
+    // zeroed.
+    struct io_uring_sqe *getSQE();
+    // Submits all SQEs gotten since the last submit, and waits until at least
+    // waitNr completions are available. Also runs pending completion work.
+    // Returns the number of SQEs submitted or a negative errno.
+    int submit(unsigned int waitNr);
+
+    // Returns nullptr if no completion is available.
+    struct io_uring_cqe *peekCQE();
+    // Marks the CQE returned by peekCQE() as consumed.
+    void seenCQE();
+
+    // Registers a ring of count provided buffers (count must be a power of
+    // two) of size bytes each, used by SQEs with IOSQE_BUFFER_SELECT set and
+    // buf_group set to group. Returns 0 on success or a negative errno.
+    int setupBufferRing(
+        unsigned short group, unsigned int count, unsigned int size);
+    char *getBuffer(unsigned short id);
+    unsigned int getBufferSize() const;
+    // Hands a buffer back to the kernel after its CQE was processed.
+    void recycleBuffer(unsigned short id);
+
+private:
+    void cleanup();
+
+    int ringFd;
+    unsigned int entries;
+
+    void *sqRingPtr;
+    std::size_t sqRingSize;
+    void *cqRingPtr;
+    std::size_t cqRingSize;
+    struct io_uring_sqe *sqes;
+    std::size_t sqesSize;
+
+    unsigned int *sqHead;
+    unsigned int *sqTail;
+    unsigned int *sqMask;
+    unsigned int *sqArray;
+    // tail of SQEs gotten but not yet submitted
+    unsigned int sqLocalTail;
+
+    unsigned int *cqHead;
+    unsigned int *cqTail;
+    unsigned int *cqMask;
+    struct io_uring_cqe *cqes;
+
+    struct io_uring_buf_ring *bufRing;
+    std::size_t bufRingSize;
+    std::unique_ptr<char[]> bufs;
+    unsigned int bufCount;
+    unsigned int bufSize;
+    unsigned short bufGroup;
+    unsigned short bufTail;
+};
+
+} // namespace UDPC
+
+#endif // UDPC_IO_URING_ENABLED
+
+#endif
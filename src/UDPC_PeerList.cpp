@@ -0,0 +1,90 @@
+#include "UDPC_PeerList.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <type_traits>
+
+UDPC::PeerListPublisher::Published::Published(
+        std::uint64_t version,
+        const std::vector<UDPC_PeerInfo> &peers) :
+list(),
+refs(0)
+{
+    list.version = version;
+    list.size = peers.size();
+    if(!peers.empty()) {
+        UDPC_PeerInfo *copy = new UDPC_PeerInfo[peers.size()];
+        std::copy(peers.begin(), peers.end(), copy);
+        list.peers = copy;
+    } else {
+        list.peers = nullptr;
+    }
+}
+
+UDPC::PeerListPublisher::Published::~Published() {
+    delete[] list.peers;
+}
+
+UDPC::PeerListPublisher::PeerListPublisher() :
+current(new Published(0, std::vector<UDPC_PeerInfo>())),
+acquiring(0),
+retired()
+{}
+
+UDPC::PeerListPublisher::~PeerListPublisher() {
+    delete current.load();
+    for(const Retired &entry : retired) {
+        delete entry.published;
+    }
+}
+
+void UDPC::PeerListPublisher::publish(const std::vector<UDPC_PeerInfo> &peers) {
+    Published *published = new Published(version() + 1, peers);
+    retired.push_back(Retired{current.exchange(published), false});
+    reclaim();
+}
+
+void UDPC::PeerListPublisher::reclaim() {
+    if(retired.empty()) {
+        return;
+    }
+    // readers that loaded a retired list have taken their reference to it
+    // once acquiring is 0, readers after that load a newer list
+    const bool isQuiescent = acquiring.load() == 0;
+    std::size_t kept = 0;
+    for(std::size_t i = 0; i < retired.size(); ++i) {
+        Retired entry = retired[i];
+        entry.isUnreachable = entry.isUnreachable || isQuiescent;
+        if(entry.isUnreachable && entry.published->refs.load() == 0) {
+            delete entry.published;
+        } else {
+            retired[kept++] = entry;
+        }
+    }
+    retired.resize(kept);
+}
+
+const UDPC_PeerList *UDPC::PeerListPublisher::acquire() {
+    acquiring.fetch_add(1);
+    Published *published = current.load();
+    published->refs.fetch_add(1);
+    acquiring.fetch_sub(1);
+    return &published->list;
+}
+
+void UDPC::PeerListPublisher::release(const UDPC_PeerList *list) {
+    static_assert(std::is_standard_layout<Published>::value,
+        "list must be at the start of Published");
+    Published *published =
+        reinterpret_cast<Published*>(const_cast<UDPC_PeerList*>(list));
+    assert(published->refs.load() > 0 && "list must be acquired");
+    published->refs.fetch_sub(1);
+}
+
+std::uint64_t UDPC::PeerListPublisher::version() const {
+    return current.load()->list.version;
+}
+
+std::size_t UDPC::PeerListPublisher::retiredSize() const {
+    return retired.size();
+}
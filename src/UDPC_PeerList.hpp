@@ -0,0 +1,66 @@
+#ifndef UDPC_PEER_LIST_HPP_
+#define UDPC_PEER_LIST_HPP_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "UDPC.h"
+
+namespace UDPC {
+
+// Immutable lists of peers (see UDPC_acquire_peer_list()), published by one
+// thread at a time and read by any thread without locking or copying.
+//
+// A reader counts itself in acquiring while it loads the current list and
+// takes a reference to it, so acquire() and release() are a few atomic
+// operations each and never wait. A list replaced by publish() is retired,
+// and freed by reclaim() once acquiring was seen to be 0 after it was
+// replaced (no reader can still reach it) and its references are released.
+class PeerListPublisher {
+public:
+    PeerListPublisher();
+    ~PeerListPublisher();
+
+    // non-copyable and non-movable
+    PeerListPublisher(const PeerListPublisher&) = delete;
+    PeerListPublisher& operator=(const PeerListPublisher&) = delete;
+
+    // Publishes peers as the next version and reclaims retired lists. Must
+    // not be called by several threads at the same time.
+    void publish(const std::vector<UDPC_PeerInfo> &peers);
+    // Frees the retired lists that are no longer used. Must not be called at
+    // the same time as publish().
+    void reclaim();
+
+    const UDPC_PeerList *acquire();
+    void release(const UDPC_PeerList *list);
+
+    std::uint64_t version() const;
+    // the number of lists replaced but not freed yet
+    std::size_t retiredSize() const;
+
+private:
+    struct Published {
+        Published(std::uint64_t version, const std::vector<UDPC_PeerInfo> &peers);
+        ~Published();
+
+        // first, release() gets the Published from it, owns list.peers
+        UDPC_PeerList list;
+        std::atomic_uint32_t refs;
+    };
+    struct Retired {
+        Published *published;
+        // acquiring was 0 after it was replaced
+        bool isUnreachable;
+    };
+
+    std::atomic<Published*> current;
+    std::atomic_uint32_t acquiring;
+    std::vector<Retired> retired;
+};
+
+} // namespace UDPC
+
+#endif
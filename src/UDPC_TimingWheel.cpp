@@ -0,0 +1,168 @@
+#include "UDPC_TimingWheel.hpp"
+
+#include "UDPC_Defines.hpp"
+
+#include <cassert>
+
+namespace {
+
+// Returns the index of the first set bit of bits at or after from, wrapping
+// around to bit 0. bits must not be 0.
+unsigned int nextBit(std::uint64_t bits, unsigned int from) {
+    const std::uint64_t after = bits & (~(std::uint64_t)0 << from);
+    const std::uint64_t search = after != 0 ? after : bits;
+    const uint32_t low = (uint32_t)search;
+    return low != 0 ? UDPC::lowestBit(low)
+        : 32 + UDPC::lowestBit((uint32_t)(search >> 32));
+}
+
+} // namespace
+
+UDPC::TimingWheel::TimingWheel(
+        const std::chrono::steady_clock::time_point &start) :
+start(start),
+current(0),
+buckets(),
+occupied(),
+expired(),
+count(0)
+{}
+
+std::uint64_t UDPC::TimingWheel::tickOf(
+        const std::chrono::steady_clock::time_point &time) const {
+    std::uint64_t tick = 0;
+    if(time > start) {
+        tick = std::chrono::ceil<std::chrono::milliseconds>(time - start)
+            / TICK;
+    }
+    if(tick <= current) {
+        return current;
+    } else if(tick - current >= RANGE) {
+        // checked again by the owner once due
+        return current + RANGE - 1;
+    }
+    return tick;
+}
+
+std::uint64_t UDPC::TimingWheel::schedule(
+        std::uint64_t handle,
+        const std::chrono::steady_clock::time_point &time) {
+    const std::uint64_t tick = tickOf(time);
+    ++count;
+    if(tick == current) {
+        expired.push_back(Entry{handle, tick});
+    } else {
+        place(Entry{handle, tick});
+    }
+    return tick;
+}
+
+void UDPC::TimingWheel::advance(
+        const std::chrono::steady_clock::time_point &now,
+        std::vector<Entry> &due) {
+    due.insert(due.end(), expired.begin(), expired.end());
+    count -= expired.size();
+    expired.clear();
+    if(now <= start) {
+        return;
+    }
+
+    const std::uint64_t target = (now - start) / TICK;
+    while(count > 0) {
+        const std::uint64_t tick = nextTick();
+        assert(tick > current && "entries must be after the current tick");
+        if(tick > target) {
+            break;
+        }
+        current = tick;
+
+        // cascade the levels that start a bucket at tick, higher levels first
+        // so that their entries are cascaded further if needed
+        for(unsigned int level = LEVELS - 1; level > 0; --level) {
+            const unsigned int shift = level * LEVEL_BITS;
+            if((tick & (((std::uint64_t)1 << shift) - 1)) != 0) {
+                continue;
+            }
+            const unsigned int index = (tick >> shift) & (BUCKETS - 1);
+            if((occupied[level] & ((std::uint64_t)1 << index)) == 0) {
+                continue;
+            }
+            // entries are placed on lower levels only, not in this bucket
+            std::vector<Entry> &bucket = buckets[level][index];
+            for(const Entry &entry : bucket) {
+                if(entry.tick <= current) {
+                    due.push_back(entry);
+                    --count;
+                } else {
+                    place(entry);
+                }
+            }
+            bucket.clear();
+            occupied[level] &= ~((std::uint64_t)1 << index);
+        }
+
+        const unsigned int index = tick & (BUCKETS - 1);
+        if((occupied[0] & ((std::uint64_t)1 << index)) != 0) {
+            std::vector<Entry> &bucket = buckets[0][index];
+            due.insert(due.end(), bucket.begin(), bucket.end());
+            count -= bucket.size();
+            bucket.clear();
+            occupied[0] &= ~((std::uint64_t)1 << index);
+        }
+    }
+    if(target > current) {
+        current = target;
+    }
+}
+
+std::chrono::steady_clock::time_point UDPC::TimingWheel::nextDeadline() const {
+    if(!expired.empty()) {
+        return start + TICK * current;
+    } else if(count == 0) {
+        return std::chrono::steady_clock::time_point::max();
+    }
+    return start + TICK * nextTick();
+}
+
+std::size_t UDPC::TimingWheel::size() const {
+    return count;
+}
+
+std::uint64_t UDPC::TimingWheel::nextTickOf(unsigned int level) const {
+    const unsigned int shift = level * LEVEL_BITS;
+    const unsigned int digit = (current >> shift) & (BUCKETS - 1);
+    const unsigned int from = (digit + 1) & (BUCKETS - 1);
+    // buckets after the current one, wrapping around into the next bucket of
+    // the level above
+    const unsigned int index = nextBit(occupied[level], from);
+    const std::uint64_t ahead = (index - from) & (BUCKETS - 1);
+    return ((current >> shift) + 1 + ahead) << shift;
+}
+
+std::uint64_t UDPC::TimingWheel::nextTick() const {
+    std::uint64_t tick = 0;
+    for(unsigned int level = 0; level < LEVELS; ++level) {
+        if(occupied[level] != 0) {
+            const std::uint64_t levelTick = nextTickOf(level);
+            if(tick == 0 || levelTick < tick) {
+                tick = levelTick;
+            }
+        }
+    }
+    return tick == 0 ? current : tick;
+}
+
+void UDPC::TimingWheel::place(const Entry &entry) {
+    // the level is chosen by how far ahead the entry is, so each bucket is
+    // reached (and cascaded) once before its entries are due
+    const std::uint64_t ahead = entry.tick - current;
+    unsigned int level = 0;
+    while(level + 1 < LEVELS
+            && ahead >= ((std::uint64_t)1 << ((level + 1) * LEVEL_BITS))) {
+        ++level;
+    }
+    const unsigned int index =
+        (entry.tick >> (level * LEVEL_BITS)) & (BUCKETS - 1);
+    buckets[level][index].push_back(entry);
+    occupied[level] |= (std::uint64_t)1 << index;
+}
@@ -0,0 +1,84 @@
+#ifndef UDPC_TIMING_WHEEL_HPP_
+#define UDPC_TIMING_WHEEL_HPP_
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace UDPC {
+
+// Hierarchical timing wheel of connection handles (see ConnectionTable).
+//
+// Time is counted in ticks of TICK since the wheel was created. Level 0 has a
+// bucket per tick for the next 64 ticks, each higher level has buckets 64
+// times as wide, and the entries of a higher level bucket are moved to lower
+// levels ("cascaded") once the current tick reaches its start. A bitmap of
+// non-empty buckets per level lets advance() skip to the next tick with
+// anything to do, so it costs the same after an idle second as after a busy
+// millisecond.
+//
+// Entries are not removed, a handle is scheduled again to be due earlier and
+// its owner ignores the entries that no longer match (see Entry::tick).
+// Times later than the wheel's range are due at the end of its range.
+//
+// Not thread safe.
+class TimingWheel {
+public:
+    static constexpr std::chrono::milliseconds TICK{1};
+
+    struct Entry {
+        std::uint64_t handle;
+        // the tick it was scheduled at, returned by schedule()
+        std::uint64_t tick;
+    };
+
+    explicit TimingWheel(const std::chrono::steady_clock::time_point &start);
+
+    // Returns the tick schedule() schedules time at: time rounded up to a
+    // tick, but not before the current tick nor after the wheel's range.
+    std::uint64_t tickOf(const std::chrono::steady_clock::time_point &time) const;
+    // Schedules handle to be due at tickOf(time), and returns that tick. A
+    // time at or before the last advance() is due on the next advance().
+    std::uint64_t schedule(
+        std::uint64_t handle, const std::chrono::steady_clock::time_point &time);
+    // Appends the entries due at or before now to due.
+    void advance(
+        const std::chrono::steady_clock::time_point &now,
+        std::vector<Entry> &due);
+    // Returns the time of the next tick with due entries, or
+    // time_point::max() if there are none. Can be before that tick if the
+    // entries first need to be cascaded, but never after.
+    std::chrono::steady_clock::time_point nextDeadline() const;
+
+    std::size_t size() const;
+
+private:
+    static constexpr unsigned int LEVELS = 4;
+    static constexpr unsigned int LEVEL_BITS = 6;
+    static constexpr unsigned int BUCKETS = 1 << LEVEL_BITS;
+    static constexpr std::uint64_t RANGE =
+        (std::uint64_t)1 << (LEVELS * LEVEL_BITS);
+
+    // tick at which the next non-empty bucket of level is cascaded or due,
+    // the level must not be empty
+    std::uint64_t nextTickOf(unsigned int level) const;
+    // tick at which the next non-empty bucket of any level is cascaded or
+    // due, or current if all are empty
+    std::uint64_t nextTick() const;
+    void place(const Entry &entry);
+
+    std::chrono::steady_clock::time_point start;
+    // all entries due at or before current were returned by advance()
+    std::uint64_t current;
+    std::array<std::array<std::vector<Entry>, BUCKETS>, LEVELS> buckets;
+    std::array<std::uint64_t, LEVELS> occupied;
+    // scheduled at or before current, returned by the next advance()
+    std::vector<Entry> expired;
+    std::size_t count;
+};
+
+} // namespace UDPC
+
+#endif
@@ -5,6 +5,7 @@
 #include <chrono>
 #include <cstring>
 #include <vector>
+#include <array>
 #include <functional>
 #include <string>
 #include <sstream>
@@ -14,10 +15,10 @@
 #include <cstdlib>
 #include <ctime>
 #include <iomanip>
-#include <list>
 
 #if UDPC_PLATFORM == UDPC_PLATFORM_WINDOWS
 #include <netioapi.h>
+#include <intrin.h>
 typedef int socklen_t;
 
 #elif UDPC_PLATFORM == UDPC_PLATFORM_MAC || UDPC_PLATFORM == UDPC_PLATFORM_LINUX
@@ -25,30 +26,79 @@ typedef int socklen_t;
 #include <net/if.h>
 #endif
 
+#if UDPC_PLATFORM == UDPC_PLATFORM_LINUX
+#include <netinet/udp.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+# ifndef UDP_SEGMENT
+#  define UDP_SEGMENT 103
+# endif
+# ifndef UDP_GRO
+#  define UDP_GRO 104
+# endif
+#endif
+
 //static const std::regex ipv6_regex = std::regex(R"d((([0-9a-fA-F]{1,4}:){7,7}[0-9a-fA-F]{1,4}|([0-9a-fA-F]{1,4}:){1,7}:|([0-9a-fA-F]{1,4}:){1,6}:[0-9a-fA-F]{1,4}|([0-9a-fA-F]{1,4}:){1,5}(:[0-9a-fA-F]{1,4}){1,2}|([0-9a-fA-F]{1,4}:){1,4}(:[0-9a-fA-F]{1,4}){1,3}|([0-9a-fA-F]{1,4}:){1,3}(:[0-9a-fA-F]{1,4}){1,4}|([0-9a-fA-F]{1,4}:){1,2}(:[0-9a-fA-F]{1,4}){1,5}|[0-9a-fA-F]{1,4}:((:[0-9a-fA-F]{1,4}){1,6})|:((:[0-9a-fA-F]{1,4}){1,7}|:)|fe80:(:[0-9a-fA-F]{0,4}){0,4}%[0-9a-zA-Z]{1,}|::(ffff(:0{1,4}){0,1}:){0,1}((25[0-5]|(2[0-4]|1{0,1}[0-9]){0,1}[0-9])\.){3,3}(25[0-5]|(2[0-4]|1{0,1}[0-9]){0,1}[0-9])|([0-9a-fA-F]{1,4}:){1,4}:((25[0-5]|(2[0-4]|1{0,1}[0-9]){0,1}[0-9])\.){3,3}(25[0-5]|(2[0-4]|1{0,1}[0-9]){0,1}[0-9])))d");
 static const std::regex ipv6_regex_nolink = std::regex(R"d((([0-9a-fA-F]{1,4}:){7,7}[0-9a-fA-F]{1,4}|([0-9a-fA-F]{1,4}:){1,7}:|([0-9a-fA-F]{1,4}:){1,6}:[0-9a-fA-F]{1,4}|([0-9a-fA-F]{1,4}:){1,5}(:[0-9a-fA-F]{1,4}){1,2}|([0-9a-fA-F]{1,4}:){1,4}(:[0-9a-fA-F]{1,4}){1,3}|([0-9a-fA-F]{1,4}:){1,3}(:[0-9a-fA-F]{1,4}){1,4}|([0-9a-fA-F]{1,4}:){1,2}(:[0-9a-fA-F]{1,4}){1,5}|[0-9a-fA-F]{1,4}:((:[0-9a-fA-F]{1,4}){1,6})|:((:[0-9a-fA-F]{1,4}){1,7}|:)|::(ffff(:0{1,4}){0,1}:){0,1}((25[0-5]|(2[0-4]|1{0,1}[0-9]){0,1}[0-9])\.){3,3}(25[0-5]|(2[0-4]|1{0,1}[0-9]){0,1}[0-9])|([0-9a-fA-F]{1,4}:){1,4}:((25[0-5]|(2[0-4]|1{0,1}[0-9]){0,1}[0-9])\.){3,3}(25[0-5]|(2[0-4]|1{0,1}[0-9]){0,1}[0-9])))d");
 static const std::regex ipv6_regex_linkonly = std::regex(R"d(fe80:(:[0-9a-fA-F]{0,4}){0,4}%([0-9a-zA-Z]+))d");
 static const std::regex ipv4_regex = std::regex(R"d((1[0-9][0-9]|2[0-4][0-9]|25[0-5]|[1-9][0-9]|[0-9])\.(1[0-9][0-9]|2[0-4][0-9]|25[0-5]|[1-9][0-9]|[0-9])\.(1[0-9][0-9]|2[0-4][0-9]|25[0-5]|[1-9][0-9]|[0-9])\.(1[0-9][0-9]|2[0-4][0-9]|25[0-5]|[1-9][0-9]|[0-9]))d");
 static const std::regex regex_numeric = std::regex("[0-9]+");
 
-UDPC::SentPktInfo::SentPktInfo() :
+UDPC::SentPkt::SentPkt() :
+data(nullptr),
+dataSize(0),
 id(0),
-sentTime(std::chrono::steady_clock::now())
+flags(0),
+sentTime()
 {}
 
-std::size_t UDPC::ConnectionIdHasher::operator()(const UDPC_ConnectionId& key) const {
-    std::string value((const char*)UDPC_IPV6_ADDR_SUB(key.addr), 16);
-    value.push_back((char)((key.scope_id >> 24) & 0xFF));
-    value.push_back((char)((key.scope_id >> 16) & 0xFF));
-    value.push_back((char)((key.scope_id >> 8) & 0xFF));
-    value.push_back((char)(key.scope_id & 0xFF));
-    value.push_back((char)((key.port >> 8) & 0xFF));
-    value.push_back((char)(key.port & 0xFF));
-    return std::hash<std::string>()(value);
+UDPC::SentPkt::~SentPkt() {
+    reset();
+}
+
+UDPC::SentPkt::SentPkt(SentPkt&& other) :
+data(other.data),
+dataSize(other.dataSize),
+id(other.id),
+flags(other.flags),
+sentTime(other.sentTime)
+{
+    other.data = nullptr;
+    other.flags = 0;
 }
 
-std::size_t UDPC::IPV6_Hasher::operator()(const UDPC_IPV6_ADDR_TYPE& addr) const {
-    return std::hash<std::string>()(std::string((const char*)UDPC_IPV6_ADDR_SUB(addr), 16));
+UDPC::SentPkt& UDPC::SentPkt::operator=(SentPkt&& other) {
+    if(this != &other) {
+        reset();
+        data = other.data;
+        dataSize = other.dataSize;
+        id = other.id;
+        flags = other.flags;
+        sentTime = other.sentTime;
+        other.data = nullptr;
+        other.flags = 0;
+    }
+    return *this;
+}
+
+void UDPC::SentPkt::reset() {
+    if(data && (flags & 0x20) != 0) {
+        // drop the reference to the shared payload after the header
+        const char *payload;
+        std::memcpy(&payload,
+            data + UDPC_NSFULL_HEADER_SIZE, sizeof(const char*));
+        BufferPool::deallocate(const_cast<char*>(payload));
+    }
+    BufferPool::deallocate(data);
+    data = nullptr;
+    dataSize = 0;
+    flags = 0;
+}
+
+std::size_t UDPC::ConnectionIdHasher::operator()(const UDPC_ConnectionId& key) const {
+    return (std::size_t)hashConnectionId(key);
 }
 
 UDPC::PKContainer::PKContainer() {
@@ -70,16 +120,11 @@ bool UDPC::PKContainer::operator==(const PKContainer& other) const {
 }
 
 bool operator ==(const UDPC_ConnectionId& a, const UDPC_ConnectionId& b) {
-    return a.addr == b.addr && a.scope_id == b.scope_id && a.port == b.port;
+    return UDPC::isSameConnectionId(a, b);
 }
 
 bool operator ==(const UDPC_IPV6_ADDR_TYPE& a, const UDPC_IPV6_ADDR_TYPE& b) {
-    for(unsigned int i = 0; i < 16; ++i) {
-        if(UDPC_IPV6_ADDR_SUB(a)[i] != UDPC_IPV6_ADDR_SUB(b)[i]) {
-            return false;
-        }
-    }
-    return true;
+    return UDPC::isSameAddr(a, b);
 }
 
 UDPC::ConnectionData::ConnectionData(bool isUsingLibsodium) :
@@ -88,17 +133,25 @@ id(0),
 lseq(0),
 rseq(0),
 ack(0xFFFFFFFF),
+peerRseq(0),
+peerAck(0xFFFFFFFF),
+sentRseq(0),
+sendWindowStart(0),
 timer(std::chrono::steady_clock::duration::zero()),
 toggleT(UDPC::THIRTY_SECONDS),
 toggleTimer(std::chrono::steady_clock::duration::zero()),
 toggledTimer(std::chrono::steady_clock::duration::zero()),
+goodModeSendRate(UDPC::GOOD_MODE_SEND_RATE),
+badModeSendRate(UDPC::BAD_MODE_SEND_RATE),
+sendBurst(1),
+timersUpdated(std::chrono::steady_clock::now()),
+timerTick(UDPC::NO_TICK),
 addr({0}),
 scope_id(0),
 port(0),
 sentPkts(),
 sendPkts(),
 priorityPkts(),
-sentInfoMap(),
 received(std::chrono::steady_clock::now()),
 sent(std::chrono::steady_clock::now()),
 rtt(std::chrono::steady_clock::duration::zero()),
@@ -141,17 +194,25 @@ id(0),
 lseq(0),
 rseq(0),
 ack(0xFFFFFFFF),
+peerRseq(0),
+peerAck(0xFFFFFFFF),
+sentRseq(0),
+sendWindowStart(0),
 timer(std::chrono::steady_clock::duration::zero()),
 toggleT(UDPC::THIRTY_SECONDS),
 toggleTimer(std::chrono::steady_clock::duration::zero()),
 toggledTimer(std::chrono::steady_clock::duration::zero()),
+goodModeSendRate(UDPC::sendRateToDuration(ctx->goodModeSends.load())),
+badModeSendRate(UDPC::sendRateToDuration(ctx->badModeSends.load())),
+sendBurst(ctx->sendBurst.load()),
+timersUpdated(std::chrono::steady_clock::now()),
+timerTick(UDPC::NO_TICK),
 addr(addr),
 scope_id(scope_id),
 port(port),
 sentPkts(),
 sendPkts(),
 priorityPkts(),
-sentInfoMap(),
 received(std::chrono::steady_clock::now()),
 sent(std::chrono::steady_clock::now()),
 rtt(std::chrono::steady_clock::duration::zero()),
@@ -191,37 +252,74 @@ verifyMessage()
 }
 
 UDPC::ConnectionData::~ConnectionData() {
-    for(auto iter = sentPkts.begin(); iter != sentPkts.end(); ++iter) {
-        std::free(iter->data);
-    }
     for(auto iter = sendPkts.begin(); iter != sendPkts.end(); ++iter) {
-        std::free(iter->data);
+        BufferPool::deallocate(iter->data);
     }
     for(auto iter = priorityPkts.begin(); iter != priorityPkts.end(); ++iter) {
-        std::free(iter->data);
+        BufferPool::deallocate(iter->data);
     }
 }
 
-void UDPC::ConnectionData::cleanupSentPkts() {
-    uint32_t id;
-    while(sentPkts.size() > UDPC_SENT_PKTS_MAX_SIZE) {
-        std::memcpy(&id, sentPkts.front().data + 8, 4);
-        id = ntohl(id);
-        auto iter = sentInfoMap.find(id);
-        assert(iter != sentInfoMap.end()
-                && "Sent packet must have correspoding entry in sentInfoMap");
-        sentInfoMap.erase(iter);
-        std::free(sentPkts.front().data);
-        sentPkts.pop_front();
+UDPC::SentPkt &UDPC::ConnectionData::addSentPkt(
+        uint32_t id, const std::chrono::steady_clock::time_point &sentTime) {
+    SentPkt &sent = sentPkts[id % UDPC_SENT_PKTS_MAX_SIZE];
+    sent.reset();
+    sent.id = id;
+    sent.flags = 0x1;
+    sent.sentTime = sentTime;
+    return sent;
+}
+
+UDPC::SentPkt *UDPC::ConnectionData::findSentPkt(uint32_t id) {
+    SentPkt &sent = sentPkts[id % UDPC_SENT_PKTS_MAX_SIZE];
+    if((sent.flags & 0x1) == 0 || sent.id != id) {
+        return nullptr;
     }
+    return &sent;
 }
 
 UDPC::Context::Context(bool isThreaded) :
 _contextIdentifier(UDPC_CONTEXT_IDENTIFIER),
+recvBufs(),
+recvTails(),
+recvBufsDepth(0),
+recvBufsSlotSize(0),
+#if UDPC_PLATFORM == UDPC_PLATFORM_LINUX
+recvMsgs(),
+recvIovs(),
+recvAddrs(),
+recvCtrl(),
+#endif
+sendStage(),
+stagedSends(),
+sendStageOwned(),
+#if UDPC_PLATFORM == UDPC_PLATFORM_LINUX
+sendMsgs(),
+sendIovs(),
+sendCtrl(),
+#endif
+#ifdef UDPC_IO_URING_ENABLED
+recvRing(),
+sendRing(),
+recvMsgTemplate(),
+isRecvArmed(false),
+#endif
 flags(),
 isAcceptNewConnections(true),
 isReceivingEvents(false),
 isAutoUpdating(false),
+recvBatchDepth(UDPC_RECV_BATCH_DEFAULT),
+ioEngine(UDPC_IO_ENGINE_SOCKET),
+isGSOEnabled(false),
+isGROEnabled(false),
+goodModeSends(UDPC::GOOD_MODE_SENDS),
+badModeSends(UDPC::BAD_MODE_SENDS),
+sendBurst(1),
+recvStatCalls(0),
+recvStatDatagrams(0),
+recvStatCoalesced(0),
+recvStatMaxPerCall(0),
+recvStatHandoffDropped(0),
 protocolID(UDPC_DEFAULT_PROTOCOL_ID),
 #ifndef NDEBUG
 loggingType(UDPC_DEBUG),
@@ -237,28 +335,60 @@ socketHandle(0),
 socketInfo(),
 lastUpdated(),
 conMap(),
-addrConMap(),
-idMap(),
+timers(std::chrono::steady_clock::now()),
+peerList(),
+isPeerListChanged(false),
 deletionMap(),
 peerPKWhitelist(),
-receivedPkts(),
-cSendPkts(),
-internalEvents(),
-externalEvents(),
+bufferPool(BufferPool::newInstance()),
+receivedPkts(UDPC_RECEIVED_QUEUE_CAPACITY),
+cSendPkts(UDPC_SEND_QUEUE_CAPACITY),
+cSendRequeue(),
+cSendRequeueNext(),
+cSendQueuedSize(0),
+internalEvents(UDPC_EVENT_QUEUE_CAPACITY),
+externalEvents(UDPC_EVENT_QUEUE_CAPACITY),
 rng_engine(),
 thread(),
 threadRunning(),
 conMapMutex(),
+timersMutex(),
 peerPKWhitelistMutex(),
 threadedSleepTime(std::chrono::milliseconds(UDPC_UPDATE_MS_DEFAULT)),
+#if UDPC_PLATFORM == UDPC_PLATFORM_LINUX
+epollFd(-1),
+wakeFd(-1),
+timerFd(-1),
+isPollFdUsed(false),
+#endif
+recvMutex(),
+#if UDPC_PLATFORM == UDPC_PLATFORM_LINUX
+recvThread(),
+isRecvThreadRunning(false),
+recvThreadWakeFd(-1),
+#endif
+recvHandoff(UDPC_RECV_HANDOFF_CAPACITY),
 keysSet(),
 atostrBufIndexMutex(),
 atostrBufIndex(0),
 setThreadedUpdateMutex(),
-enableDisableFuncRunningCount(0)
+enableDisableFuncRunningCount(0),
+shards(),
+shardIndexMap(),
+shardIndexMapMutex(),
+shardPollIndex(0),
+shardIndex(0),
+shardedContext(nullptr),
+peerListMutex()
 {
     std::memset(atostrBuf, 0, UDPC_ATOSTR_SIZE);
 
+#if UDPC_PLATFORM == UDPC_PLATFORM_LINUX
+    setupRecvBufs(recvBatchDepth.load(), BufferPool::RECEIVE_SIZE);
+#else
+    setupRecvBufs(1, UDPC_PACKET_MAX_SIZE);
+#endif
+
     if(isThreaded) {
         isAutoUpdating.store(true);
     } else {
@@ -275,10 +405,36 @@ enableDisableFuncRunningCount(0)
 
 UDPC::Context::~Context() {
     // cleanup packets
-    while (!receivedPkts.empty()) {
-        auto pinfo_ptr = receivedPkts.top_and_pop();
-        std::free(pinfo_ptr->data);
+    UDPC_PacketInfo pinfo;
+    while (receivedPkts.pop_front(pinfo)) {
+        BufferPool::deallocate(pinfo.data);
+    }
+
+#if UDPC_PLATFORM == UDPC_PLATFORM_LINUX
+    stopReceiveThread();
+#endif
+    ReceivedDatagram datagram{};
+    while(recvHandoff.pop_front(datagram)) {
+        BufferPool::deallocate(datagram.data);
+    }
+
+#if UDPC_PLATFORM == UDPC_PLATFORM_LINUX
+    if(epollFd >= 0) {
+        close(epollFd);
+    }
+    if(wakeFd >= 0) {
+        close(wakeFd);
+    }
+    if(timerFd >= 0) {
+        close(timerFd);
     }
+#endif
+
+    freeRecvBufs();
+
+    // packets still held by members are freed after this, which keeps the
+    // pool alive until then
+    bufferPool->release();
 }
 
 bool UDPC::Context::willLog(UDPC_LoggingType type) {
@@ -311,18 +467,28 @@ bool UDPC::Context::willLog(UDPC_LoggingType type) {
 }
 
 void UDPC::Context::update_impl() {
+#if UDPC_PLATFORM == UDPC_PLATFORM_LINUX
+    if(wakeFd >= 0) {
+        // clear wakeups, everything queued before this point is handled below
+        eventfd_t value;
+        eventfd_read(wakeFd, &value);
+        uint64_t expirations;
+        if(read(timerFd, &expirations, sizeof(uint64_t)) < 0) {
+            // timer had not expired
+        }
+    }
+#endif
     const auto now = std::chrono::steady_clock::now();
-    std::chrono::steady_clock::duration dt = now - lastUpdated;
-    std::chrono::steady_clock::duration temp_dt_fs;
     lastUpdated = now;
 
     // handle internalEvents
     {
-        bool isEmpty = false;
-        while(!isEmpty) {
-            auto next_event = internalEvents.top_and_pop_and_empty(&isEmpty);
-            if (next_event) {
-                const UDPC_Event &event = *next_event;
+        // only what was queued so far, so other threads queueing cannot keep
+        // update here
+        unsigned long count = internalEvents.size();
+        UDPC_Event event{UDPC_ET_NONE, UDPC_create_id_anyaddr(0), 0, 0};
+        while(count-- > 0) {
+            if (internalEvents.pop_front(event)) {
                 switch(event.type) {
                 case UDPC_ET_REQUEST_CONNECT:
                 {
@@ -364,21 +530,17 @@ void UDPC::Context::update_impl() {
                     newCon.sent = std::chrono::steady_clock::now() - UDPC::INIT_PKT_INTERVAL_DT;
 
 
-                    std::lock_guard<std::mutex> conMapLock(conMapMutex);
-                    if(conMap.find(event.conId) == conMap.end()) {
-                        conMap.insert(std::make_pair(
-                            event.conId,
-                            std::move(newCon)));
-                        auto addrConIter = addrConMap.find(event.conId.addr);
-                        if(addrConIter == addrConMap.end()) {
-                            auto insertResult = addrConMap.insert(std::make_pair(
-                                event.conId.addr,
-                                std::unordered_set<UDPC_ConnectionId, UDPC::ConnectionIdHasher>{}));
-                            assert(insertResult.second &&
-                                "new connection insert into addrConMap must not fail");
-                            addrConIter = insertResult.first;
+                    auto iter = conMap.end();
+                    {
+                        std::lock_guard<std::mutex> conMapLock(conMapMutex);
+                        if(conMap.find(event.conId) == conMap.end()) {
+                            iter = conMap.insert(
+                                event.conId, std::move(newCon)).first;
                         }
-                        addrConIter->second.insert(event.conId);
+                    }
+                    if(iter != conMap.end()) {
+                        scheduleConnection(iter, nextDue(iter->second));
+                        isPeerListChanged = true;
                         UDPC_CHECK_LOG(this,
                             UDPC_LoggingType::UDPC_INFO,
                             "Client initiating connection to ",
@@ -398,19 +560,12 @@ void UDPC::Context::update_impl() {
                     break;
                 case UDPC_ET_REQUEST_DISCONNECT:
                 {
-                    std::lock_guard<std::mutex> conMapLock(conMapMutex);
                     if(event.v.dropAllWithAddr != 0) {
                         // drop all connections with same address
-                        auto addrConIter = addrConMap.find(event.conId.addr);
-                        if(addrConIter != addrConMap.end()) {
-                            for(auto identIter = addrConIter->second.begin();
-                                    identIter != addrConIter->second.end();
-                                    ++identIter) {
-                                assert(conMap.find(*identIter) != conMap.end()
-                                    && "conMap must have connection listed in "
-                                    "addrConMap");
-                                deletionMap.insert(*identIter);
-                            }
+                        for(auto addrIter = conMap.findAddr(event.conId.addr);
+                                addrIter != conMap.end();
+                                addrIter = conMap.nextWithAddr(addrIter)) {
+                            deletionMap.insert(addrIter->first);
                         }
                     } else {
                         // drop only specific connection with addr and port
@@ -421,6 +576,19 @@ void UDPC::Context::update_impl() {
                     }
                 }
                     break;
+                case UDPC_ET_REQUEST_SEND_RATE:
+                {
+                    auto iter = conMap.find(event.conId);
+                    if(iter != conMap.end()) {
+                        iter->second.goodModeSendRate = UDPC::sendRateToDuration(
+                            event.v.sendRate.goodMode);
+                        iter->second.badModeSendRate = UDPC::sendRateToDuration(
+                            event.v.sendRate.badMode);
+                        iter->second.sendBurst = event.v.sendRate.burst;
+                        scheduleConnection(iter, nextDue(iter->second));
+                    }
+                }
+                    break;
                 default:
                     assert(!"internalEvents got invalid type");
                     break;
@@ -429,13 +597,127 @@ void UDPC::Context::update_impl() {
         }
     }
 
+    // move queued in cSendPkts to existing connection's sendPkts
+    {
+        std::unordered_set<UDPC_ConnectionId, UDPC::ConnectionIdHasher> dropped;
+        std::unordered_set<UDPC_ConnectionId, UDPC::ConnectionIdHasher> notQueued;
+        // Only update changes conMap and the connections' sendPkts, so they
+        // are read without conMapMutex, which is held only while pushing to
+        // sendPkts (read by other threads) once per chunk of packets.
+        const std::size_t chunkSize = 64;
+        std::vector<ConnectionTable<ConnectionData>::iterator> iters;
+        iters.reserve(chunkSize);
+        const auto queueToConnections = [&] (
+                PktInfoWrapper *wrappers, std::size_t size) {
+            iters.clear();
+            for(std::size_t i = 0; i < size; ++i) {
+                UDPC_PacketInfo *next = &wrappers[i].pinfo;
+                // queued by handle (see UDPC_queue_send_h()), not by receiver
+                iters.push_back(next->handle != 0
+                    ? conMap.findHandle(next->handle)
+                    : conMap.find(next->receiver));
+                if(iters[i] != conMap.end()) {
+                    next->receiver = iters[i]->first;
+                }
+            }
+
+            {
+                std::lock_guard<std::mutex> conMapLock(conMapMutex);
+                for(std::size_t i = 0; i < size; ++i) {
+                    if(iters[i] != conMap.end()
+                            && iters[i]->second.sendPkts.size()
+                                < UDPC_QUEUED_PKTS_MAX_SIZE) {
+                        iters[i]->second.sendPkts.push_back(wrappers[i].pinfo);
+                        wrappers[i].pinfo.data = nullptr;
+                    }
+                }
+            }
+
+            for(std::size_t i = 0; i < size; ++i) {
+                UDPC_PacketInfo *next = &wrappers[i].pinfo;
+                if(iters[i] == conMap.end()) {
+                    if(dropped.find(next->receiver) == dropped.end()) {
+                        UDPC_CHECK_LOG(this,
+                            UDPC_LoggingType::UDPC_WARNING,
+                            "Dropped queued packets to ",
+                            next->receiver.addr,
+                            ", port = ",
+                            next->receiver.port,
+                            " due to connection not existing");
+                        dropped.insert(next->receiver);
+                    }
+                } else if(next->data == nullptr) {
+                    // pushed to sendPkts above
+                    scheduleConnection(iters[i], nextDue(iters[i]->second));
+                } else {
+                    if(notQueued.find(next->receiver) == notQueued.end()) {
+                        notQueued.insert(next->receiver);
+                        UDPC_CHECK_LOG(this,
+                            UDPC_LoggingType::UDPC_DEBUG,
+                            "Not queueing packet to ",
+                            next->receiver.addr,
+                            ", port = ",
+                            next->receiver.port,
+                            ", connection's queue reached max size");
+                    }
+                    cSendRequeueNext.push_back(std::move(wrappers[i]));
+                }
+            }
+        };
+
+        // packets not added last update go first to keep them in order
+        for(std::size_t i = 0; i < cSendRequeue.size(); i += chunkSize) {
+            queueToConnections(&cSendRequeue[i],
+                std::min(cSendRequeue.size() - i, chunkSize));
+        }
+        // only what was queued so far, so other threads queueing cannot keep
+        // update here
+        unsigned long count = cSendPkts.size();
+        unsigned long handled = cSendRequeue.size();
+        std::array<PktInfoWrapper, chunkSize> popped;
+        while(count > 0) {
+            const std::size_t poppedCount = cSendPkts.pop_front_n(
+                popped.data(),
+                count < popped.size() ? count : popped.size());
+            if(poppedCount == 0) {
+                break;
+            }
+            queueToConnections(popped.data(), poppedCount);
+            count -= poppedCount;
+            handled += poppedCount;
+        }
+
+        // Re-queue packets that were not added due to size limits, they keep
+        // their room in cSendQueuedSize.
+        cSendRequeue.swap(cSendRequeueNext);
+        cSendRequeueNext.clear();
+        cSendQueuedSize.fetch_sub(handled - cSendRequeue.size());
+    }
+
+    // connections due in timers, checked for sending below
+    std::vector<uint64_t> dueHandles;
     {
-        // check timed out, check good/bad mode with rtt, remove timed out
+        // check timed out, check good/bad mode with rtt, remove timed out,
+        // only for the connections that are due
         std::vector<UDPC_ConnectionId> removed;
-        std::lock_guard<std::mutex> conMapLock(conMapMutex);
-        for(auto iter = conMap.begin(); iter != conMap.end(); ++iter) {
-            temp_dt_fs = now - iter->second.received;
-            if(temp_dt_fs >= UDPC::CONNECTION_TIMEOUT) {
+        std::vector<TimingWheel::Entry> due;
+        {
+            std::lock_guard<std::mutex> timersLock(timersMutex);
+            timers.advance(now, due);
+        }
+        for(const TimingWheel::Entry &entry : due) {
+            auto iter = conMap.findHandle(entry.handle);
+            if(iter == conMap.end() || iter->second.timerTick != entry.tick) {
+                // erased, or scheduled again to be due earlier
+                continue;
+            }
+            iter->second.timerTick = UDPC::NO_TICK;
+            dueHandles.push_back(entry.handle);
+            const std::chrono::steady_clock::duration dt =
+                now - iter->second.timersUpdated;
+            iter->second.timersUpdated = now;
+
+            if(now - iter->second.received >= UDPC::CONNECTION_TIMEOUT) {
                 removed.push_back(iter->first);
                 UDPC_CHECK_LOG(this,
                     UDPC_LoggingType::UDPC_VERBOSE,
@@ -458,13 +740,13 @@ void UDPC::Context::update_impl() {
                     ", port = ",
                     iter->second.port);
                 iter->second.flags.reset(1);
+                isPeerListChanged = true;
                 if(iter->second.toggledTimer <= UDPC::TEN_SECONDS) {
                     iter->second.toggleT *= 2;
                 }
                 iter->second.toggledTimer = std::chrono::steady_clock::duration::zero();
                 if(isReceivingEvents.load()) {
-                    externalEvents.push_back(UDPC_Event{
-                        UDPC_ET_BAD_MODE, iter->first, false});
+                    pushEvent(UDPC_ET_BAD_MODE, iter);
                 }
             } else if(iter->second.flags.test(1)) {
                 // good mode, good rtt
@@ -488,9 +770,9 @@ void UDPC::Context::update_impl() {
                         ", port = ",
                         iter->second.port);
                     iter->second.flags.set(1);
+                    isPeerListChanged = true;
                     if(isReceivingEvents.load()) {
-                        externalEvents.push_back(UDPC_Event{
-                            UDPC_ET_GOOD_MODE, iter->first, false});
+                        pushEvent(UDPC_ET_GOOD_MODE, iter);
                     }
                 }
             } else {
@@ -498,106 +780,58 @@ void UDPC::Context::update_impl() {
                 iter->second.toggledTimer = std::chrono::steady_clock::duration::zero();
             }
 
+            // periods missed while not updating are dropped, so a late
+            // update (e.g. waking from idle) does not trigger a burst of sends
             iter->second.timer += dt;
-            if(iter->second.flags.test(1)) {
-                if(iter->second.timer >= UDPC::GOOD_MODE_SEND_RATE) {
-                    iter->second.timer -= UDPC::GOOD_MODE_SEND_RATE;
-                    iter->second.flags.set(0);
-                }
-            } else {
-                if(iter->second.timer >= UDPC::BAD_MODE_SEND_RATE) {
-                    iter->second.timer -= UDPC::BAD_MODE_SEND_RATE;
-                    iter->second.flags.set(0);
-                }
+            const std::chrono::steady_clock::duration sendRate =
+                iter->second.flags.test(1)
+                ? iter->second.goodModeSendRate
+                : iter->second.badModeSendRate;
+            if(iter->second.timer >= sendRate) {
+                iter->second.timer %= sendRate;
+                iter->second.flags.set(0);
             }
         }
+        std::lock_guard<std::mutex> conMapLock(conMapMutex);
         for(auto iter = removed.begin(); iter != removed.end(); ++iter) {
-            auto addrConIter = addrConMap.find(iter->addr);
-            assert(addrConIter != addrConMap.end()
-                    && "addrConMap must have an entry for a current connection");
-            auto addrConSetIter = addrConIter->second.find(*iter);
-            assert(addrConSetIter != addrConIter->second.end()
-                    && "nested set in addrConMap must have an entry for a current connection");
-            addrConIter->second.erase(addrConSetIter);
-            if(addrConIter->second.empty()) {
-                addrConMap.erase(addrConIter);
-            }
-
             auto cIter = conMap.find(*iter);
             assert(cIter != conMap.end()
                     && "conMap must have the entry set to be removed");
 
-            if(cIter->second.flags.test(4)) {
-                idMap.erase(cIter->second.id);
-            }
             if(isReceivingEvents.load()) {
                 if(flags.test(1) && cIter->second.flags.test(3)) {
-                    externalEvents.push_back(UDPC_Event{
-                        UDPC_ET_FAIL_CONNECT, *iter, false});
+                    pushEvent(UDPC_ET_FAIL_CONNECT, cIter);
                 } else {
-                    externalEvents.push_back(UDPC_Event{
-                        UDPC_ET_DISCONNECTED, *iter, false});
+                    pushEvent(UDPC_ET_DISCONNECTED, cIter);
                 }
             }
 
             conMap.erase(cIter);
+            isPeerListChanged = true;
         }
     }
 
-    // move queued in cSendPkts to existing connection's sendPkts
+    // update send (only if triggerSend flag is set), without conMapMutex so
+    // signing does not hold up other threads
     {
-        std::unordered_set<UDPC_ConnectionId, UDPC::ConnectionIdHasher> dropped;
-        std::unordered_set<UDPC_ConnectionId, UDPC::ConnectionIdHasher> notQueued;
-        std::list<PktInfoWrapper> requeue;
-        bool isEmpty = false;
-        while (!isEmpty) {
-            auto next_wrapper = cSendPkts.top_and_pop_and_empty(&isEmpty);
-            if (next_wrapper) {
-                UDPC_PacketInfo *next = &next_wrapper->pinfo;
-                std::lock_guard<std::mutex> conMapLock(conMapMutex);
-                auto iter = conMap.find(next->receiver);
-                if(iter != conMap.end()) {
-                    if(iter->second.sendPkts.size() >= UDPC_QUEUED_PKTS_MAX_SIZE) {
-                        if(notQueued.find(next->receiver) == notQueued.end()) {
-                            notQueued.insert(next->receiver);
-                            UDPC_CHECK_LOG(this,
-                                UDPC_LoggingType::UDPC_DEBUG,
-                                "Not queueing packet to ",
-                                next->receiver.addr,
-                                ", port = ",
-                                next->receiver.port,
-                                ", connection's queue reached max size");
-                        }
-                        requeue.push_back(std::move(*next_wrapper));
-                        continue;
-                    }
-                    iter->second.sendPkts.push_back(*next);
-                    next_wrapper->pinfo.data = nullptr;
-                } else {
-                    if(dropped.find(next->receiver) == dropped.end()) {
-                        UDPC_CHECK_LOG(this,
-                            UDPC_LoggingType::UDPC_WARNING,
-                            "Dropped queued packets to ",
-                            next->receiver.addr,
-                            ", port = ",
-                            next->receiver.port,
-                            " due to connection not existing");
-                        dropped.insert(next->receiver);
-                    }
-                }
+        // connections to send a disconnect packet to, then the due ones
+        std::vector<ConnectionTable<ConnectionData>::iterator> sending;
+        for(const UDPC_ConnectionId &id : deletionMap) {
+            auto iter = conMap.find(id);
+            if(iter != conMap.end()) {
+                sending.push_back(iter);
             }
         }
-
-        // Re-queue packets that were not added due to size limits.
-        for (auto req_iter = requeue.rbegin(); req_iter != requeue.rend(); ++req_iter) {
-            cSendPkts.push_front(std::move(*req_iter));
+        const std::size_t deletingCount = sending.size();
+        for(uint64_t handle : dueHandles) {
+            auto iter = conMap.findHandle(handle);
+            if(iter != conMap.end()
+                    && deletionMap.find(iter->first) == deletionMap.end()) {
+                sending.push_back(iter);
+            }
         }
-    }
 
-    // update send (only if triggerSend flag is set)
-    {
-        std::lock_guard<std::mutex> conMapLock(conMapMutex);
-        for(auto iter = conMap.begin(); iter != conMap.end(); ++iter) {
+        for(auto iter : sending) {
             auto delIter = deletionMap.find(iter->first);
             if(!iter->second.flags.test(0) && delIter == deletionMap.end()) {
                 continue;
@@ -607,18 +841,18 @@ void UDPC::Context::update_impl() {
                     continue;
                 }
                 unsigned int sendSize = 0;
-                std::unique_ptr<char[]> buf;
+                char *buf = nullptr;
                 if(flags.test(2) && iter->second.flags.test(6)) {
                     sendSize = UDPC_LSFULL_HEADER_SIZE;
-                    buf = std::unique_ptr<char[]>(new char[sendSize]);
+                    buf = stageSend(sendSize, iter->first);
                     buf[UDPC_MIN_HEADER_SIZE] = 1;
                 } else {
                     sendSize = UDPC_NSFULL_HEADER_SIZE;
-                    buf = std::unique_ptr<char[]>(new char[sendSize]);
+                    buf = stageSend(sendSize, iter->first);
                     buf[UDPC_MIN_HEADER_SIZE] = 0;
                 }
                 UDPC::preparePacket(
-                    buf.get(),
+                    buf,
                     protocolID,
                     iter->second.id,
                     iter->second.rseq,
@@ -628,52 +862,28 @@ void UDPC::Context::update_impl() {
                 if(flags.test(2) && iter->second.flags.test(6)) {
 #ifdef UDPC_LIBSODIUM_ENABLED
                     unsigned char sig[crypto_sign_BYTES];
-                    std::memset(buf.get() + UDPC_MIN_HEADER_SIZE + 1, 0, crypto_sign_BYTES);
+                    std::memset(buf + UDPC_MIN_HEADER_SIZE + 1, 0, crypto_sign_BYTES);
                     if(crypto_sign_detached(
                         sig, nullptr,
-                        (unsigned char*)buf.get(), UDPC_LSFULL_HEADER_SIZE,
+                        (unsigned char*)buf, UDPC_LSFULL_HEADER_SIZE,
                         iter->second.sk) != 0) {
                         UDPC_CHECK_LOG(this, UDPC_LoggingType::UDPC_ERROR,
                             "Failed to sign packet for peer ",
                             iter->first.addr,
                             ", port ",
                             iter->second.port);
+                        unstageSend();
                         continue;
                     }
-                    std::memcpy(buf.get() + UDPC_MIN_HEADER_SIZE + 1, sig, crypto_sign_BYTES);
+                    std::memcpy(buf + UDPC_MIN_HEADER_SIZE + 1, sig, crypto_sign_BYTES);
 #else
                     assert(!"libsodium disabled, invalid state");
                     UDPC_CHECK_LOG(this, UDPC_LoggingType::UDPC_ERROR,
                         "libsodium is disabled, cannot send packet");
+                    unstageSend();
                     continue;
 #endif
                 }
-
-                UDPC_IPV6_SOCKADDR_TYPE destinationInfo;
-                destinationInfo.sin6_family = AF_INET6;
-                std::memcpy(
-                    UDPC_IPV6_ADDR_SUB(destinationInfo.sin6_addr),
-                    UDPC_IPV6_ADDR_SUB(iter->first.addr),
-                    16);
-                destinationInfo.sin6_port = htons(iter->second.port);
-                destinationInfo.sin6_flowinfo = 0;
-                destinationInfo.sin6_scope_id = iter->first.scope_id;
-                long int sentBytes = sendto(
-                    socketHandle,
-                    buf.get(),
-                    sendSize,
-                    0,
-                    (struct sockaddr*) &destinationInfo,
-                    sizeof(UDPC_IPV6_SOCKADDR_TYPE));
-                if(sentBytes != sendSize) {
-                    UDPC_CHECK_LOG(this,
-                        UDPC_LoggingType::UDPC_ERROR,
-                        "Failed to send disconnect packet to ",
-                        iter->first.addr,
-                        ", port = ",
-                        iter->second.port);
-                    continue;
-                }
                 continue;
             }
 
@@ -689,18 +899,18 @@ void UDPC::Context::update_impl() {
                     }
                     iter->second.sent = now;
 
-                    std::unique_ptr<char[]> buf;
+                    char *buf = nullptr;
                     unsigned int sendSize = 0;
                     if(flags.test(2) && iter->second.flags.test(6)) {
 #ifdef UDPC_LIBSODIUM_ENABLED
                         sendSize = UDPC_CCL_HEADER_SIZE;
-                        buf = std::unique_ptr<char[]>(new char[sendSize]);
+                        buf = stageSend(sendSize, iter->first);
                         // set type 1
                         uint32_t temp = htonl(1);
-                        std::memcpy(buf.get() + UDPC_MIN_HEADER_SIZE, &temp, 4);
+                        std::memcpy(buf + UDPC_MIN_HEADER_SIZE, &temp, 4);
                         // set public key
                         std::memcpy(
-                            buf.get() + UDPC_MIN_HEADER_SIZE + 4,
+                            buf + UDPC_MIN_HEADER_SIZE + 4,
                             iter->second.pk,
                             crypto_sign_PUBLICKEYBYTES);
                         // set verify message
@@ -709,6 +919,7 @@ void UDPC::Context::update_impl() {
                         if(time <= 0) {
                             UDPC_CHECK_LOG(this, UDPC_LoggingType::UDPC_ERROR,
                                 "Failed to get current epoch time");
+                            unstageSend();
                             continue;
                         }
                         uint64_t timeInt = time;
@@ -731,7 +942,7 @@ void UDPC::Context::update_impl() {
                             &timeInt,
                             8);
                         std::memcpy(
-                            buf.get() + UDPC_MIN_HEADER_SIZE + 4 + crypto_sign_PUBLICKEYBYTES,
+                            buf + UDPC_MIN_HEADER_SIZE + 4 + crypto_sign_PUBLICKEYBYTES,
                             iter->second.verifyMessage.get(),
                             12);
 #else
@@ -742,14 +953,14 @@ void UDPC::Context::update_impl() {
 #endif
                     } else {
                         sendSize = UDPC_CON_HEADER_SIZE;
-                        buf = std::unique_ptr<char[]>(new char[sendSize]);
+                        buf = stageSend(sendSize, iter->first);
                         buf[UDPC_MIN_HEADER_SIZE] = 0;
                         buf[UDPC_MIN_HEADER_SIZE + 1] = 0;
                         buf[UDPC_MIN_HEADER_SIZE + 2] = 0;
                         buf[UDPC_MIN_HEADER_SIZE + 3] = 0;
                     }
                     UDPC::preparePacket(
-                        buf.get(),
+                        buf,
                         protocolID,
                         0,
                         0,
@@ -757,61 +968,38 @@ void UDPC::Context::update_impl() {
                         nullptr,
                         0x1);
 
-                    UDPC_IPV6_SOCKADDR_TYPE destinationInfo;
-                    destinationInfo.sin6_family = AF_INET6;
-                    std::memcpy(UDPC_IPV6_ADDR_SUB(destinationInfo.sin6_addr), UDPC_IPV6_ADDR_SUB(iter->first.addr), 16);
-                    destinationInfo.sin6_port = htons(iter->second.port);
-                    destinationInfo.sin6_flowinfo = 0;
-                    destinationInfo.sin6_scope_id = iter->first.scope_id;
-                    long int sentBytes = sendto(
-                        socketHandle,
-                        buf.get(),
-                        sendSize,
-                        0,
-                        (struct sockaddr*) &destinationInfo,
-                        sizeof(UDPC_IPV6_SOCKADDR_TYPE));
-                    if(sentBytes != sendSize) {
-                        UDPC_CHECK_LOG(this,
-                            UDPC_LoggingType::UDPC_ERROR,
-                            "Failed to send packet to initiate connection to ",
-                            iter->first.addr,
-                            ", port = ",
-                            iter->second.port);
-                        continue;
-                    } else {
-                        UDPC_CHECK_LOG(
-                            this,
-                            UDPC_LoggingType::UDPC_INFO,
-                            "Sent initiate connection to ",
-                            iter->first.addr,
-                            ", port = ",
-                            iter->second.port,
-                            flags.test(2) && iter->second.flags.test(6) ?
-                                ", libsodium enabled" : ", libsodium disabled");
-                    }
+                    UDPC_CHECK_LOG(
+                        this,
+                        UDPC_LoggingType::UDPC_INFO,
+                        "Sent initiate connection to ",
+                        iter->first.addr,
+                        ", port = ",
+                        iter->second.port,
+                        flags.test(2) && iter->second.flags.test(6) ?
+                            ", libsodium enabled" : ", libsodium disabled");
                 } else {
                     // is server, initiate connection to client
                     iter->second.flags.reset(3);
                     iter->second.sent = now;
 
-                    std::unique_ptr<char[]> buf;
+                    char *buf = nullptr;
                     unsigned int sendSize = 0;
                     if(flags.test(2) && iter->second.flags.test(6)) {
 #ifdef UDPC_LIBSODIUM_ENABLED
                         sendSize = UDPC_CSR_HEADER_SIZE;
-                        buf = std::unique_ptr<char[]>(new char[sendSize]);
+                        buf = stageSend(sendSize, iter->first);
                         // set type
                         uint32_t temp = htonl(2);
-                        std::memcpy(buf.get() + UDPC_MIN_HEADER_SIZE, &temp, 4);
+                        std::memcpy(buf + UDPC_MIN_HEADER_SIZE, &temp, 4);
                         // set pubkey
-                        std::memcpy(buf.get() + UDPC_MIN_HEADER_SIZE + 4,
+                        std::memcpy(buf + UDPC_MIN_HEADER_SIZE + 4,
                             iter->second.pk,
                             crypto_sign_PUBLICKEYBYTES);
                         // set detached sig
                         assert(iter->second.verifyMessage &&
                             "Detached sig in verifyMessage must exist");
                         std::memcpy(
-                            buf.get() + UDPC_MIN_HEADER_SIZE + 4 + crypto_sign_PUBLICKEYBYTES,
+                            buf + UDPC_MIN_HEADER_SIZE + 4 + crypto_sign_PUBLICKEYBYTES,
                             iter->second.verifyMessage.get(),
                             crypto_sign_BYTES);
 #else
@@ -822,14 +1010,14 @@ void UDPC::Context::update_impl() {
 #endif
                     } else {
                         sendSize = UDPC_CON_HEADER_SIZE;
-                        buf = std::unique_ptr<char[]>(new char[sendSize]);
+                        buf = stageSend(sendSize, iter->first);
                         buf[UDPC_MIN_HEADER_SIZE] = 0;
                         buf[UDPC_MIN_HEADER_SIZE + 1] = 0;
                         buf[UDPC_MIN_HEADER_SIZE + 2] = 0;
                         buf[UDPC_MIN_HEADER_SIZE + 3] = 0;
                     }
                     UDPC::preparePacket(
-                        buf.get(),
+                        buf,
                         protocolID,
                         iter->second.id,
                         iter->second.rseq,
@@ -837,56 +1025,52 @@ void UDPC::Context::update_impl() {
                         &iter->second.lseq,
                         0x1);
 
-                    UDPC_IPV6_SOCKADDR_TYPE destinationInfo;
-                    destinationInfo.sin6_family = AF_INET6;
-                    std::memcpy(UDPC_IPV6_ADDR_SUB(destinationInfo.sin6_addr), UDPC_IPV6_ADDR_SUB(iter->first.addr), 16);
-                    destinationInfo.sin6_port = htons(iter->second.port);
-                    destinationInfo.sin6_flowinfo = 0;
-                    destinationInfo.sin6_scope_id = iter->first.scope_id;
-                    long int sentBytes = sendto(
-                        socketHandle,
-                        buf.get(),
-                        sendSize,
-                        0,
-                        (struct sockaddr*) &destinationInfo,
-                        sizeof(UDPC_IPV6_SOCKADDR_TYPE));
-                    if(sentBytes != sendSize) {
-                        UDPC_CHECK_LOG(this,
-                            UDPC_LoggingType::UDPC_ERROR,
-                            "Failed to send packet to initiate connection to ",
-                            iter->first.addr,
-                            ", port = ",
-                            iter->second.port);
-                        continue;
-                    }
                     UDPC_CHECK_LOG(this, UDPC_LoggingType::UDPC_DEBUG,
                         "Sent init pkt to client ",
-                        destinationInfo.sin6_addr,
+                        iter->first.addr,
                         ", port ", iter->second.port);
                 }
                 continue;
             }
 
+            // with GSO enabled, build a burst of queued packets so that
+            // equal-sized datagrams to this peer are sent as one buffer
+            const unsigned int burst = isGSOEnabled.load()
+                ? std::max(iter->second.sendBurst,
+                    (unsigned int)UDPC_GSO_BURST_MAX)
+                : iter->second.sendBurst;
+            const bool isWindowed = isSendWindowed(iter->second);
+            if(!isWindowed) {
+                // not waiting on ids sent before, if it becomes windowed
+                iter->second.sendWindowStart = iter->second.lseq;
+            }
+
             // Not initiating connection, send as normal on current connection
-            if(iter->second.sendPkts.empty() && iter->second.priorityPkts.empty()) {
-                // nothing in queues, send heartbeat packet
+            if((iter->second.sendPkts.empty() && iter->second.priorityPkts.empty())
+                    || (isWindowed && !isSendWindowOpen(
+                        iter->second, now, UDPC_SEND_WINDOW_SIZE))) {
+                // nothing in queues (or waiting for acks), send heartbeat
+                // packet, which also carries the acks the peer waits for
                 auto sentDT = now - iter->second.sent;
-                if (sentDT < UDPC::HEARTBEAT_PKT_INTERVAL_DT) {
+                if (sentDT < UDPC::HEARTBEAT_PKT_INTERVAL_DT
+                        && (!isWindowed
+                            || iter->second.rseq - iter->second.sentRseq
+                                < UDPC_SEND_WINDOW_SIZE / 2)) {
                     continue;
                 }
                 unsigned int sendSize = 0;
-                std::unique_ptr<char[]> buf;
+                char *buf = nullptr;
                 if(flags.test(2) && iter->second.flags.test(6)) {
                     sendSize = UDPC_LSFULL_HEADER_SIZE;
-                    buf = std::unique_ptr<char[]>(new char[sendSize]);
+                    buf = stageSend(sendSize, iter->first);
                     buf[UDPC_MIN_HEADER_SIZE] = 1;
                 } else {
                     sendSize = UDPC_NSFULL_HEADER_SIZE;
-                    buf = std::unique_ptr<char[]>(new char[sendSize]);
+                    buf = stageSend(sendSize, iter->first);
                     buf[UDPC_MIN_HEADER_SIZE] = 0;
                 }
                 UDPC::preparePacket(
-                    buf.get(),
+                    buf,
                     protocolID,
                     iter->second.id,
                     iter->second.rseq,
@@ -896,249 +1080,245 @@ void UDPC::Context::update_impl() {
                 if(flags.test(2) && iter->second.flags.test(6)) {
 #ifdef UDPC_LIBSODIUM_ENABLED
                     unsigned char sig[crypto_sign_BYTES];
-                    std::memset(buf.get() + UDPC_MIN_HEADER_SIZE + 1, 0, crypto_sign_BYTES);
+                    std::memset(buf + UDPC_MIN_HEADER_SIZE + 1, 0, crypto_sign_BYTES);
                     if(crypto_sign_detached(
                         sig, nullptr,
-                        (unsigned char*)buf.get(), UDPC_LSFULL_HEADER_SIZE,
+                        (unsigned char*)buf, UDPC_LSFULL_HEADER_SIZE,
                         iter->second.sk) != 0) {
                         UDPC_CHECK_LOG(this, UDPC_LoggingType::UDPC_ERROR,
                             "Failed to sign packet for peer ",
                             iter->first.addr,
                             ", port ",
                             iter->second.port);
+                        unstageSend();
                         continue;
                     }
-                    std::memcpy(buf.get() + UDPC_MIN_HEADER_SIZE + 1, sig, crypto_sign_BYTES);
+                    std::memcpy(buf + UDPC_MIN_HEADER_SIZE + 1, sig, crypto_sign_BYTES);
 #else
                     assert(!"libsodium disabled, invalid state");
                     UDPC_CHECK_LOG(this, UDPC_LoggingType::UDPC_ERROR,
                         "libsodium is disabled, cannot send packet");
+                    unstageSend();
                     continue;
 #endif
                 }
 
-                UDPC_IPV6_SOCKADDR_TYPE destinationInfo;
-                destinationInfo.sin6_family = AF_INET6;
-                std::memcpy(
-                    UDPC_IPV6_ADDR_SUB(destinationInfo.sin6_addr),
-                    UDPC_IPV6_ADDR_SUB(iter->first.addr),
-                    16);
-                destinationInfo.sin6_port = htons(iter->second.port);
-                destinationInfo.sin6_flowinfo = 0;
-                destinationInfo.sin6_scope_id = iter->first.scope_id;
-                long int sentBytes = sendto(
-                    socketHandle,
-                    buf.get(),
-                    sendSize,
-                    0,
-                    (struct sockaddr*) &destinationInfo,
-                    sizeof(UDPC_IPV6_SOCKADDR_TYPE));
-                if(sentBytes != sendSize) {
-                    UDPC_CHECK_LOG(this,
-                        UDPC_LoggingType::UDPC_ERROR,
-                        "Failed to send heartbeat packet to ",
-                        iter->first.addr,
-                        ", port = ",
-                        iter->second.port);
-                    continue;
-                }
-
-                UDPC_PacketInfo pInfo = UDPC::get_empty_pinfo();
-                pInfo.dataSize = UDPC_NSFULL_HEADER_SIZE;
-                pInfo.data = (char*)std::malloc(pInfo.dataSize);
-                pInfo.flags = 0x4;
-                pInfo.sender.addr = in6addr_loopback;
-                pInfo.receiver.addr = iter->first.addr;
-                pInfo.sender.port = ntohs(socketInfo.sin6_port);
-                pInfo.receiver.port = iter->second.port;
-                uint32_t temp = htonl(iter->second.lseq - 1);
-                std::memcpy(pInfo.data + 8, &temp, 4);
-                pInfo.data[UDPC_MIN_HEADER_SIZE] = flags.test(2) && iter->second.flags.test(6) ? 1 : 0;
-
-                iter->second.sentPkts.push_back(std::move(pInfo));
-                iter->second.cleanupSentPkts();
-
-                // store other pkt info
-                UDPC::SentPktInfo::Ptr sentPktInfo = std::make_shared<UDPC::SentPktInfo>();
-                sentPktInfo->id = iter->second.lseq - 1;
-                iter->second.sentInfoMap.insert(std::make_pair(sentPktInfo->id, sentPktInfo));
+                // heartbeat is not check-received
+                iter->second.addSentPkt(iter->second.lseq - 1, now).flags |= 0x4;
             } else {
                 // sendPkts or priorityPkts not empty
-                UDPC_PacketInfo pInfo = UDPC::get_empty_pinfo();
-                bool isResending = false;
-                if(!iter->second.priorityPkts.empty()) {
-                    pInfo = iter->second.priorityPkts.front();
-                    iter->second.priorityPkts.pop_front();
-                    isResending = true;
-                } else {
-                    pInfo = iter->second.sendPkts.front();
-                    iter->second.sendPkts.pop_front();
-                }
+                for(unsigned int i = 0; i < burst
+                        && (!iter->second.priorityPkts.empty()
+                            || !iter->second.sendPkts.empty())
+                        && (!isWindowed || isSendWindowOpen(
+                            iter->second, now, UDPC_SEND_WINDOW_SIZE)); ++i) {
+                    UDPC_PacketInfo pInfo = UDPC::get_empty_pinfo();
+                    bool isResending = false;
+                    if(!iter->second.priorityPkts.empty()) {
+                        pInfo = iter->second.priorityPkts.front();
+                        iter->second.priorityPkts.pop_front();
+                        isResending = true;
+                    } else {
+                        // sendPkts is read by other threads
+                        std::lock_guard<std::mutex> conMapLock(conMapMutex);
+                        pInfo = iter->second.sendPkts.front();
+                        iter->second.sendPkts.pop_front();
+                    }
 
-                std::unique_ptr<char[]> buf;
-                unsigned int sendSize = 0;
-                if(flags.test(2) && iter->second.flags.test(6)) {
-                    sendSize = UDPC_LSFULL_HEADER_SIZE + pInfo.dataSize;
-                    buf = std::unique_ptr<char[]>(new char[sendSize]);
-                    buf[UDPC_MIN_HEADER_SIZE] = 1;
-                } else {
-                    sendSize = UDPC_NSFULL_HEADER_SIZE + pInfo.dataSize;
-                    buf = std::unique_ptr<char[]>(new char[sendSize]);
-                    buf[UDPC_MIN_HEADER_SIZE] = 0;
-                }
+                    // A committed send buffer (flag 0x10) has room for the
+                    // header before its payload, the datagram is built in
+                    // place if the header fits exactly.
+                    const unsigned int headroom =
+                        (pInfo.flags & 0x10) != 0 ? sendHeadroom() : 0;
+                    const char *payload = pInfo.data + headroom;
+                    const uint32_t payloadSize = pInfo.dataSize - headroom;
+                    const bool isSigned =
+                        flags.test(2) && iter->second.flags.test(6);
+                    const unsigned int headerSize = isSigned
+                        ? UDPC_LSFULL_HEADER_SIZE : UDPC_NSFULL_HEADER_SIZE;
+                    const bool isInPlace = headroom == headerSize;
+                    // A payload queued to many peers (see
+                    // UDPC_queue_send_many()) is sent after a header of its
+                    // own, unless it must be signed with the header.
+                    const bool isShared = !isSigned && !isInPlace
+                        && BufferPool::isShared(pInfo.data);
+
+                    char *buf = nullptr;
+                    unsigned int sendSize = headerSize + payloadSize;
+                    if(isInPlace) {
+                        buf = pInfo.data;
+                        stageSendBuffer(buf, sendSize, iter->first);
+                    } else if(isShared) {
+                        buf = stageSendHeader(
+                            headerSize, payload, payloadSize, iter->first);
+                    } else {
+                        buf = stageSend(sendSize, iter->first);
+                    }
+                    buf[UDPC_MIN_HEADER_SIZE] = isSigned ? 1 : 0;
 
-                UDPC::preparePacket(
-                    buf.get(),
-                    protocolID,
-                    iter->second.id,
-                    iter->second.rseq,
-                    iter->second.ack,
-                    &iter->second.lseq,
-                    (pInfo.flags & 0x4) | (isResending ? 0x8 : 0));
+                    UDPC::preparePacket(
+                        buf,
+                        protocolID,
+                        iter->second.id,
+                        iter->second.rseq,
+                        iter->second.ack,
+                        &iter->second.lseq,
+                        (pInfo.flags & 0x4) | (isResending ? 0x8 : 0));
 
-                if(flags.test(2) && iter->second.flags.test(6)) {
+                    if(isSigned) {
 #ifdef UDPC_LIBSODIUM_ENABLED
-                    unsigned char sig[crypto_sign_BYTES];
-                    std::memset(buf.get() + UDPC_MIN_HEADER_SIZE + 1, 0, crypto_sign_BYTES);
-                    std::memcpy(buf.get() + UDPC_LSFULL_HEADER_SIZE, pInfo.data, pInfo.dataSize);
-                    if(crypto_sign_detached(
-                        sig, nullptr,
-                        (unsigned char*)buf.get(), sendSize,
-                        iter->second.sk) != 0) {
+                        unsigned char sig[crypto_sign_BYTES];
+                        std::memset(buf + UDPC_MIN_HEADER_SIZE + 1, 0, crypto_sign_BYTES);
+                        if(!isInPlace) {
+                            std::memcpy(buf + UDPC_LSFULL_HEADER_SIZE, payload, payloadSize);
+                        }
+                        if(crypto_sign_detached(
+                            sig, nullptr,
+                            (unsigned char*)buf, sendSize,
+                            iter->second.sk) != 0) {
+                            UDPC_CHECK_LOG(this, UDPC_LoggingType::UDPC_ERROR,
+                                "Failed to sign packet for peer ",
+                                iter->first.addr,
+                                ", port ",
+                                iter->second.port);
+                            BufferPool::deallocate(pInfo.data);
+                            unstageSend();
+                            continue;
+                        }
+                        std::memcpy(buf + UDPC_MIN_HEADER_SIZE + 1, sig, crypto_sign_BYTES);
+#else
+                        assert(!"libsodium disabled, invalid state");
                         UDPC_CHECK_LOG(this, UDPC_LoggingType::UDPC_ERROR,
-                            "Failed to sign packet for peer ",
-                            iter->first.addr,
-                            ", port ",
-                            iter->second.port);
-                        std::free(pInfo.data);
+                            "libsodium is disabled, cannot send packet");
+                        BufferPool::deallocate(pInfo.data);
+                        unstageSend();
                         continue;
-                    }
-                    std::memcpy(buf.get() + UDPC_MIN_HEADER_SIZE + 1, sig, crypto_sign_BYTES);
-#else
-                    assert(!"libsodium disabled, invalid state");
-                    UDPC_CHECK_LOG(this, UDPC_LoggingType::UDPC_ERROR,
-                        "libsodium is disabled, cannot send packet");
-                    std::free(pInfo.data);
-                    continue;
 #endif
-                } else {
-                    std::memcpy(buf.get() + UDPC_NSFULL_HEADER_SIZE, pInfo.data, pInfo.dataSize);
-                }
+                    } else if(!isInPlace && !isShared) {
+                        std::memcpy(buf + UDPC_NSFULL_HEADER_SIZE, payload, payloadSize);
+                    }
+
+                    UDPC::SentPkt &sentPkt =
+                        iter->second.addSentPkt(iter->second.lseq - 1, now);
+                    if((pInfo.flags & 0x4) == 0) {
+                        // is check-received, store data in case packet gets lost
+                        sentPkt.dataSize = sendSize;
+                        if(isInPlace) {
+                            // the datagram's buffer is kept as is
+                            sentPkt.data = pInfo.data;
+                            pInfo.data = nullptr;
+                        } else if(isShared) {
+                            // the header is kept with a reference to the
+                            // shared payload after it
+                            sentPkt.data = bufferPool->allocate(
+                                headerSize + sizeof(const char*));
+                            std::memcpy(sentPkt.data, buf, headerSize);
+                            BufferPool::share(payload);
+                            std::memcpy(sentPkt.data + headerSize,
+                                &payload, sizeof(const char*));
+                            sentPkt.flags |= 0x20;
+                        } else {
+                            sentPkt.data = bufferPool->allocate(sentPkt.dataSize);
+                            std::memcpy(sentPkt.data, buf, sendSize);
+                        }
+                    } else {
+                        sentPkt.flags |= 0x4;
 
+                        if(isInPlace) {
+                            // still staged, freed once sent
+                            sendStageOwned.push_back(pInfo.data);
+                            pInfo.data = nullptr;
+                        }
+                    }
 
-                UDPC_IPV6_SOCKADDR_TYPE destinationInfo;
-                destinationInfo.sin6_family = AF_INET6;
-                std::memcpy(
-                    UDPC_IPV6_ADDR_SUB(destinationInfo.sin6_addr),
-                    UDPC_IPV6_ADDR_SUB(iter->first.addr),
-                    16);
-                destinationInfo.sin6_port = htons(iter->second.port);
-                destinationInfo.sin6_flowinfo = 0;
-                destinationInfo.sin6_scope_id = iter->first.scope_id;
-                long int sentBytes = sendto(
-                    socketHandle,
-                    buf.get(),
-                    sendSize,
-                    0,
-                    (struct sockaddr*) &destinationInfo,
-                    sizeof(UDPC_IPV6_SOCKADDR_TYPE));
-                if(sentBytes != sendSize) {
-                    UDPC_CHECK_LOG(this,
-                        UDPC_LoggingType::UDPC_ERROR,
-                        "Failed to send packet to ",
-                        iter->first.addr,
-                        ", port = ",
-                        iter->second.port);
-                    std::free(pInfo.data);
-                    continue;
-                }
+                    if(isShared) {
+                        // still staged, the reference is dropped once sent
+                        sendStageOwned.push_back(pInfo.data);
+                        pInfo.data = nullptr;
+                    }
 
-                if((pInfo.flags & 0x4) == 0) {
-                    // is check-received, store data in case packet gets lost
-                    UDPC_PacketInfo sentPInfo = UDPC::get_empty_pinfo();
-                    sentPInfo.dataSize = sendSize;
-                    sentPInfo.data = (char*)std::malloc(sentPInfo.dataSize);
-                    std::memcpy(sentPInfo.data, buf.get(), sendSize);
-                    sentPInfo.flags = 0;
-                    sentPInfo.sender.addr = in6addr_loopback;
-                    sentPInfo.receiver.addr = iter->first.addr;
-                    sentPInfo.sender.port = ntohs(socketInfo.sin6_port);
-                    sentPInfo.receiver.port = iter->second.port;
-
-                    iter->second.sentPkts.push_back(std::move(sentPInfo));
-                    iter->second.cleanupSentPkts();
-                } else {
-                    // is not check-received, only id stored in data array
-                    UDPC_PacketInfo sentPInfo = UDPC::get_empty_pinfo();
-                    sentPInfo.dataSize = UDPC_MIN_HEADER_SIZE;
-                    sentPInfo.data = (char*)std::malloc(sentPInfo.dataSize);
-                    sentPInfo.flags = 0x4;
-                    sentPInfo.sender.addr = in6addr_loopback;
-                    sentPInfo.receiver.addr = iter->first.addr;
-                    sentPInfo.sender.port = ntohs(socketInfo.sin6_port);
-                    sentPInfo.receiver.port = iter->second.port;
-                    uint32_t temp = htonl(iter->second.lseq - 1);
-                    std::memcpy(sentPInfo.data + 8, &temp, 4);
-
-                    iter->second.sentPkts.push_back(std::move(sentPInfo));
-                    iter->second.cleanupSentPkts();
+                    BufferPool::deallocate(pInfo.data);
                 }
-
-                // store other pkt info
-                UDPC::SentPktInfo::Ptr sentPktInfo = std::make_shared<UDPC::SentPktInfo>();
-                sentPktInfo->id = iter->second.lseq - 1;
-                iter->second.sentInfoMap.insert(std::make_pair(sentPktInfo->id, sentPktInfo));
-                std::free(pInfo.data);
             }
             iter->second.sent = now;
+            iter->second.sentRseq = iter->second.rseq;
+        }
+
+        for(std::size_t i = deletingCount; i < sending.size(); ++i) {
+            scheduleConnection(sending[i], nextDue(sending[i]->second));
         }
     }
 
+    flushSends();
+
     // remove queued for deletion
     for(auto delIter = deletionMap.begin(); delIter != deletionMap.end(); ++delIter) {
         std::lock_guard<std::mutex> conMapLock(conMapMutex);
         auto iter = conMap.find(*delIter);
         if(iter != conMap.end()) {
-            if(iter->second.flags.test(4)) {
-                idMap.erase(iter->second.id);
-            }
-            auto addrConIter = addrConMap.find(delIter->addr);
-            if(addrConIter != addrConMap.end()) {
-                addrConIter->second.erase(*delIter);
-                if(addrConIter->second.empty()) {
-                    addrConMap.erase(addrConIter);
-                }
-            }
             if(isReceivingEvents.load()) {
                 if(flags.test(1) && iter->second.flags.test(3)) {
-                    externalEvents.push_back(UDPC_Event{
-                        UDPC_ET_FAIL_CONNECT, iter->first, false});
+                    pushEvent(UDPC_ET_FAIL_CONNECT, iter);
                 } else {
-                    externalEvents.push_back(UDPC_Event{
-                        UDPC_ET_DISCONNECTED, iter->first, false});
+                    pushEvent(UDPC_ET_DISCONNECTED, iter);
                 }
             }
             conMap.erase(iter);
+            isPeerListChanged = true;
         }
     }
     deletionMap.clear();
 
     // receive packet
-    do {
-        UDPC_IPV6_SOCKADDR_TYPE receivedData;
-        socklen_t receivedDataSize = sizeof(receivedData);
-        int bytes = recvfrom(
-            socketHandle,
-            recvBuf,
-            UDPC_PACKET_MAX_SIZE,
-            0,
-            (struct sockaddr*) &receivedData,
-            &receivedDataSize);
+    receive_impl(now);
 
-#if UDPC_PLATFORM == UDPC_PLATFORM_WINDOWS
-        if(bytes == 0) {
-            // connection closed
-            break;
+    if(isPeerListChanged) {
+        publishPeerList();
+    } else {
+        peerList.reclaim();
+    }
+}
+
+void UDPC::Context::receive_impl(
+        const std::chrono::steady_clock::time_point &now) {
+    receiveHandedOff();
+#if UDPC_PLATFORM == UDPC_PLATFORM_LINUX
+    if(isRecvThreadRunning.load()) {
+        // the receive thread reads from the socket
+        return;
+    }
+#endif
+    std::lock_guard<std::mutex> recvLock(recvMutex);
+#ifdef UDPC_IO_URING_ENABLED
+    if(recvRing) {
+        receiveIOUring(now);
+        return;
+    }
+#endif
+#if UDPC_PLATFORM == UDPC_PLATFORM_LINUX
+    if(recvBatchDepth.load() > 1 || isGROEnabled.load()) {
+        receiveBatched(now);
+        return;
+    }
+#endif
+    if(recvBufsDepth != 1 || recvBufsSlotSize != UDPC_PACKET_MAX_SIZE) {
+        setupRecvBufs(1, UDPC_PACKET_MAX_SIZE);
+    }
+    do {
+        UDPC_IPV6_SOCKADDR_TYPE receivedData;
+        socklen_t receivedDataSize = sizeof(receivedData);
+        int bytes = recvfrom(
+            socketHandle,
+            recvBufs[0],
+            UDPC_PACKET_MAX_SIZE,
+            0,
+            (struct sockaddr*) &receivedData,
+            &receivedDataSize);
+
+#if UDPC_PLATFORM == UDPC_PLATFORM_WINDOWS
+        if(bytes == 0) {
+            // connection closed
+            break;
         } else if(bytes == SOCKET_ERROR) {
             int error = WSAGetLastError();
             if(error != WSAEWOULDBLOCK) {
@@ -1151,1373 +1331,3552 @@ void UDPC::Context::update_impl() {
         if(bytes == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
             // no packet was received
             break;
-        }
-#endif
-        else if(bytes < UDPC_MIN_HEADER_SIZE) {
-            // packet size is too small, invalid packet
-            UDPC_CHECK_LOG(this,
-                UDPC_LoggingType::UDPC_VERBOSE,
-                "Received packet is smaller than header, ignoring packet from ",
-                receivedData.sin6_addr,
-                ", port = ",
-                ntohs(receivedData.sin6_port));
+        } else if(bytes < 0) {
+            // an error (e.g. ECONNREFUSED for an earlier send), not a
+            // received datagram
             continue;
         }
+#endif
 
-        uint32_t temp;
-        std::memcpy(&temp, recvBuf, 4);
-        temp = ntohl(temp);
-        if(temp != protocolID) {
-            // Invalid protocol id in packet
-            UDPC_CHECK_LOG(this,
-                UDPC_LoggingType::UDPC_VERBOSE,
-                "Received packet has invalid protocol id, ignoring packet "
-                "from ",
-                receivedData.sin6_addr,
-                ", port = ",
-                ntohs(receivedData.sin6_port));
-            continue;
+        countReceived(1);
+        bool isAdopted = false;
+        receivePacket(recvBufs[0], bytes, receivedData, now,
+            BufferPool::isPooled(recvBufs[0]) ? &isAdopted : nullptr);
+        if(isAdopted) {
+            replaceRecvBuf(0);
         }
+    } while (true);
+}
 
-        std::memcpy(&temp, recvBuf + 4, 4);
-        uint32_t conID = ntohl(temp);
-        std::memcpy(&temp, recvBuf + 8, 4);
-        uint32_t seqID = ntohl(temp);
-        std::memcpy(&temp, recvBuf + 12, 4);
-        uint32_t rseq = ntohl(temp);
-        std::memcpy(&temp, recvBuf + 16, 4);
-        uint32_t ack = ntohl(temp);
-
-        bool isConnect = conID & UDPC_ID_CONNECT;
-        bool isPing = conID & UDPC_ID_PING;
-        bool isNotRecChecked = conID & UDPC_ID_NO_REC_CHK;
-        bool isResending = conID & UDPC_ID_RESENDING;
-        conID &= 0x0FFFFFFF;
-        UDPC_ConnectionId identifier =
-            UDPC_create_id_full(receivedData.sin6_addr,
-                                receivedData.sin6_scope_id,
-                                ntohs(receivedData.sin6_port));
-
-        if(isConnect && !isPing && bytes < (int)(UDPC_CON_HEADER_SIZE)) {
-            // invalid packet size
-            UDPC_CHECK_LOG(this,
-                UDPC_LoggingType::UDPC_VERBOSE,
-                "Got connect packet of invalid size from ",
-                receivedData.sin6_addr,
-                ", port = ",
-                ntohs(receivedData.sin6_port),
-                ", ignoring");
-            continue;
-        } else if ((!isConnect || (isConnect && isPing))
-                && bytes < (int)UDPC_NSFULL_HEADER_SIZE) {
-            // packet is too small
-            UDPC_CHECK_LOG(this,
-                UDPC_LoggingType::UDPC_VERBOSE,
-                "Got non-connect packet of invalid size from ",
-                receivedData.sin6_addr,
-                ", port = ",
-                ntohs(receivedData.sin6_port),
-                ", ignoring");
-            continue;
+void UDPC::Context::setupRecvBufs(unsigned int depth, unsigned int slotSize) {
+    freeRecvBufs();
+    for(unsigned int i = 0; i < depth; ++i) {
+        recvBufs.push_back(allocateRecvBuf(slotSize));
+        if(slotSize < UDPC_PACKET_MAX_SIZE) {
+            recvTails.push_back(
+                (char*)std::malloc(UDPC_PACKET_MAX_SIZE - slotSize));
         }
-
-        uint32_t pktType;
-        if(isConnect && !isPing) {
-            std::memcpy(&pktType, recvBuf + UDPC_MIN_HEADER_SIZE, 4);
-            pktType = ntohl(pktType);
-            switch(pktType) {
-            case 0: // client/server connect with libsodium disabled
-                break;
-            case 1: // client connect with libsodium enabled
-                break;
-            case 2: // server connect with libsodium enabled
-                break;
-            default:
-                UDPC_CHECK_LOG(this, UDPC_LoggingType::UDPC_WARNING,
-                    "Got invalid connect pktType from ",
-                    receivedData.sin6_addr,
-                    ", port ", ntohs(receivedData.sin6_port));
-                continue;
-            }
-        } else {
-            if(recvBuf[UDPC_MIN_HEADER_SIZE] == 0) {
-                // not signed
-                pktType = 0;
-            } else if(recvBuf[UDPC_MIN_HEADER_SIZE] == 1) {
-                // signed
-                pktType = 1;
-            } else {
-                UDPC_CHECK_LOG(this, UDPC_LoggingType::UDPC_WARNING,
-                    "Got invalid pktType from ",
-                    receivedData.sin6_addr,
-                    ", port ", ntohs(receivedData.sin6_port));
-                continue;
-            }
+    }
+    recvBufsDepth = depth;
+    recvBufsSlotSize = slotSize;
+#if UDPC_PLATFORM == UDPC_PLATFORM_LINUX
+    const std::size_t ctrlSize = CMSG_SPACE(sizeof(int));
+    recvMsgs.resize(depth);
+    recvIovs.resize(depth * 2);
+    recvAddrs.resize(depth);
+    recvCtrl.resize(depth * ctrlSize);
+    for(unsigned int i = 0; i < depth; ++i) {
+        recvIovs[i * 2].iov_base = recvBufs[i];
+        recvIovs[i * 2].iov_len = slotSize;
+        std::memset(&recvMsgs[i], 0, sizeof(struct mmsghdr));
+        recvMsgs[i].msg_hdr.msg_name = &recvAddrs[i];
+        recvMsgs[i].msg_hdr.msg_iov = &recvIovs[i * 2];
+        recvMsgs[i].msg_hdr.msg_iovlen = 1;
+        if(!recvTails.empty()) {
+            // the rest of a packet larger than the slot goes to its tail
+            recvIovs[i * 2 + 1].iov_base = recvTails[i];
+            recvIovs[i * 2 + 1].iov_len = UDPC_PACKET_MAX_SIZE - slotSize;
+            recvMsgs[i].msg_hdr.msg_iovlen = 2;
         }
-
-        if(isConnect && !isPing) {
-            // is connect packet and is accepting new connections
-            std::lock_guard<std::mutex> conMapLock(conMapMutex);
-            if(!flags.test(1)
-                    && conMap.find(identifier) == conMap.end()
-                    && isAcceptNewConnections.load()) {
-                // is receiving as server, connection did not already exist
-                int authPolicy = this->authPolicy.load();
-                if(pktType == 1 && !flags.test(2)
-                        && authPolicy
-                            == UDPC_AuthPolicy::UDPC_AUTH_POLICY_STRICT) {
-                    UDPC_CHECK_LOG(this, UDPC_LoggingType::UDPC_ERROR,
-                        "Client peer ",
-                        receivedData.sin6_addr,
-                        " port ",
-                        ntohs(receivedData.sin6_port),
-                        " attempted connection with packet authentication "
-                        "enabled, but auth is disabled and AuthPolicy is "
-                        "STRICT");
-                    continue;
-                } else if(pktType == 0 && flags.test(2)
-                        && authPolicy
-                            == UDPC_AuthPolicy::UDPC_AUTH_POLICY_STRICT) {
-                    UDPC_CHECK_LOG(this, UDPC_LoggingType::UDPC_ERROR,
-                        "Client peer ",
-                        receivedData.sin6_addr,
-                        " port ",
-                        ntohs(receivedData.sin6_port),
-                        " attempted connection with packet authentication "
-                        "disabled, but auth is enabled and AuthPolicy is "
-                        "STRICT");
-                    continue;
-                }
-                unsigned char *sk = nullptr;
-                unsigned char *pk = nullptr;
-                if(keysSet.load()) {
-                    sk = this->sk;
-                    pk = this->pk;
-                }
-                UDPC::ConnectionData newConnection(
-                    true,
-                    this,
-                    receivedData.sin6_addr,
-                    receivedData.sin6_scope_id,
-                    ntohs(receivedData.sin6_port),
-#ifdef UDPC_LIBSODIUM_ENABLED
-                    pktType == 1 && flags.test(2),
-                    sk, pk);
-#else
-                    false,
-                    sk, pk);
-#endif
-
-                if(newConnection.flags.test(5)) {
-                    UDPC_CHECK_LOG(this,
-                        UDPC_LoggingType::UDPC_ERROR,
-                        "Failed to init ConnectionData instance (libsodium init"
-                        " fail) while server establishing connection with ",
-                        receivedData.sin6_addr,
-                        ", port = ",
-                        ntohs(receivedData.sin6_port));
-                    continue;
-                }
-                if(pktType == 1 && flags.test(2)) {
-#ifdef UDPC_LIBSODIUM_ENABLED
-                    std::memcpy(
-                        newConnection.peer_pk,
-                        recvBuf + UDPC_MIN_HEADER_SIZE + 4,
-                        crypto_sign_PUBLICKEYBYTES);
-                    {
-                        std::shared_lock<std::shared_mutex>
-                            pkWhitelistLock(peerPKWhitelistMutex);
-                        if(!peerPKWhitelist.empty()
-                                && peerPKWhitelist.find(
-                                    UDPC::PKContainer(newConnection.peer_pk))
-                                        == peerPKWhitelist.end()) {
-                            UDPC_CHECK_LOG(this, UDPC_LoggingType::UDPC_WARNING,
-                                "peer_pk is not in whitelist, not establishing "
-                                "connection with client");
-                            continue;
-                        }
-                    }
-                    newConnection.verifyMessage =
-                        std::unique_ptr<char[]>(new char[crypto_sign_BYTES]);
-                    std::time_t currentTime = std::time(nullptr);
-                    uint64_t receivedTime;
-                    std::memcpy(
-                        &receivedTime,
-                        recvBuf + UDPC_MIN_HEADER_SIZE + 4
-                            + crypto_sign_PUBLICKEYBYTES + 4,
-                        8);
-                    UDPC::be64((char*)&receivedTime);
-# ifndef NDEBUG
-                    if(willLog(UDPC_LoggingType::UDPC_DEBUG)) {
-                        log_impl(UDPC_LoggingType::UDPC_DEBUG,
-                            "Server got verification epoch time \"",
-                            receivedTime, "\"");
-                    }
-# endif
-                    std::time_t receivedTimeT = receivedTime;
-                    if(currentTime < receivedTimeT
-                            || currentTime - receivedTimeT > 3) {
-                        UDPC_CHECK_LOG(this, UDPC_LoggingType::UDPC_WARNING,
-                            "Got invalid epoch time from client, ignoring");
-                        continue;
-                    }
-                    crypto_sign_detached(
-                        (unsigned char*)newConnection.verifyMessage.get(),
-                        nullptr,
-                        (unsigned char*)(recvBuf + UDPC_MIN_HEADER_SIZE + 4
-                            + crypto_sign_PUBLICKEYBYTES),
-                        12,
-                        newConnection.sk);
-#else
-                    assert(!"libsodium disabled, invalid state");
-                    UDPC_CHECK_LOG(this, UDPC_LoggingType::UDPC_ERROR,
-                        "libsodium is disabled, cannot process received "
-                        "packet");
-                    continue;
-#endif
-                }
-                UDPC_CHECK_LOG(this,
-                    UDPC_LoggingType::UDPC_INFO,
-                    "Establishing connection with client ",
-                    receivedData.sin6_addr,
-                    ", port = ",
-                    ntohs(receivedData.sin6_port),
-                    ", giving client id = ", newConnection.id,
-                    pktType == 1 && flags.test(2) ?
-                        ", libsodium enabled" : ", libsodium disabled");
-
-                idMap.insert(std::make_pair(newConnection.id, identifier));
-                conMap.insert(std::make_pair(identifier,
-                                             std::move(newConnection)));
-                auto addrConIter = addrConMap.find(identifier.addr);
-                if(addrConIter == addrConMap.end()) {
-                    auto insertResult = addrConMap.insert(
-                        std::make_pair(
-                            identifier.addr,
-                            std::unordered_set<UDPC_ConnectionId,
-                                               UDPC::ConnectionIdHasher>{}
-                        ));
-                    assert(insertResult.second
-                            && "Must successfully insert into addrConMap");
-                    addrConIter = insertResult.first;
-                }
-                addrConIter->second.insert(identifier);
-                if(isReceivingEvents.load()) {
-                    externalEvents.push_back(UDPC_Event{
-                        UDPC_ET_CONNECTED,
-                        identifier,
-                        false});
-                }
-            } else if (flags.test(1)) {
-                // is client
-                auto iter = conMap.find(identifier);
-                if(iter == conMap.end() || !iter->second.flags.test(3)) {
-                    UDPC_CHECK_LOG(this, UDPC_LoggingType::UDPC_DEBUG,
-                        "client dropped pkt from ",
-                        receivedData.sin6_addr,
-                        ", port ", ntohs(receivedData.sin6_port));
-                    continue;
-                }
-                int authPolicy = this->authPolicy.load();
-                if(pktType == 2 && !iter->second.flags.test(6)
-                        && authPolicy
-                            == UDPC_AuthPolicy::UDPC_AUTH_POLICY_STRICT) {
-                    // This block actually should never happen, because the
-                    // server receives a packet first. If client requests
-                    // without auth, then the server will either deny
-                    // connection (if strict) or fallback to a connection
-                    // without auth (if fallback).
-                    UDPC_CHECK_LOG(this, UDPC_LoggingType::UDPC_ERROR,
-                        "Server peer ",
-                        receivedData.sin6_addr,
-                        " port ",
-                        ntohs(receivedData.sin6_port),
-                        " attempted connection with packet authentication "
-                        "enabled, but auth is disabled and AuthPolicy is "
-                        "STRICT");
-                    continue;
-                } else if(pktType == 0 && iter->second.flags.test(6)
-                        && authPolicy
-                            == UDPC_AuthPolicy::UDPC_AUTH_POLICY_STRICT) {
-                    UDPC_CHECK_LOG(this, UDPC_LoggingType::UDPC_ERROR,
-                        "Server peer ",
-                        receivedData.sin6_addr,
-                        " port ",
-                        ntohs(receivedData.sin6_port),
-                        " attempted connection with packet authentication "
-                        "disabled, but auth is enabled and AuthPolicy is "
-                        "STRICT");
-                    continue;
-                }
-
-                if(pktType == 2 && flags.test(2)
-                        && iter->second.flags.test(6)) {
-#ifdef UDPC_LIBSODIUM_ENABLED
-                    std::memcpy(iter->second.peer_pk,
-                        recvBuf + UDPC_MIN_HEADER_SIZE + 4,
-                        crypto_sign_PUBLICKEYBYTES);
-                    {
-                        std::shared_lock<std::shared_mutex>
-                            pkWhitelistLock(peerPKWhitelistMutex);
-                        if(!peerPKWhitelist.empty()
-                                && peerPKWhitelist.find(
-                                    UDPC::PKContainer(iter->second.peer_pk))
-                                        == peerPKWhitelist.end()) {
-                            UDPC_CHECK_LOG(this, UDPC_LoggingType::UDPC_WARNING,
-                                "peer_pk is not in whitelist, not establishing "
-                                "connection with server");
-                            continue;
-                        }
-                    }
-                    if(crypto_sign_verify_detached(
-                        (unsigned char*)(recvBuf + UDPC_MIN_HEADER_SIZE + 4
-                            + crypto_sign_PUBLICKEYBYTES),
-                        (unsigned char*)(iter->second.verifyMessage.get()),
-                        12,
-                        iter->second.peer_pk) != 0) {
-                        UDPC_CHECK_LOG(this, UDPC_LoggingType::UDPC_WARNING,
-                            "Failed to verify peer (server) ",
-                            receivedData.sin6_addr,
-                            ", port = ",
-                            ntohs(receivedData.sin6_port));
-                        continue;
-                    }
-#else
-                    assert(!"libsodium disabled, invalid state");
-                    UDPC_CHECK_LOG(this, UDPC_LoggingType::UDPC_ERROR,
-                        "libsodium is disabled, cannot process received "
-                        "packet");
-                    continue;
+    }
 #endif
-                } else if(pktType == 0 && iter->second.flags.test(6)) {
-                    iter->second.flags.reset(6);
-                    if(iter->second.flags.test(7)) {
-                        UDPC_CHECK_LOG(this, UDPC_LoggingType::UDPC_WARNING,
-                            "peer is not using libsodium, but peer_pk was "
-                            "pre-set, dropping to no-verification mode");
-                    }
-                }
+}
 
-                iter->second.flags.reset(3);
-                iter->second.id = conID;
-                iter->second.flags.set(4);
-                UDPC_CHECK_LOG(this, UDPC_LoggingType::UDPC_INFO,
-                    "Established connection with server ",
-                    receivedData.sin6_addr,
-                    ", port = ",
-                    ntohs(receivedData.sin6_port),
-                    ", got id = ", conID,
-                    flags.test(2) && iter->second.flags.test(6) ?
-                        ", libsodium enabled" : ", libsodium disabled");
-                if(isReceivingEvents.load()) {
-                    externalEvents.push_back(UDPC_Event{
-                        UDPC_ET_CONNECTED,
-                        identifier,
-                        false});
-                }
-            }
-            continue;
-        }
+void UDPC::Context::freeRecvBufs() {
+    for(char *buf : recvBufs) {
+        BufferPool::deallocate(buf);
+    }
+    recvBufs.clear();
+    for(char *tail : recvTails) {
+        std::free(tail);
+    }
+    recvTails.clear();
+}
 
-        std::lock_guard<std::mutex> conMapLock(conMapMutex);
-        auto iter = conMap.find(identifier);
-        if(iter == conMap.end() || iter->second.flags.test(3)
-                || !iter->second.flags.test(4) || iter->second.id != conID) {
-            continue;
-        } else if(isPing && !isConnect) {
-            iter->second.flags.set(0);
-        }
+char *UDPC::Context::allocateRecvBuf(unsigned int slotSize) {
+    if(slotSize == BufferPool::RECEIVE_SIZE) {
+        return bufferPool->allocateReceive();
+    }
+    // GRO buffers are larger than any size class, not worth pooling
+    return slotSize <= UDPC_PACKET_MAX_SIZE
+        ? bufferPool->allocate(slotSize)
+        : (char*)std::malloc(slotSize);
+}
 
-        if(pktType == 1) {
-#ifdef UDPC_LIBSODIUM_ENABLED
-            // verify signature of header
-            unsigned char sig[crypto_sign_BYTES];
-            std::memcpy(sig,
-                        recvBuf + UDPC_MIN_HEADER_SIZE + 1,
-                        crypto_sign_BYTES);
-            std::memset(recvBuf + UDPC_MIN_HEADER_SIZE + 1,
-                        0,
-                        crypto_sign_BYTES);
-            if(crypto_sign_verify_detached(
-                sig,
-                (unsigned char*)recvBuf,
-                bytes,
-                iter->second.peer_pk) != 0) {
-                UDPC_CHECK_LOG(
-                    this,
-                    UDPC_LoggingType::UDPC_INFO,
-                    "Failed to verify received packet from",
-                    receivedData.sin6_addr,
-                    ", port = ",
-                    ntohs(receivedData.sin6_port),
-                    ", ignoring");
-                continue;
-            }
-#else
-            assert(!"libsodium disabled, invalid state");
-            UDPC_CHECK_LOG(this, UDPC_LoggingType::UDPC_ERROR,
-                "libsodium is disabled, cannot process received packet");
-            continue;
+void UDPC::Context::replaceRecvBuf(unsigned int index) {
+    // the old buffer is now owned by a received packet
+    recvBufs[index] = allocateRecvBuf(recvBufsSlotSize);
+#if UDPC_PLATFORM == UDPC_PLATFORM_LINUX
+    recvIovs[index * 2].iov_base = recvBufs[index];
 #endif
-        }
+}
 
-        // packet is valid
-        UDPC_CHECK_LOG(this,
-            UDPC_LoggingType::UDPC_VERBOSE,
-            "Received valid packet from ",
-            receivedData.sin6_addr,
-            ", port = ",
-            ntohs(receivedData.sin6_port),
-            ", packet id = ", seqID,
-            ", good mode = ", iter->second.flags.test(1) ? "yes" : "no",
-            isPing && !isConnect ? ", ping"
-                : (isPing && isConnect ? ", disc" : ""));
-
-        // check if is delete
-        if(isConnect && isPing) {
-            auto conIter = conMap.find(identifier);
-            if(conIter != conMap.end()) {
-                UDPC_CHECK_LOG(this,
-                    UDPC_LoggingType::UDPC_VERBOSE,
-                    "Packet is request-disconnect packet, deleting "
-                    "connection...");
-                if(conIter->second.flags.test(4)) {
-                    idMap.erase(conIter->second.id);
-                }
-                auto addrConIter = addrConMap.find(identifier.addr);
-                if(addrConIter != addrConMap.end()) {
-                    addrConIter->second.erase(identifier);
-                    if(addrConIter->second.empty()) {
-                        addrConMap.erase(addrConIter);
-                    }
-                }
-                if(isReceivingEvents.load()) {
-                    externalEvents.push_back(UDPC_Event{
-                        UDPC_ET_DISCONNECTED, identifier, false});
-                }
-                conMap.erase(conIter);
-                continue;
+void UDPC::Context::countReceived(unsigned int datagrams) {
+    // only written while holding recvMutex, so load then store is fine
+    recvStatCalls.fetch_add(1, std::memory_order_relaxed);
+    recvStatDatagrams.fetch_add(datagrams, std::memory_order_relaxed);
+    if(datagrams > recvStatMaxPerCall.load(std::memory_order_relaxed)) {
+        recvStatMaxPerCall.store(datagrams, std::memory_order_relaxed);
+    }
+}
+
+#if UDPC_PLATFORM == UDPC_PLATFORM_LINUX
+void UDPC::Context::receiveBatched(
+        const std::chrono::steady_clock::time_point &now,
+        bool isHandingOff) {
+    const unsigned int depth = recvBatchDepth.load();
+    const bool isGRO = isGROEnabled.load();
+    const unsigned int slotSize =
+        isGRO ? UDPC_GRO_BUFFER_SIZE : (unsigned int)BufferPool::RECEIVE_SIZE;
+    if(depth != recvBufsDepth || slotSize != recvBufsSlotSize) {
+        setupRecvBufs(depth, slotSize);
+    }
+    const std::size_t ctrlSize = CMSG_SPACE(sizeof(int));
+
+    while(true) {
+        // kernel overwrites msg_namelen and msg_controllen on receive
+        for(unsigned int i = 0; i < depth; ++i) {
+            recvMsgs[i].msg_hdr.msg_namelen = sizeof(UDPC_IPV6_SOCKADDR_TYPE);
+            if(isGRO) {
+                recvMsgs[i].msg_hdr.msg_control = recvCtrl.data() + i * ctrlSize;
+                recvMsgs[i].msg_hdr.msg_controllen = ctrlSize;
+            } else {
+                recvMsgs[i].msg_hdr.msg_control = nullptr;
+                recvMsgs[i].msg_hdr.msg_controllen = 0;
             }
         }
-
-        // update rtt
-        for(auto sentIter = iter->second.sentPkts.rbegin();
-                sentIter != iter->second.sentPkts.rend();
-                ++sentIter) {
-            uint32_t id;
-            std::memcpy(&id, sentIter->data + 8, 4);
-            id = ntohl(id);
-            if(id == rseq) {
-                auto sentInfoIter = iter->second.sentInfoMap.find(id);
-                assert(sentInfoIter != iter->second.sentInfoMap.end()
-                        && "sentInfoMap should have known stored id");
-                auto diff = now - sentInfoIter->second->sentTime;
-                if(diff > iter->second.rtt) {
-                    iter->second.rtt += (diff - iter->second.rtt) / 10;
-                } else {
-                    iter->second.rtt -= (iter->second.rtt - diff) / 10;
-                }
-
-                iter->second.flags.set(
-                    2, iter->second.rtt <= UDPC::GOOD_RTT_LIMIT);
-
-                UDPC_CHECK_LOG(this,
-                    UDPC_LoggingType::UDPC_VERBOSE,
-                    "RTT: ",
-                    UDPC::durationToFSec(iter->second.rtt) * 1000.0f,
-                    " milliseconds");
+        int count = recvmmsg(socketHandle, recvMsgs.data(), depth, 0, nullptr);
+        if(count == -1) {
+            if(errno == EAGAIN || errno == EWOULDBLOCK) {
+                // no packet was received
                 break;
             }
+            UDPC_CHECK_LOG(this, UDPC_LoggingType::UDPC_VERBOSE,
+                "Error receiving packets, ", errno);
+            continue;
         }
 
-        iter->second.received = now;
-
-        // check pkt timeout
-        --rseq;
-        for(; ack != 0; ack = ack << 1) {
-            if((ack & 0x80000000) != 0) {
-                --rseq;
-                continue;
+        unsigned int datagrams = 0;
+        for(int i = 0; i < count; ++i) {
+            char *buf = recvBufs[i];
+            unsigned int bytes = recvMsgs[i].msg_len;
+            char *joined = nullptr;
+            if(bytes > slotSize) {
+                // continued into the slot's tail, only packets that fit the
+                // slot are received without copying them
+                joined = bufferPool->allocate(bytes);
+                std::memcpy(joined, buf, slotSize);
+                std::memcpy(joined + slotSize, recvTails[i], bytes - slotSize);
+                buf = joined;
             }
-
-            // pkt not received yet, find it in sent to check if it timed out
-            for(auto sentIter = iter->second.sentPkts.rbegin();
-                    sentIter != iter->second.sentPkts.rend();
-                    ++sentIter) {
-                uint32_t sentID;
-                std::memcpy(&sentID, sentIter->data + 8, 4);
-                sentID = ntohl(sentID);
-                if(sentID == rseq) {
-                    if((sentIter->flags & 0x4) != 0
-                            || (sentIter->flags & 0x8) != 0) {
-                        // already resent or not rec-checked pkt
-                        break;
-                    }
-                    auto sentInfoIter = iter->second.sentInfoMap.find(sentID);
-                    assert(sentInfoIter != iter->second.sentInfoMap.end()
-                            && "Every entry in sentPkts must have a "
-                            "corresponding entry in sentInfoMap");
-                    auto duration = now - sentInfoIter->second->sentTime;
-                    if(duration > UDPC::PACKET_TIMEOUT_TIME) {
-                        bool pktSigned =
-                            sentIter->data[UDPC_MIN_HEADER_SIZE] == 1;
-                        if((pktSigned
-                                && sentIter->dataSize
-                                    <= UDPC_LSFULL_HEADER_SIZE
-                                ) ||
-                                    (!pktSigned
-                                    && sentIter->dataSize
-                                        <= UDPC_NSFULL_HEADER_SIZE)) {
-                            UDPC_CHECK_LOG(this,
-                                UDPC_LoggingType::UDPC_VERBOSE,
-                                "Timed out packet has no payload (probably "
-                                "heartbeat packet), ignoring it");
-                            sentIter->flags |= 0x8;
-                            break;
+            // a coalesced buffer holds several datagrams and cannot be adopted
+            // by one of them, GRO buffers are not pooled anyway
+            bool isAdopted = false;
+            bool *adopted = !isGRO && BufferPool::isPooled(buf)
+                ? &isAdopted : nullptr;
+
+            // a GRO coalesced buffer holds datagrams of segmentSize bytes
+            // back to back, where only the last one may be shorter
+            unsigned int segmentSize = bytes;
+            if(isGRO) {
+                for(struct cmsghdr *cmsg = CMSG_FIRSTHDR(&recvMsgs[i].msg_hdr);
+                        cmsg != nullptr;
+                        cmsg = CMSG_NXTHDR(&recvMsgs[i].msg_hdr, cmsg)) {
+                    if(cmsg->cmsg_level == SOL_UDP
+                            && cmsg->cmsg_type == UDP_GRO) {
+                        int gsoSize;
+                        std::memcpy(&gsoSize, CMSG_DATA(cmsg), sizeof(int));
+                        if(gsoSize > 0 && (unsigned int)gsoSize < bytes) {
+                            segmentSize = gsoSize;
                         }
-
-                        UDPC_PacketInfo resendingData = UDPC::get_empty_pinfo();
-                        if(pktSigned) {
-                            resendingData.dataSize =
-                                sentIter->dataSize - UDPC_LSFULL_HEADER_SIZE;
-                            resendingData.data =
-                                (char*)std::malloc(resendingData.dataSize);
-                            std::memcpy(resendingData.data,
-                                sentIter->data + UDPC_LSFULL_HEADER_SIZE,
-                                resendingData.dataSize);
-                        } else {
-                            resendingData.dataSize =
-                                sentIter->dataSize - UDPC_NSFULL_HEADER_SIZE;
-                            resendingData.data =
-                                (char*)std::malloc(resendingData.dataSize);
-                            std::memcpy(resendingData.data,
-                                sentIter->data + UDPC_NSFULL_HEADER_SIZE,
-                                resendingData.dataSize);
-                        }
-                        resendingData.flags = 0;
-                        iter->second.priorityPkts.push_back(resendingData);
+                        break;
                     }
-                    break;
+                }
+                if(segmentSize < bytes) {
+                    recvStatCoalesced.fetch_add(1, std::memory_order_relaxed);
                 }
             }
 
-            --rseq;
-        }
-
-        // calculate sequence and ack
-        bool isOutOfOrder = false;
-        uint32_t diff = 0;
-        if(seqID > iter->second.rseq) {
-            diff = seqID - iter->second.rseq;
-            if(diff <= 0x7FFFFFFF) {
-                // sequence is more recent
-                iter->second.rseq = seqID;
-                iter->second.ack = (iter->second.ack >> diff) | 0x80000000;
-            } else {
-                // sequence is older, recalc diff
-                diff = 0xFFFFFFFF - seqID + 1 + iter->second.rseq;
-                if((iter->second.ack & (0x80000000 >> (diff - 1))) != 0) {
-                    // already received packet
+            while(bytes > 0) {
+                unsigned int size = bytes < segmentSize ? bytes : segmentSize;
+                ++datagrams;
+                if(size > UDPC_PACKET_MAX_SIZE) {
                     UDPC_CHECK_LOG(this,
                         UDPC_LoggingType::UDPC_VERBOSE,
-                        "Received packet is already marked as received, "
-                        "ignoring it");
-                    continue;
+                        "Received packet is too large, ignoring packet from ",
+                        recvAddrs[i].sin6_addr,
+                        ", port = ",
+                        ntohs(recvAddrs[i].sin6_port));
+                } else if(isHandingOff) {
+                    handOff(buf, size, recvAddrs[i], now, adopted);
+                } else {
+                    receivePacket(buf, size, recvAddrs[i], now, adopted);
                 }
-                iter->second.ack |= 0x80000000 >> (diff - 1);
-                isOutOfOrder = true;
-            }
-        } else if(seqID < iter->second.rseq) {
-            diff = iter->second.rseq - seqID;
-            if(diff <= 0x7FFFFFFF) {
-                // sequence is older
-                if((iter->second.ack & (0x80000000 >> (diff - 1))) != 0) {
-                    // already received packet
-                    UDPC_CHECK_LOG(this,
-                        UDPC_LoggingType::UDPC_VERBOSE,
-                        "Received packet is already marked as received, "
-                        "ignoring it");
-                    continue;
+                buf += size;
+                bytes -= size;
+            }
+            if(joined) {
+                if(!isAdopted) {
+                    BufferPool::deallocate(joined);
                 }
-                iter->second.ack |= 0x80000000 >> (diff - 1);
-                isOutOfOrder = true;
-            } else {
-                // sequence is more recent, recalc diff
-                diff = 0xFFFFFFFF - iter->second.rseq + 1 + seqID;
-                iter->second.rseq = seqID;
-                iter->second.ack = (iter->second.ack >> diff) | 0x80000000;
+            } else if(isAdopted) {
+                replaceRecvBuf(i);
             }
-        } else {
-            // already received packet
-            UDPC_CHECK_LOG(this,
-                UDPC_LoggingType::UDPC_VERBOSE,
-                "Received packet is already marked as received, ignoring it");
-            continue;
         }
+        countReceived(datagrams);
 
-        if(isOutOfOrder) {
-            UDPC_CHECK_LOG(this,
-                UDPC_LoggingType::UDPC_INFO,
-                "Received packet is out of order");
-        }
-
-        if(pktType == 0 && bytes > (int)UDPC_NSFULL_HEADER_SIZE) {
-            UDPC_PacketInfo recPktInfo = UDPC::get_empty_pinfo();
-            recPktInfo.dataSize = bytes - UDPC_NSFULL_HEADER_SIZE;
-            recPktInfo.data = (char*)std::malloc(recPktInfo.dataSize);
-            std::memcpy(recPktInfo.data,
-                        recvBuf + UDPC_NSFULL_HEADER_SIZE,
-                        recPktInfo.dataSize);
-            recPktInfo.flags =
-                (isConnect ? 0x1 : 0)
-                | (isPing ? 0x2 : 0)
-                | (isNotRecChecked ? 0x4 : 0)
-                | (isResending ? 0x8 : 0);
-            recPktInfo.sender.addr = receivedData.sin6_addr;
-            recPktInfo.receiver.addr = in6addr_loopback;
-            recPktInfo.sender.port = ntohs(receivedData.sin6_port);
-            recPktInfo.receiver.port = ntohs(socketInfo.sin6_port);
-            recPktInfo.rtt = durationToMS(iter->second.rtt);
-            recPktInfo.id = seqID;
-
-            receivedPkts.push_back(recPktInfo);
-        } else if(pktType == 1 && bytes > (int)UDPC_LSFULL_HEADER_SIZE) {
-            UDPC_PacketInfo recPktInfo = UDPC::get_empty_pinfo();
-            recPktInfo.dataSize = bytes - UDPC_LSFULL_HEADER_SIZE;
-            recPktInfo.data = (char*)std::malloc(recPktInfo.dataSize);
-            std::memcpy(recPktInfo.data,
-                        recvBuf + UDPC_LSFULL_HEADER_SIZE,
-                        recPktInfo.dataSize);
-            recPktInfo.flags =
-                (isConnect ? 0x1 : 0)
-                | (isPing ? 0x2 : 0)
-                | (isNotRecChecked ? 0x4 : 0)
-                | (isResending ? 0x8 : 0);
-            recPktInfo.sender.addr = receivedData.sin6_addr;
-            recPktInfo.receiver.addr = in6addr_loopback;
-            recPktInfo.sender.port = ntohs(receivedData.sin6_port);
-            recPktInfo.receiver.port = ntohs(socketInfo.sin6_port);
-            recPktInfo.rtt = durationToMS(iter->second.rtt);
-            recPktInfo.id = seqID;
-
-            receivedPkts.push_back(recPktInfo);
-        } else {
-            UDPC_CHECK_LOG(this,
-                UDPC_LoggingType::UDPC_VERBOSE,
-                "Received packet has no payload (probably heartbeat packet)");
+        if((unsigned int)count < depth) {
+            // socket has been drained
+            break;
         }
-    } while (true);
+    }
 }
+#endif
 
-UDPC::PktInfoWrapper::PktInfoWrapper() : pinfo(UDPC::get_empty_pinfo()) {
+#if UDPC_PLATFORM == UDPC_PLATFORM_LINUX
+bool UDPC::Context::startReceiveThread() {
+    recvThreadWakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(recvThreadWakeFd < 0) {
+        UDPC_CHECK_LOG(this, UDPC_LoggingType::UDPC_ERROR,
+            "Failed to start receive thread, errno ", errno);
+        return false;
+    }
+    isRecvThreadRunning.store(true);
+    // update no longer reads from the socket, it is woken on handoff instead
+    setPollTarget(socketHandle, -1);
+    recvThread = std::thread(&Context::receiveThreaded, this);
+    return true;
 }
 
-UDPC::PktInfoWrapper::PktInfoWrapper(UDPC_PacketInfo pinfo) : pinfo(pinfo) {
+void UDPC::Context::stopReceiveThread() {
+    if(!recvThread.joinable()) {
+        return;
+    }
+    isRecvThreadRunning.store(false);
+    eventfd_write(recvThreadWakeFd, 1);
+    recvThread.join();
+    close(recvThreadWakeFd);
+    recvThreadWakeFd = -1;
+    setPollTarget(-1, socketHandle);
 }
 
-UDPC::PktInfoWrapper::~PktInfoWrapper() {
-    if (pinfo.data) {
-        std::free(pinfo.data);
+void UDPC::Context::receiveThreaded() {
+    struct pollfd fds[2];
+    fds[0].fd = socketHandle;
+    fds[0].events = POLLIN;
+    fds[1].fd = recvThreadWakeFd;
+    fds[1].events = POLLIN;
+    while(isRecvThreadRunning.load()) {
+        if(poll(fds, 2, -1) < 0 && errno != EINTR) {
+            UDPC_CHECK_LOG(this, UDPC_LoggingType::UDPC_ERROR,
+                "Receive thread failed to poll socket, errno ", errno);
+            std::this_thread::sleep_for(
+                std::chrono::milliseconds(UDPC_UPDATE_MS_MIN));
+            continue;
+        }
+        {
+            std::lock_guard<std::mutex> recvLock(recvMutex);
+            receiveBatched(std::chrono::steady_clock::now(), true);
+        }
+        if(!recvHandoff.empty()) {
+            wake();
+        }
     }
 }
+#endif
 
-UDPC::PktInfoWrapper::PktInfoWrapper(const PktInfoWrapper &other) : pinfo(other.pinfo) {
-    if (pinfo.dataSize > 0) {
-        pinfo.data = static_cast<char*>(std::malloc(pinfo.dataSize));
-        std::memcpy(pinfo.data, other.pinfo.data, pinfo.dataSize);
-    } else {
-        pinfo.data = nullptr;
+void UDPC::Context::handOff(
+        char *buf,
+        unsigned int size,
+        const UDPC_IPV6_SOCKADDR_TYPE &sender,
+        const std::chrono::steady_clock::time_point &now,
+        bool *isAdopted) {
+    // invalid datagrams are dropped here to not take up space in the handoff
+    if(!isValidHeader(buf, size, sender)) {
+        return;
     }
-}
 
-UDPC::PktInfoWrapper& UDPC::PktInfoWrapper::operator=(const PktInfoWrapper &other) {
-    pinfo = other.pinfo;
-    if (pinfo.dataSize > 0) {
-        pinfo.data = static_cast<char*>(std::malloc(pinfo.dataSize));
-        std::memcpy(pinfo.data, other.pinfo.data, pinfo.dataSize);
+    // a datagram that may be adopted by its received packet is passed on in
+    // the receive buffer, so its payload is not copied at all
+    const bool isAdopting = isAdopted
+        && size >= UDPC_MIN_HEADER_SIZE + UDPC_RECV_ADOPT_MIN_SIZE;
+    ReceivedDatagram datagram{};
+    if(isAdopting) {
+        datagram.data = buf;
     } else {
-        pinfo.data = nullptr;
+        datagram.data = bufferPool->allocate(size);
+        std::memcpy(datagram.data, buf, size);
+    }
+    datagram.size = size;
+    datagram.sender = sender;
+    datagram.received = now;
+    if(!recvHandoff.push_back(std::move(datagram))) {
+        if(!isAdopting) {
+            BufferPool::deallocate(datagram.data);
+        }
+        recvStatHandoffDropped.fetch_add(1, std::memory_order_relaxed);
+    } else if(isAdopting) {
+        *isAdopted = true;
     }
-
-    return *this;
-}
-
-UDPC::PktInfoWrapper::PktInfoWrapper(PktInfoWrapper &&other) : pinfo(std::move(other.pinfo)) {
-    other.pinfo.data = nullptr;
 }
 
-UDPC::PktInfoWrapper& UDPC::PktInfoWrapper::operator=(PktInfoWrapper &&other) {
-    pinfo = std::move(other.pinfo);
-    other.pinfo.data = nullptr;
-
-    return *this;
+void UDPC::Context::receiveHandedOff() {
+    // only what was handed off so far, so a busy receive thread cannot keep
+    // update here
+    unsigned long count = recvHandoff.size();
+    ReceivedDatagram datagram{};
+    while(count-- > 0 && recvHandoff.pop_front(datagram)) {
+        bool isAdopted = false;
+        receivePacket(
+            datagram.data, datagram.size, datagram.sender, datagram.received,
+            BufferPool::isPooled(datagram.data) ? &isAdopted : nullptr);
+        if(!isAdopted) {
+            BufferPool::deallocate(datagram.data);
+        }
+    }
 }
 
-UDPC::Context *UDPC::verifyContext(UDPC_HContext ctx) {
-    if(ctx == nullptr) {
-        return nullptr;
+bool UDPC::Context::isValidHeader(
+        const char *buf,
+        int bytes,
+        const UDPC_IPV6_SOCKADDR_TYPE &sender) {
+    if(bytes < UDPC_MIN_HEADER_SIZE) {
+        // packet size is too small, invalid packet
+        UDPC_CHECK_LOG(this,
+            UDPC_LoggingType::UDPC_VERBOSE,
+            "Received packet is smaller than header, ignoring packet from ",
+            sender.sin6_addr,
+            ", port = ",
+            ntohs(sender.sin6_port));
+        return false;
     }
-    UDPC::Context *c = (UDPC::Context *)ctx;
-    if(c->_contextIdentifier == UDPC_CONTEXT_IDENTIFIER) {
-        return c;
-    } else {
-        return nullptr;
+
+    uint32_t temp;
+    std::memcpy(&temp, buf, 4);
+    temp = ntohl(temp);
+    if(temp != protocolID) {
+        // Invalid protocol id in packet
+        UDPC_CHECK_LOG(this,
+            UDPC_LoggingType::UDPC_VERBOSE,
+            "Received packet has invalid protocol id, ignoring packet "
+            "from ",
+            sender.sin6_addr,
+            ", port = ",
+            ntohs(sender.sin6_port));
+        return false;
     }
+    return true;
 }
 
-bool UDPC::isBigEndian() {
-    /*
-     * 0 - unset
-     * 1 - is big endian
-     * 2 - is not big endian
-     */
-    static char isBigEndian = 0;
-    if(isBigEndian != 0) {
-        return isBigEndian == 1;
+void UDPC::Context::pushEvent(const UDPC_Event &event) {
+    if(!externalEvents.push_back(event)) {
+        UDPC_CHECK_LOG(this, UDPC_LoggingType::UDPC_WARNING,
+            "Event queue is full, dropping event of type ", event.type);
     }
-    union {
-        uint32_t i;
-        char c[4];
-    } bint = {0x01020304};
+}
 
-    isBigEndian = (bint.c[0] == 1 ? 1 : 2);
-    return isBigEndian == 1;
+void UDPC::Context::pushEvent(
+        UDPC_EventType type,
+        ConnectionTable<ConnectionData>::const_iterator iter) {
+    pushEvent(UDPC_Event{type, iter->first, false, handleOf(iter)});
 }
 
-void UDPC::be64(char *integer) {
-    if(UDPC::isBigEndian()) {
+void UDPC::Context::pushSend(PktInfoWrapper &wrapper) {
+    const UDPC_ConnectionId destinationId = wrapper.pinfo.receiver;
+    if(reserveSends(1) == 0 || !cSendPkts.push_back(std::move(wrapper))) {
+        UDPC_CHECK_LOG(this, UDPC_LoggingType::UDPC_WARNING,
+            "Send queue is full, dropping packet to ",
+            destinationId.addr,
+            ", port = ",
+            destinationId.port);
         return;
     }
-    char conv[8];
-    for(unsigned int i = 0; i < 8; ++i) {
-        conv[i] = integer[7 - i];
-    }
-    std::memcpy(integer, conv, 8);
+    wake();
 }
 
-void UDPC::be64_copy(char *out, const char *in) {
-    if(UDPC::isBigEndian()) {
-        return;
+std::size_t UDPC::Context::pushSends(
+        PktInfoWrapper *wrappers, std::size_t count) {
+    const std::size_t pushed = cSendPkts.push_back_n(
+        wrappers, reserveSends(count));
+    if(pushed < count) {
+        UDPC_CHECK_LOG(this, UDPC_LoggingType::UDPC_WARNING,
+            "Send queue is full, dropping ",
+            count - pushed,
+            " of ",
+            count,
+            " batched packets");
     }
-    for(unsigned int i = 0; i < 8; ++i) {
-        out[i] = in[7 - i];
+    if(pushed > 0) {
+        wake();
     }
+    return pushed;
 }
 
-void UDPC::preparePacket(
-        char *data, uint32_t protocolID, uint32_t conID, uint32_t rseq,
-        uint32_t ack, uint32_t *seqID, int flags) {
-    uint32_t temp;
+std::size_t UDPC::Context::reserveSends(std::size_t count) {
+    // Other producers may see the room taken here until it is given back
+    // below, which can only make them reserve less.
+    const unsigned long queued = cSendQueuedSize.fetch_add(count);
+    const std::size_t room = queued < UDPC_SEND_QUEUE_CAPACITY
+        ? UDPC_SEND_QUEUE_CAPACITY - queued : 0;
+    if(room < count) {
+        cSendQueuedSize.fetch_sub(count - room);
+        return room;
+    }
+    return count;
+}
 
-    temp = htonl(protocolID);
-    std::memcpy(data, &temp, 4);
-    temp = htonl(conID | ((flags & 0x1) != 0 ? UDPC_ID_CONNECT : 0) |
-                 ((flags & 0x2) != 0 ? UDPC_ID_PING : 0) |
-                 ((flags & 0x4) != 0 ? UDPC_ID_NO_REC_CHK : 0) |
-                 ((flags & 0x8) != 0 ? UDPC_ID_RESENDING : 0));
-    std::memcpy(data + 4, &temp, 4);
+void UDPC::Context::pushReceived(UDPC_PacketInfo &pinfo) {
+    if(!receivedPkts.push_back(pinfo)) {
+        UDPC_CHECK_LOG(this, UDPC_LoggingType::UDPC_WARNING,
+            "Received packet queue is full, dropping packet from ",
+            pinfo.sender.addr,
+            ", port = ",
+            pinfo.sender.port);
+        BufferPool::deallocate(pinfo.data);
+        pinfo.data = nullptr;
+    }
+}
 
-    if(seqID) {
-        temp = htonl(*seqID);
-        ++(*seqID);
+#if UDPC_PLATFORM == UDPC_PLATFORM_LINUX
+void UDPC::Context::sendFailed(const struct msghdr &msg, int error) {
+    if(msg.msg_control
+            && (error == EIO || error == EINVAL || error == ENOPROTOOPT)) {
+        // device or kernel cannot segment, send datagrams one by one
+        UDPC_CHECK_LOG(this,
+            UDPC_LoggingType::UDPC_WARNING,
+            "UDP GSO send failed, disabling GSO, errno ",
+            error);
+        isGSOEnabled.store(false);
+        sendSegmented(msg);
     } else {
-        temp = 0;
+        const UDPC_IPV6_SOCKADDR_TYPE *dest =
+            (const UDPC_IPV6_SOCKADDR_TYPE*)msg.msg_name;
+        UDPC_CHECK_LOG(this,
+            UDPC_LoggingType::UDPC_ERROR,
+            "Failed to send packet to ",
+            dest->sin6_addr,
+            ", port = ",
+            ntohs(dest->sin6_port));
     }
-    std::memcpy(data + 8, &temp, 4);
-
-    temp = htonl(rseq);
-    std::memcpy(data + 12, &temp, 4);
-    temp = htonl(ack);
-    std::memcpy(data + 16, &temp, 4);
 }
 
-uint32_t UDPC::generateConnectionID(Context &ctx) {
-    auto dist = std::uniform_int_distribution<uint32_t>(0, 0x0FFFFFFF);
-    uint32_t id = dist(ctx.rng_engine);
-    while(ctx.idMap.find(id) != ctx.idMap.end()) {
-        id = dist(ctx.rng_engine);
+void UDPC::Context::sendSegmented(const struct msghdr &msg) {
+    uint16_t segmentSize;
+    std::memcpy(
+        &segmentSize,
+        CMSG_DATA(CMSG_FIRSTHDR(&msg)),
+        sizeof(uint16_t));
+    // a datagram is one iovec, or a header and a shared payload, that add up
+    // to segmentSize except for the last one
+    std::size_t i = 0;
+    while(i < msg.msg_iovlen) {
+        struct msghdr datagram;
+        std::memset(&datagram, 0, sizeof(struct msghdr));
+        datagram.msg_name = msg.msg_name;
+        datagram.msg_namelen = msg.msg_namelen;
+        datagram.msg_iov = msg.msg_iov + i;
+        std::size_t size = 0;
+        while(i < msg.msg_iovlen && size < segmentSize) {
+            size += msg.msg_iov[i].iov_len;
+            ++datagram.msg_iovlen;
+            ++i;
+        }
+        long int sentBytes = sendmsg(socketHandle, &datagram, 0);
+        if(sentBytes != (long int)size) {
+            const UDPC_IPV6_SOCKADDR_TYPE *dest =
+                (const UDPC_IPV6_SOCKADDR_TYPE*)msg.msg_name;
+            UDPC_CHECK_LOG(this,
+                UDPC_LoggingType::UDPC_ERROR,
+                "Failed to send packet to ",
+                dest->sin6_addr,
+                ", port = ",
+                ntohs(dest->sin6_port));
+        }
     }
-    return id;
 }
+#endif
 
-float UDPC::durationToFSec(const std::chrono::steady_clock::duration& duration) {
-    return (float)duration.count()
-        * (float)std::chrono::steady_clock::duration::period::num
-        / (float)std::chrono::steady_clock::duration::period::den;
-}
+char *UDPC::Context::stageSend(
+        unsigned int size, const UDPC_ConnectionId &dest) {
+    stageSendBuffer(nullptr, size, dest);
+    const std::size_t offset = stagedSends.back().offset;
 
-uint16_t UDPC::durationToMS(const std::chrono::steady_clock::duration& duration) {
-    return std::chrono::duration_cast<std::chrono::milliseconds>(duration).count();
+    // returned pointer is only valid until the next call to stageSend
+    sendStage.resize(offset + size);
+    return sendStage.data() + offset;
 }
 
-float UDPC::timePointsToFSec(
-        const std::chrono::steady_clock::time_point& older,
-        const std::chrono::steady_clock::time_point& newer) {
-    const auto dt = newer - older;
-    return (float)dt.count()
-        * (float)decltype(dt)::period::num / (float)decltype(dt)::period::den;
+char *UDPC::Context::stageSendHeader(
+        unsigned int headerSize, const char *payload, uint32_t payloadSize,
+        const UDPC_ConnectionId &dest) {
+    char *buf = stageSend(headerSize, dest);
+    stagedSends.back().size += payloadSize;
+    stagedSends.back().payload = payload;
+    stagedSends.back().payloadSize = payloadSize;
+    return buf;
 }
 
-UDPC_PacketInfo UDPC::get_empty_pinfo() {
-    UDPC_PacketInfo pinfo;
-    std::memset(&pinfo, 0, sizeof(UDPC_PacketInfo));
-    return pinfo;
+void UDPC::Context::stageSendBuffer(
+        const char *buf, unsigned int size, const UDPC_ConnectionId &dest) {
+    StagedSend staged;
+    staged.buf = buf;
+    staged.offset = sendStage.size();
+    staged.size = size;
+    staged.payload = nullptr;
+    staged.payloadSize = 0;
+    std::memset(&staged.dest, 0, sizeof(UDPC_IPV6_SOCKADDR_TYPE));
+    staged.dest.sin6_family = AF_INET6;
+    std::memcpy(
+        UDPC_IPV6_ADDR_SUB(staged.dest.sin6_addr),
+        UDPC_IPV6_ADDR_SUB(dest.addr),
+        16);
+    staged.dest.sin6_port = htons(dest.port);
+    staged.dest.sin6_flowinfo = 0;
+    staged.dest.sin6_scope_id = dest.scope_id;
+    stagedSends.push_back(staged);
 }
 
-void UDPC::threadedUpdate(Context *ctx) {
-    auto now = std::chrono::steady_clock::now();
-    decltype(now) nextNow;
-    while(ctx->threadRunning.load()) {
-        now = std::chrono::steady_clock::now();
-        ctx->update_impl();
-        nextNow = std::chrono::steady_clock::now();
-        std::this_thread::sleep_for(ctx->threadedSleepTime - (nextNow - now));
+void UDPC::Context::unstageSend() {
+    assert(!stagedSends.empty() && "Must have staged a send to unstage it");
+    if(!stagedSends.back().buf) {
+        sendStage.resize(stagedSends.back().offset);
     }
+    stagedSends.pop_back();
 }
 
-UDPC_ConnectionId UDPC_create_id(UDPC_IPV6_ADDR_TYPE addr, uint16_t port) {
-    UDPC_ConnectionId result;
+void UDPC::Context::flushSends() {
+    if(stagedSends.empty()) {
+        return;
+    }
 
-    std::memset(&result, 0, sizeof(UDPC_ConnectionId));
+#if UDPC_PLATFORM == UDPC_PLATFORM_LINUX
+    const std::size_t count = stagedSends.size();
+    const std::size_t ctrlSize = CMSG_SPACE(sizeof(uint16_t));
+    if(sendMsgs.size() < count) {
+        sendMsgs.resize(count);
+        sendIovs.resize(count * 2);
+        sendCtrl.resize(count * ctrlSize);
+    }
 
-    result.addr = addr;
-//    result.scope_id = 0;
-    result.port = port;
-    return result;
-}
+    // With GSO, consecutive datagrams to the same peer of the same size are
+    // sent as one message with a UDP_SEGMENT cmsg. The last segment of a run
+    // may be shorter, otherwise datagrams are sent individually.
+    const bool isGSO = isGSOEnabled.load();
+    std::size_t msgCount = 0;
+    std::size_t iovCount = 0;
+    for(std::size_t i = 0; i < count;) {
+        const StagedSend &first = stagedSends[i];
+        std::size_t segments = 1;
+        std::size_t bytes = first.size;
+        while(isGSO
+                && i + segments < count
+                && segments < UDPC_GSO_MAX_SEGMENTS) {
+            const StagedSend &next = stagedSends[i + segments];
+            if(next.size > first.size
+                    || bytes + next.size > UDPC_GSO_MAX_BYTES
+                    || std::memcmp(&next.dest, &first.dest,
+                        sizeof(UDPC_IPV6_SOCKADDR_TYPE)) != 0) {
+                break;
+            }
+            bytes += next.size;
+            ++segments;
+            if(next.size < first.size) {
+                break;
+            }
+        }
 
-UDPC_ConnectionId UDPC_create_id_full(UDPC_IPV6_ADDR_TYPE addr, uint32_t scope_id, uint16_t port) {
-    UDPC_ConnectionId result;
+        // one iovec per datagram, or two if its payload is a shared buffer,
+        // the datagrams of a message are gathered from consecutive iovecs
+        const std::size_t iovStart = iovCount;
+        for(std::size_t j = i; j < i + segments; ++j) {
+            const StagedSend &staged = stagedSends[j];
+            sendIovs[iovCount].iov_base = staged.buf
+                ? (void*)staged.buf : (void*)(sendStage.data() + staged.offset);
+            sendIovs[iovCount].iov_len = staged.size - staged.payloadSize;
+            ++iovCount;
+            if(staged.payload) {
+                sendIovs[iovCount].iov_base = (void*)staged.payload;
+                sendIovs[iovCount].iov_len = staged.payloadSize;
+                ++iovCount;
+            }
+        }
 
-    std::memset(&result, 0, sizeof(UDPC_ConnectionId));
+        struct mmsghdr &msg = sendMsgs[msgCount];
+        std::memset(&msg, 0, sizeof(struct mmsghdr));
+        msg.msg_hdr.msg_name = &stagedSends[i].dest;
+        msg.msg_hdr.msg_namelen = sizeof(UDPC_IPV6_SOCKADDR_TYPE);
+        msg.msg_hdr.msg_iov = &sendIovs[iovStart];
+        msg.msg_hdr.msg_iovlen = iovCount - iovStart;
+        if(segments > 1) {
+            msg.msg_hdr.msg_control = sendCtrl.data() + msgCount * ctrlSize;
+            msg.msg_hdr.msg_controllen = ctrlSize;
+            struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg.msg_hdr);
+            cmsg->cmsg_level = SOL_UDP;
+            cmsg->cmsg_type = UDP_SEGMENT;
+            cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+            uint16_t segmentSize = first.size;
+            std::memcpy(CMSG_DATA(cmsg), &segmentSize, sizeof(uint16_t));
+        }
 
-    result.addr = addr;
-    result.scope_id = scope_id;
-    result.port = port;
-    return result;
-}
+        ++msgCount;
+        i += segments;
+    }
 
-UDPC_ConnectionId UDPC_create_id_anyaddr(uint16_t port) {
-    UDPC_ConnectionId result;
+#ifdef UDPC_IO_URING_ENABLED
+    if(sendRing) {
+        sendIOUring(msgCount);
+        clearStagedSends();
+        return;
+    }
+#endif
 
-    std::memset(&result, 0, sizeof(UDPC_ConnectionId));
+    std::size_t sent = 0;
+    while(sent < msgCount) {
+        int result = sendmmsg(
+            socketHandle, sendMsgs.data() + sent, msgCount - sent, 0);
+        if(result == -1) {
+            // first message of the remaining batch failed, skip it
+            sendFailed(sendMsgs[sent].msg_hdr, errno);
+            ++sent;
+        } else {
+            // may be a partial send, continue from the first unsent message
+            sent += result;
+        }
+    }
+#else
+    std::vector<char> joined;
+    for(auto iter = stagedSends.begin(); iter != stagedSends.end(); ++iter) {
+        const char *buf = iter->buf ? iter->buf : sendStage.data() + iter->offset;
+        if(iter->payload) {
+            // header and shared payload sent as one buffer
+            const uint32_t headerSize = iter->size - iter->payloadSize;
+            joined.resize(iter->size);
+            std::memcpy(joined.data(), buf, headerSize);
+            std::memcpy(joined.data() + headerSize,
+                iter->payload, iter->payloadSize);
+            buf = joined.data();
+        }
+        long int sentBytes = sendto(
+            socketHandle,
+            buf,
+            iter->size,
+            0,
+            (struct sockaddr*) &iter->dest,
+            sizeof(UDPC_IPV6_SOCKADDR_TYPE));
+        if(sentBytes != (long int)iter->size) {
+            UDPC_CHECK_LOG(this,
+                UDPC_LoggingType::UDPC_ERROR,
+                "Failed to send packet to ",
+                iter->dest.sin6_addr,
+                ", port = ",
+                ntohs(iter->dest.sin6_port));
+        }
+    }
+#endif
 
-//    result.addr = in6addr_any;
-    result.scope_id = 0;
-    result.port = port;
-    return result;
+    clearStagedSends();
 }
 
-UDPC_ConnectionId UDPC_create_id_easy(const char *addrString, uint16_t port) {
-    UDPC_ConnectionId result;
-
-    std::memset(&result, 0, sizeof(UDPC_ConnectionId));
-
-    result.port = port;
-
-    if(std::regex_match(addrString, ipv6_regex_nolink)
-            || std::regex_match(addrString, ipv4_regex)) {
-        result.addr = UDPC_strtoa(addrString);
-    } else if(std::regex_match(addrString, ipv6_regex_linkonly)) {
-        result.addr = UDPC_strtoa_link(addrString, &result.scope_id);
-    } else {
-        result.addr = in6addr_loopback;
+void UDPC::Context::clearStagedSends() {
+    sendStage.clear();
+    stagedSends.clear();
+    for(char *buf : sendStageOwned) {
+        BufferPool::deallocate(buf);
     }
-    return result;
+    sendStageOwned.clear();
 }
 
-UDPC_ConnectionId UDPC_create_id_hostname(const char *hostname, uint16_t port) {
-    UDPC_ConnectionId result;
-    std::memset(&result, 0, sizeof(UDPC_ConnectionId));
-    result.port = port;
+UDPC::Context *UDPC::Context::shardFor(const UDPC_ConnectionId &id) {
+    return shards[shardIndexFor(id)];
+}
 
-#if UDPC_PLATFORM == UDPC_PLATFORM_WINDOWS
-    WORD wVersionRequested = MAKEWORD(2, 2);
-    WSADATA wsaData;
-    if(WSAStartup(wVersionRequested, &wsaData) != 0) {
-        fprintf(stderr, "Failed to initialize Winsock\n");
-        return result;
+unsigned int UDPC::Context::shardIndexFor(const UDPC_ConnectionId &id) {
+    {
+        std::shared_lock<std::shared_mutex> lock(shardIndexMapMutex);
+        auto iter = shardIndexMap.find(id);
+        if(iter != shardIndexMap.end()) {
+            return iter->second;
+        }
     }
-#elif UDPC_PLATFORM == UDPC_PLATFORM_MAC || UDPC_PLATFORM == UDPC_PLATFORM_LINUX
-#endif
-    addrinfo hints;
-    std::memset(&hints, 0, sizeof(addrinfo));
 
-    hints.ai_family = AF_UNSPEC;
-    hints.ai_socktype = SOCK_DGRAM;
-    hints.ai_protocol = IPPROTO_UDP;
+    // The kernel hashes a peer to the same SO_REUSEPORT socket as long as the
+    // set of bound sockets is unchanged, so a found shard can be cached.
+    for(unsigned int i = 0; i < shards.size(); ++i) {
+        bool found;
+        {
+            std::lock_guard<std::mutex> conMapLock(shards[i]->conMapMutex);
+            found = shards[i]->conMap.find(id) != shards[i]->conMap.end();
+        }
+        if(found) {
+            std::unique_lock<std::shared_mutex> lock(shardIndexMapMutex);
+            if(shardIndexMap.size() >= UDPC_SHARD_INDEX_MAP_MAX) {
+                shardIndexMap.clear();
+            }
+            shardIndexMap.insert(std::make_pair(id, i));
+            return i;
+        }
+    }
 
-    addrinfo *lookupResult;
-    int error = getaddrinfo(hostname, nullptr, &hints, &lookupResult);
+    // unknown peer, the first shard handles it as a non-sharded context would
+    return 0;
+}
 
-    if(error == 0) {
-        if(lookupResult->ai_family == AF_INET) {
-            sockaddr_in *a4 = (sockaddr_in*)lookupResult->ai_addr;
-            result.addr = UDPC_a4toa6(a4->sin_addr.s_addr);
-        } else if(lookupResult->ai_family == AF_INET6) {
-            sockaddr_in6 *a6 = (sockaddr_in6*)lookupResult->ai_addr;
-            result.addr = a6->sin6_addr;
-        } else {
-            result.addr = in6addr_loopback;
+template <typename IdOf>
+void UDPC::Context::groupByShard(
+        unsigned long count, IdOf idOf,
+        std::vector<unsigned long> &order,
+        std::vector<unsigned long> &offsets) {
+    // An unknown id is not cached in shardIndexMap (it may connect to any
+    // shard later), so repeats of it in the same call are resolved here.
+    std::unordered_map<UDPC_ConnectionId, unsigned char, ConnectionIdHasher>
+        resolved;
+    std::vector<unsigned char> shardOf(count);
+    offsets.assign(shards.size() + 1, 0);
+    for(unsigned long i = 0; i < count; ++i) {
+        const UDPC_ConnectionId &id = idOf(i);
+        auto iter = resolved.find(id);
+        if(iter == resolved.end()) {
+            iter = resolved.emplace(id, (unsigned char)shardIndexFor(id)).first;
         }
-        freeaddrinfo(lookupResult);
-    } else {
-        result.addr = in6addr_loopback;
+        shardOf[i] = iter->second;
+        ++offsets[shardOf[i] + 1];
+    }
+    for(std::size_t i = 1; i < offsets.size(); ++i) {
+        offsets[i] += offsets[i - 1];
     }
 
-#if UDPC_PLATFORM == UDPC_PLATFORM_WINDOWS
-    WSACleanup();
-#endif
+    std::vector<unsigned long> next(offsets.begin(), offsets.end() - 1);
+    order.resize(count);
+    for(unsigned long i = 0; i < count; ++i) {
+        order[next[shardOf[i]]++] = i;
+    }
+}
 
-    return result;
+UDPC::Context *UDPC::Context::shardForHandle(UDPC_ConnectionHandle handle) {
+    const unsigned int index = (unsigned int)((handle >> 24) & 0xFF);
+    return index < shards.size() ? shards[index] : nullptr;
 }
 
-UDPC_HContext UDPC_init(UDPC_ConnectionId listenId, int isClient, int isUsingLibsodium) {
-    UDPC::Context *ctx = new UDPC::Context(false);
-    ctx->flags.set(1, isClient != 0);
-    ctx->authPolicy.exchange(UDPC_AuthPolicy::UDPC_AUTH_POLICY_FALLBACK);
+UDPC_ConnectionHandle UDPC::Context::handleOf(
+        ConnectionTable<ConnectionData>::const_iterator iter) const {
+    return conMap.handleOf(iter) | ((UDPC_ConnectionHandle)shardIndex << 24);
+}
+
+#if UDPC_PLATFORM == UDPC_PLATFORM_LINUX
+bool UDPC::Context::setupPolling() {
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    bool isSetup = epollFd >= 0 && wakeFd >= 0 && timerFd >= 0;
+
+    struct epoll_event event;
+    std::memset(&event, 0, sizeof(struct epoll_event));
+    event.events = EPOLLIN;
+    for(int fd : {(int)socketHandle, wakeFd, timerFd}) {
+        if(isSetup) {
+            event.data.fd = fd;
+            isSetup = epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) == 0;
+        }
+    }
+
+    if(!isSetup) {
+        UDPC_CHECK_LOG(this, UDPC_LoggingType::UDPC_WARNING,
+            "Failed to set up event-driven update, threaded update will "
+            "update at a fixed interval, errno ", errno);
+        for(int *fd : {&epollFd, &wakeFd, &timerFd}) {
+            if(*fd >= 0) {
+                close(*fd);
+                *fd = -1;
+            }
+        }
+        return false;
+    }
+    return true;
+}
+
+void UDPC::Context::setPollTarget(int oldFd, int newFd) {
+    // either may be -1 to only add or only remove
+    if(epollFd < 0) {
+        return;
+    }
+    struct epoll_event event;
+    std::memset(&event, 0, sizeof(struct epoll_event));
+    event.events = EPOLLIN;
+    event.data.fd = newFd;
+    if(oldFd >= 0) {
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, oldFd, nullptr);
+    }
+    if(newFd >= 0) {
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, newFd, &event);
+    }
+}
+
+void UDPC::Context::armTimer(
+        const std::chrono::steady_clock::time_point &deadline) {
+    // a zeroed it_value disarms the timer if there is no deadline, a deadline
+    // in the past expires immediately
+    struct itimerspec spec;
+    std::memset(&spec, 0, sizeof(struct itimerspec));
+    if(deadline != std::chrono::steady_clock::time_point::max()) {
+        // steady_clock is CLOCK_MONOTONIC
+        const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            deadline.time_since_epoch()).count();
+        spec.it_value.tv_sec = ns / 1000000000;
+        spec.it_value.tv_nsec = ns % 1000000000;
+    }
+    timerfd_settime(timerFd, TFD_TIMER_ABSTIME, &spec, nullptr);
+}
+
+void UDPC::Context::waitForWork() {
+    const auto deadline = nextDeadline();
+    if(deadline <= std::chrono::steady_clock::now()) {
+        return;
+    }
+    armTimer(deadline);
+
+    // also returns early (EINTR) when io_uring completion work is run, the
+    // update then handles whatever woke it
+    struct epoll_event events[3];
+    epoll_wait(epollFd, events, 3, -1);
+}
+#endif
+
+void UDPC::Context::wake() {
+#if UDPC_PLATFORM == UDPC_PLATFORM_LINUX
+    if(wakeFd >= 0) {
+        // only fails if the counter is saturated, which is still a wakeup
+        eventfd_write(wakeFd, 1);
+    }
+#endif
+}
+
+unsigned int UDPC::Context::sendHeadroom() const {
+    // fixed once the context is initialized
+    return flags.test(2) ? UDPC_LSFULL_HEADER_SIZE : UDPC_NSFULL_HEADER_SIZE;
+}
+
+std::chrono::steady_clock::time_point UDPC::Context::nextDeadline() {
+    std::lock_guard<std::mutex> timersLock(timersMutex);
+    return timers.nextDeadline();
+}
+
+std::chrono::steady_clock::time_point UDPC::Context::nextDue(
+        const ConnectionData &con) const {
+    // Connection timers were last advanced at timersUpdated, so the deadlines
+    // are relative to it.
+    if(con.flags.test(1) && !con.flags.test(2)) {
+        // good mode with bad rtt, switch to bad mode is pending
+        return con.timersUpdated;
+    }
+
+    auto next = con.received + UDPC::CONNECTION_TIMEOUT;
+    if(con.flags.test(1)) {
+        next = std::min(next,
+            con.timersUpdated + (UDPC::TEN_SECONDS - con.toggleTimer));
+    } else if(con.flags.test(2)) {
+        next = std::min(next,
+            con.timersUpdated + (con.toggleT - con.toggledTimer));
+    }
+
+    // nothing is sent before then
+    auto sendFrom = con.timersUpdated;
+    if(con.flags.test(3)) {
+        if(flags.test(1)) {
+            sendFrom = con.sent + UDPC::INIT_PKT_INTERVAL_DT;
+        }
+    } else if(con.sendPkts.empty() && con.priorityPkts.empty()
+            && (!isSendWindowed(con)
+                || con.rseq - con.sentRseq < UDPC_SEND_WINDOW_SIZE / 2)) {
+        sendFrom = con.sent + UDPC::HEARTBEAT_PKT_INTERVAL_DT;
+    }
+
+    // send is only checked when the send rate timer triggers, the first time
+    // it does at or after sendFrom
+    auto sendAt = con.timersUpdated;
+    if(!con.flags.test(0) || sendFrom > sendAt) {
+        const std::chrono::steady_clock::duration rate =
+            con.flags.test(1) ? con.goodModeSendRate : con.badModeSendRate;
+        if(con.timer < rate) {
+            sendAt += rate - con.timer;
+        }
+        if(sendAt < sendFrom) {
+            sendAt += rate * ((sendFrom - sendAt + rate
+                - std::chrono::steady_clock::duration(1)) / rate);
+        }
+    }
+
+    return std::min(next, sendAt);
+}
+
+void UDPC::Context::scheduleConnection(
+        ConnectionTable<ConnectionData>::iterator iter,
+        const std::chrono::steady_clock::time_point &time) {
+    std::lock_guard<std::mutex> timersLock(timersMutex);
+    if(iter->second.timerTick <= timers.tickOf(time)) {
+        return;
+    }
+    iter->second.timerTick = timers.schedule(conMap.handleOf(iter), time);
+}
+
+void UDPC::Context::publishPeerList() {
+    isPeerListChanged = false;
+    std::vector<UDPC_PeerInfo> peers;
+    peers.reserve(conMap.size());
+    for(auto iter = conMap.begin(); iter != conMap.end(); ++iter) {
+        peers.push_back(UDPC_PeerInfo{
+            iter->first,
+            handleOf(iter),
+            durationToMS(iter->second.rtt),
+            (uint16_t)(iter->second.flags.test(1) ? 1 : 0)});
+    }
+    peerList.publish(peers);
+
+    if(!shardedContext) {
+        return;
+    }
+    // combined from the lists the shards published last
+    std::lock_guard<std::mutex> peerListLock(shardedContext->peerListMutex);
+    if(shardedContext->shards.empty()) {
+        // the sharded context is being destroyed
+        return;
+    }
+    peers.clear();
+    for(Context *shard : shardedContext->shards) {
+        const UDPC_PeerList *list = shard->peerList.acquire();
+        peers.insert(peers.end(), list->peers, list->peers + list->size);
+        shard->peerList.release(list);
+    }
+    shardedContext->peerList.publish(peers);
+}
+
+#ifdef UDPC_IO_URING_ENABLED
+bool UDPC::Context::setupIOUring() {
+    recvRing = std::unique_ptr<IOUring>(new IOUring());
+    sendRing = std::unique_ptr<IOUring>(new IOUring());
+
+    // each provided buffer holds the recvmsg header, sender address and payload
+    int ret = recvRing->init(UDPC_IO_URING_RECV_ENTRIES);
+    if(ret == 0) {
+        ret = recvRing->setupBufferRing(
+            0,
+            UDPC_IO_URING_RECV_BUFFERS,
+            sizeof(struct io_uring_recvmsg_out)
+                + sizeof(UDPC_IPV6_SOCKADDR_TYPE)
+                + UDPC_PACKET_MAX_SIZE);
+    }
+    if(ret == 0) {
+        ret = sendRing->init(UDPC_IO_URING_SEND_ENTRIES);
+    }
+    if(ret != 0) {
+        UDPC_CHECK_LOG(this, UDPC_LoggingType::UDPC_WARNING,
+            "Failed to set up io_uring, using socket I/O instead, errno ",
+            -ret);
+        recvRing.reset();
+        sendRing.reset();
+        return false;
+    }
+
+    std::memset(&recvMsgTemplate, 0, sizeof(struct msghdr));
+    recvMsgTemplate.msg_namelen = sizeof(UDPC_IPV6_SOCKADDR_TYPE);
+    isRecvArmed = false;
+
+    // received datagrams are consumed by the ring, wait on its completions
+    setPollTarget(socketHandle, recvRing->getFd());
+    return true;
+}
+
+void UDPC::Context::armReceiveIOUring() {
+    struct io_uring_sqe *sqe = recvRing->getSQE();
+    if(!sqe) {
+        return;
+    }
+    // multishot, keeps posting a completion per datagram until buffers run out
+    sqe->opcode = IORING_OP_RECVMSG;
+    sqe->fd = socketHandle;
+    sqe->addr = (unsigned long)&recvMsgTemplate;
+    sqe->len = 1;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = 0;
+    isRecvArmed = true;
+}
+
+void UDPC::Context::receiveIOUring(
+        const std::chrono::steady_clock::time_point &now) {
+    if(!isRecvArmed) {
+        armReceiveIOUring();
+    }
+    // submits a re-armed receive and runs pending completion work
+    int ret = recvRing->submit(0);
+    if(ret < 0) {
+        UDPC_CHECK_LOG(this, UDPC_LoggingType::UDPC_VERBOSE,
+            "Error receiving packets, ", -ret);
+    }
+
+    unsigned int datagrams = 0;
+    struct io_uring_cqe *cqe;
+    while((cqe = recvRing->peekCQE()) != nullptr) {
+        const int res = cqe->res;
+        const unsigned int cqeFlags = cqe->flags;
+        recvRing->seenCQE();
+
+        if((cqeFlags & IORING_CQE_F_MORE) == 0) {
+            isRecvArmed = false;
+        }
+        if((cqeFlags & IORING_CQE_F_BUFFER) == 0) {
+            // -ENOBUFS only requires re-arming
+            if(res < 0 && res != -ENOBUFS) {
+                UDPC_CHECK_LOG(this, UDPC_LoggingType::UDPC_VERBOSE,
+                    "Error receiving packets, ", -res);
+            }
+            continue;
+        }
+
+        unsigned short id = cqeFlags >> IORING_CQE_BUFFER_SHIFT;
+        char *buf = recvRing->getBuffer(id);
+        struct io_uring_recvmsg_out *out = (struct io_uring_recvmsg_out*)buf;
+        if(res >= 0 && (out->flags & MSG_TRUNC) == 0) {
+            UDPC_IPV6_SOCKADDR_TYPE receivedData;
+            std::memset(&receivedData, 0, sizeof(UDPC_IPV6_SOCKADDR_TYPE));
+            std::memcpy(
+                &receivedData,
+                buf + sizeof(struct io_uring_recvmsg_out),
+                out->namelen < sizeof(UDPC_IPV6_SOCKADDR_TYPE) ?
+                    out->namelen : sizeof(UDPC_IPV6_SOCKADDR_TYPE));
+            ++datagrams;
+            receivePacket(
+                buf + sizeof(struct io_uring_recvmsg_out)
+                    + recvMsgTemplate.msg_namelen,
+                out->payloadlen,
+                receivedData,
+                now);
+        }
+        recvRing->recycleBuffer(id);
+    }
+
+    if(!isRecvArmed) {
+        // re-arm now that buffers are recycled, so that completions (and
+        // wakeups of a waiting threaded update) resume without another update
+        armReceiveIOUring();
+        recvRing->submit(0);
+    }
+
+    if(datagrams > 0) {
+        countReceived(datagrams);
+    }
+}
+
+void UDPC::Context::sendIOUring(std::size_t msgCount) {
+    std::size_t sent = 0;
+    while(sent < msgCount) {
+        unsigned int batch = 0;
+        struct io_uring_sqe *sqe;
+        while(sent + batch < msgCount && (sqe = sendRing->getSQE()) != nullptr) {
+            sqe->opcode = IORING_OP_SENDMSG;
+            sqe->fd = socketHandle;
+            sqe->addr = (unsigned long)&sendMsgs[sent + batch].msg_hdr;
+            sqe->len = 1;
+            sqe->user_data = sent + batch;
+            ++batch;
+        }
+
+        int ret = sendRing->submit(batch);
+        if(ret < 0) {
+            // unusable ring, drop it and send the rest with sendmmsg
+            UDPC_CHECK_LOG(this, UDPC_LoggingType::UDPC_WARNING,
+                "Failed to submit to io_uring, using socket I/O instead, errno ",
+                -ret);
+            sendRing.reset();
+            while(sent < msgCount) {
+                int result = sendmmsg(
+                    socketHandle, sendMsgs.data() + sent, msgCount - sent, 0);
+                if(result == -1) {
+                    sendFailed(sendMsgs[sent].msg_hdr, errno);
+                    ++sent;
+                } else {
+                    sent += result;
+                }
+            }
+            return;
+        }
+
+        struct io_uring_cqe *cqe;
+        while((cqe = sendRing->peekCQE()) != nullptr) {
+            if(cqe->res < 0) {
+                sendFailed(sendMsgs[cqe->user_data].msg_hdr, -cqe->res);
+            }
+            sendRing->seenCQE();
+        }
+        sent += batch;
+    }
+}
+#endif
+
+void UDPC::Context::receivePacket(
+        char *recvBuf,
+        int bytes,
+        const UDPC_IPV6_SOCKADDR_TYPE &receivedData,
+        const std::chrono::steady_clock::time_point &now,
+        bool *isAdopted) {
+    if(!isValidHeader(recvBuf, bytes, receivedData)) {
+        return;
+    }
+
+    uint32_t temp;
+    std::memcpy(&temp, recvBuf + 4, 4);
+    uint32_t conID = ntohl(temp);
+    std::memcpy(&temp, recvBuf + 8, 4);
+    uint32_t seqID = ntohl(temp);
+    std::memcpy(&temp, recvBuf + 12, 4);
+    uint32_t rseq = ntohl(temp);
+    std::memcpy(&temp, recvBuf + 16, 4);
+    uint32_t ack = ntohl(temp);
+
+    bool isConnect = conID & UDPC_ID_CONNECT;
+    bool isPing = conID & UDPC_ID_PING;
+    bool isNotRecChecked = conID & UDPC_ID_NO_REC_CHK;
+    bool isResending = conID & UDPC_ID_RESENDING;
+    conID &= 0x0FFFFFFF;
+    UDPC_ConnectionId identifier =
+        UDPC_create_id_full(receivedData.sin6_addr,
+                            receivedData.sin6_scope_id,
+                            ntohs(receivedData.sin6_port));
+
+    if(isConnect && !isPing && bytes < (int)(UDPC_CON_HEADER_SIZE)) {
+        // invalid packet size
+        UDPC_CHECK_LOG(this,
+            UDPC_LoggingType::UDPC_VERBOSE,
+            "Got connect packet of invalid size from ",
+            receivedData.sin6_addr,
+            ", port = ",
+            ntohs(receivedData.sin6_port),
+            ", ignoring");
+        return;
+    } else if ((!isConnect || (isConnect && isPing))
+            && bytes < (int)UDPC_NSFULL_HEADER_SIZE) {
+        // packet is too small
+        UDPC_CHECK_LOG(this,
+            UDPC_LoggingType::UDPC_VERBOSE,
+            "Got non-connect packet of invalid size from ",
+            receivedData.sin6_addr,
+            ", port = ",
+            ntohs(receivedData.sin6_port),
+            ", ignoring");
+        return;
+    }
+
+    uint32_t pktType;
+    if(isConnect && !isPing) {
+        std::memcpy(&pktType, recvBuf + UDPC_MIN_HEADER_SIZE, 4);
+        pktType = ntohl(pktType);
+        switch(pktType) {
+        case 0: // client/server connect with libsodium disabled
+            break;
+        case 1: // client connect with libsodium enabled
+            break;
+        case 2: // server connect with libsodium enabled
+            break;
+        default:
+            UDPC_CHECK_LOG(this, UDPC_LoggingType::UDPC_WARNING,
+                "Got invalid connect pktType from ",
+                receivedData.sin6_addr,
+                ", port ", ntohs(receivedData.sin6_port));
+            return;
+        }
+    } else {
+        if(recvBuf[UDPC_MIN_HEADER_SIZE] == 0) {
+            // not signed
+            pktType = 0;
+        } else if(recvBuf[UDPC_MIN_HEADER_SIZE] == 1) {
+            // signed
+            pktType = 1;
+        } else {
+            UDPC_CHECK_LOG(this, UDPC_LoggingType::UDPC_WARNING,
+                "Got invalid pktType from ",
+                receivedData.sin6_addr,
+                ", port ", ntohs(receivedData.sin6_port));
+            return;
+        }
+    }
+
+    if(isConnect && !isPing) {
+        // is connect packet and is accepting new connections
+        if(!flags.test(1)
+                && conMap.find(identifier) == conMap.end()
+                && isAcceptNewConnections.load()) {
+            // is receiving as server, connection did not already exist
+            int authPolicy = this->authPolicy.load();
+            if(pktType == 1 && !flags.test(2)
+                    && authPolicy
+                        == UDPC_AuthPolicy::UDPC_AUTH_POLICY_STRICT) {
+                UDPC_CHECK_LOG(this, UDPC_LoggingType::UDPC_ERROR,
+                    "Client peer ",
+                    receivedData.sin6_addr,
+                    " port ",
+                    ntohs(receivedData.sin6_port),
+                    " attempted connection with packet authentication "
+                    "enabled, but auth is disabled and AuthPolicy is "
+                    "STRICT");
+                return;
+            } else if(pktType == 0 && flags.test(2)
+                    && authPolicy
+                        == UDPC_AuthPolicy::UDPC_AUTH_POLICY_STRICT) {
+                UDPC_CHECK_LOG(this, UDPC_LoggingType::UDPC_ERROR,
+                    "Client peer ",
+                    receivedData.sin6_addr,
+                    " port ",
+                    ntohs(receivedData.sin6_port),
+                    " attempted connection with packet authentication "
+                    "disabled, but auth is enabled and AuthPolicy is "
+                    "STRICT");
+                return;
+            }
+            unsigned char *sk = nullptr;
+            unsigned char *pk = nullptr;
+            if(keysSet.load()) {
+                sk = this->sk;
+                pk = this->pk;
+            }
+            UDPC::ConnectionData newConnection(
+                true,
+                this,
+                receivedData.sin6_addr,
+                receivedData.sin6_scope_id,
+                ntohs(receivedData.sin6_port),
+#ifdef UDPC_LIBSODIUM_ENABLED
+                pktType == 1 && flags.test(2),
+                sk, pk);
+#else
+                false,
+                sk, pk);
+#endif
+
+            if(newConnection.flags.test(5)) {
+                UDPC_CHECK_LOG(this,
+                    UDPC_LoggingType::UDPC_ERROR,
+                    "Failed to init ConnectionData instance (libsodium init"
+                    " fail) while server establishing connection with ",
+                    receivedData.sin6_addr,
+                    ", port = ",
+                    ntohs(receivedData.sin6_port));
+                return;
+            }
+            if(pktType == 1 && flags.test(2)) {
+#ifdef UDPC_LIBSODIUM_ENABLED
+                std::memcpy(
+                    newConnection.peer_pk,
+                    recvBuf + UDPC_MIN_HEADER_SIZE + 4,
+                    crypto_sign_PUBLICKEYBYTES);
+                {
+                    std::shared_lock<std::shared_mutex>
+                        pkWhitelistLock(peerPKWhitelistMutex);
+                    if(!peerPKWhitelist.empty()
+                            && peerPKWhitelist.find(
+                                UDPC::PKContainer(newConnection.peer_pk))
+                                    == peerPKWhitelist.end()) {
+                        UDPC_CHECK_LOG(this, UDPC_LoggingType::UDPC_WARNING,
+                            "peer_pk is not in whitelist, not establishing "
+                            "connection with client");
+                        return;
+                    }
+                }
+                newConnection.verifyMessage =
+                    std::unique_ptr<char[]>(new char[crypto_sign_BYTES]);
+                std::time_t currentTime = std::time(nullptr);
+                uint64_t receivedTime;
+                std::memcpy(
+                    &receivedTime,
+                    recvBuf + UDPC_MIN_HEADER_SIZE + 4
+                        + crypto_sign_PUBLICKEYBYTES + 4,
+                    8);
+                UDPC::be64((char*)&receivedTime);
+# ifndef NDEBUG
+                if(willLog(UDPC_LoggingType::UDPC_DEBUG)) {
+                    log_impl(UDPC_LoggingType::UDPC_DEBUG,
+                        "Server got verification epoch time \"",
+                        receivedTime, "\"");
+                }
+# endif
+                std::time_t receivedTimeT = receivedTime;
+                if(currentTime < receivedTimeT
+                        || currentTime - receivedTimeT > 3) {
+                    UDPC_CHECK_LOG(this, UDPC_LoggingType::UDPC_WARNING,
+                        "Got invalid epoch time from client, ignoring");
+                    return;
+                }
+                crypto_sign_detached(
+                    (unsigned char*)newConnection.verifyMessage.get(),
+                    nullptr,
+                    (unsigned char*)(recvBuf + UDPC_MIN_HEADER_SIZE + 4
+                        + crypto_sign_PUBLICKEYBYTES),
+                    12,
+                    newConnection.sk);
+#else
+                assert(!"libsodium disabled, invalid state");
+                UDPC_CHECK_LOG(this, UDPC_LoggingType::UDPC_ERROR,
+                    "libsodium is disabled, cannot process received "
+                    "packet");
+                return;
+#endif
+            }
+            UDPC_CHECK_LOG(this,
+                UDPC_LoggingType::UDPC_INFO,
+                "Establishing connection with client ",
+                receivedData.sin6_addr,
+                ", port = ",
+                ntohs(receivedData.sin6_port),
+                ", giving client id = ", newConnection.id,
+                pktType == 1 && flags.test(2) ?
+                    ", libsodium enabled" : ", libsodium disabled");
+
+            auto iter = conMap.end();
+            {
+                std::lock_guard<std::mutex> conMapLock(conMapMutex);
+                iter = conMap.insert(identifier,
+                                     std::move(newConnection)).first;
+                conMap.setConID(iter, iter->second.id);
+            }
+            scheduleConnection(iter, nextDue(iter->second));
+            isPeerListChanged = true;
+            if(isReceivingEvents.load()) {
+                pushEvent(UDPC_ET_CONNECTED, iter);
+            }
+        } else if (flags.test(1)) {
+            // is client
+            auto iter = conMap.find(identifier);
+            if(iter == conMap.end() || !iter->second.flags.test(3)) {
+                UDPC_CHECK_LOG(this, UDPC_LoggingType::UDPC_DEBUG,
+                    "client dropped pkt from ",
+                    receivedData.sin6_addr,
+                    ", port ", ntohs(receivedData.sin6_port));
+                return;
+            }
+            int authPolicy = this->authPolicy.load();
+            if(pktType == 2 && !iter->second.flags.test(6)
+                    && authPolicy
+                        == UDPC_AuthPolicy::UDPC_AUTH_POLICY_STRICT) {
+                // This block actually should never happen, because the
+                // server receives a packet first. If client requests
+                // without auth, then the server will either deny
+                // connection (if strict) or fallback to a connection
+                // without auth (if fallback).
+                UDPC_CHECK_LOG(this, UDPC_LoggingType::UDPC_ERROR,
+                    "Server peer ",
+                    receivedData.sin6_addr,
+                    " port ",
+                    ntohs(receivedData.sin6_port),
+                    " attempted connection with packet authentication "
+                    "enabled, but auth is disabled and AuthPolicy is "
+                    "STRICT");
+                return;
+            } else if(pktType == 0 && iter->second.flags.test(6)
+                    && authPolicy
+                        == UDPC_AuthPolicy::UDPC_AUTH_POLICY_STRICT) {
+                UDPC_CHECK_LOG(this, UDPC_LoggingType::UDPC_ERROR,
+                    "Server peer ",
+                    receivedData.sin6_addr,
+                    " port ",
+                    ntohs(receivedData.sin6_port),
+                    " attempted connection with packet authentication "
+                    "disabled, but auth is enabled and AuthPolicy is "
+                    "STRICT");
+                return;
+            }
+
+            if(pktType == 2 && flags.test(2)
+                    && iter->second.flags.test(6)) {
+#ifdef UDPC_LIBSODIUM_ENABLED
+                std::memcpy(iter->second.peer_pk,
+                    recvBuf + UDPC_MIN_HEADER_SIZE + 4,
+                    crypto_sign_PUBLICKEYBYTES);
+                {
+                    std::shared_lock<std::shared_mutex>
+                        pkWhitelistLock(peerPKWhitelistMutex);
+                    if(!peerPKWhitelist.empty()
+                            && peerPKWhitelist.find(
+                                UDPC::PKContainer(iter->second.peer_pk))
+                                    == peerPKWhitelist.end()) {
+                        UDPC_CHECK_LOG(this, UDPC_LoggingType::UDPC_WARNING,
+                            "peer_pk is not in whitelist, not establishing "
+                            "connection with server");
+                        return;
+                    }
+                }
+                if(crypto_sign_verify_detached(
+                    (unsigned char*)(recvBuf + UDPC_MIN_HEADER_SIZE + 4
+                        + crypto_sign_PUBLICKEYBYTES),
+                    (unsigned char*)(iter->second.verifyMessage.get()),
+                    12,
+                    iter->second.peer_pk) != 0) {
+                    UDPC_CHECK_LOG(this, UDPC_LoggingType::UDPC_WARNING,
+                        "Failed to verify peer (server) ",
+                        receivedData.sin6_addr,
+                        ", port = ",
+                        ntohs(receivedData.sin6_port));
+                    return;
+                }
+#else
+                assert(!"libsodium disabled, invalid state");
+                UDPC_CHECK_LOG(this, UDPC_LoggingType::UDPC_ERROR,
+                    "libsodium is disabled, cannot process received "
+                    "packet");
+                return;
+#endif
+            } else if(pktType == 0 && iter->second.flags.test(6)) {
+                iter->second.flags.reset(6);
+                if(iter->second.flags.test(7)) {
+                    UDPC_CHECK_LOG(this, UDPC_LoggingType::UDPC_WARNING,
+                        "peer is not using libsodium, but peer_pk was "
+                        "pre-set, dropping to no-verification mode");
+                }
+            }
+
+            iter->second.flags.reset(3);
+            iter->second.id = conID;
+            iter->second.flags.set(4);
+            scheduleConnection(iter, nextDue(iter->second));
+            UDPC_CHECK_LOG(this, UDPC_LoggingType::UDPC_INFO,
+                "Established connection with server ",
+                receivedData.sin6_addr,
+                ", port = ",
+                ntohs(receivedData.sin6_port),
+                ", got id = ", conID,
+                flags.test(2) && iter->second.flags.test(6) ?
+                    ", libsodium enabled" : ", libsodium disabled");
+            if(isReceivingEvents.load()) {
+                pushEvent(UDPC_ET_CONNECTED, iter);
+            }
+        }
+        return;
+    }
+
+    auto iter = conMap.find(identifier);
+    if(iter == conMap.end() || iter->second.flags.test(3)
+            || !iter->second.flags.test(4) || iter->second.id != conID) {
+        return;
+    } else if(isPing && !isConnect) {
+        iter->second.flags.set(0);
+    }
+
+    if(pktType == 1) {
+#ifdef UDPC_LIBSODIUM_ENABLED
+        // verify signature of header
+        unsigned char sig[crypto_sign_BYTES];
+        std::memcpy(sig,
+                    recvBuf + UDPC_MIN_HEADER_SIZE + 1,
+                    crypto_sign_BYTES);
+        std::memset(recvBuf + UDPC_MIN_HEADER_SIZE + 1,
+                    0,
+                    crypto_sign_BYTES);
+        if(crypto_sign_verify_detached(
+            sig,
+            (unsigned char*)recvBuf,
+            bytes,
+            iter->second.peer_pk) != 0) {
+            UDPC_CHECK_LOG(
+                this,
+                UDPC_LoggingType::UDPC_INFO,
+                "Failed to verify received packet from",
+                receivedData.sin6_addr,
+                ", port = ",
+                ntohs(receivedData.sin6_port),
+                ", ignoring");
+            return;
+        }
+#else
+        assert(!"libsodium disabled, invalid state");
+        UDPC_CHECK_LOG(this, UDPC_LoggingType::UDPC_ERROR,
+            "libsodium is disabled, cannot process received packet");
+        return;
+#endif
+    }
+
+    // packet is valid
+    UDPC_CHECK_LOG(this,
+        UDPC_LoggingType::UDPC_VERBOSE,
+        "Received valid packet from ",
+        receivedData.sin6_addr,
+        ", port = ",
+        ntohs(receivedData.sin6_port),
+        ", packet id = ", seqID,
+        ", good mode = ", iter->second.flags.test(1) ? "yes" : "no",
+        isPing && !isConnect ? ", ping"
+            : (isPing && isConnect ? ", disc" : ""));
+
+    // check if is delete
+    if(isConnect && isPing) {
+        auto conIter = conMap.find(identifier);
+        if(conIter != conMap.end()) {
+            UDPC_CHECK_LOG(this,
+                UDPC_LoggingType::UDPC_VERBOSE,
+                "Packet is request-disconnect packet, deleting "
+                "connection...");
+            if(isReceivingEvents.load()) {
+                pushEvent(UDPC_ET_DISCONNECTED, conIter);
+            }
+            std::lock_guard<std::mutex> conMapLock(conMapMutex);
+            conMap.erase(conIter);
+            isPeerListChanged = true;
+            return;
+        }
+    }
+
+    // update rtt
+    if(UDPC::SentPkt *sent = iter->second.findSentPkt(rseq)) {
+        auto diff = now - sent->sentTime;
+        if(diff > iter->second.rtt) {
+            iter->second.rtt += (diff - iter->second.rtt) / 10;
+        } else {
+            iter->second.rtt -= (iter->second.rtt - diff) / 10;
+        }
+
+        iter->second.flags.set(
+            2, iter->second.rtt <= UDPC::GOOD_RTT_LIMIT);
+
+        UDPC_CHECK_LOG(this,
+            UDPC_LoggingType::UDPC_VERBOSE,
+            "RTT: ",
+            UDPC::durationToFSec(iter->second.rtt) * 1000.0f,
+            " milliseconds");
+    }
+
+    iter->second.received = now;
+
+    // merge the acks, packets may arrive out of order
+    {
+        UDPC::ConnectionData &con = iter->second;
+        const uint32_t ackDiff = rseq - con.peerRseq;
+        if(ackDiff == 0) {
+            con.peerAck |= ack;
+        } else if(ackDiff <= 0x7FFFFFFF) {
+            // more recent, the previous peerRseq is in the window if not
+            // too old
+            con.peerAck = (ackDiff < 32 ? con.peerAck >> ackDiff : 0)
+                | (ackDiff <= 32 ? 0x80000000 >> (ackDiff - 1) : 0)
+                | ack;
+            con.peerRseq = rseq;
+        } else if(0 - ackDiff <= 32) {
+            // older, rseq is in the window
+            const uint32_t olderDiff = 0 - ackDiff;
+            con.peerAck |= (0x80000000 >> (olderDiff - 1))
+                | (olderDiff < 32 ? ack >> olderDiff : 0);
+        }
+    }
+
+    // check pkt timeout
+    // Bit 31 of ack is rseq - 1, bit 0 is rseq - 32. Only the missing bits
+    // above the oldest received one are checked, oldest first.
+    if(ack != 0) {
+        uint32_t missing = ~ack & ~((ack & (~ack + 1)) - 1);
+        while(missing != 0) {
+            unsigned int bit = UDPC::lowestBit(missing);
+            missing &= missing - 1;
+            UDPC::SentPkt *sent = iter->second.findSentPkt(rseq - 32 + bit);
+            if(!sent) {
+                continue;
+            } else if(now - sent->sentTime <= UDPC::PACKET_TIMEOUT_TIME) {
+                // packets are sent in id order, newer ones did not time out
+                break;
+            }
+            resendTimedOut(iter->second, *sent);
+        }
+    }
+
+    // a resend or rtt change can make the connection due earlier
+    scheduleConnection(iter, nextDue(iter->second));
+
+    // calculate sequence and ack
+    bool isOutOfOrder = false;
+    uint32_t diff = 0;
+    if(seqID > iter->second.rseq) {
+        diff = seqID - iter->second.rseq;
+        if(diff <= 0x7FFFFFFF) {
+            // sequence is more recent
+            iter->second.rseq = seqID;
+            // none of the window is kept if the sequence moved past it, the
+            // previous rseq is in it if not older than the window
+            iter->second.ack = (diff < 32 ? iter->second.ack >> diff : 0)
+                | (diff <= 32 ? 0x80000000 >> (diff - 1) : 0);
+        } else {
+            // sequence is older, recalc diff
+            diff = 0xFFFFFFFF - seqID + 1 + iter->second.rseq;
+            // older than the ack window, it may have been received already
+            if(diff > 32 || (iter->second.ack & (0x80000000 >> (diff - 1))) != 0) {
+                // already received packet
+                UDPC_CHECK_LOG(this,
+                    UDPC_LoggingType::UDPC_VERBOSE,
+                    "Received packet is already marked as received, "
+                    "ignoring it");
+                return;
+            }
+            iter->second.ack |= 0x80000000 >> (diff - 1);
+            isOutOfOrder = true;
+        }
+    } else if(seqID < iter->second.rseq) {
+        diff = iter->second.rseq - seqID;
+        if(diff <= 0x7FFFFFFF) {
+            // sequence is older
+            // older than the ack window, it may have been received already
+            if(diff > 32 || (iter->second.ack & (0x80000000 >> (diff - 1))) != 0) {
+                // already received packet
+                UDPC_CHECK_LOG(this,
+                    UDPC_LoggingType::UDPC_VERBOSE,
+                    "Received packet is already marked as received, "
+                    "ignoring it");
+                return;
+            }
+            iter->second.ack |= 0x80000000 >> (diff - 1);
+            isOutOfOrder = true;
+        } else {
+            // sequence is more recent, recalc diff
+            diff = 0xFFFFFFFF - iter->second.rseq + 1 + seqID;
+            iter->second.rseq = seqID;
+            // none of the window is kept if the sequence moved past it, the
+            // previous rseq is in it if not older than the window
+            iter->second.ack = (diff < 32 ? iter->second.ack >> diff : 0)
+                | (diff <= 32 ? 0x80000000 >> (diff - 1) : 0);
+        }
+    } else {
+        // already received packet
+        UDPC_CHECK_LOG(this,
+            UDPC_LoggingType::UDPC_VERBOSE,
+            "Received packet is already marked as received, ignoring it");
+        return;
+    }
+
+    if(isOutOfOrder) {
+        UDPC_CHECK_LOG(this,
+            UDPC_LoggingType::UDPC_INFO,
+            "Received packet is out of order");
+    }
+
+    if(pktType == 0 && bytes > (int)UDPC_NSFULL_HEADER_SIZE) {
+        UDPC_PacketInfo recPktInfo = UDPC::get_empty_pinfo();
+        recPktInfo.dataSize = bytes - UDPC_NSFULL_HEADER_SIZE;
+        recPktInfo.data = takePayload(recvBuf,
+                                      UDPC_NSFULL_HEADER_SIZE,
+                                      recPktInfo.dataSize,
+                                      isAdopted);
+        recPktInfo.flags =
+            (isConnect ? 0x1 : 0)
+            | (isPing ? 0x2 : 0)
+            | (isNotRecChecked ? 0x4 : 0)
+            | (isResending ? 0x8 : 0);
+        recPktInfo.sender.addr = receivedData.sin6_addr;
+        recPktInfo.receiver.addr = in6addr_loopback;
+        recPktInfo.sender.port = ntohs(receivedData.sin6_port);
+        recPktInfo.receiver.port = ntohs(socketInfo.sin6_port);
+        recPktInfo.rtt = durationToMS(iter->second.rtt);
+        recPktInfo.id = seqID;
+        recPktInfo.handle = handleOf(iter);
+
+        pushReceived(recPktInfo);
+    } else if(pktType == 1 && bytes > (int)UDPC_LSFULL_HEADER_SIZE) {
+        UDPC_PacketInfo recPktInfo = UDPC::get_empty_pinfo();
+        recPktInfo.dataSize = bytes - UDPC_LSFULL_HEADER_SIZE;
+        recPktInfo.data = takePayload(recvBuf,
+                                      UDPC_LSFULL_HEADER_SIZE,
+                                      recPktInfo.dataSize,
+                                      isAdopted);
+        recPktInfo.flags =
+            (isConnect ? 0x1 : 0)
+            | (isPing ? 0x2 : 0)
+            | (isNotRecChecked ? 0x4 : 0)
+            | (isResending ? 0x8 : 0);
+        recPktInfo.sender.addr = receivedData.sin6_addr;
+        recPktInfo.receiver.addr = in6addr_loopback;
+        recPktInfo.sender.port = ntohs(receivedData.sin6_port);
+        recPktInfo.receiver.port = ntohs(socketInfo.sin6_port);
+        recPktInfo.rtt = durationToMS(iter->second.rtt);
+        recPktInfo.id = seqID;
+        recPktInfo.handle = handleOf(iter);
+
+        pushReceived(recPktInfo);
+    } else {
+        UDPC_CHECK_LOG(this,
+            UDPC_LoggingType::UDPC_VERBOSE,
+            "Received packet has no payload (probably heartbeat packet)");
+    }
+}
+
+void UDPC::Context::resendTimedOut(ConnectionData &con, SentPkt &sent) {
+    if((sent.flags & 0x4) != 0 || (sent.flags & 0x8) != 0) {
+        // already resent or not rec-checked pkt
+        return;
+    }
+
+    bool pktSigned = sent.data[UDPC_MIN_HEADER_SIZE] == 1;
+    if((pktSigned && sent.dataSize <= UDPC_LSFULL_HEADER_SIZE)
+            || (!pktSigned && sent.dataSize <= UDPC_NSFULL_HEADER_SIZE)) {
+        UDPC_CHECK_LOG(this,
+            UDPC_LoggingType::UDPC_VERBOSE,
+            "Timed out packet has no payload (probably "
+            "heartbeat packet), ignoring it");
+        sent.flags |= 0x8;
+        return;
+    }
+
+    UDPC_PacketInfo resendingData = UDPC::get_empty_pinfo();
+    if((sent.flags & 0x20) != 0) {
+        // re-sent with the same shared payload
+        const char *payload;
+        std::memcpy(&payload,
+            sent.data + UDPC_NSFULL_HEADER_SIZE,
+            sizeof(const char*));
+        BufferPool::share(payload);
+        resendingData.dataSize = sent.dataSize - UDPC_NSFULL_HEADER_SIZE;
+        resendingData.data = const_cast<char*>(payload);
+    } else if(pktSigned) {
+        resendingData.dataSize = sent.dataSize - UDPC_LSFULL_HEADER_SIZE;
+        resendingData.data = bufferPool->allocate(resendingData.dataSize);
+        std::memcpy(resendingData.data,
+            sent.data + UDPC_LSFULL_HEADER_SIZE,
+            resendingData.dataSize);
+    } else {
+        resendingData.dataSize = sent.dataSize - UDPC_NSFULL_HEADER_SIZE;
+        resendingData.data = bufferPool->allocate(resendingData.dataSize);
+        std::memcpy(resendingData.data,
+            sent.data + UDPC_NSFULL_HEADER_SIZE,
+            resendingData.dataSize);
+    }
+    resendingData.flags = 0;
+    con.priorityPkts.push_back(resendingData);
+    // the re-sent copy is tracked under its own id from here on
+    sent.flags |= 0x8;
+}
+
+bool UDPC::Context::isSendWindowed(const ConnectionData &con) const {
+    // with GSO enabled, queued packets are sent in bursts
+    return con.sendBurst > 1 || isGSOEnabled.load()
+        || con.goodModeSendRate < UDPC::GOOD_MODE_SEND_RATE
+        || con.badModeSendRate < UDPC::BAD_MODE_SEND_RATE;
+}
+
+bool UDPC::Context::isSendWindowOpen(
+        ConnectionData &con,
+        const std::chrono::steady_clock::time_point &now,
+        uint32_t size) {
+    for(; con.sendWindowStart != con.lseq; ++con.sendWindowStart) {
+        SentPkt *sent = con.findSentPkt(con.sendWindowStart);
+        if(!sent || (sent->flags & 0x4) != 0 || (sent->flags & 0x8) != 0) {
+            continue;
+        }
+
+        const uint32_t diff = con.peerRseq - sent->id;
+        if(diff > 0x7FFFFFFF) {
+            // not acked yet, newer ones were sent after it
+            if(now - sent->sentTime <= UDPC::PACKET_TIMEOUT_TIME) {
+                break;
+            }
+        } else if(diff == 0 || (diff < UDPC_ACK_WINDOW_SIZE
+                && (con.peerAck & (0x80000000 >> (diff - 1))) != 0)) {
+            // received
+            continue;
+        }
+        // reported missing, or timed out
+        resendTimedOut(con, *sent);
+    }
+    return con.lseq - con.sendWindowStart < size;
+}
+
+char *UDPC::Context::takePayload(
+        char *recvBuf,
+        unsigned int offset,
+        unsigned int size,
+        bool *isAdopted) {
+    if(isAdopted && size >= UDPC_RECV_ADOPT_MIN_SIZE) {
+        // BufferPool::deallocate() accepts the pointer into recvBuf
+        *isAdopted = true;
+        return recvBuf + offset;
+    }
+    char *data = bufferPool->allocate(size);
+    std::memcpy(data, recvBuf + offset, size);
+    return data;
+}
+
+void UDPC::Context::shrinkReceived(UDPC_PacketInfo &pinfo) {
+    if(pinfo.dataSize > UDPC_RECV_SHRINK_MAX_SIZE
+            || !BufferPool::isReceive(pinfo.data)) {
+        return;
+    }
+    char *data = bufferPool->allocate(pinfo.dataSize);
+    std::memcpy(data, pinfo.data, pinfo.dataSize);
+    // gives the receive buffer back for receiving
+    BufferPool::deallocate(pinfo.data);
+    pinfo.data = data;
+}
+
+UDPC::PktInfoWrapper::PktInfoWrapper() : pinfo(UDPC::get_empty_pinfo()) {
+}
+
+UDPC::PktInfoWrapper::PktInfoWrapper(UDPC_PacketInfo pinfo) : pinfo(pinfo) {
+}
+
+UDPC::PktInfoWrapper::~PktInfoWrapper() {
+    if (pinfo.data) {
+        BufferPool::deallocate(pinfo.data);
+    }
+}
+
+UDPC::PktInfoWrapper::PktInfoWrapper(const PktInfoWrapper &other) : pinfo(other.pinfo) {
+    // copies are not tied to a context, BufferPool::deallocate() also frees
+    // malloc'd data
+    if (pinfo.dataSize > 0) {
+        pinfo.data = static_cast<char*>(std::malloc(pinfo.dataSize));
+        std::memcpy(pinfo.data, other.pinfo.data, pinfo.dataSize);
+    } else {
+        pinfo.data = nullptr;
+    }
+}
+
+UDPC::PktInfoWrapper& UDPC::PktInfoWrapper::operator=(const PktInfoWrapper &other) {
+    pinfo = other.pinfo;
+    if (pinfo.dataSize > 0) {
+        pinfo.data = static_cast<char*>(std::malloc(pinfo.dataSize));
+        std::memcpy(pinfo.data, other.pinfo.data, pinfo.dataSize);
+    } else {
+        pinfo.data = nullptr;
+    }
+
+    return *this;
+}
+
+UDPC::PktInfoWrapper::PktInfoWrapper(PktInfoWrapper &&other) noexcept : pinfo(std::move(other.pinfo)) {
+    other.pinfo.data = nullptr;
+}
+
+UDPC::PktInfoWrapper& UDPC::PktInfoWrapper::operator=(PktInfoWrapper &&other) noexcept {
+    if (this == &other) {
+        return *this;
+    }
+    if (pinfo.data) {
+        BufferPool::deallocate(pinfo.data);
+    }
+    pinfo = std::move(other.pinfo);
+    other.pinfo.data = nullptr;
+
+    return *this;
+}
+
+UDPC::Context *UDPC::verifyContext(UDPC_HContext ctx) {
+    if(ctx == nullptr) {
+        return nullptr;
+    }
+    UDPC::Context *c = (UDPC::Context *)ctx;
+    if(c->_contextIdentifier == UDPC_CONTEXT_IDENTIFIER) {
+        return c;
+    } else {
+        return nullptr;
+    }
+}
+
+bool UDPC::isBigEndian() {
+    /*
+     * 0 - unset
+     * 1 - is big endian
+     * 2 - is not big endian
+     */
+    static char isBigEndian = 0;
+    if(isBigEndian != 0) {
+        return isBigEndian == 1;
+    }
+    union {
+        uint32_t i;
+        char c[4];
+    } bint = {0x01020304};
+
+    isBigEndian = (bint.c[0] == 1 ? 1 : 2);
+    return isBigEndian == 1;
+}
+
+void UDPC::be64(char *integer) {
+    if(UDPC::isBigEndian()) {
+        return;
+    }
+    char conv[8];
+    for(unsigned int i = 0; i < 8; ++i) {
+        conv[i] = integer[7 - i];
+    }
+    std::memcpy(integer, conv, 8);
+}
+
+void UDPC::be64_copy(char *out, const char *in) {
+    if(UDPC::isBigEndian()) {
+        return;
+    }
+    for(unsigned int i = 0; i < 8; ++i) {
+        out[i] = in[7 - i];
+    }
+}
+
+void UDPC::preparePacket(
+        char *data, uint32_t protocolID, uint32_t conID, uint32_t rseq,
+        uint32_t ack, uint32_t *seqID, int flags) {
+    uint32_t temp;
+
+    temp = htonl(protocolID);
+    std::memcpy(data, &temp, 4);
+    temp = htonl(conID | ((flags & 0x1) != 0 ? UDPC_ID_CONNECT : 0) |
+                 ((flags & 0x2) != 0 ? UDPC_ID_PING : 0) |
+                 ((flags & 0x4) != 0 ? UDPC_ID_NO_REC_CHK : 0) |
+                 ((flags & 0x8) != 0 ? UDPC_ID_RESENDING : 0));
+    std::memcpy(data + 4, &temp, 4);
+
+    if(seqID) {
+        temp = htonl(*seqID);
+        ++(*seqID);
+    } else {
+        temp = 0;
+    }
+    std::memcpy(data + 8, &temp, 4);
+
+    temp = htonl(rseq);
+    std::memcpy(data + 12, &temp, 4);
+    temp = htonl(ack);
+    std::memcpy(data + 16, &temp, 4);
+}
+
+uint32_t UDPC::generateConnectionID(Context &ctx) {
+    auto dist = std::uniform_int_distribution<uint32_t>(0, 0x0FFFFFFF);
+    uint32_t id = dist(ctx.rng_engine);
+    while(ctx.conMap.findConID(id) != ctx.conMap.end()) {
+        id = dist(ctx.rng_engine);
+    }
+    return id;
+}
+
+unsigned int UDPC::lowestBit(uint32_t bits) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctz(bits);
+#elif defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, bits);
+    return index;
+#else
+    unsigned int index = 0;
+    while((bits & 1) == 0) {
+        bits >>= 1;
+        ++index;
+    }
+    return index;
+#endif
+}
+
+std::chrono::steady_clock::duration UDPC::sendRateToDuration(unsigned int sends) {
+    return std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::microseconds(1000000 / sends));
+}
+
+void UDPC::clampSendRate(
+        unsigned int &goodModeRate,
+        unsigned int &badModeRate,
+        unsigned int &burst) {
+    goodModeRate = std::min(
+        std::max(goodModeRate, 1u), (unsigned int)UDPC_SEND_RATE_MAX);
+    badModeRate = std::min(std::max(badModeRate, 1u), goodModeRate);
+    burst = std::min(std::max(burst, 1u), (unsigned int)UDPC_SEND_BURST_MAX);
+}
+
+float UDPC::durationToFSec(const std::chrono::steady_clock::duration& duration) {
+    return (float)duration.count()
+        * (float)std::chrono::steady_clock::duration::period::num
+        / (float)std::chrono::steady_clock::duration::period::den;
+}
+
+uint16_t UDPC::durationToMS(const std::chrono::steady_clock::duration& duration) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(duration).count();
+}
+
+float UDPC::timePointsToFSec(
+        const std::chrono::steady_clock::time_point& older,
+        const std::chrono::steady_clock::time_point& newer) {
+    const auto dt = newer - older;
+    return (float)dt.count()
+        * (float)decltype(dt)::period::num / (float)decltype(dt)::period::den;
+}
+
+UDPC_PacketInfo UDPC::get_empty_pinfo() {
+    UDPC_PacketInfo pinfo;
+    std::memset(&pinfo, 0, sizeof(UDPC_PacketInfo));
+    return pinfo;
+}
+
+void UDPC::threadedUpdate(Context *ctx) {
+#if UDPC_PLATFORM == UDPC_PLATFORM_LINUX
+    if(ctx->epollFd >= 0) {
+        // update only when there is something to do
+        while(ctx->threadRunning.load()) {
+            ctx->update_impl();
+            ctx->waitForWork();
+        }
+        return;
+    }
+#endif
+    auto now = std::chrono::steady_clock::now();
+    decltype(now) nextNow;
+    while(ctx->threadRunning.load()) {
+        now = std::chrono::steady_clock::now();
+        ctx->update_impl();
+        nextNow = std::chrono::steady_clock::now();
+        std::this_thread::sleep_for(ctx->threadedSleepTime - (nextNow - now));
+    }
+}
+
+UDPC_ConnectionId UDPC_create_id(UDPC_IPV6_ADDR_TYPE addr, uint16_t port) {
+    UDPC_ConnectionId result;
+
+    std::memset(&result, 0, sizeof(UDPC_ConnectionId));
+
+    result.addr = addr;
+//    result.scope_id = 0;
+    result.port = port;
+    return result;
+}
+
+UDPC_ConnectionId UDPC_create_id_full(UDPC_IPV6_ADDR_TYPE addr, uint32_t scope_id, uint16_t port) {
+    UDPC_ConnectionId result;
+
+    std::memset(&result, 0, sizeof(UDPC_ConnectionId));
+
+    result.addr = addr;
+    result.scope_id = scope_id;
+    result.port = port;
+    return result;
+}
+
+UDPC_ConnectionId UDPC_create_id_anyaddr(uint16_t port) {
+    UDPC_ConnectionId result;
+
+    std::memset(&result, 0, sizeof(UDPC_ConnectionId));
+
+//    result.addr = in6addr_any;
+    result.scope_id = 0;
+    result.port = port;
+    return result;
+}
+
+UDPC_ConnectionId UDPC_create_id_easy(const char *addrString, uint16_t port) {
+    UDPC_ConnectionId result;
+
+    std::memset(&result, 0, sizeof(UDPC_ConnectionId));
+
+    result.port = port;
+
+    if(std::regex_match(addrString, ipv6_regex_nolink)
+            || std::regex_match(addrString, ipv4_regex)) {
+        result.addr = UDPC_strtoa(addrString);
+    } else if(std::regex_match(addrString, ipv6_regex_linkonly)) {
+        result.addr = UDPC_strtoa_link(addrString, &result.scope_id);
+    } else {
+        result.addr = in6addr_loopback;
+    }
+    return result;
+}
+
+UDPC_ConnectionId UDPC_create_id_hostname(const char *hostname, uint16_t port) {
+    UDPC_ConnectionId result;
+    std::memset(&result, 0, sizeof(UDPC_ConnectionId));
+    result.port = port;
+
+#if UDPC_PLATFORM == UDPC_PLATFORM_WINDOWS
+    WORD wVersionRequested = MAKEWORD(2, 2);
+    WSADATA wsaData;
+    if(WSAStartup(wVersionRequested, &wsaData) != 0) {
+        fprintf(stderr, "Failed to initialize Winsock\n");
+        return result;
+    }
+#elif UDPC_PLATFORM == UDPC_PLATFORM_MAC || UDPC_PLATFORM == UDPC_PLATFORM_LINUX
+#endif
+    addrinfo hints;
+    std::memset(&hints, 0, sizeof(addrinfo));
+
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    hints.ai_protocol = IPPROTO_UDP;
+
+    addrinfo *lookupResult;
+    int error = getaddrinfo(hostname, nullptr, &hints, &lookupResult);
+
+    if(error == 0) {
+        if(lookupResult->ai_family == AF_INET) {
+            sockaddr_in *a4 = (sockaddr_in*)lookupResult->ai_addr;
+            result.addr = UDPC_a4toa6(a4->sin_addr.s_addr);
+        } else if(lookupResult->ai_family == AF_INET6) {
+            sockaddr_in6 *a6 = (sockaddr_in6*)lookupResult->ai_addr;
+            result.addr = a6->sin6_addr;
+        } else {
+            result.addr = in6addr_loopback;
+        }
+        freeaddrinfo(lookupResult);
+    } else {
+        result.addr = in6addr_loopback;
+    }
+
+#if UDPC_PLATFORM == UDPC_PLATFORM_WINDOWS
+    WSACleanup();
+#endif
+
+    return result;
+}
+
+UDPC::Context *UDPC::initContext(
+        UDPC_ConnectionId listenId,
+        int isClient,
+        int isUsingLibsodium,
+        bool isReusePort) {
+    UDPC::Context *ctx = new UDPC::Context(false);
+    ctx->flags.set(1, isClient != 0);
+    ctx->authPolicy.exchange(UDPC_AuthPolicy::UDPC_AUTH_POLICY_FALLBACK);
+
+    UDPC_CHECK_LOG(ctx, UDPC_LoggingType::UDPC_INFO, "Got listen addr ",
+        listenId.addr);
+
+    if(isUsingLibsodium) {
+#ifdef UDPC_LIBSODIUM_ENABLED
+        // initialize libsodium
+        if(sodium_init() < 0) {
+            UDPC_CHECK_LOG(ctx, UDPC_LoggingType::UDPC_ERROR,
+                "Failed to initialize libsodium");
+            delete ctx;
+            return nullptr;
+        } else {
+            ctx->flags.set(2);
+        }
+#else
+        UDPC_CHECK_LOG(ctx, UDPC_LoggingType::UDPC_ERROR,
+            "Cannot use libsodium, UDPC was compiled without libsodium support");
+        delete ctx;
+        return nullptr;
+#endif
+    } else {
+        ctx->flags.reset(2);
+    }
+
+#if UDPC_PLATFORM == UDPC_PLATFORM_WINDOWS
+    // Initialize Winsock
+    WORD wVersionRequested = MAKEWORD(2, 2);
+    WSADATA wsaData;
+    if(WSAStartup(wVersionRequested, &wsaData) != 0) {
+        UDPC_CHECK_LOG(ctx, UDPC_LoggingType::UDPC_ERROR, "Failed to initialize Winsock");
+        delete ctx;
+        return nullptr;
+    }
+#endif
+
+    // create socket
+    ctx->socketHandle = socket(AF_INET6, SOCK_DGRAM, IPPROTO_UDP);
+    if(UDPC_SOCKET_RETURN_ERROR(ctx->socketHandle)) {
+        // TODO maybe different way of handling init fail
+#if UDPC_PLATFORM == UDPC_PLATFORM_WINDOWS
+        UDPC_CHECK_LOG(ctx, UDPC_LoggingType::UDPC_ERROR, "Failed to create socket, ",
+            WSAGetLastError());
+#else
+        UDPC_CHECK_LOG(ctx, UDPC_LoggingType::UDPC_ERROR, "Failed to create socket");
+#endif
+        delete ctx;
+        return nullptr;
+    }
+
+    // allow ipv4 connections on ipv6 socket
+    {
+#if UDPC_PLATFORM == UDPC_PLATFORM_WINDOWS
+        char no = 0;
+#else
+        int no = 0;
+#endif
+        setsockopt(ctx->socketHandle, IPPROTO_IPV6, IPV6_V6ONLY, &no, sizeof(no));
+    }
+
+    // allow other sockets of a sharded context to bind the same port
+    if(isReusePort) {
+#ifdef SO_REUSEPORT
+        int yes = 1;
+        if(setsockopt(ctx->socketHandle, SOL_SOCKET, SO_REUSEPORT,
+                &yes, sizeof(yes)) != 0) {
+            UDPC_CHECK_LOG(ctx, UDPC_LoggingType::UDPC_ERROR,
+                "Failed to set SO_REUSEPORT on socket");
+            UDPC_CLEANUPSOCKET(ctx->socketHandle);
+            delete ctx;
+            return nullptr;
+        }
+#else
+        UDPC_CHECK_LOG(ctx, UDPC_LoggingType::UDPC_ERROR,
+            "SO_REUSEPORT is not supported on this platform");
+        UDPC_CLEANUPSOCKET(ctx->socketHandle);
+        delete ctx;
+        return nullptr;
+#endif
+    }
+
+    // bind socket
+    ctx->socketInfo.sin6_family = AF_INET6;
+    ctx->socketInfo.sin6_addr = listenId.addr;
+    ctx->socketInfo.sin6_port = htons(listenId.port);
+    ctx->socketInfo.sin6_flowinfo = 0;
+    ctx->socketInfo.sin6_scope_id = listenId.scope_id;
+    if(bind(ctx->socketHandle, (const struct sockaddr *)&ctx->socketInfo,
+            sizeof(UDPC_IPV6_SOCKADDR_TYPE)) < 0) {
+        // TODO maybe different way of handling init fail
+        UDPC_CHECK_LOG(ctx, UDPC_LoggingType::UDPC_ERROR, "Failed to bind socket");
+        UDPC_CLEANUPSOCKET(ctx->socketHandle);
+        delete ctx;
+        return nullptr;
+    }
+
+    // TODO verify this is necessary to get the listen port
+    if(ctx->socketInfo.sin6_port == 0) {
+        UDPC_IPV6_SOCKADDR_TYPE getInfo;
+        socklen_t size = sizeof(UDPC_IPV6_SOCKADDR_TYPE);
+        if(getsockname(ctx->socketHandle, (struct sockaddr *)&getInfo, &size) == 0) {
+            ctx->socketInfo.sin6_port = getInfo.sin6_port;
+        }
+    }
+
+    // set non-blocking on socket
+#if UDPC_PLATFORM == UDPC_PLATFORM_MAC || UDPC_PLATFORM == UDPC_PLATFORM_LINUX
+    int nonblocking = 1;
+    if(fcntl(ctx->socketHandle, F_SETFL, O_NONBLOCK, nonblocking) == -1) {
+#elif UDPC_PLATFORM == UDPC_PLATFORM_WINDOWS
+    DWORD nonblocking = 1;
+    if(ioctlsocket(ctx->socketHandle, FIONBIO, &nonblocking) != 0) {
+#else
+    {
+#endif
+        // TODO maybe different way of handling init fail
+        UDPC_CHECK_LOG(ctx, UDPC_LoggingType::UDPC_ERROR, "Failed to set nonblocking on socket");
+        UDPC_CLEANUPSOCKET(ctx->socketHandle);
+        delete ctx;
+        return nullptr;
+    }
+
+#if UDPC_PLATFORM == UDPC_PLATFORM_LINUX
+    ctx->setupPolling();
+#endif
+
+    UDPC_CHECK_LOG(ctx, UDPC_LoggingType::UDPC_INFO, "Initialized UDPC");
+
+    return ctx;
+}
+
+UDPC_HContext UDPC_init(UDPC_ConnectionId listenId, int isClient, int isUsingLibsodium) {
+    return (UDPC_HContext) UDPC::initContext(
+        listenId, isClient, isUsingLibsodium, false);
+}
+
+UDPC_HContext UDPC_init_threaded_update(UDPC_ConnectionId listenId,
+                                int isClient, int isUsingLibsodium) {
+    UDPC::Context *ctx = (UDPC::Context *)UDPC_init(listenId, isClient, isUsingLibsodium);
+    if(!ctx) {
+        return nullptr;
+    }
+
+    ctx->isAutoUpdating.store(true);
+    ctx->threadedSleepTime = std::chrono::milliseconds(UDPC_UPDATE_MS_DEFAULT);
+    ctx->thread = std::thread(UDPC::threadedUpdate, ctx);
+
+    UDPC_CHECK_LOG(ctx, UDPC_LoggingType::UDPC_INFO, "Initialized threaded UDPC");
+
+    return (UDPC_HContext) ctx;
+}
+
+UDPC_HContext UDPC_init_threaded_update_ms(
+        UDPC_ConnectionId listenId,
+        int isClient,int updateMS, int isUsingLibsodium) {
+    UDPC::Context *ctx = (UDPC::Context *)UDPC_init(
+        listenId, isClient, isUsingLibsodium);
+    if(!ctx) {
+        return nullptr;
+    }
+
+    ctx->isAutoUpdating.store(true);
+    if(updateMS < UDPC_UPDATE_MS_MIN) {
+        ctx->threadedSleepTime = std::chrono::milliseconds(UDPC_UPDATE_MS_MIN);
+    } else if(updateMS > UDPC_UPDATE_MS_MAX) {
+        ctx->threadedSleepTime = std::chrono::milliseconds(UDPC_UPDATE_MS_MAX);
+    } else {
+        ctx->threadedSleepTime = std::chrono::milliseconds(updateMS);
+    }
+    ctx->thread = std::thread(UDPC::threadedUpdate, ctx);
+
+    UDPC_CHECK_LOG(ctx, UDPC_LoggingType::UDPC_INFO, "Initialized threaded UDPC");
+
+    return (UDPC_HContext) ctx;
+}
+
+UDPC_HContext UDPC_init_io_engine(
+        UDPC_ConnectionId listenId,
+        int isClient,
+        int isUsingLibsodium,
+        UDPC_IOEngine ioEngine) {
+    UDPC::Context *ctx = (UDPC::Context *)UDPC_init(
+        listenId, isClient, isUsingLibsodium);
+    if(!ctx) {
+        return nullptr;
+    }
+
+    if(ioEngine == UDPC_IO_ENGINE_IO_URING) {
+#ifdef UDPC_IO_URING_ENABLED
+        if(ctx->setupIOUring()) {
+            ctx->ioEngine = UDPC_IO_ENGINE_IO_URING;
+            UDPC_CHECK_LOG(ctx, UDPC_LoggingType::UDPC_INFO,
+                "Using io_uring I/O engine");
+        }
+#else
+        UDPC_CHECK_LOG(ctx, UDPC_LoggingType::UDPC_WARNING,
+            "UDPC was compiled without io_uring support, using socket I/O");
+#endif
+    }
+
+    return (UDPC_HContext) ctx;
+}
+
+UDPC_IOEngine UDPC_get_io_engine(UDPC_HContext ctx) {
+    UDPC::Context *c = UDPC::verifyContext(ctx);
+    if(!c) {
+        return UDPC_IO_ENGINE_SOCKET;
+    }
+
+    return c->ioEngine;
+}
+
+UDPC_HContext UDPC_init_sharded(
+        UDPC_ConnectionId listenId,
+        unsigned int workerCount,
+        int isUsingLibsodium) {
+#if UDPC_PLATFORM != UDPC_PLATFORM_LINUX
+    // other platforms do not balance SO_REUSEPORT UDP sockets
+    (void)workerCount;
+    return UDPC_init_threaded_update(listenId, 0, isUsingLibsodium);
+#else
+    if(workerCount < 1) {
+        workerCount = 1;
+    } else if(workerCount > UDPC_SHARDS_MAX) {
+        workerCount = UDPC_SHARDS_MAX;
+    }
+
+    UDPC::Context *ctx = new UDPC::Context(false);
+    ctx->flags.reset(1);
+    ctx->authPolicy.exchange(UDPC_AuthPolicy::UDPC_AUTH_POLICY_FALLBACK);
+
+    for(unsigned int i = 0; i < workerCount; ++i) {
+        UDPC::Context *shard = UDPC::initContext(
+            listenId, 0, isUsingLibsodium, true);
+        if(!shard) {
+            UDPC_CHECK_LOG(ctx, UDPC_LoggingType::UDPC_ERROR,
+                "Failed to initialize shard ", i);
+            UDPC_destroy((UDPC_HContext)ctx);
+            return nullptr;
+        }
+        if(i == 0) {
+            // remaining shards must bind the port actually bound
+            listenId.port = ntohs(shard->socketInfo.sin6_port);
+            ctx->socketInfo = shard->socketInfo;
+            ctx->flags.set(2, shard->flags.test(2));
+        }
+        shard->shardIndex = i;
+        shard->shardedContext = ctx;
+        ctx->shards.push_back(shard);
+    }
+
+    for(UDPC::Context *shard : ctx->shards) {
+        UDPC_enable_threaded_update((UDPC_HContext)shard);
+    }
+
+    UDPC_CHECK_LOG(ctx, UDPC_LoggingType::UDPC_INFO,
+        "Initialized sharded UDPC with ", workerCount, " workers");
+
+    return (UDPC_HContext) ctx;
+#endif
+}
+
+int UDPC_enable_threaded_update(UDPC_HContext ctx) {
+    UDPC::Context *c = UDPC::verifyContext(ctx);
+    if (!c) {
+        return 0;
+    }
+
+    if(!c->shards.empty()) {
+        int result = 0;
+        for(UDPC::Context *shard : c->shards) {
+            if(UDPC_enable_threaded_update((UDPC_HContext)shard)) {
+                result = 1;
+            }
+        }
+        return result;
+    }
+
+    c->enableDisableFuncRunningCount.fetch_add(1);
+
+    std::lock_guard<std::mutex> setThreadedLock(c->setThreadedUpdateMutex);
+
+    if(c->flags.test(0) || c->isAutoUpdating.load() || c->thread.joinable()) {
+        c->enableDisableFuncRunningCount.fetch_sub(1);
+        return 0;
+    }
+
+    c->isAutoUpdating.store(true);
+    c->threadedSleepTime = std::chrono::milliseconds(UDPC_UPDATE_MS_DEFAULT);
+    c->threadRunning.store(true);
+    c->thread = std::thread(UDPC::threadedUpdate, c);
+
+    UDPC_CHECK_LOG(c, UDPC_LoggingType::UDPC_INFO, "Started threaded update");
+
+    c->enableDisableFuncRunningCount.fetch_sub(1);
+
+    return 1;
+}
+
+int UDPC_enable_threaded_update_ms(UDPC_HContext ctx, int updateMS) {
+    UDPC::Context *c = UDPC::verifyContext(ctx);
+    if (!c) {
+        return 0;
+    }
+
+    if(!c->shards.empty()) {
+        int result = 0;
+        for(UDPC::Context *shard : c->shards) {
+            if(UDPC_enable_threaded_update_ms((UDPC_HContext)shard, updateMS)) {
+                result = 1;
+            }
+        }
+        return result;
+    }
+
+    c->enableDisableFuncRunningCount.fetch_add(1);
+
+    std::lock_guard<std::mutex> setThreadedLock(c->setThreadedUpdateMutex);
+
+    if(c->flags.test(0) || c->isAutoUpdating.load() || c->thread.joinable()) {
+        c->enableDisableFuncRunningCount.fetch_sub(1);
+        return 0;
+    }
+
+    c->isAutoUpdating.store(true);
+    if(updateMS < UDPC_UPDATE_MS_MIN) {
+        c->threadedSleepTime = std::chrono::milliseconds(UDPC_UPDATE_MS_MIN);
+    } else if(updateMS > UDPC_UPDATE_MS_MAX) {
+        c->threadedSleepTime = std::chrono::milliseconds(UDPC_UPDATE_MS_MAX);
+    } else {
+        c->threadedSleepTime = std::chrono::milliseconds(updateMS);
+    }
+    c->threadRunning.store(true);
+    c->thread = std::thread(UDPC::threadedUpdate, c);
+
+    UDPC_CHECK_LOG(c, UDPC_LoggingType::UDPC_INFO, "Started threaded update");
+
+    c->enableDisableFuncRunningCount.fetch_sub(1);
+
+    return 1;
+}
+
+int UDPC_disable_threaded_update(UDPC_HContext ctx) {
+    UDPC::Context *c = UDPC::verifyContext(ctx);
+    if (!c) {
+        return 0;
+    }
+
+    if(!c->shards.empty()) {
+        int result = 0;
+        for(UDPC::Context *shard : c->shards) {
+            if(UDPC_disable_threaded_update((UDPC_HContext)shard)) {
+                result = 1;
+            }
+        }
+        return result;
+    }
+
+    c->enableDisableFuncRunningCount.fetch_add(1);
+
+    std::lock_guard<std::mutex> setThreadedLock(c->setThreadedUpdateMutex);
 
-    UDPC_CHECK_LOG(ctx, UDPC_LoggingType::UDPC_INFO, "Got listen addr ",
-        listenId.addr);
+    if(c->flags.test(0) || !c->isAutoUpdating.load() || !c->thread.joinable()) {
+        c->enableDisableFuncRunningCount.fetch_sub(1);
+        return 0;
+    }
 
-    if(isUsingLibsodium) {
-#ifdef UDPC_LIBSODIUM_ENABLED
-        // initialize libsodium
-        if(sodium_init() < 0) {
-            UDPC_CHECK_LOG(ctx, UDPC_LoggingType::UDPC_ERROR,
-                "Failed to initialize libsodium");
-            delete ctx;
-            return nullptr;
-        } else {
-            ctx->flags.set(2);
+    c->threadRunning.store(false);
+    c->wake();
+    c->thread.join();
+    c->isAutoUpdating.store(false);
+
+    UDPC_CHECK_LOG(c, UDPC_LoggingType::UDPC_INFO, "Stopped threaded update");
+
+    c->enableDisableFuncRunningCount.fetch_sub(1);
+
+    return 1;
+}
+
+int UDPC_is_valid_context(UDPC_HContext ctx) {
+    return UDPC::verifyContext(ctx) != nullptr ? 1 : 0;
+}
+
+void UDPC_destroy(UDPC_HContext ctx) {
+    UDPC::Context *UDPC_ctx = UDPC::verifyContext(ctx);
+    if(UDPC_ctx) {
+        // A sharded context owns its shards, and has no socket or thread.
+        if(!UDPC_ctx->shards.empty()) {
+            std::vector<UDPC::Context*> shards;
+            {
+                // shards stop publishing to this context's peerList
+                std::lock_guard<std::mutex>
+                    peerListLock(UDPC_ctx->peerListMutex);
+                shards.swap(UDPC_ctx->shards);
+            }
+            for(UDPC::Context *shard : shards) {
+                UDPC_destroy((UDPC_HContext)shard);
+            }
+            UDPC_ctx->_contextIdentifier = 0;
+            delete UDPC_ctx;
+            return;
         }
-#else
-        UDPC_CHECK_LOG(ctx, UDPC_LoggingType::UDPC_ERROR,
-            "Cannot use libsodium, UDPC was compiled without libsodium support");
-        delete ctx;
-        return nullptr;
+
+        {
+            // Acquire lock so that this code does not run at the same time as
+            // enabling/disabling threaded-update.
+            std::lock_guard<std::mutex>
+                setThreadedLock(UDPC_ctx->setThreadedUpdateMutex);
+
+            // Stop thread if threaded.
+            // Set atomic bool to false always so that the thread will always
+            // stop at this point.
+            UDPC_ctx->threadRunning.store(false);
+            UDPC_ctx->wake();
+            if(UDPC_ctx->isAutoUpdating.load() && UDPC_ctx->thread.joinable()) {
+                UDPC_ctx->thread.join();
+            }
+            UDPC_ctx->isAutoUpdating.store(false);
+
+            // Set destructing flag.
+            UDPC_ctx->flags.set(0);
+
+            // Drop lock at this point before destructing the context.
+        }
+
+        // After lock has been dropped, wait in case there are enable/disable
+        // threaded update functions waiting on the lock. Do this via a
+        // atomic-int-based spin-lock.
+        while(UDPC_ctx->enableDisableFuncRunningCount.load() != 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+
+#if UDPC_PLATFORM == UDPC_PLATFORM_WINDOWS
+        WSACleanup();
 #endif
-    } else {
-        ctx->flags.reset(2);
+        UDPC_ctx->_contextIdentifier = 0;
+        delete UDPC_ctx;
     }
+}
 
-#if UDPC_PLATFORM == UDPC_PLATFORM_WINDOWS
-    // Initialize Winsock
-    WORD wVersionRequested = MAKEWORD(2, 2);
-    WSADATA wsaData;
-    if(WSAStartup(wVersionRequested, &wsaData) != 0) {
-        UDPC_CHECK_LOG(ctx, UDPC_LoggingType::UDPC_ERROR, "Failed to initialize Winsock");
-        delete ctx;
-        return nullptr;
+void UDPC_update(UDPC_HContext ctx) {
+    UDPC::Context *c = UDPC::verifyContext(ctx);
+    if(c && !c->shards.empty()) {
+        for(UDPC::Context *shard : c->shards) {
+            UDPC_update((UDPC_HContext)shard);
+        }
+        return;
+    }
+    if(!c || c->isAutoUpdating.load()) {
+        // invalid or is threaded, update should not be called
+        return;
+    }
+
+    c->update_impl();
+#if UDPC_PLATFORM == UDPC_PLATFORM_LINUX
+    if(c->isPollFdUsed.load()) {
+        // make the pollable fd readable when the next update is due
+        c->armTimer(c->nextDeadline());
     }
 #endif
+}
 
-    // create socket
-    ctx->socketHandle = socket(AF_INET6, SOCK_DGRAM, IPPROTO_UDP);
-    if(UDPC_SOCKET_RETURN_ERROR(ctx->socketHandle)) {
-        // TODO maybe different way of handling init fail
-#if UDPC_PLATFORM == UDPC_PLATFORM_WINDOWS
-        UDPC_CHECK_LOG(ctx, UDPC_LoggingType::UDPC_ERROR, "Failed to create socket, ",
-            WSAGetLastError());
+int UDPC_get_pollable_fd(UDPC_HContext ctx) {
+    UDPC::Context *c = UDPC::verifyContext(ctx);
+    if(!c || c->isAutoUpdating.load()) {
+        return -1;
+    }
+
+#if UDPC_PLATFORM == UDPC_PLATFORM_LINUX
+    if(c->epollFd >= 0) {
+        c->isPollFdUsed.store(true);
+        c->armTimer(c->nextDeadline());
+    }
+    return c->epollFd;
 #else
-        UDPC_CHECK_LOG(ctx, UDPC_LoggingType::UDPC_ERROR, "Failed to create socket");
+    return -1;
 #endif
-        delete ctx;
-        return nullptr;
+}
+
+int64_t UDPC_get_next_deadline_us(UDPC_HContext ctx) {
+    UDPC::Context *c = UDPC::verifyContext(ctx);
+    if(!c) {
+        return -1;
     }
 
-    // allow ipv4 connections on ipv6 socket
-    {
-#if UDPC_PLATFORM == UDPC_PLATFORM_WINDOWS
-        char no = 0;
-#else
-        int no = 0;
+    const auto deadline = c->nextDeadline();
+    if(deadline == std::chrono::steady_clock::time_point::max()) {
+        return -1;
+    }
+    const auto now = std::chrono::steady_clock::now();
+    if(deadline <= now) {
+        return 0;
+    }
+    // round up, so that the update is not called just before it is due
+    auto us = std::chrono::duration_cast<std::chrono::microseconds>(
+        deadline - now);
+    if(now + us < deadline) {
+        ++us;
+    }
+    return us.count();
+}
+
+void UDPC_client_initiate_connection(
+        UDPC_HContext ctx,
+        UDPC_ConnectionId connectionId,
+        int enableLibSodium) {
+    UDPC::Context *c = UDPC::verifyContext(ctx);
+    if(!c || !c->flags.test(1)) {
+        return;
+    }
+#ifndef UDPC_LIBSODIUM_ENABLED
+    if(enableLibSodium) {
+        UDPC_CHECK_LOG(c, UDPC_LoggingType::UDPC_ERROR,
+            "Cannot enable libsodium, UDPC was compiled without libsodium");
+        return;
+    }
 #endif
-        setsockopt(ctx->socketHandle, IPPROTO_IPV6, IPV6_V6ONLY, &no, sizeof(no));
+
+    if(!c->internalEvents.push_back(UDPC_Event{UDPC_ET_REQUEST_CONNECT, connectionId, enableLibSodium, 0})) {
+        UDPC_CHECK_LOG(c, UDPC_LoggingType::UDPC_WARNING,
+            "Internal event queue is full, not initiating connection");
+        return;
     }
+    c->wake();
+}
 
-    // bind socket
-    ctx->socketInfo.sin6_family = AF_INET6;
-    ctx->socketInfo.sin6_addr = listenId.addr;
-    ctx->socketInfo.sin6_port = htons(listenId.port);
-    ctx->socketInfo.sin6_flowinfo = 0;
-    ctx->socketInfo.sin6_scope_id = listenId.scope_id;
-    if(bind(ctx->socketHandle, (const struct sockaddr *)&ctx->socketInfo,
-            sizeof(UDPC_IPV6_SOCKADDR_TYPE)) < 0) {
-        // TODO maybe different way of handling init fail
-        UDPC_CHECK_LOG(ctx, UDPC_LoggingType::UDPC_ERROR, "Failed to bind socket");
-        UDPC_CLEANUPSOCKET(ctx->socketHandle);
-        delete ctx;
-        return nullptr;
+void UDPC_queue_send(UDPC_HContext ctx, UDPC_ConnectionId destinationId,
+                     int isChecked, const void *data, uint32_t size) {
+    if(size == 0 || !data) {
+        return;
+    }
+
+    UDPC::Context *c = UDPC::verifyContext(ctx);
+    if(!c) {
+        return;
+    }
+
+    if(!c->shards.empty()) {
+        UDPC_queue_send((UDPC_HContext)c->shardFor(destinationId),
+            destinationId, isChecked, data, size);
+        return;
+    }
+
+    UDPC::PktInfoWrapper sendInfoWrapper{};
+    UDPC_PacketInfo &sendInfo = sendInfoWrapper.pinfo;
+    sendInfo.dataSize = size;
+    sendInfo.data = c->bufferPool->allocate(sendInfo.dataSize);
+    std::memcpy(sendInfo.data, data, size);
+    sendInfo.sender.addr = in6addr_loopback;
+    sendInfo.sender.port = ntohs(c->socketInfo.sin6_port);
+    sendInfo.receiver.addr = destinationId.addr;
+    sendInfo.receiver.port = destinationId.port;
+    sendInfo.flags = (isChecked != 0 ? 0x0 : 0x4);
+
+    c->pushSend(sendInfoWrapper);
+}
+
+void UDPC_queue_send_h(UDPC_HContext ctx, UDPC_ConnectionHandle handle,
+                       int isChecked, const void *data, uint32_t size) {
+    if(size == 0 || !data || handle == 0) {
+        return;
+    }
+
+    UDPC::Context *c = UDPC::verifyContext(ctx);
+    if(!c) {
+        return;
+    }
+
+    if(!c->shards.empty()) {
+        UDPC::Context *shard = c->shardForHandle(handle);
+        if(shard) {
+            UDPC_queue_send_h((UDPC_HContext)shard,
+                handle, isChecked, data, size);
+        }
+        return;
+    }
+
+    // the receiver is set from the handle's connection in update
+    UDPC::PktInfoWrapper sendInfoWrapper{};
+    UDPC_PacketInfo &sendInfo = sendInfoWrapper.pinfo;
+    sendInfo.dataSize = size;
+    sendInfo.data = c->bufferPool->allocate(sendInfo.dataSize);
+    std::memcpy(sendInfo.data, data, size);
+    sendInfo.sender.addr = in6addr_loopback;
+    sendInfo.sender.port = ntohs(c->socketInfo.sin6_port);
+    sendInfo.flags = (isChecked != 0 ? 0x0 : 0x4);
+    sendInfo.handle = handle;
+
+    c->pushSend(sendInfoWrapper);
+}
+
+unsigned long UDPC_queue_send_batch(
+        UDPC_HContext ctx, const UDPC_SendItem *items, unsigned long count,
+        UDPC_SendResult *results) {
+    UDPC::Context *c = UDPC::verifyContext(ctx);
+    if(!c || !items) {
+        if(results) {
+            for(unsigned long i = 0; i < count; ++i) {
+                results[i] = UDPC_SR_INVALID;
+            }
+        }
+        return 0;
+    }
+
+    if(!c->shards.empty()) {
+        // each shard gets the items to the peers it owns as one batch
+        std::vector<unsigned long> order;
+        std::vector<unsigned long> offsets;
+        c->groupByShard(count,
+            [items] (unsigned long i) -> const UDPC_ConnectionId& {
+                return items[i].destinationId;
+            },
+            order, offsets);
+
+        unsigned long queued = 0;
+        std::vector<UDPC_SendItem> shardItems;
+        std::vector<UDPC_SendResult> shardResults;
+        for(std::size_t s = 0; s < c->shards.size(); ++s) {
+            if(offsets[s] == offsets[s + 1]) {
+                continue;
+            }
+            shardItems.clear();
+            for(unsigned long j = offsets[s]; j < offsets[s + 1]; ++j) {
+                shardItems.push_back(items[order[j]]);
+            }
+            shardResults.resize(shardItems.size());
+            queued += UDPC_queue_send_batch((UDPC_HContext)c->shards[s],
+                shardItems.data(), shardItems.size(), shardResults.data());
+            if(results) {
+                for(std::size_t i = 0; i < shardResults.size(); ++i) {
+                    results[order[offsets[s] + i]] = shardResults[i];
+                }
+            }
+        }
+        return queued;
+    }
+
+    std::vector<UDPC_SendResult> localResults;
+    if(!results) {
+        localResults.resize(count);
+        results = localResults.data();
+    }
+
+    // packets accepted so far to each connection, on top of its sendPkts
+    std::unordered_map<UDPC_ConnectionId, unsigned long,
+        UDPC::ConnectionIdHasher> accepted;
+    {
+        std::lock_guard<std::mutex> conMapLock(c->conMapMutex);
+        for(unsigned long i = 0; i < count; ++i) {
+            const UDPC_SendItem &item = items[i];
+            if(item.size == 0 || !item.data) {
+                results[i] = UDPC_SR_INVALID;
+                continue;
+            }
+            auto iter = c->conMap.find(item.destinationId);
+            if(iter == c->conMap.end()) {
+                results[i] = UDPC_SR_NOT_CONNECTED;
+                continue;
+            }
+            unsigned long &queuedCount = accepted[item.destinationId];
+            if(iter->second.sendPkts.size() + queuedCount
+                    >= UDPC_QUEUED_PKTS_MAX_SIZE) {
+                results[i] = UDPC_SR_CONNECTION_QUEUE_FULL;
+                continue;
+            }
+            ++queuedCount;
+            results[i] = UDPC_SR_QUEUED;
+        }
+    }
+
+    std::vector<UDPC::PktInfoWrapper> wrappers;
+    std::vector<unsigned long> indices;
+    wrappers.reserve(count);
+    indices.reserve(count);
+    for(unsigned long i = 0; i < count; ++i) {
+        if(results[i] != UDPC_SR_QUEUED) {
+            continue;
+        }
+        const UDPC_SendItem &item = items[i];
+        wrappers.emplace_back();
+        UDPC_PacketInfo &sendInfo = wrappers.back().pinfo;
+        sendInfo.dataSize = item.size;
+        sendInfo.data = c->bufferPool->allocate(sendInfo.dataSize);
+        std::memcpy(sendInfo.data, item.data, item.size);
+        sendInfo.sender.addr = in6addr_loopback;
+        sendInfo.sender.port = ntohs(c->socketInfo.sin6_port);
+        sendInfo.receiver.addr = item.destinationId.addr;
+        sendInfo.receiver.port = item.destinationId.port;
+        sendInfo.flags = (item.isChecked != 0 ? 0x0 : 0x4);
+        indices.push_back(i);
+    }
+    if(wrappers.empty()) {
+        return 0;
+    }
+
+    // the wrappers that did not fit free their data when destroyed
+    const std::size_t pushed = c->pushSends(wrappers.data(), wrappers.size());
+    for(std::size_t i = pushed; i < indices.size(); ++i) {
+        results[indices[i]] = UDPC_SR_SEND_QUEUE_FULL;
+    }
+    return pushed;
+}
+
+unsigned long UDPC_queue_send_many(
+        UDPC_HContext ctx, const UDPC_ConnectionId *destinationIds,
+        unsigned long count, int isChecked, const void *data, uint32_t size) {
+    if(size == 0 || !data || !destinationIds || count == 0) {
+        return 0;
+    }
+
+    UDPC::Context *c = UDPC::verifyContext(ctx);
+    if(!c) {
+        return 0;
+    }
+
+    if(!c->shards.empty()) {
+        // each shard shares a copy of the payload from its own pool
+        std::vector<unsigned long> order;
+        std::vector<unsigned long> offsets;
+        c->groupByShard(count,
+            [destinationIds] (unsigned long i) -> const UDPC_ConnectionId& {
+                return destinationIds[i];
+            },
+            order, offsets);
+
+        unsigned long queued = 0;
+        std::vector<UDPC_ConnectionId> shardIds;
+        for(std::size_t s = 0; s < c->shards.size(); ++s) {
+            if(offsets[s] == offsets[s + 1]) {
+                continue;
+            }
+            shardIds.clear();
+            for(unsigned long j = offsets[s]; j < offsets[s + 1]; ++j) {
+                shardIds.push_back(destinationIds[order[j]]);
+            }
+            queued += UDPC_queue_send_many((UDPC_HContext)c->shards[s],
+                shardIds.data(), shardIds.size(), isChecked, data, size);
+        }
+        return queued;
+    }
+
+    // Every queued packet holds a reference to the one copy of the payload,
+    // which is freed once the last of them was sent (or acked if checked).
+    // Without room for a shared buffer, each packet gets its own copy.
+    char *shared = c->bufferPool->allocateShared(size);
+    if(shared) {
+        std::memcpy(shared, data, size);
     }
 
-    // TODO verify this is necessary to get the listen port
-    if(ctx->socketInfo.sin6_port == 0) {
-        UDPC_IPV6_SOCKADDR_TYPE getInfo;
-        socklen_t size = sizeof(UDPC_IPV6_SOCKADDR_TYPE);
-        if(getsockname(ctx->socketHandle, (struct sockaddr *)&getInfo, &size) == 0) {
-            ctx->socketInfo.sin6_port = getInfo.sin6_port;
+    std::vector<UDPC::PktInfoWrapper> wrappers(count);
+    for(unsigned long i = 0; i < count; ++i) {
+        UDPC_PacketInfo &sendInfo = wrappers[i].pinfo;
+        sendInfo.dataSize = size;
+        if(shared) {
+            if(i > 0) {
+                UDPC::BufferPool::share(shared);
+            }
+            sendInfo.data = shared;
+        } else {
+            sendInfo.data = c->bufferPool->allocate(sendInfo.dataSize);
+            std::memcpy(sendInfo.data, data, size);
         }
+        sendInfo.sender.addr = in6addr_loopback;
+        sendInfo.sender.port = ntohs(c->socketInfo.sin6_port);
+        sendInfo.receiver.addr = destinationIds[i].addr;
+        sendInfo.receiver.port = destinationIds[i].port;
+        sendInfo.flags = (isChecked != 0 ? 0x0 : 0x4);
     }
 
-    // set non-blocking on socket
-#if UDPC_PLATFORM == UDPC_PLATFORM_MAC || UDPC_PLATFORM == UDPC_PLATFORM_LINUX
-    int nonblocking = 1;
-    if(fcntl(ctx->socketHandle, F_SETFL, O_NONBLOCK, nonblocking) == -1) {
-#elif UDPC_PLATFORM == UDPC_PLATFORM_WINDOWS
-    DWORD nonblocking = 1;
-    if(ioctlsocket(ctx->socketHandle, FIONBIO, &nonblocking) != 0) {
-#else
-    {
-#endif
-        // TODO maybe different way of handling init fail
-        UDPC_CHECK_LOG(ctx, UDPC_LoggingType::UDPC_ERROR, "Failed to set nonblocking on socket");
-        UDPC_CLEANUPSOCKET(ctx->socketHandle);
-        delete ctx;
+    return c->pushSends(wrappers.data(), wrappers.size());
+}
+
+void *UDPC_send_reserve(UDPC_HContext ctx, UDPC_ConnectionId destinationId,
+                        uint32_t size) {
+    UDPC::Context *c = UDPC::verifyContext(ctx);
+    if(!c || size == 0) {
         return nullptr;
     }
 
-    UDPC_CHECK_LOG(ctx, UDPC_LoggingType::UDPC_INFO, "Initialized UDPC");
+    if(!c->shards.empty()) {
+        // from the pool of the shard that will send it
+        return UDPC_send_reserve((UDPC_HContext)c->shardFor(destinationId),
+            destinationId, size);
+    }
 
-    return (UDPC_HContext) ctx;
+    // The header's space holds the reserved size until it is sent, and the
+    // destination is kept after the data.
+    const unsigned int headroom = c->sendHeadroom();
+    char *buf = c->bufferPool->allocate(
+        headroom + size + sizeof(UDPC_ConnectionId));
+    std::memcpy(buf, &size, 4);
+    std::memcpy(buf + headroom + size,
+        &destinationId, sizeof(UDPC_ConnectionId));
+    return buf + headroom;
 }
 
-UDPC_HContext UDPC_init_threaded_update(UDPC_ConnectionId listenId,
-                                int isClient, int isUsingLibsodium) {
-    UDPC::Context *ctx = (UDPC::Context *)UDPC_init(listenId, isClient, isUsingLibsodium);
-    if(!ctx) {
-        return nullptr;
+void UDPC_send_commit(UDPC_HContext ctx, void *buf, uint32_t size,
+                      int isChecked) {
+    UDPC::Context *c = UDPC::verifyContext(ctx);
+    if(!c || !buf) {
+        return;
     }
 
-    ctx->isAutoUpdating.store(true);
-    ctx->threadedSleepTime = std::chrono::milliseconds(UDPC_UPDATE_MS_DEFAULT);
-    ctx->thread = std::thread(UDPC::threadedUpdate, ctx);
+    char *data = (char*)buf - c->sendHeadroom();
+    uint32_t reservedSize;
+    std::memcpy(&reservedSize, data, 4);
+    UDPC_ConnectionId destinationId;
+    std::memcpy(&destinationId, (char*)buf + reservedSize,
+        sizeof(UDPC_ConnectionId));
+    if(size == 0 || size > reservedSize) {
+        if(size > reservedSize) {
+            UDPC_CHECK_LOG(c, UDPC_LoggingType::UDPC_ERROR,
+                "Committed size ", size, " is larger than reserved size ",
+                reservedSize, ", dropping packet to ",
+                destinationId.addr,
+                ", port = ",
+                destinationId.port);
+        }
+        UDPC::BufferPool::deallocate(data);
+        return;
+    }
 
-    UDPC_CHECK_LOG(ctx, UDPC_LoggingType::UDPC_INFO, "Initialized threaded UDPC");
+    if(!c->shards.empty()) {
+        UDPC_send_commit((UDPC_HContext)c->shardFor(destinationId),
+            buf, size, isChecked);
+        return;
+    }
 
-    return (UDPC_HContext) ctx;
+    UDPC::PktInfoWrapper sendInfoWrapper{};
+    UDPC_PacketInfo &sendInfo = sendInfoWrapper.pinfo;
+    sendInfo.dataSize = c->sendHeadroom() + size;
+    sendInfo.data = data;
+    sendInfo.sender.addr = in6addr_loopback;
+    sendInfo.sender.port = ntohs(c->socketInfo.sin6_port);
+    sendInfo.receiver.addr = destinationId.addr;
+    sendInfo.receiver.port = destinationId.port;
+    // 0x10: data starts with room for the header
+    sendInfo.flags = (isChecked != 0 ? 0x0 : 0x4) | 0x10;
+
+    c->pushSend(sendInfoWrapper);
 }
 
-UDPC_HContext UDPC_init_threaded_update_ms(
-        UDPC_ConnectionId listenId,
-        int isClient,int updateMS, int isUsingLibsodium) {
-    UDPC::Context *ctx = (UDPC::Context *)UDPC_init(
-        listenId, isClient, isUsingLibsodium);
-    if(!ctx) {
-        return nullptr;
+void UDPC_send_abort(UDPC_HContext ctx, void *buf) {
+    UDPC::Context *c = UDPC::verifyContext(ctx);
+    if(!c || !buf) {
+        return;
     }
+    UDPC::BufferPool::deallocate((char*)buf - c->sendHeadroom());
+}
 
-    ctx->isAutoUpdating.store(true);
-    if(updateMS < UDPC_UPDATE_MS_MIN) {
-        ctx->threadedSleepTime = std::chrono::milliseconds(UDPC_UPDATE_MS_MIN);
-    } else if(updateMS > UDPC_UPDATE_MS_MAX) {
-        ctx->threadedSleepTime = std::chrono::milliseconds(UDPC_UPDATE_MS_MAX);
-    } else {
-        ctx->threadedSleepTime = std::chrono::milliseconds(updateMS);
+unsigned long UDPC_get_queue_send_current_size(UDPC_HContext ctx) {
+    UDPC::Context *c = UDPC::verifyContext(ctx);
+    if(!c) {
+        return 0;
     }
-    ctx->thread = std::thread(UDPC::threadedUpdate, ctx);
 
-    UDPC_CHECK_LOG(ctx, UDPC_LoggingType::UDPC_INFO, "Initialized threaded UDPC");
+    if(!c->shards.empty()) {
+        unsigned long size = 0;
+        for(UDPC::Context *shard : c->shards) {
+            size += shard->cSendQueuedSize.load();
+        }
+        return size;
+    }
 
-    return (UDPC_HContext) ctx;
+    return c->cSendQueuedSize.load();
 }
 
-int UDPC_enable_threaded_update(UDPC_HContext ctx) {
+unsigned long UDPC_get_queued_size(UDPC_HContext ctx, UDPC_ConnectionId id, int *exists) {
     UDPC::Context *c = UDPC::verifyContext(ctx);
-    if (!c) {
+    if(!c) {
         return 0;
     }
 
-    c->enableDisableFuncRunningCount.fetch_add(1);
+    if(!c->shards.empty()) {
+        return UDPC_get_queued_size((UDPC_HContext)c->shardFor(id), id, exists);
+    }
 
-    std::lock_guard<std::mutex> setThreadedLock(c->setThreadedUpdateMutex);
+    std::lock_guard<std::mutex> conMapLock(c->conMapMutex);
+    auto iter = c->conMap.find(id);
+    if(iter != c->conMap.end()) {
+        if(exists) {
+            *exists = 1;
+        }
+        return iter->second.sendPkts.size();
+    }
+    if(exists) {
+        *exists = 0;
+    }
+    return 0;
+}
 
-    if(c->flags.test(0) || c->isAutoUpdating.load() || c->thread.joinable()) {
-        c->enableDisableFuncRunningCount.fetch_sub(1);
+unsigned long UDPC_get_queued_size_h(UDPC_HContext ctx, UDPC_ConnectionHandle handle, int *exists) {
+    if(exists) {
+        *exists = 0;
+    }
+    UDPC::Context *c = UDPC::verifyContext(ctx);
+    if(!c || handle == 0) {
         return 0;
     }
 
-    c->isAutoUpdating.store(true);
-    c->threadedSleepTime = std::chrono::milliseconds(UDPC_UPDATE_MS_DEFAULT);
-    c->threadRunning.store(true);
-    c->thread = std::thread(UDPC::threadedUpdate, c);
+    if(!c->shards.empty()) {
+        UDPC::Context *shard = c->shardForHandle(handle);
+        return shard ? UDPC_get_queued_size_h((UDPC_HContext)shard, handle, exists)
+            : 0;
+    }
 
-    UDPC_CHECK_LOG(c, UDPC_LoggingType::UDPC_INFO, "Started threaded update");
+    std::lock_guard<std::mutex> conMapLock(c->conMapMutex);
+    auto iter = c->conMap.findHandle(handle);
+    if(iter != c->conMap.end()) {
+        if(exists) {
+            *exists = 1;
+        }
+        return iter->second.sendPkts.size();
+    }
+    return 0;
+}
 
-    c->enableDisableFuncRunningCount.fetch_sub(1);
+unsigned long UDPC_get_max_queued_size() {
+    return UDPC_QUEUED_PKTS_MAX_SIZE;
+}
 
-    return 1;
+void UDPC_set_send_rate(
+        UDPC_HContext ctx,
+        UDPC_ConnectionId connectionId,
+        unsigned int goodModeRate,
+        unsigned int badModeRate,
+        unsigned int burst) {
+    UDPC::Context *c = UDPC::verifyContext(ctx);
+    if(!c) {
+        return;
+    }
+
+    if(!c->shards.empty()) {
+        UDPC_set_send_rate((UDPC_HContext)c->shardFor(connectionId),
+            connectionId, goodModeRate, badModeRate, burst);
+        return;
+    }
+
+    UDPC::clampSendRate(goodModeRate, badModeRate, burst);
+    UDPC_Event event{UDPC_ET_REQUEST_SEND_RATE, connectionId, 0, 0};
+    event.v.sendRate.goodMode = goodModeRate;
+    event.v.sendRate.badMode = badModeRate;
+    event.v.sendRate.burst = burst;
+    if(!c->internalEvents.push_back(event)) {
+        UDPC_CHECK_LOG(c, UDPC_LoggingType::UDPC_WARNING,
+            "Internal event queue is full, not setting send rate");
+        return;
+    }
+    c->wake();
 }
 
-int UDPC_enable_threaded_update_ms(UDPC_HContext ctx, int updateMS) {
+void UDPC_set_send_rate_h(
+        UDPC_HContext ctx,
+        UDPC_ConnectionHandle handle,
+        unsigned int goodModeRate,
+        unsigned int badModeRate,
+        unsigned int burst) {
     UDPC::Context *c = UDPC::verifyContext(ctx);
-    if (!c) {
-        return 0;
+    if(!c || handle == 0) {
+        return;
     }
 
-    c->enableDisableFuncRunningCount.fetch_add(1);
+    if(!c->shards.empty()) {
+        UDPC::Context *shard = c->shardForHandle(handle);
+        if(shard) {
+            UDPC_set_send_rate_h((UDPC_HContext)shard,
+                handle, goodModeRate, badModeRate, burst);
+        }
+        return;
+    }
 
-    std::lock_guard<std::mutex> setThreadedLock(c->setThreadedUpdateMutex);
+    UDPC_ConnectionId connectionId;
+    {
+        std::lock_guard<std::mutex> conMapLock(c->conMapMutex);
+        auto iter = c->conMap.findHandle(handle);
+        if(iter == c->conMap.end()) {
+            return;
+        }
+        connectionId = iter->first;
+    }
+    UDPC_set_send_rate(ctx, connectionId, goodModeRate, badModeRate, burst);
+}
 
-    if(c->flags.test(0) || c->isAutoUpdating.load() || c->thread.joinable()) {
-        c->enableDisableFuncRunningCount.fetch_sub(1);
+void UDPC_set_default_send_rate(
+        UDPC_HContext ctx,
+        unsigned int goodModeRate,
+        unsigned int badModeRate,
+        unsigned int burst) {
+    UDPC::Context *c = UDPC::verifyContext(ctx);
+    if(!c) {
+        return;
+    }
+
+    for(UDPC::Context *shard : c->shards) {
+        UDPC_set_default_send_rate(
+            (UDPC_HContext)shard, goodModeRate, badModeRate, burst);
+    }
+
+    UDPC::clampSendRate(goodModeRate, badModeRate, burst);
+    c->goodModeSends.store(goodModeRate);
+    c->badModeSends.store(badModeRate);
+    c->sendBurst.store(burst);
+}
+
+int UDPC_set_accept_new_connections(UDPC_HContext ctx, int isAccepting) {
+    UDPC::Context *c = UDPC::verifyContext(ctx);
+    if(!c) {
         return 0;
     }
 
-    c->isAutoUpdating.store(true);
-    if(updateMS < UDPC_UPDATE_MS_MIN) {
-        c->threadedSleepTime = std::chrono::milliseconds(UDPC_UPDATE_MS_MIN);
-    } else if(updateMS > UDPC_UPDATE_MS_MAX) {
-        c->threadedSleepTime = std::chrono::milliseconds(UDPC_UPDATE_MS_MAX);
-    } else {
-        c->threadedSleepTime = std::chrono::milliseconds(updateMS);
+    for(UDPC::Context *shard : c->shards) {
+        UDPC_set_accept_new_connections((UDPC_HContext)shard, isAccepting);
     }
-    c->threadRunning.store(true);
-    c->thread = std::thread(UDPC::threadedUpdate, c);
+    return c->isAcceptNewConnections.exchange(isAccepting == 0 ? false : true)
+        ? 1 : 0;
+}
 
-    UDPC_CHECK_LOG(c, UDPC_LoggingType::UDPC_INFO, "Started threaded update");
+void UDPC_drop_connection(UDPC_HContext ctx, UDPC_ConnectionId connectionId, int dropAllWithAddr) {
+    UDPC::Context *c = UDPC::verifyContext(ctx);
+    if(!c) {
+        return;
+    }
 
-    c->enableDisableFuncRunningCount.fetch_sub(1);
+    if(!c->shards.empty()) {
+        if(dropAllWithAddr != 0) {
+            // connections from the same address may be on different shards
+            for(UDPC::Context *shard : c->shards) {
+                UDPC_drop_connection(
+                    (UDPC_HContext)shard, connectionId, dropAllWithAddr);
+            }
+        } else {
+            UDPC_drop_connection((UDPC_HContext)c->shardFor(connectionId),
+                connectionId, dropAllWithAddr);
+        }
+        return;
+    }
 
-    return 1;
+    if(!c->internalEvents.push_back(UDPC_Event{UDPC_ET_REQUEST_DISCONNECT, connectionId, dropAllWithAddr, 0})) {
+        UDPC_CHECK_LOG(c, UDPC_LoggingType::UDPC_WARNING,
+            "Internal event queue is full, not dropping connection");
+        return;
+    }
+    c->wake();
+    return;
 }
 
-int UDPC_disable_threaded_update(UDPC_HContext ctx) {
+void UDPC_drop_connection_h(UDPC_HContext ctx, UDPC_ConnectionHandle handle) {
     UDPC::Context *c = UDPC::verifyContext(ctx);
-    if (!c) {
-        return 0;
+    if(!c || handle == 0) {
+        return;
     }
 
-    c->enableDisableFuncRunningCount.fetch_add(1);
+    if(!c->shards.empty()) {
+        UDPC::Context *shard = c->shardForHandle(handle);
+        if(shard) {
+            UDPC_drop_connection_h((UDPC_HContext)shard, handle);
+        }
+        return;
+    }
 
-    std::lock_guard<std::mutex> setThreadedLock(c->setThreadedUpdateMutex);
+    UDPC_ConnectionId connectionId;
+    {
+        std::lock_guard<std::mutex> conMapLock(c->conMapMutex);
+        auto iter = c->conMap.findHandle(handle);
+        if(iter == c->conMap.end()) {
+            return;
+        }
+        connectionId = iter->first;
+    }
+    UDPC_drop_connection(ctx, connectionId, 0);
+}
 
-    if(c->flags.test(0) || !c->isAutoUpdating.load() || !c->thread.joinable()) {
-        c->enableDisableFuncRunningCount.fetch_sub(1);
+int UDPC_has_connection(UDPC_HContext ctx, UDPC_ConnectionId connectionId) {
+    UDPC::Context *c = UDPC::verifyContext(ctx);
+    if(!c) {
         return 0;
     }
 
-    c->threadRunning.store(false);
-    c->thread.join();
-    c->isAutoUpdating.store(false);
-
-    UDPC_CHECK_LOG(c, UDPC_LoggingType::UDPC_INFO, "Stopped threaded update");
+    if(!c->shards.empty()) {
+        return UDPC_has_connection(
+            (UDPC_HContext)c->shardFor(connectionId), connectionId);
+    }
 
-    c->enableDisableFuncRunningCount.fetch_sub(1);
+    std::lock_guard<std::mutex> conMapLock(c->conMapMutex);
 
-    return 1;
+    return c->conMap.find(connectionId) == c->conMap.end() ? 0 : 1;
 }
 
-int UDPC_is_valid_context(UDPC_HContext ctx) {
-    return UDPC::verifyContext(ctx) != nullptr ? 1 : 0;
+int UDPC_has_connection_h(UDPC_HContext ctx, UDPC_ConnectionHandle handle) {
+    UDPC::Context *c = UDPC::verifyContext(ctx);
+    if(!c || handle == 0) {
+        return 0;
+    }
+
+    if(!c->shards.empty()) {
+        UDPC::Context *shard = c->shardForHandle(handle);
+        return shard ? UDPC_has_connection_h((UDPC_HContext)shard, handle) : 0;
+    }
+
+    std::lock_guard<std::mutex> conMapLock(c->conMapMutex);
+
+    return c->conMap.findHandle(handle) == c->conMap.end() ? 0 : 1;
 }
 
-void UDPC_destroy(UDPC_HContext ctx) {
-    UDPC::Context *UDPC_ctx = UDPC::verifyContext(ctx);
-    if(UDPC_ctx) {
-        {
-            // Acquire lock so that this code does not run at the same time as
-            // enabling/disabling threaded-update.
-            std::lock_guard<std::mutex>
-                setThreadedLock(UDPC_ctx->setThreadedUpdateMutex);
+UDPC_ConnectionHandle UDPC_get_handle(UDPC_HContext ctx, UDPC_ConnectionId connectionId) {
+    UDPC::Context *c = UDPC::verifyContext(ctx);
+    if(!c) {
+        return 0;
+    }
 
-            // Stop thread if threaded.
-            // Set atomic bool to false always so that the thread will always
-            // stop at this point.
-            UDPC_ctx->threadRunning.store(false);
-            if(UDPC_ctx->isAutoUpdating.load() && UDPC_ctx->thread.joinable()) {
-                UDPC_ctx->thread.join();
-            }
-            UDPC_ctx->isAutoUpdating.store(false);
+    if(!c->shards.empty()) {
+        return UDPC_get_handle(
+            (UDPC_HContext)c->shardFor(connectionId), connectionId);
+    }
+
+    std::lock_guard<std::mutex> conMapLock(c->conMapMutex);
+    auto iter = c->conMap.find(connectionId);
+    return iter == c->conMap.end() ? 0 : c->handleOf(iter);
+}
 
-            // Set destructing flag.
-            UDPC_ctx->flags.set(0);
+UDPC_ConnectionId* UDPC_get_list_connected(UDPC_HContext ctx, unsigned int *size) {
+    UDPC::Context *c = UDPC::verifyContext(ctx);
+    if(!c) {
+        return nullptr;
+    }
 
-            // Drop lock at this point before destructing the context.
+    if(!c->shards.empty()) {
+        std::vector<UDPC_ConnectionId> ids;
+        for(UDPC::Context *shard : c->shards) {
+            std::lock_guard<std::mutex> conMapLock(shard->conMapMutex);
+            for(auto iter = shard->conMap.begin();
+                    iter != shard->conMap.end();
+                    ++iter) {
+                ids.push_back(iter->first);
+            }
+        }
+        if(size) {
+            *size = ids.size();
         }
+        if(ids.empty()) {
+            return nullptr;
+        }
+        UDPC_ConnectionId *list = (UDPC_ConnectionId*)std::calloc(
+                ids.size() + 1, sizeof(UDPC_ConnectionId));
+        std::memcpy(list, ids.data(), ids.size() * sizeof(UDPC_ConnectionId));
+        return list;
+    }
 
-        // After lock has been dropped, wait in case there are enable/disable
-        // threaded update functions waiting on the lock. Do this via a
-        // atomic-int-based spin-lock.
-        while(UDPC_ctx->enableDisableFuncRunningCount.load() != 0) {
-            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    std::lock_guard<std::mutex> conMapLock(c->conMapMutex);
+
+    if(c->conMap.empty()) {
+        if(size) {
+            *size = 0;
         }
+        return nullptr;
+    }
+    if(size) {
+        *size = c->conMap.size();
+    }
 
-#if UDPC_PLATFORM == UDPC_PLATFORM_WINDOWS
-        WSACleanup();
-#endif
-        UDPC_ctx->_contextIdentifier = 0;
-        delete UDPC_ctx;
+    UDPC_ConnectionId *list = (UDPC_ConnectionId*)std::calloc(
+            c->conMap.size() + 1, sizeof(UDPC_ConnectionId));
+    UDPC_ConnectionId *current = list;
+    for(auto iter = c->conMap.begin(); iter != c->conMap.end(); ++iter) {
+        *current = iter->first;
+        ++current;
     }
+    // following line is redudnant, since calloc initialized all bits to zero
+//    *current = UDPC_ConnectionId{{0}, 0, 0};
+    return list;
 }
 
-void UDPC_update(UDPC_HContext ctx) {
+void UDPC_free_list_connected(UDPC_ConnectionId *list) {
+    if(list) { std::free(list); }
+}
+
+const UDPC_PeerList *UDPC_acquire_peer_list(UDPC_HContext ctx) {
     UDPC::Context *c = UDPC::verifyContext(ctx);
-    if(!c || c->isAutoUpdating.load()) {
-        // invalid or is threaded, update should not be called
-        return;
+    if(!c) {
+        return nullptr;
     }
 
-    c->update_impl();
+    return c->peerList.acquire();
 }
 
-void UDPC_client_initiate_connection(
-        UDPC_HContext ctx,
-        UDPC_ConnectionId connectionId,
-        int enableLibSodium) {
+void UDPC_release_peer_list(UDPC_HContext ctx, const UDPC_PeerList *list) {
     UDPC::Context *c = UDPC::verifyContext(ctx);
-    if(!c || !c->flags.test(1)) {
-        return;
-    }
-#ifndef UDPC_LIBSODIUM_ENABLED
-    if(enableLibSodium) {
-        UDPC_CHECK_LOG(c, UDPC_LoggingType::UDPC_ERROR,
-            "Cannot enable libsodium, UDPC was compiled without libsodium");
+    if(!c || !list) {
         return;
     }
-#endif
 
-    c->internalEvents.push_back(UDPC_Event{UDPC_ET_REQUEST_CONNECT, connectionId, enableLibSodium});
+    c->peerList.release(list);
 }
 
-void UDPC_queue_send(UDPC_HContext ctx, UDPC_ConnectionId destinationId,
-                     int isChecked, const void *data, uint32_t size) {
-    if(size == 0 || !data) {
-        return;
+uint32_t UDPC_get_protocol_id(UDPC_HContext ctx) {
+    UDPC::Context *c = UDPC::verifyContext(ctx);
+    if(!c) {
+        return 0;
     }
 
+    return c->protocolID.load();
+}
+
+uint32_t UDPC_set_protocol_id(UDPC_HContext ctx, uint32_t id) {
     UDPC::Context *c = UDPC::verifyContext(ctx);
     if(!c) {
-        return;
+        return 0;
     }
 
-    UDPC::PktInfoWrapper sendInfoWrapper{};
-    UDPC_PacketInfo &sendInfo = sendInfoWrapper.pinfo;
-    sendInfo.dataSize = size;
-    sendInfo.data = (char*)std::malloc(sendInfo.dataSize);
-    std::memcpy(sendInfo.data, data, size);
-    sendInfo.sender.addr = in6addr_loopback;
-    sendInfo.sender.port = ntohs(c->socketInfo.sin6_port);
-    sendInfo.receiver.addr = destinationId.addr;
-    sendInfo.receiver.port = destinationId.port;
-    sendInfo.flags = (isChecked != 0 ? 0x0 : 0x4);
+    for(UDPC::Context *shard : c->shards) {
+        UDPC_set_protocol_id((UDPC_HContext)shard, id);
+    }
 
-    c->cSendPkts.push_back(std::move(sendInfoWrapper));
+    return c->protocolID.exchange(id);
 }
 
-unsigned long UDPC_get_queue_send_current_size(UDPC_HContext ctx) {
+unsigned int UDPC_get_receive_batch_depth(UDPC_HContext ctx) {
     UDPC::Context *c = UDPC::verifyContext(ctx);
     if(!c) {
         return 0;
     }
 
-    return c->cSendPkts.size();
+    return c->recvBatchDepth.load();
 }
 
-unsigned long UDPC_get_queued_size(UDPC_HContext ctx, UDPC_ConnectionId id, int *exists) {
+unsigned int UDPC_set_receive_batch_depth(UDPC_HContext ctx, unsigned int depth) {
     UDPC::Context *c = UDPC::verifyContext(ctx);
     if(!c) {
         return 0;
     }
 
-    std::lock_guard<std::mutex> conMapLock(c->conMapMutex);
-    auto iter = c->conMap.find(id);
-    if(iter != c->conMap.end()) {
-        if(exists) {
-            *exists = 1;
-        }
-        return iter->second.sendPkts.size();
+    for(UDPC::Context *shard : c->shards) {
+        UDPC_set_receive_batch_depth((UDPC_HContext)shard, depth);
     }
-    if(exists) {
-        *exists = 0;
+
+    if(depth < 1) {
+        depth = 1;
+    } else if(depth > UDPC_RECV_BATCH_MAX) {
+        depth = UDPC_RECV_BATCH_MAX;
     }
-    return 0;
+    return c->recvBatchDepth.exchange(depth);
 }
 
-unsigned long UDPC_get_max_queued_size() {
-    return UDPC_QUEUED_PKTS_MAX_SIZE;
+int UDPC_get_gso_enabled(UDPC_HContext ctx) {
+    UDPC::Context *c = UDPC::verifyContext(ctx);
+    if(!c) {
+        return 0;
+    }
+
+    return c->isGSOEnabled.load() ? 1 : 0;
 }
 
-int UDPC_set_accept_new_connections(UDPC_HContext ctx, int isAccepting) {
+int UDPC_set_gso_enabled(UDPC_HContext ctx, int isEnabled) {
     UDPC::Context *c = UDPC::verifyContext(ctx);
     if(!c) {
         return 0;
     }
-    return c->isAcceptNewConnections.exchange(isAccepting == 0 ? false : true)
-        ? 1 : 0;
+
+    if(!c->shards.empty()) {
+        // a sharded context has no socket of its own, mirror the first shard
+        for(UDPC::Context *shard : c->shards) {
+            UDPC_set_gso_enabled((UDPC_HContext)shard, isEnabled);
+        }
+        return c->isGSOEnabled.exchange(c->shards[0]->isGSOEnabled.load()) ? 1 : 0;
+    }
+
+#if UDPC_PLATFORM == UDPC_PLATFORM_LINUX
+    if(isEnabled != 0) {
+        // check that the kernel knows about UDP_SEGMENT
+        int segmentSize = 0;
+        socklen_t optLen = sizeof(int);
+        if(getsockopt(
+                c->socketHandle,
+                SOL_UDP,
+                UDP_SEGMENT,
+                &segmentSize,
+                &optLen) != 0) {
+            UDPC_CHECK_LOG(c, UDPC_LoggingType::UDPC_WARNING,
+                "UDP GSO is not supported, errno ", errno);
+            return c->isGSOEnabled.exchange(false) ? 1 : 0;
+        }
+    }
+    return c->isGSOEnabled.exchange(isEnabled != 0) ? 1 : 0;
+#else
+    (void)isEnabled;
+    return 0;
+#endif
 }
 
-void UDPC_drop_connection(UDPC_HContext ctx, UDPC_ConnectionId connectionId, int dropAllWithAddr) {
+int UDPC_get_gro_enabled(UDPC_HContext ctx) {
     UDPC::Context *c = UDPC::verifyContext(ctx);
     if(!c) {
-        return;
+        return 0;
     }
 
-    c->internalEvents.push_back(UDPC_Event{UDPC_ET_REQUEST_DISCONNECT, connectionId, dropAllWithAddr});
-    return;
+    return c->isGROEnabled.load() ? 1 : 0;
 }
 
-int UDPC_has_connection(UDPC_HContext ctx, UDPC_ConnectionId connectionId) {
+int UDPC_set_gro_enabled(UDPC_HContext ctx, int isEnabled) {
     UDPC::Context *c = UDPC::verifyContext(ctx);
     if(!c) {
         return 0;
     }
 
-    std::lock_guard<std::mutex> conMapLock(c->conMapMutex);
+    if(!c->shards.empty()) {
+        // a sharded context has no socket of its own, mirror the first shard
+        for(UDPC::Context *shard : c->shards) {
+            UDPC_set_gro_enabled((UDPC_HContext)shard, isEnabled);
+        }
+        return c->isGROEnabled.exchange(c->shards[0]->isGROEnabled.load()) ? 1 : 0;
+    }
 
-    return c->conMap.find(connectionId) == c->conMap.end() ? 0 : 1;
+#if UDPC_PLATFORM == UDPC_PLATFORM_LINUX
+    if(c->ioEngine != UDPC_IO_ENGINE_SOCKET && isEnabled != 0) {
+        UDPC_CHECK_LOG(c, UDPC_LoggingType::UDPC_WARNING,
+            "UDP GRO is not supported with the io_uring I/O engine");
+        return c->isGROEnabled.load() ? 1 : 0;
+    }
+    int value = isEnabled != 0 ? 1 : 0;
+    if(setsockopt(
+            c->socketHandle,
+            SOL_UDP,
+            UDP_GRO,
+            &value,
+            sizeof(int)) != 0) {
+        UDPC_CHECK_LOG(c, UDPC_LoggingType::UDPC_WARNING,
+            "Failed to set UDP GRO, errno ", errno);
+        return c->isGROEnabled.load() ? 1 : 0;
+    }
+    return c->isGROEnabled.exchange(value != 0) ? 1 : 0;
+#else
+    (void)isEnabled;
+    return 0;
+#endif
 }
 
-UDPC_ConnectionId* UDPC_get_list_connected(UDPC_HContext ctx, unsigned int *size) {
+UDPC_ReceiveStats UDPC_get_receive_stats(UDPC_HContext ctx) {
+    UDPC_ReceiveStats stats;
+    std::memset(&stats, 0, sizeof(UDPC_ReceiveStats));
     UDPC::Context *c = UDPC::verifyContext(ctx);
     if(!c) {
-        return nullptr;
+        return stats;
     }
 
-    std::lock_guard<std::mutex> conMapLock(c->conMapMutex);
-
-    if(c->conMap.empty()) {
-        if(size) {
-            *size = 0;
+    if(!c->shards.empty()) {
+        for(UDPC::Context *shard : c->shards) {
+            UDPC_ReceiveStats shardStats =
+                UDPC_get_receive_stats((UDPC_HContext)shard);
+            stats.calls += shardStats.calls;
+            stats.datagrams += shardStats.datagrams;
+            stats.coalescedBuffers += shardStats.coalescedBuffers;
+            if(shardStats.maxPerCall > stats.maxPerCall) {
+                stats.maxPerCall = shardStats.maxPerCall;
+            }
+            stats.handoffDropped += shardStats.handoffDropped;
         }
-        return nullptr;
+        return stats;
     }
-    if(size) {
-        *size = c->conMap.size();
+
+    stats.calls = c->recvStatCalls.load();
+    stats.datagrams = c->recvStatDatagrams.load();
+    stats.coalescedBuffers = c->recvStatCoalesced.load();
+    stats.maxPerCall = c->recvStatMaxPerCall.load();
+    stats.handoffDropped = c->recvStatHandoffDropped.load();
+    return stats;
+}
+
+UDPC_PoolStats UDPC_get_pool_stats(UDPC_HContext ctx) {
+    UDPC_PoolStats stats;
+    std::memset(&stats, 0, sizeof(UDPC_PoolStats));
+    UDPC::Context *c = UDPC::verifyContext(ctx);
+    if(!c) {
+        return stats;
     }
 
-    UDPC_ConnectionId *list = (UDPC_ConnectionId*)std::calloc(
-            c->conMap.size() + 1, sizeof(UDPC_ConnectionId));
-    UDPC_ConnectionId *current = list;
-    for(auto iter = c->conMap.begin(); iter != c->conMap.end(); ++iter) {
-        *current = iter->first;
-        ++current;
+    if(!c->shards.empty()) {
+        for(UDPC::Context *shard : c->shards) {
+            UDPC_PoolStats shardStats = shard->bufferPool->getStats();
+            stats.hits += shardStats.hits;
+            stats.misses += shardStats.misses;
+            stats.fallbacks += shardStats.fallbacks;
+            stats.slabs += shardStats.slabs;
+            stats.inUse += shardStats.inUse;
+        }
+        return stats;
     }
-    // following line is redudnant, since calloc initialized all bits to zero
-//    *current = UDPC_ConnectionId{{0}, 0, 0};
-    return list;
-}
 
-void UDPC_free_list_connected(UDPC_ConnectionId *list) {
-    if(list) { std::free(list); }
+    return c->bufferPool->getStats();
 }
 
-uint32_t UDPC_get_protocol_id(UDPC_HContext ctx) {
+int UDPC_get_receive_thread_enabled(UDPC_HContext ctx) {
     UDPC::Context *c = UDPC::verifyContext(ctx);
     if(!c) {
         return 0;
     }
 
-    return c->protocolID.load();
+#if UDPC_PLATFORM == UDPC_PLATFORM_LINUX
+    return c->isRecvThreadRunning.load() ? 1 : 0;
+#else
+    return 0;
+#endif
 }
 
-uint32_t UDPC_set_protocol_id(UDPC_HContext ctx, uint32_t id) {
+int UDPC_set_receive_thread_enabled(UDPC_HContext ctx, int isEnabled) {
     UDPC::Context *c = UDPC::verifyContext(ctx);
     if(!c) {
         return 0;
     }
 
-    return c->protocolID.exchange(id);
+#if UDPC_PLATFORM == UDPC_PLATFORM_LINUX
+    if(!c->shards.empty()) {
+        // a sharded context has no socket of its own, mirror the first shard
+        for(UDPC::Context *shard : c->shards) {
+            UDPC_set_receive_thread_enabled((UDPC_HContext)shard, isEnabled);
+        }
+        return c->isRecvThreadRunning.exchange(
+            c->shards[0]->isRecvThreadRunning.load()) ? 1 : 0;
+    }
+
+    c->enableDisableFuncRunningCount.fetch_add(1);
+
+    std::lock_guard<std::mutex> setThreadedLock(c->setThreadedUpdateMutex);
+
+    const int wasEnabled = c->isRecvThreadRunning.load() ? 1 : 0;
+    if(c->flags.test(0)) {
+        c->enableDisableFuncRunningCount.fetch_sub(1);
+        return wasEnabled;
+    }
+
+    if(isEnabled != 0 && wasEnabled == 0) {
+        if(c->ioEngine != UDPC_IO_ENGINE_SOCKET) {
+            UDPC_CHECK_LOG(c, UDPC_LoggingType::UDPC_WARNING,
+                "Receive thread is not supported with the io_uring I/O engine");
+        } else if(c->startReceiveThread()) {
+            UDPC_CHECK_LOG(c, UDPC_LoggingType::UDPC_INFO,
+                "Started receive thread");
+        }
+    } else if(isEnabled == 0 && wasEnabled != 0) {
+        c->stopReceiveThread();
+        UDPC_CHECK_LOG(c, UDPC_LoggingType::UDPC_INFO,
+            "Stopped receive thread");
+    }
+
+    c->enableDisableFuncRunningCount.fetch_sub(1);
+
+    return wasEnabled;
+#else
+    (void)isEnabled;
+    return 0;
+#endif
 }
 
 UDPC_LoggingType UDPC_get_logging_type(UDPC_HContext ctx) {
@@ -2533,6 +4892,10 @@ UDPC_LoggingType UDPC_set_logging_type(UDPC_HContext ctx, UDPC_LoggingType loggi
     if(!c) {
         return UDPC_LoggingType::UDPC_SILENT;
     }
+
+    for(UDPC::Context *shard : c->shards) {
+        UDPC_set_logging_type((UDPC_HContext)shard, loggingType);
+    }
     return static_cast<UDPC_LoggingType>(c->loggingType.exchange(loggingType));
 }
 
@@ -2551,24 +4914,78 @@ int UDPC_set_receiving_events(UDPC_HContext ctx, int isReceivingEvents) {
         return 0;
     }
 
+    for(UDPC::Context *shard : c->shards) {
+        UDPC_set_receiving_events((UDPC_HContext)shard, isReceivingEvents);
+    }
+
     return c->isReceivingEvents.exchange(isReceivingEvents != 0) ? 1 : 0;
 }
 
 UDPC_Event UDPC_get_event(UDPC_HContext ctx, unsigned long *remaining) {
     UDPC::Context *c = UDPC::verifyContext(ctx);
     if(!c) {
-        return UDPC_Event{UDPC_ET_NONE, UDPC_create_id_anyaddr(0), 0};
+        return UDPC_Event{UDPC_ET_NONE, UDPC_create_id_anyaddr(0), 0, 0};
+    }
+
+    if(!c->shards.empty()) {
+        // start at a different shard each call so no shard is starved
+        const std::size_t count = c->shards.size();
+        const std::size_t start = c->shardPollIndex.fetch_add(1) % count;
+        UDPC_Event event{UDPC_ET_NONE, UDPC_create_id_anyaddr(0), 0, 0};
+        unsigned long total = 0;
+        for(std::size_t i = 0; i < count; ++i) {
+            UDPC::Context *shard = c->shards[(start + i) % count];
+            if(event.type == UDPC_ET_NONE) {
+                unsigned long size = 0;
+                event = UDPC_get_event((UDPC_HContext)shard, &size);
+                total += size;
+            } else if(remaining) {
+                total += shard->externalEvents.size();
+            }
+        }
+        if(remaining) { *remaining = total; }
+        return event;
     }
 
-    unsigned long size = 0;
-    auto next_event = c->externalEvents.top_and_pop_and_rsize(&size);
-    if(next_event) {
-        if(remaining) { *remaining = size; }
-        return *next_event;
+    UDPC_Event event{UDPC_ET_NONE, UDPC_create_id_anyaddr(0), 0, 0};
+    if(c->externalEvents.pop_front(event)) {
+        if(remaining) { *remaining = c->externalEvents.size(); }
+        return event;
     } else {
         if(remaining) { *remaining = 0; }
-        return UDPC_Event{UDPC_ET_NONE, UDPC_create_id_anyaddr(0), 0};
+        return UDPC_Event{UDPC_ET_NONE, UDPC_create_id_anyaddr(0), 0, 0};
+    }
+}
+
+unsigned long UDPC_get_event_batch(
+        UDPC_HContext ctx, UDPC_Event *events, unsigned long max,
+        unsigned long *remaining) {
+    UDPC::Context *c = UDPC::verifyContext(ctx);
+    if(!c || !events) {
+        if(remaining) { *remaining = 0; }
+        return 0;
+    }
+
+    if(!c->shards.empty()) {
+        // start at a different shard each call so no shard is starved
+        const std::size_t count = c->shards.size();
+        const std::size_t start = c->shardPollIndex.fetch_add(1) % count;
+        unsigned long gotten = 0;
+        unsigned long total = 0;
+        for(std::size_t i = 0; i < count; ++i) {
+            UDPC::Context *shard = c->shards[(start + i) % count];
+            unsigned long size = 0;
+            gotten += UDPC_get_event_batch(
+                (UDPC_HContext)shard, events + gotten, max - gotten, &size);
+            total += size;
+        }
+        if(remaining) { *remaining = total; }
+        return gotten;
     }
+
+    unsigned long gotten = c->externalEvents.pop_front_n(events, max);
+    if(remaining) { *remaining = c->externalEvents.size(); }
+    return gotten;
 }
 
 UDPC_PacketInfo UDPC_get_received(UDPC_HContext ctx, unsigned long *remaining) {
@@ -2577,26 +4994,130 @@ UDPC_PacketInfo UDPC_get_received(UDPC_HContext ctx, unsigned long *remaining) {
         return UDPC::get_empty_pinfo();
     }
 
-    unsigned long size = 0;
-    auto pinfo_ptr = c->receivedPkts.top_and_pop_and_rsize(&size);
-    if(pinfo_ptr) {
-        if(remaining) { *remaining = size; }
-        return *pinfo_ptr;
+    if(!c->shards.empty()) {
+        // start at a different shard each call so no shard is starved
+        const std::size_t count = c->shards.size();
+        const std::size_t start = c->shardPollIndex.fetch_add(1) % count;
+        UDPC_PacketInfo pinfo = UDPC::get_empty_pinfo();
+        unsigned long total = 0;
+        for(std::size_t i = 0; i < count; ++i) {
+            UDPC::Context *shard = c->shards[(start + i) % count];
+            if(!pinfo.data) {
+                unsigned long size = 0;
+                pinfo = UDPC_get_received((UDPC_HContext)shard, &size);
+                total += size;
+            } else if(remaining) {
+                total += shard->receivedPkts.size();
+            }
+        }
+        if(remaining) { *remaining = total; }
+        return pinfo;
+    }
+
+    UDPC_PacketInfo pinfo;
+    if(c->receivedPkts.pop_front(pinfo)) {
+        c->shrinkReceived(pinfo);
+        if(remaining) { *remaining = c->receivedPkts.size(); }
+        return pinfo;
     } else {
         if(remaining) { *remaining = 0; }
         return UDPC::get_empty_pinfo();
     }
 }
 
+unsigned long UDPC_get_received_batch(
+        UDPC_HContext ctx, UDPC_PacketInfo *pinfos, unsigned long max,
+        unsigned long *remaining) {
+    UDPC::Context *c = UDPC::verifyContext(ctx);
+    if(!c || !pinfos) {
+        if(remaining) { *remaining = 0; }
+        return 0;
+    }
+
+    if(!c->shards.empty()) {
+        // start at a different shard each call so no shard is starved
+        const std::size_t count = c->shards.size();
+        const std::size_t start = c->shardPollIndex.fetch_add(1) % count;
+        unsigned long gotten = 0;
+        unsigned long total = 0;
+        for(std::size_t i = 0; i < count; ++i) {
+            UDPC::Context *shard = c->shards[(start + i) % count];
+            unsigned long size = 0;
+            gotten += UDPC_get_received_batch(
+                (UDPC_HContext)shard, pinfos + gotten, max - gotten, &size);
+            total += size;
+        }
+        if(remaining) { *remaining = total; }
+        return gotten;
+    }
+
+    unsigned long gotten = c->receivedPkts.pop_front_n(pinfos, max);
+    for(unsigned long i = 0; i < gotten; ++i) {
+        c->shrinkReceived(pinfos[i]);
+    }
+    if(remaining) { *remaining = c->receivedPkts.size(); }
+    return gotten;
+}
+
+int UDPC_get_received_view(
+        UDPC_HContext ctx, UDPC_PacketInfo *view, unsigned long *remaining) {
+    if(!view) {
+        if(remaining) { *remaining = 0; }
+        return 0;
+    }
+    *view = UDPC::get_empty_pinfo();
+    UDPC::Context *c = UDPC::verifyContext(ctx);
+    if(!c) {
+        if(remaining) { *remaining = 0; }
+        return 0;
+    }
+
+    if(!c->shards.empty()) {
+        // start at a different shard each call so no shard is starved
+        const std::size_t count = c->shards.size();
+        const std::size_t start = c->shardPollIndex.fetch_add(1) % count;
+        int isGotten = 0;
+        unsigned long total = 0;
+        for(std::size_t i = 0; i < count; ++i) {
+            UDPC::Context *shard = c->shards[(start + i) % count];
+            if(!isGotten) {
+                unsigned long size = 0;
+                isGotten = UDPC_get_received_view(
+                    (UDPC_HContext)shard, view, &size);
+                total += size;
+            } else if(remaining) {
+                total += shard->receivedPkts.size();
+            }
+        }
+        if(remaining) { *remaining = total; }
+        return isGotten;
+    }
+
+    // the view is the queued packet itself, its data is left where it is
+    const bool isGotten = c->receivedPkts.pop_front(*view);
+    if(remaining) { *remaining = c->receivedPkts.size(); }
+    return isGotten ? 1 : 0;
+}
+
+void UDPC_release_view(UDPC_HContext ctx, UDPC_PacketInfo *view) {
+    // the buffer's pool is found through the data, ctx may already be destroyed
+    (void)ctx;
+    if(view && view->data) {
+        UDPC::BufferPool::deallocate(view->data);
+        view->data = nullptr;
+        view->dataSize = 0;
+    }
+}
+
 void UDPC_free_PacketInfo(UDPC_PacketInfo pInfo) {
     if(pInfo.data && pInfo.dataSize > 0) {
-        std::free(pInfo.data);
+        UDPC::BufferPool::deallocate(pInfo.data);
     }
 }
 
 void UDPC_free_PacketInfo_ptr(UDPC_PacketInfo *pInfoPtr) {
     if (pInfoPtr && pInfoPtr->data && pInfoPtr->dataSize > 0) {
-        std::free(pInfoPtr->data);
+        UDPC::BufferPool::deallocate(pInfoPtr->data);
         pInfoPtr->data = nullptr;
         pInfoPtr->dataSize = 0;
     }
@@ -2608,6 +5129,10 @@ int UDPC_set_libsodium_keys(UDPC_HContext ctx, const unsigned char *sk, const un
         return 0;
     }
 
+    for(UDPC::Context *shard : c->shards) {
+        UDPC_set_libsodium_keys((UDPC_HContext)shard, sk, pk);
+    }
+
     c->keysSet.store(false);
     std::memcpy(c->sk, sk, crypto_sign_SECRETKEYBYTES);
     std::memcpy(c->pk, pk, crypto_sign_PUBLICKEYBYTES);
@@ -2633,6 +5158,10 @@ int UDPC_unset_libsodium_keys(UDPC_HContext ctx) {
         return 0;
     }
 
+    for(UDPC::Context *shard : c->shards) {
+        UDPC_unset_libsodium_keys((UDPC_HContext)shard);
+    }
+
     c->keysSet.store(false);
     std::memset(c->pk, 0, crypto_sign_PUBLICKEYBYTES);
     std::memset(c->sk, 0, crypto_sign_SECRETKEYBYTES);
@@ -2645,6 +5174,10 @@ int UDPC_add_whitelist_pk(UDPC_HContext ctx, const unsigned char *pk) {
         return 0;
     }
 
+    for(UDPC::Context *shard : c->shards) {
+        UDPC_add_whitelist_pk((UDPC_HContext)shard, pk);
+    }
+
     std::unique_lock<std::shared_mutex> pkWhitelistLock(c->peerPKWhitelistMutex);
     auto result = c->peerPKWhitelist.insert(UDPC::PKContainer(pk));
     if(result.second) {
@@ -2672,6 +5205,10 @@ int UDPC_remove_whitelist_pk(UDPC_HContext ctx, const unsigned char *pk) {
         return 0;
     }
 
+    for(UDPC::Context *shard : c->shards) {
+        UDPC_remove_whitelist_pk((UDPC_HContext)shard, pk);
+    }
+
     std::unique_lock<std::shared_mutex> pkWhitelistLock(c->peerPKWhitelistMutex);
     if(c->peerPKWhitelist.erase(UDPC::PKContainer(pk)) != 0) {
         return 1;
@@ -2685,6 +5222,10 @@ int UDPC_clear_whitelist(UDPC_HContext ctx) {
         return 0;
     }
 
+    for(UDPC::Context *shard : c->shards) {
+        UDPC_clear_whitelist((UDPC_HContext)shard);
+    }
+
     std::unique_lock<std::shared_mutex> pkWhitelistLock(c->peerPKWhitelistMutex);
     c->peerPKWhitelist.clear();
     return 1;
@@ -2705,6 +5246,10 @@ int UDPC_set_auth_policy(UDPC_HContext ctx, int policy) {
         return 0;
     }
 
+    for(UDPC::Context *shard : c->shards) {
+        UDPC_set_auth_policy((UDPC_HContext)shard, policy);
+    }
+
     bool isInRange = false;
     for(int i = 0; i < UDPC_AuthPolicy::UDPC_AUTH_POLICY_SIZE; ++i) {
         if(policy == i) {
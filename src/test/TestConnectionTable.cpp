@@ -0,0 +1,295 @@
+#include "test_helpers.h"
+#include "test_headers.h"
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include "UDPC_ConnectionTable.hpp"
+
+namespace {
+
+constexpr unsigned int BENCH_CONNECTIONS = 20000;
+
+UDPC_ConnectionId makeId(unsigned int addr, uint16_t port) {
+    UDPC_ConnectionId id;
+    std::memset(&id, 0, sizeof(UDPC_ConnectionId));
+    UDPC_IPV6_ADDR_SUB(id.addr)[15] = addr & 0xFF;
+    UDPC_IPV6_ADDR_SUB(id.addr)[14] = (addr >> 8) & 0xFF;
+    UDPC_IPV6_ADDR_SUB(id.addr)[13] = (addr >> 16) & 0xFF;
+    id.port = port;
+    return id;
+}
+
+// the hash conMap used before ConnectionTable, for comparison
+struct StringIdHasher {
+    std::size_t operator()(const UDPC_ConnectionId &key) const {
+        std::string value((const char*)UDPC_IPV6_ADDR_SUB(key.addr), 16);
+        value.push_back((char)((key.scope_id >> 24) & 0xFF));
+        value.push_back((char)((key.scope_id >> 16) & 0xFF));
+        value.push_back((char)((key.scope_id >> 8) & 0xFF));
+        value.push_back((char)(key.scope_id & 0xFF));
+        value.push_back((char)((key.port >> 8) & 0xFF));
+        value.push_back((char)(key.port & 0xFF));
+        return std::hash<std::string>()(value);
+    }
+};
+
+struct IdEqual {
+    bool operator()(
+            const UDPC_ConnectionId &a, const UDPC_ConnectionId &b) const {
+        return UDPC::isSameConnectionId(a, b);
+    }
+};
+
+// Returns the number of ids found, prints the time per lookup.
+template <typename FindFn>
+unsigned long benchFind(const char *name, FindFn find) {
+    unsigned long found = 0;
+    auto start = std::chrono::steady_clock::now();
+    for(unsigned int round = 0; round < 10; ++round) {
+        for(unsigned int i = 0; i < BENCH_CONNECTIONS; ++i) {
+            if(find(makeId(i, 1000 + (i & 0xFF)))) {
+                ++found;
+            }
+        }
+    }
+    double ns = std::chrono::duration<double, std::nano>(
+        std::chrono::steady_clock::now() - start).count()
+        / (BENCH_CONNECTIONS * 10);
+    std::cout << name << " find among " << BENCH_CONNECTIONS
+        << " connections: " << ns << " ns\n";
+    return found;
+}
+
+} // namespace
+
+void TEST_ConnectionTable() {
+    // InsertFindErase
+    {
+        UDPC::ConnectionTable<std::unique_ptr<int>> table;
+        CHECK_TRUE(table.empty());
+        CHECK_TRUE(table.begin() == table.end());
+        CHECK_TRUE(table.find(makeId(1, 1)) == table.end());
+
+        auto result = table.insert(makeId(1, 1), std::unique_ptr<int>(new int(1)));
+        CHECK_TRUE(result.second);
+        ASSERT_TRUE(result.first != table.end());
+        CHECK_EQ(*result.first->second, 1);
+
+        // not moved from if already in the table
+        std::unique_ptr<int> other(new int(2));
+        result = table.insert(makeId(1, 1), std::move(other));
+        CHECK_FALSE(result.second);
+        CHECK_TRUE(other);
+        CHECK_EQ(*result.first->second, 1);
+        CHECK_EQ(table.size(), 1);
+
+        // same address, other port
+        CHECK_TRUE(table.insert(makeId(1, 2), std::move(other)).second);
+        CHECK_EQ(table.size(), 2);
+        ASSERT_TRUE(table.find(makeId(1, 2)) != table.end());
+        CHECK_EQ(*table.find(makeId(1, 2))->second, 2);
+
+        CHECK_EQ(table.erase(makeId(1, 1)), 1);
+        CHECK_EQ(table.erase(makeId(1, 1)), 0);
+        CHECK_TRUE(table.find(makeId(1, 1)) == table.end());
+        CHECK_EQ(table.size(), 1);
+
+        unsigned int count = 0;
+        for(auto iter = table.begin(); iter != table.end(); ++iter) {
+            CHECK_EQ(iter->first.port, 2);
+            ++count;
+        }
+        CHECK_EQ(count, 1);
+    }
+
+    // Grow
+    {
+        UDPC::ConnectionTable<unsigned int> table;
+        unsigned int mismatches = 0;
+        for(unsigned int i = 0; i < 5000; ++i) {
+            table.insert(makeId(i, 7), (unsigned int)i);
+            // every entry stays reachable while the index grows
+            if((i & 0x3F) == 0) {
+                for(unsigned int j = 0; j <= i; ++j) {
+                    auto iter = table.find(makeId(j, 7));
+                    if(iter == table.end() || iter->second != j) {
+                        ++mismatches;
+                    }
+                }
+            }
+        }
+        CHECK_EQ(mismatches, 0);
+        CHECK_EQ(table.size(), 5000);
+
+        // erase every other one, the freed slots are reused
+        for(unsigned int i = 0; i < 5000; i += 2) {
+            table.erase(makeId(i, 7));
+        }
+        for(unsigned int i = 0; i < 5000; ++i) {
+            bool isFound = table.find(makeId(i, 7)) != table.end();
+            if(isFound != ((i & 1) == 1)) {
+                ++mismatches;
+            }
+        }
+        CHECK_EQ(mismatches, 0);
+        for(unsigned int i = 0; i < 2500; ++i) {
+            table.insert(makeId(i + 10000, 7), i + 10000);
+        }
+        CHECK_EQ(table.size(), 5000);
+        unsigned long sum = 0;
+        std::size_t count = 0;
+        for(auto iter = table.begin(); iter != table.end(); ++iter) {
+            sum += iter->second;
+            ++count;
+        }
+        CHECK_EQ(count, 5000);
+        // odd numbers below 5000 and 10000 to 12499
+        CHECK_EQ(sum, 2500ul * 2500 + (10000ul + 12499) * 2500 / 2);
+    }
+
+    // Index
+    {
+        UDPC::ConnectionTableIndex index;
+        const auto findSlot = [&index] (std::uint32_t hash, std::uint32_t slot) {
+            return index.find(hash, [slot] (std::uint32_t other) {
+                return other == slot;
+            }) == slot;
+        };
+
+        // few distinct hashes, so that probes collide and cross the old
+        // buckets while they are moved
+        bool wasGrowing = false;
+        unsigned int mismatches = 0;
+        for(std::uint32_t slot = 0; slot < 1000; ++slot) {
+            index.insert(slot % 37, slot);
+            wasGrowing = wasGrowing || index.isGrowing();
+            if(index.isGrowing()) {
+                for(std::uint32_t other = 0; other <= slot; ++other) {
+                    if(!findSlot(other % 37, other)) {
+                        ++mismatches;
+                    }
+                }
+            }
+        }
+        CHECK_TRUE(wasGrowing);
+        CHECK_EQ(mismatches, 0);
+        CHECK_EQ(index.size(), 1000);
+
+        // erasing shifts later buckets of a probe back
+        for(std::uint32_t slot = 0; slot < 1000; slot += 3) {
+            index.erase(slot % 37, slot);
+        }
+        for(std::uint32_t slot = 0; slot < 1000; ++slot) {
+            if(findSlot(slot % 37, slot) != (slot % 3 != 0)) {
+                ++mismatches;
+            }
+        }
+        CHECK_EQ(mismatches, 0);
+
+        index.replace(1 % 37, 1, 5000);
+        CHECK_TRUE(findSlot(1 % 37, 5000));
+        CHECK_FALSE(findSlot(1 % 37, 1));
+    }
+
+    // AddrIndex
+    {
+        UDPC::ConnectionTable<int> table;
+        for(uint16_t port = 1; port <= 4; ++port) {
+            table.insert(makeId(5, port), (int)port);
+        }
+        table.insert(makeId(6, 1), 0);
+
+        const auto sumWithAddr = [&table] (unsigned int addr) -> int {
+            int sum = 0;
+            for(auto iter = table.findAddr(makeId(addr, 0).addr);
+                    iter != table.end();
+                    iter = table.nextWithAddr(iter)) {
+                sum += iter->second;
+            }
+            return sum;
+        };
+        CHECK_EQ(sumWithAddr(5), 10);
+        CHECK_EQ(sumWithAddr(6), 0);
+        CHECK_TRUE(table.findAddr(makeId(7, 0).addr) == table.end());
+
+        // erase the first, a middle and the last of the address
+        auto first = table.findAddr(makeId(5, 0).addr);
+        ASSERT_TRUE(first != table.end());
+        int firstValue = first->second;
+        table.erase(first);
+        CHECK_EQ(sumWithAddr(5), 10 - firstValue);
+        table.erase(makeId(5, 3));
+        table.erase(makeId(5, 4));
+        table.erase(makeId(5, 2));
+        table.erase(makeId(5, 1));
+        CHECK_TRUE(table.findAddr(makeId(5, 0).addr) == table.end());
+        CHECK_EQ(table.size(), 1);
+    }
+
+    // ConIDIndex
+    {
+        UDPC::ConnectionTable<int> table;
+        auto first = table.insert(makeId(1, 1), 1).first;
+        auto second = table.insert(makeId(2, 1), 2).first;
+        CHECK_TRUE(table.findConID(100) == table.end());
+        table.setConID(first, 100);
+        table.setConID(second, 200);
+        CHECK_TRUE(table.findConID(100) == first);
+        CHECK_TRUE(table.findConID(200) == second);
+
+        table.setConID(first, 300);
+        CHECK_TRUE(table.findConID(100) == table.end());
+        CHECK_TRUE(table.findConID(300) == first);
+
+        table.erase(second);
+        CHECK_TRUE(table.findConID(200) == table.end());
+    }
+
+    // Handles
+    {
+        UDPC::ConnectionTable<int> table;
+        auto first = table.insert(makeId(1, 1), 1).first;
+        auto second = table.insert(makeId(2, 1), 2).first;
+        const std::uint64_t firstHandle = table.handleOf(first);
+        const std::uint64_t secondHandle = table.handleOf(second);
+        CHECK_TRUE(firstHandle != 0);
+        CHECK_TRUE(firstHandle != secondHandle);
+        CHECK_TRUE(table.findHandle(firstHandle) == first);
+        CHECK_TRUE(table.findHandle(secondHandle) == second);
+        // bits 24 to 31 are ignored
+        CHECK_TRUE(table.findHandle(secondHandle | (0x5Aull << 24)) == second);
+        CHECK_TRUE(table.findHandle(0) == table.end());
+        CHECK_TRUE(table.findHandle(0xFFFFFF) == table.end());
+
+        // the reused slot gets a new handle
+        table.erase(first);
+        CHECK_TRUE(table.findHandle(firstHandle) == table.end());
+        auto third = table.insert(makeId(1, 1), 3).first;
+        CHECK_EQ(third.getSlot(), first.getSlot());
+        CHECK_TRUE(table.handleOf(third) != firstHandle);
+        CHECK_TRUE(table.findHandle(firstHandle) == table.end());
+        CHECK_TRUE(table.findHandle(table.handleOf(third)) == third);
+        CHECK_TRUE(table.findHandle(secondHandle) == second);
+    }
+
+    // FindBenchmark
+    if(run_benchmarks) {
+        UDPC::ConnectionTable<int> table;
+        std::unordered_map<UDPC_ConnectionId, int, StringIdHasher, IdEqual> map;
+        for(unsigned int i = 0; i < BENCH_CONNECTIONS; ++i) {
+            table.insert(makeId(i, 1000 + (i & 0xFF)), 0);
+            map.insert(std::make_pair(makeId(i, 1000 + (i & 0xFF)), 0));
+        }
+        CHECK_EQ(benchFind("unordered_map (string hash)",
+            [&map] (const UDPC_ConnectionId &id) {
+                return map.find(id) != map.end();
+            }), BENCH_CONNECTIONS * 10);
+        CHECK_EQ(benchFind("ConnectionTable",
+            [&table] (const UDPC_ConnectionId &id) {
+                return table.find(id) != table.end();
+            }), BENCH_CONNECTIONS * 10);
+    }
+}
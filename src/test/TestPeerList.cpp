@@ -0,0 +1,121 @@
+#include "test_helpers.h"
+#include "test_headers.h"
+
+#include <atomic>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "UDPC_PeerList.hpp"
+
+namespace {
+
+// size peers, each with handle set to version
+std::vector<UDPC_PeerInfo> makePeers(std::uint64_t version, unsigned int size) {
+    std::vector<UDPC_PeerInfo> peers(size);
+    for(unsigned int i = 0; i < size; ++i) {
+        std::memset(&peers[i], 0, sizeof(UDPC_PeerInfo));
+        peers[i].id.port = i;
+        peers[i].handle = version;
+        peers[i].rtt = i;
+        peers[i].isGoodMode = i % 2;
+    }
+    return peers;
+}
+
+} // namespace
+
+void TEST_PeerList() {
+    // Publish
+    {
+        UDPC::PeerListPublisher publisher;
+        const UDPC_PeerList *first = publisher.acquire();
+        ASSERT_TRUE(first);
+        CHECK_EQ(first->version, 0);
+        CHECK_EQ(first->size, 0);
+        CHECK_TRUE(first->peers == nullptr);
+
+        publisher.publish(makePeers(1, 3));
+        const UDPC_PeerList *second = publisher.acquire();
+        CHECK_EQ(second->version, 1);
+        ASSERT_TRUE(second->size == 3);
+        for(unsigned int i = 0; i < 3; ++i) {
+            CHECK_EQ(second->peers[i].id.port, i);
+            CHECK_EQ(second->peers[i].handle, 1);
+            CHECK_EQ(second->peers[i].rtt, i);
+            CHECK_EQ(second->peers[i].isGoodMode, i % 2);
+        }
+        CHECK_EQ(publisher.version(), 1);
+
+        // acquired lists stay valid until released
+        CHECK_EQ(first->version, 0);
+        CHECK_EQ(publisher.retiredSize(), 1);
+        publisher.release(first);
+        publisher.reclaim();
+        CHECK_EQ(publisher.retiredSize(), 0);
+
+        publisher.publish(makePeers(2, 0));
+        CHECK_EQ(publisher.retiredSize(), 1);
+        CHECK_EQ(second->peers[2].handle, 1);
+        publisher.release(second);
+        publisher.reclaim();
+        CHECK_EQ(publisher.retiredSize(), 0);
+
+        const UDPC_PeerList *third = publisher.acquire();
+        CHECK_EQ(third->version, 2);
+        CHECK_EQ(third->size, 0);
+        publisher.release(third);
+    }
+
+    // Concurrent
+    {
+        // lists are never seen changed or freed while acquired, and versions
+        // only increase
+        UDPC::PeerListPublisher publisher;
+        std::atomic_bool isPublishing(true);
+        std::atomic_uint inconsistent(0);
+        std::atomic_uint acquired(0);
+        std::vector<std::thread> readers;
+        for(unsigned int i = 0; i < 3; ++i) {
+            readers.emplace_back([&] () {
+                std::uint64_t lastVersion = 0;
+                while(isPublishing.load()) {
+                    const UDPC_PeerList *list = publisher.acquire();
+                    bool isConsistent = list->version >= lastVersion
+                        && list->size == list->version % 16;
+                    for(unsigned int j = 0; j < list->size; ++j) {
+                        isConsistent = isConsistent
+                            && list->peers[j].handle == list->version
+                            && list->peers[j].id.port == j;
+                    }
+                    lastVersion = list->version;
+                    std::this_thread::yield();
+                    isConsistent = isConsistent
+                        && list->size == list->version % 16;
+                    publisher.release(list);
+                    if(!isConsistent) {
+                        inconsistent.fetch_add(1);
+                    }
+                    acquired.fetch_add(1);
+                }
+            });
+        }
+
+        for(std::uint64_t version = 1; version <= 20000; ++version) {
+            publisher.publish(makePeers(version, version % 16));
+            if(version % 64 == 0) {
+                std::this_thread::yield();
+            }
+        }
+        isPublishing.store(false);
+        for(std::thread &reader : readers) {
+            reader.join();
+        }
+        CHECK_EQ(inconsistent.load(), 0);
+        CHECK_GE(acquired.load(), 1);
+
+        publisher.reclaim();
+        CHECK_EQ(publisher.retiredSize(), 0);
+        CHECK_EQ(publisher.version(), 20000);
+    }
+}
@@ -0,0 +1,257 @@
+#include "test_helpers.h"
+#include "test_headers.h"
+
+#include <chrono>
+#include <future>
+#include <memory>
+#include <thread>
+
+#include "RingQueue.hpp"
+#include "TSLQueue.hpp"
+
+namespace {
+
+constexpr int BENCH_PRODUCERS = 4;
+constexpr int BENCH_ITEMS = 1000;
+
+// Returns the sum of all popped values, producers push and one consumer pops
+// concurrently.
+template <typename PushFn, typename PopFn>
+long contend(const char *name, PushFn push, PopFn pop) {
+    auto start = std::chrono::steady_clock::now();
+    std::future<void> futures[BENCH_PRODUCERS];
+    for(int i = 0; i < BENCH_PRODUCERS; ++i) {
+        futures[i] = std::async(std::launch::async, [i, &push] () {
+            for(int j = 0; j < BENCH_ITEMS; ++j) {
+                push(i * BENCH_ITEMS + j);
+            }
+        });
+    }
+    long sum = 0;
+    int v;
+    for(int popped = 0; popped < BENCH_PRODUCERS * BENCH_ITEMS;) {
+        if(pop(v)) {
+            sum += v;
+            ++popped;
+        }
+    }
+    for(int i = 0; i < BENCH_PRODUCERS; ++i) {
+        futures[i].wait();
+    }
+    double seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+    std::cout << name << " " << BENCH_PRODUCERS << " producers 1 consumer: "
+        << (unsigned long)(BENCH_PRODUCERS * BENCH_ITEMS / seconds)
+        << " items/s\n";
+    return sum;
+}
+
+} // namespace
+
+void TEST_RingQueue() {
+    // PushPopSize
+    {
+        RingQueue<int> q(16);
+
+        CHECK_EQ(q.capacity(), 16);
+        CHECK_TRUE(q.empty());
+
+        int v = -1;
+        CHECK_FALSE(q.pop_front(v));
+        CHECK_EQ(v, -1);
+
+        for(int i = 0; i < 10; ++i) {
+            CHECK_EQ(q.size(), i);
+            CHECK_TRUE(q.push_back(i));
+        }
+
+        for(int i = 0; i < 10; ++i) {
+            CHECK_EQ(q.size(), 10 - i);
+            ASSERT_TRUE(q.pop_front(v));
+            CHECK_EQ(v, i);
+        }
+        CHECK_EQ(q.size(), 0);
+        CHECK_TRUE(q.empty());
+    }
+
+    // CapacityRoundsUp
+    {
+        RingQueue<int> q(5);
+        CHECK_EQ(q.capacity(), 8);
+
+        RingQueue<int> q2(0);
+        CHECK_EQ(q2.capacity(), 2);
+    }
+
+    // Full
+    {
+        RingQueue<std::unique_ptr<int>> q(4);
+
+        for(int i = 0; i < 4; ++i) {
+            CHECK_TRUE(q.push_back(std::unique_ptr<int>(new int(i))));
+        }
+
+        // not moved from when full
+        std::unique_ptr<int> extra(new int(4));
+        CHECK_FALSE(q.push_back(std::move(extra)));
+        ASSERT_TRUE(extra);
+        CHECK_EQ(*extra, 4);
+
+        std::unique_ptr<int> v;
+        ASSERT_TRUE(q.pop_front(v));
+        ASSERT_TRUE(v);
+        CHECK_EQ(*v, 0);
+
+        CHECK_TRUE(q.push_back(std::move(extra)));
+        CHECK_FALSE(extra);
+        CHECK_EQ(q.size(), 4);
+    }
+
+    // Wrap
+    {
+        RingQueue<int> q(4);
+
+        int v;
+        for(int i = 0; i < 100; ++i) {
+            CHECK_TRUE(q.push_back(i));
+            CHECK_TRUE(q.push_back(i + 1000));
+            ASSERT_TRUE(q.pop_front(v));
+            CHECK_EQ(v, i);
+            ASSERT_TRUE(q.pop_front(v));
+            CHECK_EQ(v, i + 1000);
+        }
+        CHECK_TRUE(q.empty());
+    }
+
+    // PopFrontN
+    {
+        RingQueue<int> q(8);
+        int out[8] = {-1, -1, -1, -1, -1, -1, -1, -1};
+        CHECK_EQ(q.pop_front_n(out, 8), 0);
+        CHECK_EQ(out[0], -1);
+
+        for(int i = 0; i < 6; ++i) {
+            CHECK_TRUE(q.push_back(i));
+        }
+        CHECK_EQ(q.pop_front_n(out, 0), 0);
+        CHECK_EQ(q.pop_front_n(out, 4), 4);
+        for(int i = 0; i < 4; ++i) {
+            CHECK_EQ(out[i], i);
+        }
+
+        // wraps around the end of the slots
+        for(int i = 6; i < 12; ++i) {
+            CHECK_TRUE(q.push_back(i));
+        }
+        CHECK_EQ(q.pop_front_n(out, 8), 8);
+        for(int i = 0; i < 8; ++i) {
+            CHECK_EQ(out[i], i + 4);
+        }
+        CHECK_TRUE(q.empty());
+    }
+
+    // PushBackN
+    {
+        RingQueue<std::unique_ptr<int>> q(4);
+        std::unique_ptr<int> items[6];
+        for(int i = 0; i < 6; ++i) {
+            items[i].reset(new int(i));
+        }
+        CHECK_EQ(q.push_back_n(items, 0), 0);
+        CHECK_EQ(q.push_back_n(items, 3), 3);
+        CHECK_FALSE(items[0]);
+
+        // only as many as fit, the rest are not moved from
+        CHECK_EQ(q.push_back_n(items + 3, 3), 1);
+        CHECK_FALSE(items[3]);
+        ASSERT_TRUE(items[4]);
+        CHECK_EQ(*items[4], 4);
+        CHECK_EQ(q.push_back_n(items + 4, 2), 0);
+
+        std::unique_ptr<int> out[4];
+        CHECK_EQ(q.pop_front_n(out, 4), 4);
+        for(int i = 0; i < 4; ++i) {
+            ASSERT_TRUE(out[i]);
+            CHECK_EQ(*out[i], i);
+        }
+    }
+
+    // Concurrent
+    {
+        RingQueue<int> q(64);
+
+        const auto add_fn = [] (RingQueue<int> *q, int i) -> void {
+            for(int j = 0; j < 1000; ++j) {
+                while(!q->push_back(i * 1000 + j)) {
+                    std::this_thread::yield();
+                }
+            }
+        };
+        const auto pop_fn = [] (RingQueue<int> *q) -> long {
+            long sum = 0;
+            int v;
+            for(int j = 0; j < 1000; ++j) {
+                while(!q->pop_front(v)) {
+                    std::this_thread::yield();
+                }
+                sum += v;
+            }
+            return sum;
+        };
+
+        std::future<void> pushFutures[4];
+        std::future<long> popFutures[4];
+        for(int i = 0; i < 4; ++i) {
+            pushFutures[i] = std::async(std::launch::async, add_fn, &q, i);
+            popFutures[i] = std::async(std::launch::async, pop_fn, &q);
+        }
+        long sum = 0;
+        for(int i = 0; i < 4; ++i) {
+            pushFutures[i].wait();
+            sum += popFutures[i].get();
+        }
+
+        // every pushed value popped exactly once
+        long expected = 0;
+        for(int i = 0; i < 4000; ++i) {
+            expected += i;
+        }
+        CHECK_EQ(sum, expected);
+        CHECK_TRUE(q.empty());
+    }
+
+    // ContentionBenchmark
+    {
+        long expected = 0;
+        for(int i = 0; i < BENCH_PRODUCERS * BENCH_ITEMS; ++i) {
+            expected += i;
+        }
+
+        TSLQueue<int> tslQueue;
+        long sum = contend("TSLQueue",
+            [&tslQueue] (int i) {
+                tslQueue.push_back(i);
+            },
+            [&tslQueue] (int &out) {
+                auto v = tslQueue.top_and_pop();
+                if(v) {
+                    out = *v;
+                    return true;
+                }
+                return false;
+            });
+        CHECK_EQ(sum, expected);
+
+        RingQueue<int> ringQueue(8192);
+        sum = contend("RingQueue",
+            [&ringQueue] (int i) {
+                while(!ringQueue.push_back(i)) {
+                    std::this_thread::yield();
+                }
+            },
+            [&ringQueue] (int &out) {
+                return ringQueue.pop_front(out);
+            });
+        CHECK_EQ(sum, expected);
+    }
+}
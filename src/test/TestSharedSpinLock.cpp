@@ -2,6 +2,11 @@
 #include "test_helpers.h"
 #include "test_headers.h"
 
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <thread>
+
 void TEST_CXX11_shared_spin_lock() {
     UDPC::SharedSpinLock::Ptr spinLockPtr = UDPC::SharedSpinLock::newInstance();
 
@@ -16,4 +21,79 @@ void TEST_CXX11_shared_spin_lock() {
     CHECK_FALSE(readLock.isValid());
     CHECK_FALSE(spinLockPtr->try_spin_read_lock().isValid());
     CHECK_FALSE(spinLockPtr->try_spin_write_lock().isValid());
+
+    // trade wakes a reader waiting on the write lock
+    UDPC::SharedSpinLockStats stats{};
+    {
+        std::atomic_bool isWaiting(false);
+        auto readFuture = std::async(std::launch::async,
+                [spinLockPtr, &isWaiting] () {
+            isWaiting.store(true);
+            return spinLockPtr->spin_read_lock().isValid();
+        });
+        while(!isWaiting.load()) {
+            std::this_thread::yield();
+        }
+        // the reader spins (then parks) until the write lock is traded
+        stats = spinLockPtr->get_stats();
+        for(unsigned int i = 0;
+                i < 1000 && stats.spins == 0 && stats.parks == 0; ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            stats = spinLockPtr->get_stats();
+        }
+        CHECK_TRUE(stats.spins > 0 || stats.parks > 0);
+
+        readLock = spinLockPtr->trade_write_for_read_lock(writeLock);
+        CHECK_TRUE(readLock.isValid());
+        CHECK_FALSE(writeLock.isValid());
+        CHECK_TRUE(readFuture.get());
+        readLock = UDPC::LockObj<false>::newInvalid();
+    }
+
+    // failed try_* count nothing, the waiting reader counted once it got the
+    // lock
+    stats = spinLockPtr->get_stats();
+    CHECK_EQ(stats.acquisitions, 5);
+
+    // ContentionBenchmark
+    {
+        UDPC::SharedSpinLock::Ptr lock = UDPC::SharedSpinLock::newInstance();
+        const unsigned int threads = 4;
+        const unsigned int iterations = 20000;
+        unsigned long counter = 0;
+
+        const auto lock_fn = [lock, &counter] (bool isWriter) -> unsigned long {
+            unsigned long seen = 0;
+            for(unsigned int i = 0; i < iterations; ++i) {
+                if(isWriter) {
+                    auto writeLock = lock->spin_write_lock();
+                    ++counter;
+                } else {
+                    auto readLock = lock->spin_read_lock();
+                    seen += counter;
+                }
+            }
+            return seen;
+        };
+
+        auto start = std::chrono::steady_clock::now();
+        std::future<unsigned long> futures[threads];
+        for(unsigned int i = 0; i < threads; ++i) {
+            // half writers, half readers
+            futures[i] = std::async(std::launch::async, lock_fn, i % 2 == 0);
+        }
+        for(unsigned int i = 0; i < threads; ++i) {
+            futures[i].wait();
+        }
+        double seconds = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start).count();
+
+        CHECK_EQ(counter, threads / 2 * iterations);
+        stats = lock->get_stats();
+        CHECK_EQ(stats.acquisitions, threads * iterations);
+        std::cout << "shared spin lock " << threads << " threads: "
+            << (unsigned long)(threads * iterations / seconds) << " locks/s, "
+            << stats.spins << " spins, " << stats.parks << " parks, "
+            << stats.waitNs / 1000 << " us waited\n";
+    }
 }
@@ -0,0 +1,123 @@
+#include "test_helpers.h"
+#include "test_headers.h"
+
+#include <chrono>
+#include <map>
+#include <random>
+#include <vector>
+
+#include "UDPC_TimingWheel.hpp"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+Clock::time_point atTick(const Clock::time_point &start, std::uint64_t tick) {
+    return start + UDPC::TimingWheel::TICK * tick;
+}
+
+} // namespace
+
+void TEST_TimingWheel() {
+    const Clock::time_point start = Clock::now();
+
+    // Schedule
+    {
+        UDPC::TimingWheel wheel(start);
+        std::vector<UDPC::TimingWheel::Entry> due;
+        CHECK_TRUE(wheel.nextDeadline() == Clock::time_point::max());
+
+        CHECK_EQ(wheel.schedule(1, atTick(start, 5)), 5);
+        // rounded up to the next tick, never due early
+        CHECK_EQ(wheel.schedule(2, atTick(start, 5) + std::chrono::microseconds(1)), 6);
+        CHECK_EQ(wheel.size(), 2);
+        CHECK_TRUE(wheel.nextDeadline() == atTick(start, 5));
+
+        wheel.advance(atTick(start, 4), due);
+        CHECK_TRUE(due.empty());
+        wheel.advance(atTick(start, 5) + std::chrono::microseconds(999), due);
+        ASSERT_TRUE(due.size() == 1);
+        CHECK_EQ(due[0].handle, 1);
+        CHECK_EQ(due[0].tick, 5);
+        CHECK_TRUE(wheel.nextDeadline() == atTick(start, 6));
+
+        due.clear();
+        wheel.advance(atTick(start, 6), due);
+        ASSERT_TRUE(due.size() == 1);
+        CHECK_EQ(due[0].handle, 2);
+        CHECK_EQ(wheel.size(), 0);
+        CHECK_TRUE(wheel.nextDeadline() == Clock::time_point::max());
+
+        // at or before the current tick, due on the next advance
+        due.clear();
+        CHECK_EQ(wheel.tickOf(start), 6);
+        CHECK_EQ(wheel.schedule(3, start), 6);
+        CHECK_TRUE(wheel.nextDeadline() == atTick(start, 6));
+        wheel.advance(atTick(start, 6), due);
+        ASSERT_TRUE(due.size() == 1);
+        CHECK_EQ(due[0].handle, 3);
+    }
+
+    // Cascade
+    {
+        // entries on every level, due exactly at their tick while advancing
+        // in steps of varying size
+        UDPC::TimingWheel wheel(start);
+        std::mt19937 rng(7);
+        std::multimap<std::uint64_t, std::uint64_t> expected;
+        std::vector<UDPC::TimingWheel::Entry> due;
+        std::uint64_t now = 0;
+        unsigned int early = 0;
+        unsigned int late = 0;
+        unsigned int handle = 0;
+        while(now < 3000000) {
+            for(unsigned int i = 0; i < 4; ++i) {
+                const std::uint64_t ahead =
+                    1 + rng() % (i == 0 ? 100 : (i == 1 ? 5000 : 400000));
+                expected.insert(std::make_pair(
+                    wheel.schedule(++handle, atTick(start, now + ahead)),
+                    handle));
+            }
+            if(wheel.nextDeadline() > atTick(start, expected.begin()->first)) {
+                ++late;
+            }
+
+            now += 1 + rng() % (rng() % 8 == 0 ? 20000 : 40);
+            due.clear();
+            wheel.advance(atTick(start, now), due);
+            for(const UDPC::TimingWheel::Entry &entry : due) {
+                auto iter = expected.find(entry.tick);
+                while(iter != expected.end() && iter->first == entry.tick
+                        && iter->second != entry.handle) {
+                    ++iter;
+                }
+                if(iter == expected.end() || iter->first != entry.tick
+                        || entry.tick > now) {
+                    ++early;
+                } else {
+                    expected.erase(iter);
+                }
+            }
+            if(!expected.empty() && expected.begin()->first <= now) {
+                ++late;
+            }
+        }
+        CHECK_EQ(early, 0);
+        CHECK_EQ(late, 0);
+        CHECK_EQ(wheel.size(), expected.size());
+    }
+
+    // Range
+    {
+        // later than the wheel's range, due at its end
+        UDPC::TimingWheel wheel(start);
+        std::vector<UDPC::TimingWheel::Entry> due;
+        const std::uint64_t tick = wheel.schedule(1, start + std::chrono::hours(24 * 365));
+        CHECK_LE(tick, 24ull * 365 * 3600 * 1000);
+        wheel.advance(atTick(start, tick - 1), due);
+        CHECK_TRUE(due.empty());
+        wheel.advance(atTick(start, tick), due);
+        ASSERT_TRUE(due.size() == 1);
+        CHECK_EQ(due[0].tick, tick);
+    }
+}
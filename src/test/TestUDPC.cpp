@@ -4,11 +4,20 @@
 #include <UDPC.h>
 #include <UDPC_Defines.hpp>
 
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <chrono>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <ctime>
 #include <future>
+#include <thread>
+
+#if UDPC_PLATFORM == UDPC_PLATFORM_LINUX
+# include <poll.h>
+#endif
 
 void TEST_UDPC() {
     // atostr
@@ -475,4 +484,1627 @@ void TEST_UDPC() {
             thread_array[i].join();
         }
     }
+
+    // recvBatchLoopbackBenchmark
+    if(run_benchmarks) {
+        UDPC_HContext ctx = UDPC_init(UDPC_create_id_easy("::1", 0), 0, 0);
+        ASSERT_TRUE(ctx);
+        UDPC_set_logging_type(ctx, UDPC_LoggingType::UDPC_SILENT);
+        UDPC::Context *c = UDPC::verifyContext(ctx);
+
+        int sender = socket(AF_INET6, SOCK_DGRAM, IPPROTO_UDP);
+        ASSERT_TRUE(sender >= 0);
+
+        // valid protocol id, but not from a connected peer
+        char pkt[UDPC_NSFULL_HEADER_SIZE + 4];
+        std::memset(pkt, 0, sizeof(pkt));
+        UDPC::preparePacket(pkt, UDPC_DEFAULT_PROTOCOL_ID, 1, 0, 0xFFFFFFFF,
+                            nullptr, 0);
+
+        const unsigned int depths[2] = {1, UDPC_RECV_BATCH_DEFAULT};
+        for(unsigned int depth : depths) {
+            UDPC_set_receive_batch_depth(ctx, depth);
+            CHECK_EQ(UDPC_get_receive_batch_depth(ctx), depth);
+            UDPC_update(ctx);
+
+            std::chrono::steady_clock::duration wall{0};
+            std::clock_t cpu = 0;
+            unsigned long count = 0;
+            for(unsigned int round = 0; round < 200; ++round) {
+                for(unsigned int i = 0; i < 64; ++i) {
+                    sendto(sender, pkt, sizeof(pkt), 0,
+                           (struct sockaddr*)&c->socketInfo,
+                           sizeof(UDPC_IPV6_SOCKADDR_TYPE));
+                }
+                count += 64;
+                auto start = std::chrono::steady_clock::now();
+                std::clock_t cpuStart = std::clock();
+                UDPC_update(ctx);
+                cpu += std::clock() - cpuStart;
+                wall += std::chrono::steady_clock::now() - start;
+            }
+
+            // update must have drained the socket
+            char peek;
+            CHECK_EQ(recv(c->socketHandle, &peek, 1, MSG_PEEK | MSG_DONTWAIT), -1);
+
+            double seconds = std::chrono::duration<double>(wall).count();
+            std::cout << "recv batch depth " << depth << ": "
+                << (unsigned long)(count / seconds) << " pkts/s, "
+                << (double)cpu * 1.0e9 / CLOCKS_PER_SEC / count
+                << " ns cpu/pkt\n";
+        }
+
+        UDPC_CLEANUPSOCKET(sender);
+        UDPC_destroy(ctx);
+    }
+
+    // receiveAckBenchmark
+    {
+        UDPC_HContext server = UDPC_init(UDPC_create_id_easy("::1", 0), 0, 0);
+        ASSERT_TRUE(server);
+        UDPC_HContext client = UDPC_init(UDPC_create_id_easy("::1", 0), 1, 0);
+        ASSERT_TRUE(client);
+        UDPC_set_logging_type(server, UDPC_LoggingType::UDPC_SILENT);
+        UDPC_set_logging_type(client, UDPC_LoggingType::UDPC_SILENT);
+        UDPC::Context *s = UDPC::verifyContext(server);
+        UDPC::Context *c = UDPC::verifyContext(client);
+
+        UDPC_ConnectionId serverId;
+        UDPC_ConnectionId clientId;
+        ASSERT_TRUE(connectLoopback(server, client, &serverId, &clientId));
+        // the server ignores packets until it sent its connect response
+        for(unsigned int i = 0; i < 200; ++i) {
+            UDPC_update(server);
+            {
+                std::lock_guard<std::mutex> conMapLock(s->conMapMutex);
+                if(!s->conMap.find(clientId)->second.flags.test(3)) {
+                    break;
+                }
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+
+        // a full window of checked packets that have not timed out yet
+        const auto now = std::chrono::steady_clock::now();
+        uint32_t conID;
+        uint32_t lseq;
+        {
+            std::lock_guard<std::mutex> conMapLock(s->conMapMutex);
+            UDPC::ConnectionData &con = s->conMap.find(clientId)->second;
+            ASSERT_FALSE(con.flags.test(3));
+            conID = con.id;
+            lseq = con.lseq;
+            for(uint32_t id = lseq - UDPC_SENT_PKTS_MAX_SIZE; id != lseq; ++id) {
+                UDPC::SentPkt &sent = con.addSentPkt(id, now);
+                sent.dataSize = UDPC_NSFULL_HEADER_SIZE + 64;
+                sent.data = s->bufferPool->allocate(sent.dataSize);
+                sent.data[UDPC_MIN_HEADER_SIZE] = 0;
+            }
+        }
+
+        UDPC_IPV6_SOCKADDR_TYPE clientAddr = c->socketInfo;
+        clientAddr.sin6_addr = in6addr_loopback;
+        char pkt[UDPC_NSFULL_HEADER_SIZE];
+        uint32_t seq = 0x10000;
+        // best of a few rounds, the receive path is short enough to be
+        // skewed by anything else running
+        double best = 0.0;
+        for(unsigned int round = 0; round < 5; ++round) {
+            const unsigned long count = 200000;
+            auto start = std::chrono::steady_clock::now();
+            for(unsigned long i = 0; i < count; ++i) {
+                // every other packet of the window is missing
+                std::memset(pkt, 0, sizeof(pkt));
+                UDPC::preparePacket(pkt, UDPC_DEFAULT_PROTOCOL_ID, conID,
+                    lseq - 1, 0xAAAAAAAA, &seq, 0x4);
+                s->receivePacket(pkt, sizeof(pkt), clientAddr, now);
+            }
+            double ns = std::chrono::duration<double, std::nano>(
+                std::chrono::steady_clock::now() - start).count() / count;
+            if(round == 0 || ns < best) {
+                best = ns;
+            }
+        }
+        std::cout << "receive ack processing: " << best << " ns/pkt\n";
+
+        // nothing timed out, so nothing was queued to be re-sent
+        {
+            std::lock_guard<std::mutex> conMapLock(s->conMapMutex);
+            CHECK_TRUE(s->conMap.find(clientId)->second.priorityPkts.empty());
+        }
+
+        // once timed out, each missing packet above the oldest received one
+        // is re-sent once, the lowest bit of the window is received
+        {
+            std::lock_guard<std::mutex> conMapLock(s->conMapMutex);
+            UDPC::ConnectionData &con = s->conMap.find(clientId)->second;
+            for(UDPC::SentPkt &sent : con.sentPkts) {
+                sent.sentTime = now - UDPC::PACKET_TIMEOUT_TIME * 2;
+            }
+        }
+        for(unsigned int i = 0; i < 2; ++i) {
+            UDPC::preparePacket(pkt, UDPC_DEFAULT_PROTOCOL_ID, conID,
+                lseq - 1, 0xAAAAAAAA, &seq, 0x4);
+            s->receivePacket(pkt, sizeof(pkt), clientAddr, now);
+        }
+        {
+            std::lock_guard<std::mutex> conMapLock(s->conMapMutex);
+            UDPC::ConnectionData &con = s->conMap.find(clientId)->second;
+            CHECK_EQ(con.priorityPkts.size(), 15);
+            CHECK_TRUE((con.findSentPkt(lseq - 2)->flags & 0x8) == 0);
+            CHECK_TRUE((con.findSentPkt(lseq - 3)->flags & 0x8) != 0);
+            CHECK_TRUE((con.findSentPkt(lseq - 31)->flags & 0x8) != 0);
+            CHECK_TRUE((con.findSentPkt(lseq - 33)->flags & 0x8) == 0);
+        }
+
+        // a skipped sequence is not acked, an older ack is merged into the
+        // peer's acks
+        {
+            std::unique_lock<std::mutex> conMapLock(s->conMapMutex);
+            UDPC::ConnectionData &con = s->conMap.find(clientId)->second;
+            CHECK_EQ(con.peerRseq, lseq - 1);
+            CHECK_TRUE((con.peerAck & 0xAAAAAAAA) == 0xAAAAAAAA);
+            // as if only the acks above were received
+            con.peerAck = 0xAAAAAAAA;
+            conMapLock.unlock();
+
+            const uint32_t skipped = seq++;
+            UDPC::preparePacket(pkt, UDPC_DEFAULT_PROTOCOL_ID, conID,
+                lseq - 3, 0, &seq, 0x4);
+            s->receivePacket(pkt, sizeof(pkt), clientAddr, now);
+            conMapLock.lock();
+            CHECK_EQ(con.rseq, skipped + 1);
+            CHECK_TRUE((con.ack & 0x80000000) == 0);
+            CHECK_TRUE((con.ack & 0x40000000) != 0);
+            CHECK_EQ(con.peerRseq, lseq - 1);
+            CHECK_EQ(con.peerAck, 0xAAAAAAAA | 0x40000000);
+        }
+
+        UDPC_destroy(client);
+        UDPC_destroy(server);
+    }
+
+    // gsoSegmentedSend
+    {
+        UDPC_HContext ctx = UDPC_init(UDPC_create_id_easy("::1", 0), 0, 0);
+        ASSERT_TRUE(ctx);
+        UDPC_set_logging_type(ctx, UDPC_LoggingType::UDPC_SILENT);
+        UDPC::Context *c = UDPC::verifyContext(ctx);
+
+        int receiver = socket(AF_INET6, SOCK_DGRAM, IPPROTO_UDP);
+        ASSERT_TRUE(receiver >= 0);
+        UDPC_IPV6_SOCKADDR_TYPE receiverInfo;
+        std::memset(&receiverInfo, 0, sizeof(receiverInfo));
+        receiverInfo.sin6_family = AF_INET6;
+        receiverInfo.sin6_addr = in6addr_loopback;
+        ASSERT_TRUE(bind(receiver, (struct sockaddr*)&receiverInfo,
+                         sizeof(receiverInfo)) == 0);
+        socklen_t receiverInfoSize = sizeof(receiverInfo);
+        getsockname(receiver, (struct sockaddr*)&receiverInfo,
+                    &receiverInfoSize);
+        UDPC_ConnectionId receiverId = UDPC_create_id(
+            in6addr_loopback, ntohs(receiverInfo.sin6_port));
+
+        CHECK_EQ(UDPC_get_gso_enabled(ctx), 0);
+#if UDPC_PLATFORM == UDPC_PLATFORM_LINUX
+        UDPC_set_gso_enabled(ctx, 1);
+        CHECK_EQ(UDPC_get_gso_enabled(ctx), 1);
+#endif
+
+        // run of equal sizes with a shorter tail, then an odd-sized datagram
+        const unsigned int sizes[12] = {
+            100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 60, 200};
+        for(unsigned int i = 0; i < 12; ++i) {
+            char *buf = c->stageSend(sizes[i], receiverId);
+            std::memset(buf, (int)i, sizes[i]);
+        }
+        c->flushSends();
+
+        char recvBuf[UDPC_PACKET_MAX_SIZE];
+        for(unsigned int i = 0; i < 12; ++i) {
+            long int bytes = recv(receiver, recvBuf, sizeof(recvBuf), 0);
+            CHECK_EQ(bytes, (long int)sizes[i]);
+            CHECK_EQ(recvBuf[0], (char)i);
+            CHECK_EQ(recvBuf[bytes - 1], (char)i);
+        }
+        CHECK_EQ(recv(receiver, recvBuf, 1, MSG_DONTWAIT), -1);
+
+        UDPC_CLEANUPSOCKET(receiver);
+        UDPC_destroy(ctx);
+    }
+
+    // groCoalescedReceive
+    {
+        UDPC_HContext ctx = UDPC_init(UDPC_create_id_easy("::1", 0), 0, 0);
+        ASSERT_TRUE(ctx);
+        UDPC_set_logging_type(ctx, UDPC_LoggingType::UDPC_SILENT);
+        UDPC::Context *c = UDPC::verifyContext(ctx);
+        UDPC_ConnectionId ctxId = UDPC_create_id(
+            in6addr_loopback, ntohs(c->socketInfo.sin6_port));
+
+        UDPC_ReceiveStats stats = UDPC_get_receive_stats(ctx);
+        CHECK_EQ(stats.calls, 0);
+        CHECK_EQ(stats.datagrams, 0);
+
+        // sender context segments with GSO, receiver coalesces with GRO
+        UDPC_HContext sendCtx = UDPC_init(UDPC_create_id_easy("::1", 0), 0, 0);
+        ASSERT_TRUE(sendCtx);
+        UDPC_set_logging_type(sendCtx, UDPC_LoggingType::UDPC_SILENT);
+        UDPC::Context *sendC = UDPC::verifyContext(sendCtx);
+
+        CHECK_EQ(UDPC_get_gro_enabled(ctx), 0);
+#if UDPC_PLATFORM == UDPC_PLATFORM_LINUX
+        UDPC_set_gso_enabled(sendCtx, 1);
+        UDPC_set_gro_enabled(ctx, 1);
+        CHECK_EQ(UDPC_get_gro_enabled(ctx), 1);
+#endif
+
+        // valid protocol id, but not from a connected peer
+        for(unsigned int i = 0; i < 16; ++i) {
+            char *buf = sendC->stageSend(UDPC_NSFULL_HEADER_SIZE + 4, ctxId);
+            std::memset(buf, 0, UDPC_NSFULL_HEADER_SIZE + 4);
+            UDPC::preparePacket(buf, UDPC_DEFAULT_PROTOCOL_ID, 1, 0,
+                                0xFFFFFFFF, nullptr, 0);
+        }
+        sendC->flushSends();
+        UDPC_update(ctx);
+
+        stats = UDPC_get_receive_stats(ctx);
+        CHECK_EQ(stats.datagrams, 16);
+        CHECK_TRUE(stats.calls >= 1);
+        CHECK_TRUE(stats.maxPerCall >= 1);
+#if UDPC_PLATFORM == UDPC_PLATFORM_LINUX
+        if(run_benchmarks) {
+            std::cout << "gro: " << stats.datagrams << " datagrams in "
+                << stats.calls << " receive calls, "
+                << stats.coalescedBuffers << " coalesced buffers\n";
+        }
+#endif
+
+        UDPC_destroy(sendCtx);
+        UDPC_destroy(ctx);
+    }
+
+    // ioUringEngineLoopback
+    {
+        UDPC_HContext server = UDPC_init_io_engine(
+            UDPC_create_id_easy("::1", 0), 0, 0, UDPC_IO_ENGINE_IO_URING);
+        ASSERT_TRUE(server);
+        UDPC_HContext client = UDPC_init_io_engine(
+            UDPC_create_id_easy("::1", 0), 1, 0, UDPC_IO_ENGINE_IO_URING);
+        ASSERT_TRUE(client);
+        UDPC_set_logging_type(server, UDPC_LoggingType::UDPC_SILENT);
+        UDPC_set_logging_type(client, UDPC_LoggingType::UDPC_SILENT);
+#ifndef UDPC_IO_URING_ENABLED
+        CHECK_EQ(UDPC_get_io_engine(server), UDPC_IO_ENGINE_SOCKET);
+#endif
+        if(run_benchmarks) {
+            std::cout << "io engine: "
+                << (UDPC_get_io_engine(server) == UDPC_IO_ENGINE_IO_URING ?
+                    "io_uring" : "socket") << '\n';
+        }
+
+        UDPC_ConnectionId serverId;
+        UDPC_ConnectionId clientId;
+        CHECK_TRUE(connectLoopback(server, client, &serverId, &clientId));
+
+        UDPC_queue_send(client, serverId, 1, "io_uring", 9);
+        UDPC_PacketInfo pinfo = UDPC::get_empty_pinfo();
+        for(unsigned int i = 0; i < 200 && pinfo.dataSize == 0; ++i) {
+            UDPC_update(client);
+            UDPC_update(server);
+            pinfo = UDPC_get_received(server, nullptr);
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+        CHECK_EQ(pinfo.dataSize, 9);
+        if(pinfo.data) {
+            CHECK_STREQ(pinfo.data, "io_uring");
+        }
+        UDPC_free_PacketInfo(pinfo);
+
+        UDPC_destroy(client);
+        UDPC_destroy(server);
+    }
+
+    // shardedServer
+    {
+        UDPC_HContext server = UDPC_init_sharded(
+            UDPC_create_id_easy("::1", 0), 4, 0);
+        ASSERT_TRUE(server);
+        UDPC_set_logging_type(server, UDPC_LoggingType::UDPC_SILENT);
+        UDPC::Context *s = UDPC::verifyContext(server);
+        CHECK_EQ(s->shards.size(), 4);
+        for(UDPC::Context *shard : s->shards) {
+            CHECK_EQ(shard->socketInfo.sin6_port, s->socketInfo.sin6_port);
+            CHECK_TRUE(shard->isAutoUpdating.load());
+        }
+        UDPC_ConnectionId serverId;
+
+        const unsigned int clientCount = 8;
+        UDPC_HContext clients[clientCount];
+        UDPC_ConnectionId clientIds[clientCount];
+        unsigned int connected = 0;
+        for(unsigned int i = 0; i < clientCount; ++i) {
+            clients[i] = UDPC_init(UDPC_create_id_easy("::1", 0), 1, 0);
+            ASSERT_TRUE(clients[i]);
+            UDPC_set_logging_type(clients[i], UDPC_LoggingType::UDPC_SILENT);
+            if(connectLoopback(server, clients[i], &serverId, &clientIds[i])) {
+                ++connected;
+            }
+        }
+        CHECK_EQ(connected, clientCount);
+
+        // each peer is on exactly one shard
+        unsigned int usedShards = 0;
+        for(UDPC::Context *shard : s->shards) {
+            unsigned int size = 0;
+            UDPC_ConnectionId *list = UDPC_get_list_connected(
+                (UDPC_HContext)shard, &size);
+            UDPC_free_list_connected(list);
+            if(size != 0) {
+                ++usedShards;
+            }
+        }
+        for(unsigned int i = 0; i < clientCount; ++i) {
+            unsigned int owners = 0;
+            for(UDPC::Context *shard : s->shards) {
+                owners += UDPC_has_connection(
+                    (UDPC_HContext)shard, clientIds[i]);
+            }
+            CHECK_EQ(owners, 1);
+        }
+        if(run_benchmarks) {
+            std::cout << "sharded server: " << clientCount
+                << " clients on " << usedShards << " of 4 shards\n";
+        }
+
+        unsigned int size = 0;
+        UDPC_ConnectionId *list = UDPC_get_list_connected(server, &size);
+        CHECK_EQ(size, clientCount);
+        UDPC_free_list_connected(list);
+
+        // the published peer list combines the shards' lists
+        const UDPC_PeerList *peerList = UDPC_acquire_peer_list(server);
+        for(unsigned int j = 0; j < 200 && peerList->size != clientCount; ++j) {
+            UDPC_release_peer_list(server, peerList);
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            peerList = UDPC_acquire_peer_list(server);
+        }
+        CHECK_EQ(peerList->size, clientCount);
+        unsigned int listed = 0;
+        for(unsigned int i = 0; i < clientCount; ++i) {
+            for(unsigned int j = 0; j < peerList->size; ++j) {
+                if(peerList->peers[j].id == clientIds[i]
+                        && peerList->peers[j].handle
+                            == UDPC_get_handle(server, clientIds[i])) {
+                    ++listed;
+                }
+            }
+        }
+        CHECK_EQ(listed, clientCount);
+        UDPC_release_peer_list(server, peerList);
+
+        // handles carry their shard
+        unsigned int handleMismatches = 0;
+        for(unsigned int i = 0; i < clientCount; ++i) {
+            UDPC_ConnectionHandle handle = UDPC_get_handle(server, clientIds[i]);
+            UDPC::Context *shard = s->shards[(handle >> 24) & 0xFF];
+            if(handle == 0 || !UDPC_has_connection_h(server, handle)
+                    || !UDPC_has_connection((UDPC_HContext)shard, clientIds[i])) {
+                ++handleMismatches;
+            }
+        }
+        CHECK_EQ(handleMismatches, 0);
+
+        // a batch is split by shard, an unknown peer goes to the first one
+        {
+            std::vector<UDPC_SendItem> items;
+            const UDPC_ConnectionId unknownId = UDPC_create_id_easy("::1", 1);
+            for(unsigned int i = 0; i < clientCount; ++i) {
+                items.push_back(UDPC_SendItem{clientIds[i], "batched", 8, 0});
+                items.push_back(UDPC_SendItem{unknownId, "batched", 8, 0});
+            }
+            std::vector<UDPC_SendResult> results(items.size());
+            CHECK_EQ(UDPC_queue_send_batch(server, items.data(), items.size(),
+                results.data()), clientCount);
+            unsigned int misrouted = 0;
+            for(std::size_t i = 0; i < items.size(); ++i) {
+                if(results[i] != (i % 2 == 0 ? UDPC_SR_QUEUED
+                                             : UDPC_SR_NOT_CONNECTED)) {
+                    ++misrouted;
+                }
+            }
+            CHECK_EQ(misrouted, 0);
+        }
+
+        // server replies are routed to the owning shard
+        for(unsigned int i = 0; i < clientCount; ++i) {
+            UDPC_queue_send(clients[i], serverId, 1, "shard", 6);
+            UDPC_queue_send(server, clientIds[i], 1, "reply", 6);
+        }
+        unsigned int received = 0;
+        unsigned int replies = 0;
+        for(unsigned int j = 0; j < 200
+                && (received != clientCount || replies != clientCount); ++j) {
+            for(unsigned int i = 0; i < clientCount; ++i) {
+                UDPC_update(clients[i]);
+                UDPC_PacketInfo pinfo = UDPC_get_received(clients[i], nullptr);
+                if(pinfo.dataSize == 6) {
+                    CHECK_STREQ(pinfo.data, "reply");
+                    ++replies;
+                }
+                UDPC_free_PacketInfo(pinfo);
+            }
+            UDPC_PacketInfo pinfo = UDPC_get_received(server, nullptr);
+            while(pinfo.dataSize != 0) {
+                CHECK_STREQ(pinfo.data, "shard");
+                ++received;
+                UDPC_free_PacketInfo(pinfo);
+                pinfo = UDPC_get_received(server, nullptr);
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+        CHECK_EQ(received, clientCount);
+        CHECK_EQ(replies, clientCount);
+
+        for(unsigned int i = 0; i < clientCount; ++i) {
+            UDPC_destroy(clients[i]);
+        }
+        UDPC_destroy(server);
+    }
+
+    // eventDrivenThreadedUpdate
+    {
+        UDPC_HContext server = UDPC_init_threaded_update(
+            UDPC_create_id_easy("::1", 0), 0, 0);
+        ASSERT_TRUE(server);
+        UDPC_HContext client = UDPC_init_threaded_update(
+            UDPC_create_id_easy("::1", 0), 1, 0);
+        ASSERT_TRUE(client);
+        UDPC_set_logging_type(server, UDPC_LoggingType::UDPC_SILENT);
+        UDPC_set_logging_type(client, UDPC_LoggingType::UDPC_SILENT);
+        UDPC::Context *s = UDPC::verifyContext(server);
+        UDPC::Context *c = UDPC::verifyContext(client);
+#if UDPC_PLATFORM == UDPC_PLATFORM_LINUX
+        CHECK_TRUE(s->epollFd >= 0);
+        CHECK_TRUE(c->epollFd >= 0);
+#endif
+        // no connections, nothing to wake up for
+        CHECK_TRUE(s->nextDeadline() == std::chrono::steady_clock::time_point::max());
+
+        UDPC_ConnectionId serverId;
+        UDPC_ConnectionId clientId;
+        CHECK_TRUE(connectLoopback(server, client, &serverId, &clientId));
+
+        // connected, next wakeup is at most a heartbeat away, once update
+        // scheduled the connection it added
+        auto deadline = s->nextDeadline();
+        for(unsigned int i = 0; i < 200
+                && deadline == std::chrono::steady_clock::time_point::max();
+                ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            deadline = s->nextDeadline();
+        }
+        CHECK_TRUE(deadline != std::chrono::steady_clock::time_point::max());
+        CHECK_TRUE(deadline - std::chrono::steady_clock::now()
+            <= UDPC::HEARTBEAT_PKT_INTERVAL_DT + UDPC::BAD_MODE_SEND_RATE);
+
+        UDPC_queue_send(client, serverId, 1, "wake", 5);
+        UDPC_PacketInfo pinfo = UDPC::get_empty_pinfo();
+        for(unsigned int i = 0; i < 200 && pinfo.dataSize == 0; ++i) {
+            pinfo = UDPC_get_received(server, nullptr);
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+        CHECK_EQ(pinfo.dataSize, 5);
+        if(pinfo.data) {
+            CHECK_STREQ(pinfo.data, "wake");
+        }
+        UDPC_free_PacketInfo(pinfo);
+
+        // stopping wakes the waiting thread
+        CHECK_TRUE(UDPC_disable_threaded_update(server));
+        CHECK_TRUE(UDPC_enable_threaded_update(server));
+
+        UDPC_destroy(client);
+        UDPC_destroy(server);
+    }
+
+#if UDPC_PLATFORM == UDPC_PLATFORM_LINUX
+    // pollableFdUpdate
+    {
+        UDPC_HContext server = UDPC_init(UDPC_create_id_easy("::1", 0), 0, 0);
+        ASSERT_TRUE(server);
+        UDPC_HContext client = UDPC_init(UDPC_create_id_easy("::1", 0), 1, 0);
+        ASSERT_TRUE(client);
+        UDPC_set_logging_type(server, UDPC_LoggingType::UDPC_SILENT);
+        UDPC_set_logging_type(client, UDPC_LoggingType::UDPC_SILENT);
+        UDPC::Context *s = UDPC::verifyContext(server);
+        UDPC::Context *c = UDPC::verifyContext(client);
+        UDPC_ConnectionId serverId = UDPC_create_id(
+            in6addr_loopback, ntohs(s->socketInfo.sin6_port));
+        UDPC_ConnectionId clientId = UDPC_create_id(
+            in6addr_loopback, ntohs(c->socketInfo.sin6_port));
+
+        struct pollfd fds[2];
+        fds[0].fd = UDPC_get_pollable_fd(server);
+        fds[0].events = POLLIN;
+        fds[1].fd = UDPC_get_pollable_fd(client);
+        fds[1].events = POLLIN;
+        CHECK_TRUE(fds[0].fd >= 0);
+        CHECK_TRUE(fds[1].fd >= 0);
+
+        // idle, nothing to poll for
+        CHECK_EQ(UDPC_get_next_deadline_us(server), -1);
+        CHECK_EQ(poll(fds, 2, 20), 0);
+
+        // queued work makes the fd readable
+        UDPC_client_initiate_connection(client, serverId, 0);
+        CHECK_EQ(poll(fds + 1, 1, 0), 1);
+
+        // update only when a fd is readable
+        unsigned int updates = 0;
+        for(unsigned int i = 0; i < 200; ++i) {
+            if(UDPC_has_connection(client, serverId)
+                    && UDPC_has_connection(server, clientId)) {
+                break;
+            }
+            if(poll(fds, 2, 100) > 0) {
+                if(fds[0].revents & POLLIN) {
+                    UDPC_update(server);
+                    ++updates;
+                }
+                if(fds[1].revents & POLLIN) {
+                    UDPC_update(client);
+                    ++updates;
+                }
+            }
+        }
+        CHECK_TRUE(UDPC_has_connection(client, serverId));
+        CHECK_TRUE(UDPC_has_connection(server, clientId));
+
+        // connected, the next heartbeat is due soon
+        int64_t deadline = UDPC_get_next_deadline_us(server);
+        CHECK_TRUE(deadline >= 0);
+        CHECK_TRUE(deadline <= std::chrono::duration_cast<std::chrono::microseconds>(
+            UDPC::HEARTBEAT_PKT_INTERVAL_DT + UDPC::BAD_MODE_SEND_RATE).count());
+
+        UDPC_queue_send(client, serverId, 1, "poll", 5);
+        UDPC_PacketInfo pinfo = UDPC::get_empty_pinfo();
+        for(unsigned int i = 0; i < 200 && pinfo.dataSize == 0; ++i) {
+            if(poll(fds, 2, 100) > 0) {
+                if(fds[0].revents & POLLIN) {
+                    UDPC_update(server);
+                    ++updates;
+                }
+                if(fds[1].revents & POLLIN) {
+                    UDPC_update(client);
+                    ++updates;
+                }
+            }
+            pinfo = UDPC_get_received(server, nullptr);
+        }
+        CHECK_EQ(pinfo.dataSize, 5);
+        if(pinfo.data) {
+            CHECK_STREQ(pinfo.data, "poll");
+        }
+        UDPC_free_PacketInfo(pinfo);
+        if(run_benchmarks) {
+            std::cout << "pollable fd: " << updates << " updates\n";
+        }
+
+        // not available with auto updating
+        UDPC_enable_threaded_update(client);
+        CHECK_EQ(UDPC_get_pollable_fd(client), -1);
+
+        UDPC_destroy(client);
+        UDPC_destroy(server);
+    }
+#endif
+
+#if UDPC_PLATFORM == UDPC_PLATFORM_LINUX
+    // receiveThreadHandoff
+    {
+        UDPC_HContext server = UDPC_init_threaded_update(
+            UDPC_create_id_easy("::1", 0), 0, 0);
+        ASSERT_TRUE(server);
+        UDPC_HContext client = UDPC_init_threaded_update(
+            UDPC_create_id_easy("::1", 0), 1, 0);
+        ASSERT_TRUE(client);
+        UDPC_set_logging_type(server, UDPC_LoggingType::UDPC_SILENT);
+        UDPC_set_logging_type(client, UDPC_LoggingType::UDPC_SILENT);
+
+        CHECK_EQ(UDPC_get_receive_thread_enabled(server), 0);
+        CHECK_EQ(UDPC_set_receive_thread_enabled(server, 1), 0);
+        CHECK_EQ(UDPC_get_receive_thread_enabled(server), 1);
+        CHECK_EQ(UDPC_set_receive_thread_enabled(server, 1), 1);
+
+        UDPC_ConnectionId serverId;
+        UDPC_ConnectionId clientId;
+        CHECK_TRUE(connectLoopback(server, client, &serverId, &clientId));
+
+        UDPC_queue_send(client, serverId, 1, "recv", 5);
+        UDPC_PacketInfo pinfo = UDPC::get_empty_pinfo();
+        for(unsigned int i = 0; i < 200 && pinfo.dataSize == 0; ++i) {
+            pinfo = UDPC_get_received(server, nullptr);
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+        CHECK_EQ(pinfo.dataSize, 5);
+        if(pinfo.data) {
+            CHECK_STREQ(pinfo.data, "recv");
+        }
+        UDPC_free_PacketInfo(pinfo);
+
+        UDPC_ReceiveStats stats = UDPC_get_receive_stats(server);
+        CHECK_TRUE(stats.datagrams > 0);
+        CHECK_EQ(stats.handoffDropped, 0);
+
+        // back to receiving in update
+        CHECK_EQ(UDPC_set_receive_thread_enabled(server, 0), 1);
+        CHECK_EQ(UDPC_get_receive_thread_enabled(server), 0);
+
+        UDPC_queue_send(client, serverId, 1, "back", 5);
+        pinfo = UDPC::get_empty_pinfo();
+        for(unsigned int i = 0; i < 200 && pinfo.dataSize == 0; ++i) {
+            pinfo = UDPC_get_received(server, nullptr);
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+        CHECK_EQ(pinfo.dataSize, 5);
+        if(pinfo.data) {
+            CHECK_STREQ(pinfo.data, "back");
+        }
+        UDPC_free_PacketInfo(pinfo);
+
+        // destroyed with the receive thread running
+        UDPC_set_receive_thread_enabled(client, 1);
+        UDPC_destroy(client);
+        UDPC_destroy(server);
+    }
+#endif
+
+    // boundedContextQueues
+    {
+        UDPC_HContext ctx = UDPC_init(UDPC_create_id_easy("::1", 0), 0, 0);
+        ASSERT_TRUE(ctx);
+        UDPC_set_logging_type(ctx, UDPC_LoggingType::UDPC_SILENT);
+        UDPC_ConnectionId peer = UDPC_create_id_easy("::1", 1);
+
+        // full queue drops further packets
+        for(unsigned int i = 0; i < UDPC_SEND_QUEUE_CAPACITY + 10; ++i) {
+            UDPC_queue_send(ctx, peer, 0, "full", 5);
+        }
+        CHECK_EQ(UDPC_get_queue_send_current_size(ctx), UDPC_SEND_QUEUE_CAPACITY);
+
+        // not connected, dropped by update
+        UDPC_update(ctx);
+        CHECK_EQ(UDPC_get_queue_send_current_size(ctx), 0);
+
+        UDPC_destroy(ctx);
+    }
+
+    // batchDrain
+    {
+        UDPC_HContext ctx = UDPC_init(UDPC_create_id_easy("::1", 0), 0, 0);
+        ASSERT_TRUE(ctx);
+        UDPC::Context *c = UDPC::verifyContext(ctx);
+        UDPC_ConnectionId peer = UDPC_create_id_easy("::1", 1);
+
+        for(unsigned int i = 0; i < 10; ++i) {
+            c->pushEvent(UDPC_Event{UDPC_ET_CONNECTED, peer, (int)i, 0});
+            UDPC_PacketInfo pinfo = UDPC::get_empty_pinfo();
+            pinfo.dataSize = 4;
+            pinfo.data = c->bufferPool->allocate(pinfo.dataSize);
+            std::memcpy(pinfo.data, &i, 4);
+            c->pushReceived(pinfo);
+        }
+
+        std::array<UDPC_Event, 8> events;
+        unsigned long remaining = 0;
+        CHECK_EQ(UDPC_get_event_batch(ctx, events.data(), 8, &remaining), 8);
+        CHECK_EQ(remaining, 2);
+        for(unsigned int i = 0; i < 8; ++i) {
+            CHECK_EQ(events[i].type, UDPC_ET_CONNECTED);
+            CHECK_EQ(events[i].v.enableLibSodium, (int)i);
+        }
+        CHECK_EQ(UDPC_get_event_batch(ctx, events.data(), 8, &remaining), 2);
+        CHECK_EQ(remaining, 0);
+        CHECK_EQ(events[1].v.enableLibSodium, 9);
+        CHECK_EQ(UDPC_get_event_batch(ctx, events.data(), 8, &remaining), 0);
+
+        std::array<UDPC_PacketInfo, 16> pinfos;
+        CHECK_EQ(UDPC_get_received_batch(ctx, pinfos.data(), 16, &remaining), 10);
+        CHECK_EQ(remaining, 0);
+        for(unsigned int i = 0; i < 10; ++i) {
+            unsigned int value;
+            std::memcpy(&value, pinfos[i].data, 4);
+            CHECK_EQ(value, i);
+            UDPC_free_PacketInfo(pinfos[i]);
+        }
+
+        CHECK_EQ(UDPC_get_received_batch(nullptr, pinfos.data(), 16, &remaining), 0);
+        CHECK_EQ(remaining, 0);
+
+        UDPC_destroy(ctx);
+    }
+
+    // queueSendBatch
+    {
+        UDPC_HContext server = UDPC_init(UDPC_create_id_easy("::1", 0), 0, 0);
+        ASSERT_TRUE(server);
+        UDPC_HContext client = UDPC_init(UDPC_create_id_easy("::1", 0), 1, 0);
+        ASSERT_TRUE(client);
+        UDPC_set_logging_type(server, UDPC_LoggingType::UDPC_SILENT);
+        UDPC_set_logging_type(client, UDPC_LoggingType::UDPC_SILENT);
+
+        UDPC_ConnectionId serverId;
+        UDPC_ConnectionId clientId;
+        ASSERT_TRUE(connectLoopback(server, client, &serverId, &clientId));
+
+        const char *msg = "batched";
+        std::array<UDPC_SendItem, UDPC_QUEUED_PKTS_MAX_SIZE + 4> items;
+        for(UDPC_SendItem &item : items) {
+            item = UDPC_SendItem{serverId, msg, 8, 0};
+        }
+        items[0].size = 0;
+        items[1].destinationId = UDPC_create_id_easy("::1", 1);
+        std::array<UDPC_SendResult, items.size()> results;
+        CHECK_EQ(UDPC_queue_send_batch(client, items.data(), items.size(),
+            results.data()), UDPC_QUEUED_PKTS_MAX_SIZE);
+        CHECK_EQ(results[0], UDPC_SR_INVALID);
+        CHECK_EQ(results[1], UDPC_SR_NOT_CONNECTED);
+        for(unsigned int i = 2; i < UDPC_QUEUED_PKTS_MAX_SIZE + 2; ++i) {
+            CHECK_EQ(results[i], UDPC_SR_QUEUED);
+        }
+        // the connection's queue is full with the items before them
+        CHECK_EQ(results[UDPC_QUEUED_PKTS_MAX_SIZE + 2],
+            UDPC_SR_CONNECTION_QUEUE_FULL);
+        CHECK_EQ(results[UDPC_QUEUED_PKTS_MAX_SIZE + 3],
+            UDPC_SR_CONNECTION_QUEUE_FULL);
+        CHECK_EQ(UDPC_get_queue_send_current_size(client),
+            UDPC_QUEUED_PKTS_MAX_SIZE);
+
+        // moved to the connection by update
+        UDPC_update(client);
+        CHECK_EQ(UDPC_get_queue_send_current_size(client), 0);
+        CHECK_TRUE(UDPC_get_queued_size(client, serverId, nullptr) > 0);
+
+        // packets kept for a full connection count against the send queue
+        for(unsigned int i = 0; i < UDPC_SEND_QUEUE_CAPACITY + 10; ++i) {
+            UDPC_queue_send(client, serverId, 0, msg, 8);
+        }
+        UDPC_update(client);
+        CHECK_TRUE(UDPC_get_queue_send_current_size(client)
+            > UDPC_SEND_QUEUE_CAPACITY - 2 * UDPC_QUEUED_PKTS_MAX_SIZE);
+        for(unsigned int i = 0; i < UDPC_SEND_QUEUE_CAPACITY; ++i) {
+            UDPC_queue_send(client, serverId, 0, msg, 8);
+        }
+        CHECK_EQ(UDPC_get_queue_send_current_size(client),
+            UDPC_SEND_QUEUE_CAPACITY);
+
+        CHECK_EQ(UDPC_queue_send_batch(nullptr, items.data(), 1,
+            results.data()), 0);
+        CHECK_EQ(results[0], UDPC_SR_INVALID);
+        CHECK_EQ(UDPC_queue_send_batch(client, items.data(), 1, nullptr), 0);
+
+        UDPC_destroy(client);
+        UDPC_destroy(server);
+    }
+
+    // sentPktRing
+    {
+        UDPC::BufferPool *pool = UDPC::BufferPool::newInstance();
+        UDPC::ConnectionData con(false);
+        const auto now = std::chrono::steady_clock::now();
+
+        CHECK_TRUE(con.findSentPkt(0) == nullptr);
+        UDPC::SentPkt &first = con.addSentPkt(5, now);
+        first.data = pool->allocate(UDPC_NSFULL_HEADER_SIZE + 4);
+        first.dataSize = UDPC_NSFULL_HEADER_SIZE + 4;
+        CHECK_TRUE(con.findSentPkt(5) == &first);
+        CHECK_TRUE(con.findSentPkt(5 + UDPC_SENT_PKTS_MAX_SIZE) == nullptr);
+        CHECK_TRUE(con.findSentPkt(6) == nullptr);
+
+        // reusing the slot frees the packet sent before
+        UDPC::SentPkt &next = con.addSentPkt(5 + UDPC_SENT_PKTS_MAX_SIZE, now);
+        CHECK_TRUE(&next == &first);
+        CHECK_TRUE(next.data == nullptr);
+        CHECK_EQ(pool->getStats().inUse, 0);
+        CHECK_TRUE(con.findSentPkt(5) == nullptr);
+        CHECK_TRUE(con.findSentPkt(5 + UDPC_SENT_PKTS_MAX_SIZE) == &next);
+
+        // ids wrap around
+        con.addSentPkt(0xFFFFFFFF, now);
+        CHECK_TRUE(con.findSentPkt(0xFFFFFFFF) != nullptr);
+
+        // freed with the connection
+        next.data = pool->allocate(UDPC_NSFULL_HEADER_SIZE + 4);
+        CHECK_EQ(pool->getStats().inUse, 1);
+        pool->release();
+    }
+
+    // bufferPool
+    {
+        UDPC::BufferPool *pool = UDPC::BufferPool::newInstance();
+
+        char *buf = pool->allocate(100);
+        ASSERT_TRUE(buf);
+        std::memset(buf, 1, 100);
+        UDPC_PoolStats stats = pool->getStats();
+        CHECK_EQ(stats.misses, 1);
+        CHECK_EQ(stats.slabs, 1);
+        CHECK_EQ(stats.inUse, 1);
+
+        // freed buffers are reused
+        UDPC::BufferPool::deallocate(buf);
+        char *again = pool->allocate(64);
+        CHECK_TRUE(again != nullptr);
+        stats = pool->getStats();
+        CHECK_EQ(stats.hits, 1);
+        CHECK_EQ(stats.inUse, 1);
+
+        // larger than any size class
+        char *large = pool->allocate(UDPC_PACKET_MAX_SIZE * 2);
+        ASSERT_TRUE(large);
+        std::memset(large, 2, UDPC_PACKET_MAX_SIZE * 2);
+        stats = pool->getStats();
+        CHECK_EQ(stats.fallbacks, 1);
+        CHECK_EQ(stats.inUse, 1);
+        UDPC::BufferPool::deallocate(large);
+
+        // not from a pool
+        UDPC::BufferPool::deallocate(std::malloc(32));
+        UDPC::BufferPool::deallocate(nullptr);
+
+        // outlives its owner while buffers are held
+        pool->release();
+        std::memset(again, 3, 64);
+        UDPC::BufferPool::deallocate(again);
+    }
+
+    // bufferPoolShared
+    {
+        UDPC::BufferPool *pool = UDPC::BufferPool::newInstance();
+
+        char *shared = pool->allocateShared(1000);
+        ASSERT_TRUE(shared);
+        std::memset(shared, 4, 1000);
+        CHECK_TRUE(UDPC::BufferPool::isShared(shared));
+        CHECK_TRUE(UDPC::BufferPool::isShared(shared + 999));
+        char *plain = pool->allocate(1000);
+        CHECK_FALSE(UDPC::BufferPool::isShared(plain));
+        UDPC::BufferPool::deallocate(plain);
+
+        // freed with the last reference
+        UDPC::BufferPool::share(shared);
+        UDPC::BufferPool::share(shared + 10);
+        UDPC::BufferPool::deallocate(shared);
+        UDPC::BufferPool::deallocate(shared + 500);
+        CHECK_EQ(pool->getStats().inUse, 1);
+        CHECK_EQ(shared[999], 4);
+        UDPC::BufferPool::deallocate(shared);
+        CHECK_EQ(pool->getStats().inUse, 0);
+
+        // too large to be shared
+        CHECK_TRUE(pool->allocateShared(UDPC_PACKET_MAX_SIZE * 2) == nullptr);
+
+        pool->release();
+    }
+
+    // bufferPoolLoopback
+    {
+        UDPC_HContext server = UDPC_init_threaded_update(
+            UDPC_create_id_easy("::1", 0), 0, 0);
+        ASSERT_TRUE(server);
+        UDPC_HContext client = UDPC_init_threaded_update(
+            UDPC_create_id_easy("::1", 0), 1, 0);
+        ASSERT_TRUE(client);
+        UDPC_set_logging_type(server, UDPC_LoggingType::UDPC_SILENT);
+        UDPC_set_logging_type(client, UDPC_LoggingType::UDPC_SILENT);
+
+        UDPC_ConnectionId serverId;
+        UDPC_ConnectionId clientId;
+        CHECK_TRUE(connectLoopback(server, client, &serverId, &clientId));
+
+        std::array<UDPC_PacketInfo, 4> received;
+        unsigned int receivedCount = 0;
+        for(unsigned int i = 0; i < 400 && receivedCount < received.size(); ++i) {
+            if(i % 20 == 0) {
+                UDPC_queue_send(client, serverId, 1, "pooled", 7);
+            }
+            UDPC_PacketInfo pinfo = UDPC_get_received(server, nullptr);
+            if(pinfo.dataSize > 0) {
+                received[receivedCount++] = pinfo;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+        CHECK_EQ(receivedCount, received.size());
+
+        // queued, sent and received packets come from the pools
+        UDPC_PoolStats clientStats = UDPC_get_pool_stats(client);
+        CHECK_TRUE(clientStats.hits > 0);
+        CHECK_EQ(clientStats.fallbacks, 0);
+        UDPC_PoolStats serverStats = UDPC_get_pool_stats(server);
+        CHECK_TRUE(serverStats.inUse >= receivedCount);
+
+        // received packets may be freed after their context
+        UDPC_destroy(client);
+        UDPC_destroy(server);
+        for(unsigned int i = 0; i < receivedCount; ++i) {
+            CHECK_STREQ(received[i].data, "pooled");
+            UDPC_free_PacketInfo(received[i]);
+        }
+    }
+
+    // receivedView
+    for(int isThreaded = 0; isThreaded < 2; ++isThreaded) {
+        UDPC_HContext server = UDPC_init_threaded_update(
+            UDPC_create_id_easy("::1", 0), 0, 0);
+        ASSERT_TRUE(server);
+        UDPC_HContext client = UDPC_init_threaded_update(
+            UDPC_create_id_easy("::1", 0), 1, 0);
+        ASSERT_TRUE(client);
+        UDPC_set_logging_type(server, UDPC_LoggingType::UDPC_SILENT);
+        UDPC_set_logging_type(client, UDPC_LoggingType::UDPC_SILENT);
+#if UDPC_PLATFORM == UDPC_PLATFORM_LINUX
+        if(isThreaded) {
+            UDPC_set_receive_thread_enabled(server, 1);
+        }
+#endif
+        UDPC::Context *s = UDPC::verifyContext(server);
+
+        UDPC_ConnectionId serverId;
+        UDPC_ConnectionId clientId;
+        CHECK_TRUE(connectLoopback(server, client, &serverId, &clientId));
+
+        std::array<char, 2000> large;
+        for(std::size_t i = 0; i < large.size(); ++i) {
+            large[i] = (char)i;
+        }
+        std::array<char, 6000> huge;
+        for(std::size_t i = 0; i < huge.size(); ++i) {
+            huge[i] = (char)(i * 3);
+        }
+        std::array<UDPC_PacketInfo, 3> views;
+        unsigned int viewCount = 0;
+        for(unsigned int i = 0; i < 400 && viewCount < views.size(); ++i) {
+            if(i == 0) {
+                UDPC_queue_send(client, serverId, 0,
+                    large.data(), large.size());
+                UDPC_queue_send(client, serverId, 0, "small", 6);
+                UDPC_queue_send(client, serverId, 0,
+                    huge.data(), huge.size());
+            }
+            if(UDPC_get_received_view(server, &views[viewCount], nullptr)) {
+                ++viewCount;
+            } else {
+                CHECK_TRUE(views[viewCount].data == nullptr);
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+        ASSERT_TRUE(viewCount == views.size());
+        std::sort(views.begin(), views.end(),
+            [] (const UDPC_PacketInfo &a, const UDPC_PacketInfo &b) {
+                return a.dataSize < b.dataSize;
+            });
+
+        // the small payload was copied to a buffer of its own
+        CHECK_STREQ(views[0].data, "small");
+        CHECK_TRUE(UDPC::BufferPool::isPooled(views[0].data));
+        CHECK_FALSE(UDPC::BufferPool::isReceive(views[0].data));
+
+        // the large payload was left in the buffer it was received in, right
+        // after the packet's header
+        ASSERT_TRUE(views[1].dataSize == large.size());
+        CHECK_TRUE(std::memcmp(views[1].data, large.data(), large.size()) == 0);
+        CHECK_TRUE(UDPC::BufferPool::isPooled(views[1].data));
+#if UDPC_PLATFORM == UDPC_PLATFORM_LINUX
+        CHECK_TRUE(UDPC::BufferPool::isReceive(views[1].data));
+#endif
+        uint32_t protocolID;
+        std::memcpy(&protocolID, views[1].data - UDPC_NSFULL_HEADER_SIZE, 4);
+        CHECK_EQ(ntohl(protocolID), s->protocolID.load());
+
+        // a packet larger than a receive buffer is whole
+        ASSERT_TRUE(views[2].dataSize == huge.size());
+        CHECK_TRUE(std::memcmp(views[2].data, huge.data(), huge.size()) == 0);
+        CHECK_FALSE(UDPC::BufferPool::isReceive(views[2].data));
+
+        // gotten as an owned packet, a small adopted payload is copied out of
+        // its receive buffer
+        UDPC_PacketInfo pinfo = UDPC::get_empty_pinfo();
+        for(unsigned int i = 0; i < 400 && !pinfo.data; ++i) {
+            if(i == 0) {
+                UDPC_queue_send(client, serverId, 0,
+                    large.data(), large.size() - 500);
+            }
+            pinfo = UDPC_get_received(server, nullptr);
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+        ASSERT_TRUE(pinfo.dataSize == large.size() - 500);
+        CHECK_TRUE(std::memcmp(pinfo.data, large.data(), pinfo.dataSize) == 0);
+        CHECK_TRUE(UDPC::BufferPool::isPooled(pinfo.data));
+        CHECK_FALSE(UDPC::BufferPool::isReceive(pinfo.data));
+        UDPC_free_PacketInfo_ptr(&pinfo);
+
+        UDPC_PoolStats stats = UDPC_get_pool_stats(server);
+        CHECK_EQ(stats.fallbacks, 0);
+        const uint64_t inUse = stats.inUse;
+        UDPC_release_view(server, &views[1]);
+        CHECK_TRUE(views[1].data == nullptr);
+        CHECK_EQ(views[1].dataSize, 0);
+        UDPC_release_view(server, &views[1]);
+        CHECK_EQ(UDPC_get_pool_stats(server).inUse, inUse - 1);
+        UDPC_release_view(server, &views[0]);
+
+        // views may be released after their context
+        UDPC_destroy(client);
+        UDPC_destroy(server);
+        UDPC_release_view(nullptr, &views[2]);
+        CHECK_TRUE(views[2].data == nullptr);
+    }
+
+    // queueSendMany
+    {
+        UDPC_HContext server = UDPC_init_threaded_update(
+            UDPC_create_id_easy("::1", 0), 0, 0);
+        ASSERT_TRUE(server);
+        UDPC_set_logging_type(server, UDPC_LoggingType::UDPC_SILENT);
+        UDPC::Context *s = UDPC::verifyContext(server);
+        UDPC_ConnectionId serverId;
+
+        std::array<UDPC_HContext, 3> clients;
+        std::array<UDPC_ConnectionId, 3> clientIds;
+        for(unsigned int i = 0; i < clients.size(); ++i) {
+            clients[i] = UDPC_init_threaded_update(
+                UDPC_create_id_easy("::1", 0), 1, 0);
+            ASSERT_TRUE(clients[i]);
+            UDPC_set_logging_type(clients[i], UDPC_LoggingType::UDPC_SILENT);
+            CHECK_TRUE(connectLoopback(
+                server, clients[i], &serverId, &clientIds[i]));
+        }
+
+        CHECK_EQ(UDPC_queue_send_many(server, clientIds.data(), 0, 1,
+            "none", 5), 0);
+        CHECK_EQ(UDPC_queue_send_many(server, clientIds.data(),
+            clientIds.size(), 1, nullptr, 5), 0);
+
+        std::array<char, 1200> state;
+        for(unsigned int i = 0; i < state.size(); ++i) {
+            state[i] = (char)(i * 7);
+        }
+        CHECK_EQ(UDPC_queue_send_many(server, clientIds.data(),
+            clientIds.size(), 1, state.data(), state.size()), clientIds.size());
+
+        for(unsigned int i = 0; i < clients.size(); ++i) {
+            UDPC_PacketInfo pinfo = UDPC::get_empty_pinfo();
+            for(unsigned int j = 0; j < 400 && !pinfo.data; ++j) {
+                pinfo = UDPC_get_received(clients[i], nullptr);
+                if(!pinfo.data) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+                }
+            }
+            ASSERT_TRUE(pinfo.data);
+            CHECK_EQ(pinfo.dataSize, state.size());
+            CHECK_TRUE(std::memcmp(pinfo.data, state.data(), state.size()) == 0);
+            UDPC_free_PacketInfo(pinfo);
+        }
+
+        // the connections' re-send storage refers to one shared payload
+        {
+            std::lock_guard<std::mutex> conMapLock(s->conMapMutex);
+            std::array<const char*, 3> payloads;
+            for(unsigned int i = 0; i < clientIds.size(); ++i) {
+                payloads[i] = nullptr;
+                auto iter = s->conMap.find(clientIds[i]);
+                ASSERT_TRUE(iter != s->conMap.end());
+                for(const UDPC::SentPkt &sent : iter->second.sentPkts) {
+                    if((sent.flags & 0x20) != 0) {
+                        CHECK_EQ(sent.dataSize,
+                            UDPC_NSFULL_HEADER_SIZE + state.size());
+                        std::memcpy(&payloads[i],
+                            sent.data + UDPC_NSFULL_HEADER_SIZE,
+                            sizeof(const char*));
+                    }
+                }
+            }
+            ASSERT_TRUE(payloads[0]);
+            CHECK_TRUE(UDPC::BufferPool::isShared(payloads[0]));
+            CHECK_TRUE(payloads[1] == payloads[0]);
+            CHECK_TRUE(payloads[2] == payloads[0]);
+        }
+
+        for(UDPC_HContext client : clients) {
+            UDPC_destroy(client);
+        }
+        UDPC_destroy(server);
+    }
+
+    // sendReserveCommit
+    {
+        UDPC_HContext server = UDPC_init_threaded_update(
+            UDPC_create_id_easy("::1", 0), 0, 0);
+        ASSERT_TRUE(server);
+        UDPC_HContext client = UDPC_init_threaded_update(
+            UDPC_create_id_easy("::1", 0), 1, 0);
+        ASSERT_TRUE(client);
+        UDPC_set_logging_type(server, UDPC_LoggingType::UDPC_SILENT);
+        UDPC_set_logging_type(client, UDPC_LoggingType::UDPC_SILENT);
+        UDPC::Context *c = UDPC::verifyContext(client);
+
+        UDPC_ConnectionId serverId;
+        UDPC_ConnectionId clientId;
+        CHECK_TRUE(connectLoopback(server, client, &serverId, &clientId));
+
+        CHECK_TRUE(UDPC_send_reserve(client, serverId, 0) == nullptr);
+        CHECK_TRUE(UDPC_send_reserve(nullptr, serverId, 8) == nullptr);
+        UDPC_send_abort(client, UDPC_send_reserve(client, serverId, 8));
+        // larger than reserved, freed and not sent
+        UDPC_send_commit(client, UDPC_send_reserve(client, serverId, 4), 5, 0);
+
+        char *checked = (char*)UDPC_send_reserve(client, serverId, 2000);
+        ASSERT_TRUE(checked);
+        for(unsigned int i = 0; i < 2000; ++i) {
+            checked[i] = (char)i;
+        }
+        // only part of the reserved size is used
+        char *unchecked = (char*)UDPC_send_reserve(client, serverId, 64);
+        ASSERT_TRUE(unchecked);
+        std::strcpy(unchecked, "unchecked");
+        UDPC_send_commit(client, checked, 2000, 1);
+        UDPC_send_commit(client, unchecked, 10, 0);
+
+        std::array<UDPC_PacketInfo, 2> received;
+        unsigned int receivedCount = 0;
+        for(unsigned int i = 0; i < 400 && receivedCount < received.size(); ++i) {
+            UDPC_PacketInfo pinfo = UDPC_get_received(server, nullptr);
+            if(pinfo.dataSize > 0) {
+                received[receivedCount++] = pinfo;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+        ASSERT_TRUE(receivedCount == received.size());
+        CHECK_EQ(received[0].dataSize, 2000);
+        bool isSame = true;
+        for(unsigned int i = 0; i < 2000; ++i) {
+            isSame = isSame && received[0].data[i] == (char)i;
+        }
+        CHECK_TRUE(isSame);
+        CHECK_EQ(received[1].dataSize, 10);
+        CHECK_STREQ(received[1].data, "unchecked");
+        CHECK_EQ(received[0].flags & 0x4, 0);
+        CHECK_EQ(received[1].flags & 0x4, 0x4);
+
+        // the checked packet was sent from and kept in the reserved buffer
+        {
+            std::lock_guard<std::mutex> conMapLock(c->conMapMutex);
+            auto iter = c->conMap.find(serverId);
+            ASSERT_TRUE(iter != c->conMap.end());
+            bool isKept = false;
+            for(const UDPC::SentPkt &sent : iter->second.sentPkts) {
+                if(sent.data == checked - UDPC_NSFULL_HEADER_SIZE) {
+                    isKept = sent.dataSize == UDPC_NSFULL_HEADER_SIZE + 2000;
+                }
+            }
+            CHECK_TRUE(isKept);
+        }
+
+        UDPC_destroy(client);
+        UDPC_destroy(server);
+        UDPC_free_PacketInfo(received[0]);
+        UDPC_free_PacketInfo(received[1]);
+    }
+
+    // connectionHandles
+    {
+        UDPC_HContext server = UDPC_init_threaded_update(
+            UDPC_create_id_easy("::1", 0), 0, 0);
+        ASSERT_TRUE(server);
+        UDPC_HContext client = UDPC_init_threaded_update(
+            UDPC_create_id_easy("::1", 0), 1, 0);
+        ASSERT_TRUE(client);
+        UDPC_set_logging_type(server, UDPC_LoggingType::UDPC_SILENT);
+        UDPC_set_logging_type(client, UDPC_LoggingType::UDPC_SILENT);
+        UDPC_set_receiving_events(server, 1);
+        UDPC::Context *s = UDPC::verifyContext(server);
+        UDPC::Context *c = UDPC::verifyContext(client);
+
+        UDPC_ConnectionId serverId = UDPC_create_id(
+            in6addr_loopback, ntohs(s->socketInfo.sin6_port));
+        UDPC_ConnectionId clientId = UDPC_create_id(
+            in6addr_loopback, ntohs(c->socketInfo.sin6_port));
+        CHECK_EQ(UDPC_get_handle(server, clientId), 0);
+        CHECK_EQ(UDPC_has_connection_h(server, 0), 0);
+
+        const auto waitForEvent = [server] (UDPC_EventType type) {
+            UDPC_Event event{UDPC_ET_NONE, UDPC_create_id_anyaddr(0), 0, 0};
+            for(unsigned int i = 0; i < 400 && event.type != type; ++i) {
+                event = UDPC_get_event(server, nullptr);
+                if(event.type != type) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+                }
+            }
+            return event;
+        };
+
+        UDPC_client_initiate_connection(client, serverId, 0);
+        UDPC_Event event = waitForEvent(UDPC_ET_CONNECTED);
+        ASSERT_TRUE(event.type == UDPC_ET_CONNECTED);
+        const UDPC_ConnectionHandle handle = event.handle;
+        CHECK_TRUE(handle != 0);
+        CHECK_EQ(UDPC_get_handle(server, clientId), handle);
+        CHECK_EQ(UDPC_has_connection_h(server, handle), 1);
+        int exists = 0;
+        CHECK_EQ(UDPC_get_queued_size_h(server, handle, &exists), 0);
+        CHECK_EQ(exists, 1);
+
+        // sent by handle, and received packets carry the handle
+        UDPC_queue_send_h(server, handle, 1, "by handle", 10);
+        UDPC_PacketInfo pinfo = UDPC::get_empty_pinfo();
+        for(unsigned int i = 0; i < 400 && pinfo.dataSize == 0; ++i) {
+            pinfo = UDPC_get_received(client, nullptr);
+            if(pinfo.dataSize == 0) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            }
+        }
+        CHECK_EQ(pinfo.dataSize, 10);
+        CHECK_STREQ(pinfo.data, "by handle");
+        CHECK_EQ(pinfo.handle, UDPC_get_handle(client, serverId));
+        UDPC_free_PacketInfo(pinfo);
+
+        UDPC_queue_send(client, serverId, 1, "reply", 6);
+        pinfo = UDPC::get_empty_pinfo();
+        for(unsigned int i = 0; i < 400 && pinfo.dataSize == 0; ++i) {
+            pinfo = UDPC_get_received(server, nullptr);
+            if(pinfo.dataSize == 0) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            }
+        }
+        CHECK_EQ(pinfo.dataSize, 6);
+        CHECK_EQ(pinfo.handle, handle);
+        UDPC_free_PacketInfo(pinfo);
+
+        UDPC_drop_connection_h(server, handle);
+        event = waitForEvent(UDPC_ET_DISCONNECTED);
+        CHECK_EQ(event.type, UDPC_ET_DISCONNECTED);
+        CHECK_EQ(event.handle, handle);
+        CHECK_EQ(UDPC_has_connection_h(server, handle), 0);
+        exists = 1;
+        CHECK_EQ(UDPC_get_queued_size_h(server, handle, &exists), 0);
+        CHECK_EQ(exists, 0);
+
+        // the next connection reuses the slot, but the old handle stays
+        // stale
+        UDPC_destroy(client);
+        client = UDPC_init_threaded_update(
+            UDPC_create_id_easy("::1", 0), 1, 0);
+        ASSERT_TRUE(client);
+        UDPC_set_logging_type(client, UDPC_LoggingType::UDPC_SILENT);
+        UDPC_client_initiate_connection(client, serverId, 0);
+        event = waitForEvent(UDPC_ET_CONNECTED);
+        ASSERT_TRUE(event.type == UDPC_ET_CONNECTED);
+        CHECK_TRUE(event.handle != handle);
+        CHECK_EQ(event.handle & 0xFFFFFF, handle & 0xFFFFFF);
+        CHECK_EQ(UDPC_has_connection_h(server, handle), 0);
+        CHECK_EQ(UDPC_has_connection_h(server, event.handle), 1);
+
+        UDPC_destroy(client);
+        UDPC_destroy(server);
+    }
+
+    // peerList
+    {
+        UDPC_HContext server = UDPC_init_threaded_update(
+            UDPC_create_id_easy("::1", 0), 0, 0);
+        ASSERT_TRUE(server);
+        UDPC_HContext client = UDPC_init_threaded_update(
+            UDPC_create_id_easy("::1", 0), 1, 0);
+        ASSERT_TRUE(client);
+        UDPC_set_logging_type(server, UDPC_LoggingType::UDPC_SILENT);
+        UDPC_set_logging_type(client, UDPC_LoggingType::UDPC_SILENT);
+        UDPC::Context *s = UDPC::verifyContext(server);
+        UDPC::Context *c = UDPC::verifyContext(client);
+        UDPC_ConnectionId serverId = UDPC_create_id(
+            in6addr_loopback, ntohs(s->socketInfo.sin6_port));
+        UDPC_ConnectionId clientId = UDPC_create_id(
+            in6addr_loopback, ntohs(c->socketInfo.sin6_port));
+        CHECK_TRUE(UDPC_acquire_peer_list(nullptr) == nullptr);
+
+        const UDPC_PeerList *first = UDPC_acquire_peer_list(server);
+        ASSERT_TRUE(first);
+        CHECK_EQ(first->version, 0);
+        CHECK_EQ(first->size, 0);
+
+        const auto waitForList = [server] (uint32_t size) {
+            const UDPC_PeerList *list = UDPC_acquire_peer_list(server);
+            for(unsigned int i = 0; i < 400 && list->size != size; ++i) {
+                UDPC_release_peer_list(server, list);
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+                list = UDPC_acquire_peer_list(server);
+            }
+            return list;
+        };
+
+        UDPC_client_initiate_connection(client, serverId, 0);
+        const UDPC_PeerList *connected = waitForList(1);
+        ASSERT_TRUE(connected->size == 1);
+        CHECK_GE(connected->version, 1);
+        CHECK_TRUE(connected->peers[0].id == clientId);
+        CHECK_EQ(connected->peers[0].handle, UDPC_get_handle(server, clientId));
+        // not changed by publishing newer lists
+        CHECK_EQ(first->version, 0);
+        CHECK_EQ(first->size, 0);
+        UDPC_release_peer_list(server, first);
+
+        UDPC_drop_connection(server, clientId, 0);
+        const UDPC_PeerList *dropped = waitForList(0);
+        CHECK_EQ(dropped->size, 0);
+        CHECK_GE(dropped->version, connected->version + 1);
+        CHECK_TRUE(connected->peers[0].id == clientId);
+        UDPC_release_peer_list(server, connected);
+        UDPC_release_peer_list(server, dropped);
+
+        UDPC_destroy(client);
+        UDPC_destroy(server);
+    }
+
+    // idleConnectionsBenchmark
+    if(run_benchmarks) {
+        UDPC_HContext server = UDPC_init(UDPC_create_id_easy("::1", 0), 0, 0);
+        ASSERT_TRUE(server);
+        UDPC_set_logging_type(server, UDPC_LoggingType::UDPC_SILENT);
+        UDPC::Context *s = UDPC::verifyContext(server);
+
+        // peers that never answer, sending to their IPv4 addresses from
+        // the ::1 socket fails without putting anything on the wire
+        const unsigned int connectionCount = 20000;
+        {
+            std::lock_guard<std::mutex> conMapLock(s->conMapMutex);
+            for(unsigned int i = 0; i < connectionCount; ++i) {
+                UDPC_ConnectionId id = UDPC_create_id(
+                    UDPC_a4toa6(htonl(0x7F000000 | i)), 9);
+                auto iter = s->conMap.insert(id, UDPC::ConnectionData(
+                    true, s, id.addr, 0, id.port, false,
+                    nullptr, nullptr)).first;
+                s->scheduleConnection(iter, s->nextDue(iter->second));
+            }
+        }
+        // sends the initiate connection packets
+        UDPC_update(server);
+
+        // updates at the default threaded update interval
+        std::clock_t cpu = 0;
+        unsigned int updates = 0;
+        const auto start = std::chrono::steady_clock::now();
+        while(std::chrono::steady_clock::now() - start
+                < std::chrono::milliseconds(600)) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(8));
+            std::clock_t cpuStart = std::clock();
+            UDPC_update(server);
+            cpu += std::clock() - cpuStart;
+            ++updates;
+        }
+        const double seconds = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start).count();
+        std::cout << "update with " << connectionCount
+            << " idle connections: "
+            << (double)cpu * 1.0e6 / CLOCKS_PER_SEC / updates
+            << " us cpu/update, "
+            << (double)cpu * 1.0e3 / CLOCKS_PER_SEC / seconds
+            << " ms cpu/s\n";
+
+        // every connection is still scheduled to send its heartbeats
+        unsigned int unscheduled = 0;
+        {
+            std::lock_guard<std::mutex> conMapLock(s->conMapMutex);
+            CHECK_EQ(s->conMap.size(), connectionCount);
+            for(auto iter = s->conMap.begin(); iter != s->conMap.end(); ++iter) {
+                if(iter->second.timerTick == UDPC::NO_TICK) {
+                    ++unscheduled;
+                }
+            }
+        }
+        CHECK_EQ(unscheduled, 0);
+
+        UDPC_destroy(server);
+    }
+
+    // queriesDuringUpdate
+    {
+        UDPC_HContext server = UDPC_init(UDPC_create_id_easy("::1", 0), 0, 0);
+        ASSERT_TRUE(server);
+        UDPC_set_logging_type(server, UDPC_LoggingType::UDPC_SILENT);
+        UDPC::Context *s = UDPC::verifyContext(server);
+
+        // as in idleConnectionsBenchmark when measuring
+        const unsigned int connectionCount = run_benchmarks ? 20000 : 1000;
+        UDPC_ConnectionId queried = UDPC_create_id_anyaddr(0);
+        {
+            std::lock_guard<std::mutex> conMapLock(s->conMapMutex);
+            for(unsigned int i = 0; i < connectionCount; ++i) {
+                UDPC_ConnectionId id = UDPC_create_id(
+                    UDPC_a4toa6(htonl(0x7F000000 | i)), 9);
+                auto iter = s->conMap.insert(id, UDPC::ConnectionData(
+                    true, s, id.addr, 0, id.port, false,
+                    nullptr, nullptr)).first;
+                s->scheduleConnection(iter, s->nextDue(iter->second));
+                queried = id;
+            }
+        }
+
+        // queries from another thread while updating, they only wait for
+        // connections being added or removed and packets being queued
+        std::atomic_bool isQuerying(true);
+        std::atomic_uint missing(0);
+        unsigned long queries = 0;
+        unsigned long waiting = 0;
+        std::thread queryThread([&] () {
+            while(isQuerying.load()) {
+                if(s->conMapMutex.try_lock()) {
+                    s->conMapMutex.unlock();
+                } else {
+                    ++waiting;
+                }
+                ++queries;
+                int exists = 0;
+                UDPC_get_queued_size(server, queried, &exists);
+                if(UDPC_has_connection(server, queried) == 0 || exists == 0) {
+                    missing.fetch_add(1);
+                }
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+            }
+        });
+
+        const unsigned int updates = run_benchmarks ? 50 : 5;
+        for(unsigned int i = 0; i < updates; ++i) {
+            UDPC_update(server);
+            std::this_thread::sleep_for(std::chrono::milliseconds(8));
+        }
+        isQuerying.store(false);
+        queryThread.join();
+        if(run_benchmarks) {
+            std::cout << "queries with " << connectionCount
+                << " connections: " << (double)waiting * 100.0 / queries
+                << "% waited for an update\n";
+        }
+        CHECK_EQ(missing.load(), 0);
+
+        UDPC_destroy(server);
+    }
+
+    // sendWindow
+    {
+        UDPC_HContext ctx = UDPC_init(UDPC_create_id_easy("::1", 0), 0, 0);
+        ASSERT_TRUE(ctx);
+        UDPC_set_logging_type(ctx, UDPC_LoggingType::UDPC_SILENT);
+        UDPC::Context *c = UDPC::verifyContext(ctx);
+        const auto now = std::chrono::steady_clock::now();
+        {
+            // as a client's connection, whose ids start at 1
+            UDPC::ConnectionData con(false);
+            con.lseq = 1;
+            auto send = [&] (const std::chrono::steady_clock::time_point &sentTime) {
+                UDPC::SentPkt &sent = con.addSentPkt(con.lseq++, sentTime);
+                sent.dataSize = UDPC_NSFULL_HEADER_SIZE + 4;
+                sent.data = c->bufferPool->allocate(sent.dataSize);
+                std::memset(sent.data, 0, sent.dataSize);
+            };
+
+            for(unsigned int i = 0; i < UDPC_SEND_WINDOW_SIZE; ++i) {
+                CHECK_TRUE(c->isSendWindowOpen(con, now, UDPC_SEND_WINDOW_SIZE));
+                send(now);
+            }
+            CHECK_FALSE(c->isSendWindowOpen(con, now, UDPC_SEND_WINDOW_SIZE));
+            CHECK_EQ(con.sendWindowStart, 1);
+
+            // acked up to id 9
+            con.peerRseq = 9;
+            CHECK_TRUE(c->isSendWindowOpen(con, now, UDPC_SEND_WINDOW_SIZE));
+            CHECK_EQ(con.sendWindowStart, 10);
+            CHECK_TRUE(con.priorityPkts.empty());
+
+            // acked up to id 24 except id 12, which is re-sent
+            con.peerRseq = 24;
+            con.peerAck = ~(0x80000000 >> (24 - 12 - 1));
+            CHECK_TRUE(c->isSendWindowOpen(con, now, UDPC_SEND_WINDOW_SIZE));
+            CHECK_EQ(con.sendWindowStart, 25);
+            CHECK_EQ(con.priorityPkts.size(), 1);
+            ASSERT_TRUE(con.findSentPkt(12));
+            CHECK_TRUE((con.findSentPkt(12)->flags & 0x8) != 0);
+
+            // not acked, re-sent once timed out
+            send(now);
+            send(now);
+            CHECK_FALSE(c->isSendWindowOpen(con, now, 1));
+            CHECK_EQ(con.sendWindowStart, 25);
+            CHECK_TRUE(c->isSendWindowOpen(
+                con, now + UDPC::PACKET_TIMEOUT_TIME * 2, 1));
+            CHECK_EQ(con.sendWindowStart, 27);
+            CHECK_EQ(con.priorityPkts.size(), 3);
+
+            // not check-received packets are not waited for
+            con.addSentPkt(con.lseq++, now).flags |= 0x4;
+            CHECK_TRUE(c->isSendWindowOpen(con, now, 1));
+            CHECK_EQ(con.sendWindowStart, 28);
+        }
+        UDPC_destroy(ctx);
+    }
+
+    // sendRate
+    {
+        // far more packets than 30 sends a second could send in time
+        const unsigned int count = 3000;
+        UDPC_HContext server = UDPC_init_threaded_update(
+            UDPC_create_id_easy("::1", 0), 0, 0);
+        UDPC_HContext client = UDPC_init_threaded_update(
+            UDPC_create_id_easy("::1", 0), 1, 0);
+        ASSERT_TRUE(server);
+        ASSERT_TRUE(client);
+        UDPC_set_logging_type(server, UDPC_LoggingType::UDPC_SILENT);
+        UDPC_set_logging_type(client, UDPC_LoggingType::UDPC_SILENT);
+        UDPC_set_default_send_rate(server, 1000, 1000, 1);
+        UDPC_ConnectionId serverId;
+        UDPC_ConnectionId clientId;
+        ASSERT_TRUE(connectLoopback(server, client, &serverId, &clientId));
+        UDPC_set_send_rate_h(client, UDPC_get_handle(client, serverId),
+            1000, 5000, 100);
+        {
+            UDPC::Context *c = UDPC::verifyContext(client);
+            for(unsigned int i = 0; i < 200; ++i) {
+                std::lock_guard<std::mutex> conMapLock(c->conMapMutex);
+                auto iter = c->conMap.find(serverId);
+                ASSERT_TRUE(iter != c->conMap.end());
+                if(iter->second.sendBurst != 1) {
+                    break;
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            }
+            std::lock_guard<std::mutex> conMapLock(c->conMapMutex);
+            auto iter = c->conMap.find(serverId);
+            ASSERT_TRUE(iter != c->conMap.end());
+            // clamped
+            CHECK_EQ(iter->second.sendBurst, UDPC_SEND_BURST_MAX);
+            CHECK_TRUE(iter->second.goodModeSendRate
+                == UDPC::sendRateToDuration(UDPC_SEND_RATE_MAX));
+            CHECK_TRUE(iter->second.badModeSendRate
+                == UDPC::sendRateToDuration(UDPC_SEND_RATE_MAX));
+        }
+
+        const auto start = std::chrono::steady_clock::now();
+        for(unsigned int i = 0; i < count; ++i) {
+            UDPC_queue_send(client, serverId, 1, &i, 4);
+        }
+        std::vector<bool> isReceived(count, false);
+        unsigned int received = 0;
+        unsigned int invalid = 0;
+        while(received < count && std::chrono::steady_clock::now() - start
+                < std::chrono::seconds(10)) {
+            UDPC_PacketInfo pinfo = UDPC_get_received(server, nullptr);
+            if(!pinfo.data) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                continue;
+            }
+            unsigned int index = count;
+            if(pinfo.dataSize == 4) {
+                std::memcpy(&index, pinfo.data, 4);
+            }
+            if(index < count && !isReceived[index]) {
+                isReceived[index] = true;
+                ++received;
+            } else {
+                ++invalid;
+            }
+            UDPC_free_PacketInfo(pinfo);
+        }
+        const auto elapsed = std::chrono::steady_clock::now() - start;
+        if(run_benchmarks) {
+            std::cout << "send rate: " << received << " packets in "
+                << std::chrono::duration_cast<std::chrono::milliseconds>(
+                    elapsed).count() << " ms\n";
+        }
+        CHECK_EQ(received, count);
+        CHECK_EQ(invalid, 0);
+
+        UDPC_destroy(client);
+        UDPC_destroy(server);
+    }
 }
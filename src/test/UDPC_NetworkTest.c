@@ -48,6 +48,9 @@ void usage(void) {
     puts("-ck <pubkey_file> - add pubkey to whitelist");
     puts("-sk <pubkey> <seckey> - start with pub/sec key pair");
     puts("-p <\"fallback\" or \"strict\"> - set auth policy");
+    puts("-io (socket|io_uring) - I/O engine, default socket");
+    puts("-w <workers> - sharded server with worker threads (server only, socket I/O)");
+    puts("-r - receive on a dedicated receive thread");
     puts("--hostname <hostname> - dont run test, just lookup hostname");
 }
 
@@ -107,6 +110,9 @@ int main(int argc, char **argv) {
     unsigned int whitelist_pk_files_index = 0;
     unsigned char whitelist_pks[WHITELIST_FILES_SIZE][crypto_sign_PUBLICKEYBYTES];
     int authPolicy = UDPC_AUTH_POLICY_FALLBACK;
+    UDPC_IOEngine ioEngine = UDPC_IO_ENGINE_SOCKET;
+    unsigned int workerCount = 0;
+    int isReceiveThreaded = 0;
 
     while(argc > 0) {
         if(strcmp(argv[0], "-c") == 0) {
@@ -185,6 +191,23 @@ int main(int argc, char **argv) {
                 usage();
                 return 1;
             }
+        } else if(strcmp(argv[0], "-io") == 0 && argc > 1) {
+            --argc; ++argv;
+            if(strcmp(argv[0], "socket") == 0) {
+                ioEngine = UDPC_IO_ENGINE_SOCKET;
+            } else if(strcmp(argv[0], "io_uring") == 0) {
+                ioEngine = UDPC_IO_ENGINE_IO_URING;
+            } else {
+                printf("ERROR: invalid argument \"%s\", expected "
+                    "socket|io_uring\n", argv[0]);
+                usage();
+                return 1;
+            }
+        } else if(strcmp(argv[0], "-w") == 0 && argc > 1) {
+            --argc; ++argv;
+            workerCount = atoi(argv[0]);
+        } else if(strcmp(argv[0], "-r") == 0) {
+            isReceiveThreaded = 1;
         } else if(strcmp(argv[0], "--hostname") == 0 && argc > 1) {
             --argc; ++argv;
             UDPC_ConnectionId id = UDPC_create_id_hostname(argv[0], 9000);
@@ -288,14 +311,34 @@ int main(int argc, char **argv) {
             }
         }
     }
-    UDPC_HContext context = UDPC_init(listenId, isClient, isLibSodiumEnabled);
+    if(!isClient && workerCount > 0 && ioEngine != UDPC_IO_ENGINE_SOCKET) {
+        puts("ERROR: -io io_uring cannot be used with -w, shards use socket");
+        return 1;
+    }
+
+    UDPC_HContext context;
+    if(!isClient && workerCount > 0) {
+        context = UDPC_init_sharded(listenId, workerCount, isLibSodiumEnabled);
+    } else {
+        context = UDPC_init_io_engine(
+            listenId, isClient, isLibSodiumEnabled, ioEngine);
+    }
     if(!context) {
         puts("ERROR: context is NULL");
         return 1;
     }
+    if(workerCount == 0 && UDPC_get_io_engine(context) != ioEngine) {
+        puts("WARNING: requested I/O engine is unavailable, using socket");
+    }
 
     UDPC_set_logging_type(context, logLevel);
     UDPC_set_receiving_events(context, isReceivingEvents);
+    if(isReceiveThreaded) {
+        UDPC_set_receive_thread_enabled(context, 1);
+        if(!UDPC_get_receive_thread_enabled(context)) {
+            puts("WARNING: receive thread is unavailable");
+        }
+    }
     if(pubkey_file && seckey_file) {
         UDPC_set_libsodium_keys(context, seckey, pubkey);
         puts("Set pubkey/seckey");
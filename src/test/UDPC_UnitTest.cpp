@@ -3,12 +3,24 @@
 
 int checks_checked = 0;
 int checks_passed = 0;
+bool run_benchmarks = false;
 
+#include <cstring>
 #include <iostream>
 
-int main() {
+int main(int argc, char **argv) {
+    for(int i = 1; i < argc; ++i) {
+        if(std::strcmp(argv[i], "--benchmarks") == 0) {
+            run_benchmarks = true;
+        }
+    }
+
     TEST_CXX11_shared_spin_lock();
     TEST_TSLQueue();
+    TEST_RingQueue();
+    TEST_ConnectionTable();
+    TEST_TimingWheel();
+    TEST_PeerList();
     TEST_UDPC();
 
     std::cout << "checks_checked: " << checks_checked
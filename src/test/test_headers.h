@@ -5,6 +5,14 @@ void TEST_CXX11_shared_spin_lock();
 
 void TEST_TSLQueue();
 
+void TEST_RingQueue();
+
+void TEST_ConnectionTable();
+
+void TEST_TimingWheel();
+
+void TEST_PeerList();
+
 void TEST_UDPC();
 
 #endif
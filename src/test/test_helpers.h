@@ -1,11 +1,18 @@
 #ifndef SEODISPARATE_COM_UDPC_TEST_HELPERS_H_
 #define SEODISPARATE_COM_UDPC_TEST_HELPERS_H_
 
+#include <chrono>
 #include <cstring>
 #include <iostream>
+#include <thread>
+
+#include <UDPC.h>
+#include <UDPC_Defines.hpp>
 
 extern int checks_checked;
 extern int checks_passed;
+// set by UnitTest's --benchmarks flag, timing loops only run if true
+extern bool run_benchmarks;
 
 // Macros for unit testing.
 
@@ -105,4 +112,34 @@ extern int checks_passed;
     }                                                                         \
   } while (false);
 
+// Test fixtures.
+
+// The id of ctx's socket on the loopback address.
+inline UDPC_ConnectionId loopbackId(UDPC_HContext ctx) {
+  return UDPC_create_id(in6addr_loopback,
+                        ntohs(UDPC::verifyContext(ctx)->socketInfo.sin6_port));
+}
+
+// Connects client to server over the loopback address, setting serverId and
+// clientId to their ids. Both are updated while waiting, which does nothing
+// for contexts that update on their own. Returns true once both have the
+// connection.
+inline bool connectLoopback(UDPC_HContext server, UDPC_HContext client,
+                            UDPC_ConnectionId *serverId,
+                            UDPC_ConnectionId *clientId) {
+  *serverId = loopbackId(server);
+  *clientId = loopbackId(client);
+  UDPC_client_initiate_connection(client, *serverId, 0);
+  for (unsigned int i = 0; i < 200; ++i) {
+    UDPC_update(client);
+    UDPC_update(server);
+    if (UDPC_has_connection(client, *serverId) &&
+        UDPC_has_connection(server, *clientId)) {
+      return true;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  return false;
+}
+
 #endif